@@ -12,6 +12,6 @@ public:
 
 	Transform* GetTransform();
 
-	~AObjectBehavior();
+	virtual ~AObjectBehavior();
 };
 
@@ -0,0 +1,238 @@
+#include "AnimationEngine.h"
+
+#include <algorithm>
+
+#include "Transform.h"
+#include "BehaviorSystem.h"
+#include "JobSystem.h"
+#include "MatrixKernels.h"
+#include "Time.h"
+
+std::vector<float> AnimationEngine::mKeyTimes;
+std::vector<glm::vec3> AnimationEngine::mKeyPositions;
+std::vector<glm::quat> AnimationEngine::mKeyRotations;
+
+std::vector<size_t> AnimationEngine::mFirstKeys;
+std::vector<size_t> AnimationEngine::mKeyCounts;
+std::vector<size_t> AnimationEngine::mCursors;
+std::vector<float> AnimationEngine::mTimes;
+std::vector<Transform*> AnimationEngine::mTransforms;
+std::vector<int> AnimationEngine::mIds;
+
+std::vector<int> AnimationEngine::mIndices;
+std::vector<int> AnimationEngine::mFreeIds;
+
+std::vector<glm::vec3> AnimationEngine::mPositions;
+std::vector<glm::quat> AnimationEngine::mRotations;
+std::vector<glm::mat4> AnimationEngine::mLocalMatrices;
+std::vector<unsigned char> AnimationEngine::mMoved;
+
+bool AnimationEngine::mNestedDirty = false;
+bool AnimationEngine::mNested = false;
+
+int AnimationEngine::AddTrack(Transform * transform, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& rotations,
+	const std::vector<float>& durations)
+{
+	size_t first = mKeyTimes.size();
+	float time = 0.0f;
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (i > 0)
+			time += durations[i];
+		glm::quat rotation = Transform::EulerToQuaternion(rotations[i].x, rotations[i].y, rotations[i].z);
+		// On the hemisphere of the previous key, so the lerp takes the short way
+		if (i > 0 && glm::dot(mKeyRotations.back(), rotation) < 0.0f)
+			rotation = -rotation;
+
+		mKeyTimes.push_back(time);
+		mKeyPositions.push_back(positions[i]);
+		mKeyRotations.push_back(rotation);
+	}
+
+	int id;
+	if (!mFreeIds.empty()) {
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+	else {
+		id = (int)mIndices.size();
+		mIndices.push_back(-1);
+	}
+	mIndices[id] = (int)mIds.size();
+
+	mFirstKeys.push_back(first);
+	mKeyCounts.push_back(positions.size());
+	mCursors.push_back(0);
+	mTimes.push_back(0.0f);
+	mTransforms.push_back(transform);
+	mIds.push_back(id);
+	mPositions.push_back(glm::vec3());
+	mRotations.push_back(glm::quat());
+	mLocalMatrices.push_back(glm::mat4());
+	mMoved.push_back(0);
+	mNestedDirty = true;
+	return id;
+}
+
+void AnimationEngine::RemoveTrack(int id)
+{
+	if (id < 0 || (size_t)id >= mIndices.size() || mIndices[id] < 0)
+		return;
+	size_t index = (size_t)mIndices[id];
+
+	// The keys of the tracks after it move down
+	size_t first = mFirstKeys[index];
+	size_t count = mKeyCounts[index];
+	mKeyTimes.erase(mKeyTimes.begin() + first, mKeyTimes.begin() + first + count);
+	mKeyPositions.erase(mKeyPositions.begin() + first, mKeyPositions.begin() + first + count);
+	mKeyRotations.erase(mKeyRotations.begin() + first, mKeyRotations.begin() + first + count);
+	for (size_t i = 0; i < mFirstKeys.size(); i++) {
+		if (mFirstKeys[i] > first)
+			mFirstKeys[i] -= count;
+	}
+
+	// The last track takes its place
+	size_t last = mIds.size() - 1;
+	mFirstKeys[index] = mFirstKeys[last];
+	mKeyCounts[index] = mKeyCounts[last];
+	mCursors[index] = mCursors[last];
+	mTimes[index] = mTimes[last];
+	mTransforms[index] = mTransforms[last];
+	mIds[index] = mIds[last];
+	mIndices[mIds[index]] = (int)index;
+
+	mFirstKeys.pop_back();
+	mKeyCounts.pop_back();
+	mCursors.pop_back();
+	mTimes.pop_back();
+	mTransforms.pop_back();
+	mIds.pop_back();
+	mPositions.pop_back();
+	mRotations.pop_back();
+	mLocalMatrices.pop_back();
+	mMoved.pop_back();
+
+	mIndices[id] = -1;
+	mFreeIds.push_back(id);
+	mNestedDirty = true;
+}
+
+void AnimationEngine::Restart(int id)
+{
+	size_t index = (size_t)mIndices[id];
+	mTimes[index] = 0.0f;
+	mCursors[index] = 0;
+	if (mKeyCounts[index] == 0)
+		return;
+
+	size_t first = mFirstKeys[index];
+	mTransforms[index]->SetLocalTransform(mKeyPositions[first], mKeyRotations[first]);
+}
+
+float AnimationEngine::GetTime(int id)
+{
+	return mTimes[mIndices[id]];
+}
+
+float AnimationEngine::GetDuration(int id)
+{
+	size_t index = (size_t)mIndices[id];
+	if (mKeyCounts[index] == 0)
+		return 0.0f;
+	return mKeyTimes[mFirstKeys[index] + mKeyCounts[index] - 1];
+}
+
+void AnimationEngine::_Sample(size_t first, size_t count, size_t cursor, float time, glm::vec3 & position, glm::quat & rotation)
+{
+	size_t key = first + cursor;
+	if (cursor + 1 >= count) {
+		position = mKeyPositions[key];
+		rotation = mKeyRotations[key];
+		return;
+	}
+
+	float duration = mKeyTimes[key + 1] - mKeyTimes[key];
+	float t = duration > 0.0f ? glm::clamp((time - mKeyTimes[key]) / duration, 0.0f, 1.0f) : 1.0f;
+	position = mKeyPositions[key] + (mKeyPositions[key + 1] - mKeyPositions[key]) * t;
+	rotation = glm::normalize(mKeyRotations[key] * (1.0f - t) + mKeyRotations[key + 1] * t);
+}
+
+glm::vec3 AnimationEngine::SamplePosition(int id, float time)
+{
+	size_t index = (size_t)mIndices[id];
+	size_t first = mFirstKeys[index];
+	size_t count = mKeyCounts[index];
+	if (count == 0)
+		return glm::vec3();
+
+	// Last key at or before the time
+	std::vector<float>::const_iterator begin = mKeyTimes.begin() + first;
+	size_t after = (size_t)(std::upper_bound(begin, begin + count, time) - begin);
+	size_t cursor = after > 0 ? after - 1 : 0;
+
+	glm::vec3 position;
+	glm::quat rotation;
+	_Sample(first, count, cursor, time, position, rotation);
+	return position;
+}
+
+void AnimationEngine::_Evaluate(size_t begin, size_t end, float deltaTime)
+{
+	for (size_t i = begin; i < end; i++) {
+		size_t first = mFirstKeys[i];
+		size_t count = mKeyCounts[i];
+		size_t cursor = mCursors[i];
+		// Finished tracks were left on their last key
+		if (cursor + 1 >= count) {
+			mMoved[i] = 0;
+			continue;
+		}
+
+		float time = mTimes[i] + deltaTime;
+		while (cursor + 1 < count && time >= mKeyTimes[first + cursor + 1])
+			cursor++;
+		mTimes[i] = time;
+		mCursors[i] = cursor;
+
+		_Sample(first, count, cursor, time, mPositions[i], mRotations[i]);
+		mMoved[i] = 1;
+	}
+
+	// The whole batch at once, the tracks that did not move included
+	MatrixKernels::Compose(&mPositions[begin], &mRotations[begin], nullptr, &mLocalMatrices[begin], end - begin);
+}
+
+void AnimationEngine::_Apply(size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		if (mMoved[i])
+			mTransforms[i]->SetLocalTransform(mPositions[i], mRotations[i], mLocalMatrices[i]);
+	}
+}
+
+void AnimationEngine::Update(bool parallel)
+{
+	if (mIds.empty())
+		return;
+
+	float deltaTime = (float)Time::GetDeltaTime();
+	size_t count = mIds.size();
+	if (!parallel) {
+		_Evaluate(0, count, deltaTime);
+		_Apply(0, count);
+		return;
+	}
+
+	if (mNestedDirty) {
+		mNested = BehaviorSystem::HasNestedTransforms(mTransforms);
+		mNestedDirty = false;
+	}
+
+	JobSystem::ParallelFor(count, ANIMATION_UPDATE_BATCH, [deltaTime](size_t begin, size_t end) {
+		_Evaluate(begin, end, deltaTime);
+		if (!mNested)
+			_Apply(begin, end);
+	});
+	// Transforms that nest are written one at a time, once every track was sampled
+	if (mNested)
+		_Apply(0, count);
+}
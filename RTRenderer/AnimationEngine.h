@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+class Transform;
+
+// Tracks evaluated and written by one job
+const size_t ANIMATION_UPDATE_BATCH = 256;
+
+/*!
+	Plays the keyframed animations of every transform in one pass.
+
+	Keys are stored as curves: the absolute time, position and rotation of every key of every track, one array each,
+	with each track's keys next to each other. Every track keeps the key it is at, so finding the segment to sample
+	is a step forward from the last frame; sampling an arbitrary time searches the key times. Rotations are
+	quaternions, interpolated with a normalized lerp, and neighbouring keys are stored on the same hemisphere so that
+	takes the short way. Update evaluates a batch of tracks into flat position and rotation arrays, then writes them to
+	the transforms as absolute local transforms, so a track costs one matrix and one propagation per frame. The local
+	matrices of a batch are composed together by MatrixKernels. Tracks that reached their last key are not written
+	again.
+*/
+class AnimationEngine
+{
+private:
+	// -- Keys of every track --
+	static std::vector<float> mKeyTimes;
+	static std::vector<glm::vec3> mKeyPositions;
+	static std::vector<glm::quat> mKeyRotations;
+
+	// -- Tracks, packed --
+	static std::vector<size_t> mFirstKeys;
+	static std::vector<size_t> mKeyCounts;
+	// Key at or before the track's time
+	static std::vector<size_t> mCursors;
+	static std::vector<float> mTimes;
+	static std::vector<Transform*> mTransforms;
+	// Id of each packed track
+	static std::vector<int> mIds;
+
+	// Packed index of every id, -1 for removed tracks
+	static std::vector<int> mIndices;
+	static std::vector<int> mFreeIds;
+
+	// -- Samples of the last update, by packed index --
+	static std::vector<glm::vec3> mPositions;
+	static std::vector<glm::quat> mRotations;
+	static std::vector<glm::mat4> mLocalMatrices;
+	static std::vector<unsigned char> mMoved;
+
+	// Whether the animated transforms nest, checked again when tracks come or go
+	static bool mNestedDirty;
+	static bool mNested;
+
+	// Samples a track at a time past the key at cursor
+	static void _Sample(size_t first, size_t count, size_t cursor, float time, glm::vec3& position, glm::quat& rotation);
+	// Moves the tracks [begin, end) forward, samples them and builds their local matrices
+	static void _Evaluate(size_t begin, size_t end, float deltaTime);
+	static void _Apply(size_t begin, size_t end);
+
+public:
+	/*!
+		\n int AnimationEngine::AddTrack(Transform* transform, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& rotations, const std::vector<float>& durations)
+		\param Transform* transform Transform the track moves, in its parent's space
+		\param const std::vector<glm::vec3>& positions Position of each key
+		\param const std::vector<glm::vec3>& rotations Pitch, yaw and roll of each key, as Transform::Rotate takes them
+		\param const std::vector<float>& durations Time to get to each key from the previous one. The first is ignored
+
+		Returns the track's id. The track starts at its first key
+	*/
+	static int AddTrack(Transform* transform, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& rotations,
+		const std::vector<float>& durations);
+	static void RemoveTrack(int id);
+	// Rewinds the track and moves its transform to the first key
+	static void Restart(int id);
+
+	// Seconds since the track started
+	static float GetTime(int id);
+	// Time of the track's last key
+	static float GetDuration(int id);
+	// Position of the track at any time, found by a binary search
+	static glm::vec3 SamplePosition(int id, float time);
+
+	/*!
+		\n void AnimationEngine::Update(bool parallel)
+		\param bool parallel Splits the tracks between the threads, unless their transforms nest
+
+		Moves every track forward by the frame's time and writes the ones that moved to their transforms
+	*/
+	static void Update(bool parallel);
+
+	static size_t GetTrackCount() { return mIds.size(); }
+};
@@ -0,0 +1,358 @@
+#include "BakedProbe.h"
+
+#include <string.h>
+#include <algorithm>
+#include <future>
+#include <cmath>
+
+#include <glm\gtc\packing.hpp>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Identifies a cache file and its layout version
+const char PROBE_CACHE_MAGIC[4] = { 'R', 'P', 'B', '1' };
+
+// Settings a cached bake was made with. The faces of every level follow, as RGBA half floats
+struct ProbeCacheHeader {
+	char magic[4];
+	unsigned int size;
+	unsigned int levels;
+	float position[3];
+	float boxMin[3];
+	float boxMax[3];
+};
+
+// Direction of the center of a texel of a cube map face, following the GL face orientation
+static glm::vec3 TexelDirection(int face, int x, int y, int size)
+{
+	float u = 2.0f * (x + 0.5f) / size - 1.0f;
+	float v = 2.0f * (y + 0.5f) / size - 1.0f;
+	switch (face) {
+	case 0: return glm::normalize(glm::vec3(1.0f, -v, -u));
+	case 1: return glm::normalize(glm::vec3(-1.0f, -v, u));
+	case 2: return glm::normalize(glm::vec3(u, 1.0f, v));
+	case 3: return glm::normalize(glm::vec3(u, -1.0f, -v));
+	case 4: return glm::normalize(glm::vec3(u, -v, 1.0f));
+	default: return glm::normalize(glm::vec3(-u, -v, -1.0f));
+	}
+}
+
+// Solid angle covered by a texel, relative to the one at the center of the face
+static float TexelSolidAngle(int x, int y, int size)
+{
+	float u = 2.0f * (x + 0.5f) / size - 1.0f;
+	float v = 2.0f * (y + 0.5f) / size - 1.0f;
+	float d = 1.0f + u * u + v * v;
+	return 1.0f / (d * std::sqrt(d));
+}
+
+// Averages 2x2 blocks of RGBA texels
+static std::vector<float> Downsample(const std::vector<float>& face, int size)
+{
+	int half = size / 2;
+	std::vector<float> result((size_t)half * half * 4);
+	for (int y = 0; y < half; y++) {
+		for (int x = 0; x < half; x++) {
+			for (int c = 0; c < 4; c++) {
+				float sum = face[((size_t)(2 * y) * size + 2 * x) * 4 + c] + face[((size_t)(2 * y) * size + 2 * x + 1) * 4 + c] +
+					face[((size_t)(2 * y + 1) * size + 2 * x) * 4 + c] + face[((size_t)(2 * y + 1) * size + 2 * x + 1) * 4 + c];
+				result[((size_t)y * half + x) * 4 + c] = sum * 0.25f;
+			}
+		}
+	}
+	return result;
+}
+
+BakedProbe::BakedProbe(int index, glm::vec3 position, glm::vec3 boxMin, glm::vec3 boxMax, GLuint size, bool dynamic) :
+	m_index(index),
+	m_boxMin(boxMin),
+	m_boxMax(boxMax),
+	m_size(size),
+	m_dynamic(dynamic),
+	m_cubemap(0),
+	m_levels(0)
+{
+	m_transform = ObjectPool<Transform>::Create();
+	m_transform->SetStatic(!dynamic);
+	m_transform->TranslateLocal(position);
+
+	m_capture = new CubeMap(0.1f, 200.0f);
+	m_capture->Init(m_size, m_size, 0.1f, 200.0f);
+
+	// Dynamic probes are sampled straight from the capture, without roughness levels
+	if (m_dynamic)
+		m_levels = 1;
+}
+
+glm::vec3 BakedProbe::GetPosition() const
+{
+	return glm::vec3(m_transform->GetWorldMatrix()[3]);
+}
+
+float BakedProbe::GetRadius() const
+{
+	return glm::length(m_boxMax - m_boxMin) * 0.5f;
+}
+
+bool BakedProbe::Contains(glm::vec3 point) const
+{
+	return glm::all(glm::greaterThanEqual(point, m_boxMin)) && glm::all(glm::lessThanEqual(point, m_boxMax));
+}
+
+std::string BakedProbe::_GetCachePath() const
+{
+	char name[64] = { "\0" };
+	snprintf(name, sizeof(name), "probe_%d.rpb", m_index);
+	return CACHE_DIRECTORY + name;
+}
+
+bool BakedProbe::EnsureDirectory(const std::string & directory)
+{
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	// Fails if it already existed, opening the file tells if it is usable
+	return true;
+}
+
+bool BakedProbe::LoadCache()
+{
+	if (m_dynamic)
+		return false;
+
+	FILE* file = fopen(_GetCachePath().c_str(), "rb");
+	if (!file)
+		return false;
+
+	ProbeCacheHeader header;
+	glm::vec3 position = GetPosition();
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, PROBE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.size == m_size && header.levels == (unsigned int)BAKED_PROBE_LEVELS &&
+		header.position[0] == position.x && header.position[1] == position.y && header.position[2] == position.z &&
+		header.boxMin[0] == m_boxMin.x && header.boxMin[1] == m_boxMin.y && header.boxMin[2] == m_boxMin.z &&
+		header.boxMax[0] == m_boxMax.x && header.boxMax[1] == m_boxMax.y && header.boxMax[2] == m_boxMax.z;
+
+	std::vector<std::vector<unsigned short>> levels;
+	for (int level = 0; valid && level < BAKED_PROBE_LEVELS; level++) {
+		size_t levelSize = std::max(m_size >> level, 1u);
+		levels.push_back(std::vector<unsigned short>(levelSize * levelSize * 4 * 6));
+		valid = fread(levels.back().data(), sizeof(unsigned short), levels.back().size(), file) == levels.back().size();
+	}
+	fclose(file);
+
+	if (!valid) {
+		printf("Probe cache %s is out of date\n", _GetCachePath().c_str());
+		return false;
+	}
+
+	_Upload(levels);
+	return true;
+}
+
+bool BakedProbe::_StoreCache(const std::vector<std::vector<unsigned short>>& levels) const
+{
+	EnsureDirectory(CACHE_DIRECTORY);
+
+	FILE* file = fopen(_GetCachePath().c_str(), "wb");
+	if (!file) {
+		printf("Failed to write the probe cache %s\n", _GetCachePath().c_str());
+		return false;
+	}
+
+	ProbeCacheHeader header;
+	glm::vec3 position = GetPosition();
+	memcpy(header.magic, PROBE_CACHE_MAGIC, sizeof(header.magic));
+	header.size = m_size;
+	header.levels = (unsigned int)levels.size();
+	header.position[0] = position.x; header.position[1] = position.y; header.position[2] = position.z;
+	header.boxMin[0] = m_boxMin.x; header.boxMin[1] = m_boxMin.y; header.boxMin[2] = m_boxMin.z;
+	header.boxMax[0] = m_boxMax.x; header.boxMax[1] = m_boxMax.y; header.boxMax[2] = m_boxMax.z;
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (size_t i = 0; success && i < levels.size(); i++)
+		success = fwrite(levels[i].data(), sizeof(unsigned short), levels[i].size(), file) == levels[i].size();
+	fclose(file);
+
+	return success;
+}
+
+std::vector<std::vector<float>> BakedProbe::_ReadCapture()
+{
+	std::vector<std::vector<float>> faces(6);
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, m_capture->GetCubeMap());
+	for (int face = 0; face < 6; face++) {
+		faces[face].resize((size_t)m_size * m_size * 4);
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, GL_FLOAT, faces[face].data());
+	}
+	return faces;
+}
+
+std::vector<std::vector<unsigned short>> BakedProbe::_Prefilter(const std::vector<std::vector<float>>& faces) const
+{
+	// Box filtered copies of the capture, the sources of the convolution
+	std::vector<std::vector<std::vector<float>>> chain(1, faces);
+	std::vector<int> chainSizes(1, (int)m_size);
+	while (chainSizes.back() > 1) {
+		std::vector<std::vector<float>> next(6);
+		for (int face = 0; face < 6; face++)
+			next[face] = Downsample(chain.back()[face], chainSizes.back());
+		chain.push_back(next);
+		chainSizes.push_back(chainSizes.back() / 2);
+	}
+
+	std::vector<std::vector<unsigned short>> levels(BAKED_PROBE_LEVELS);
+	for (int level = 0; level < BAKED_PROBE_LEVELS; level++) {
+		int size = std::max((int)m_size >> level, 1);
+		levels[level].resize((size_t)size * size * 4 * 6);
+
+		if (level == 0) {
+			// Mirror reflection, the capture as is
+			for (int face = 0; face < 6; face++) {
+				for (size_t i = 0; i < (size_t)size * size * 4; i++)
+					levels[0][face * (size_t)size * size * 4 + i] = (unsigned short)glm::packHalf1x16(faces[face][i]);
+			}
+			continue;
+		}
+
+		// Source with at most twice the resolution of the level
+		size_t source = 0;
+		while (source + 1 < chainSizes.size() &&
+			(chainSizes[source] > 2 * size || chainSizes[source] > BAKED_PROBE_PREFILTER_SOURCE))
+			source++;
+		int sourceSize = chainSizes[source];
+		const std::vector<std::vector<float>>& sourceFaces = chain[source];
+
+		// Phong lobe matching the roughness of the level
+		float roughness = (float)level / (BAKED_PROBE_LEVELS - 1);
+		float exponent = std::max(2.0f / std::max(roughness * roughness * roughness * roughness, 0.0001f) - 2.0f, 1.0f);
+		// Texels whose weight would be under 1/1000 are skipped
+		float minCos = std::pow(0.001f, 1.0f / exponent);
+
+		// Direction (xyz) and solid angle (w) of every source texel
+		std::vector<glm::vec4> sourceTexels((size_t)sourceSize * sourceSize * 6);
+		for (int sourceFace = 0; sourceFace < 6; sourceFace++) {
+			for (int sy = 0; sy < sourceSize; sy++) {
+				for (int sx = 0; sx < sourceSize; sx++) {
+					sourceTexels[((size_t)sourceFace * sourceSize + sy) * sourceSize + sx] =
+						glm::vec4(TexelDirection(sourceFace, sx, sy, sourceSize), TexelSolidAngle(sx, sy, sourceSize));
+				}
+			}
+		}
+
+		// Every face of the level is convolved on its own thread
+		std::vector<std::future<void>> jobs;
+		for (int face = 0; face < 6; face++) {
+			jobs.push_back(std::async(std::launch::async, [&, face, size]() {
+				unsigned short* output = &levels[level][face * (size_t)size * size * 4];
+				for (int y = 0; y < size; y++) {
+					for (int x = 0; x < size; x++) {
+						glm::vec3 normal = TexelDirection(face, x, y, size);
+						glm::vec4 sum(0.0f);
+						float weights = 0.0f;
+
+						for (int sourceFace = 0; sourceFace < 6; sourceFace++) {
+							const glm::vec4* directions = &sourceTexels[(size_t)sourceFace * sourceSize * sourceSize];
+							for (size_t i = 0; i < (size_t)sourceSize * sourceSize; i++) {
+								float cosine = glm::dot(normal, glm::vec3(directions[i]));
+								if (cosine < minCos)
+									continue;
+
+								float weight = std::pow(cosine, exponent) * directions[i].w;
+								const float* texel = &sourceFaces[sourceFace][i * 4];
+								sum += glm::vec4(texel[0], texel[1], texel[2], texel[3]) * weight;
+								weights += weight;
+							}
+						}
+
+						if (weights > 0.0f)
+							sum /= weights;
+						for (int c = 0; c < 4; c++)
+							output[((size_t)y * size + x) * 4 + c] = (unsigned short)glm::packHalf1x16(sum[c]);
+					}
+				}
+			}));
+		}
+		for (size_t i = 0; i < jobs.size(); i++)
+			jobs[i].get();
+	}
+
+	return levels;
+}
+
+void BakedProbe::_Upload(const std::vector<std::vector<unsigned short>>& levels)
+{
+	if (!m_cubemap)
+		glGenTextures(1, &m_cubemap);
+
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, m_cubemap);
+	for (size_t level = 0; level < levels.size(); level++) {
+		int size = std::max((int)m_size >> level, 1);
+		for (int face = 0; face < 6; face++) {
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)level, GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT,
+				&levels[level][face * (size_t)size * size * 4]);
+		}
+	}
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	m_levels = (int)levels.size();
+
+	// The capture is not needed anymore, its targets go back to the pool
+	delete m_capture;
+	m_capture = nullptr;
+}
+
+void BakedProbe::FinishBake(bool store)
+{
+	if (m_dynamic || m_capture == nullptr)
+		return;
+
+	std::vector<std::vector<unsigned short>> levels = _Prefilter(_ReadCapture());
+	if (store && _StoreCache(levels))
+		printf("Baked %s\n", _GetCachePath().c_str());
+	_Upload(levels);
+}
+
+void BakedProbe::Read(GLenum textureUnit)
+{
+	GLuint texture = m_cubemap ? m_cubemap : (m_capture ? m_capture->GetCubeMap() : 0);
+	GLState::BindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, texture);
+}
+
+BakedProbe * BakedProbe::Find(const std::vector<BakedProbe*>& probes, glm::vec3 point)
+{
+	BakedProbe* closest = nullptr;
+	float closestDistance = 0.0f;
+	for (size_t i = 0; i < probes.size(); i++) {
+		if (probes[i]->GetLevels() == 0 || !probes[i]->Contains(point))
+			continue;
+
+		float distance = glm::distance(point, probes[i]->GetPosition());
+		if (closest == nullptr || distance < closestDistance) {
+			closest = probes[i];
+			closestDistance = distance;
+		}
+	}
+	return closest;
+}
+
+BakedProbe::~BakedProbe()
+{
+	delete m_capture;
+	if (m_cubemap)
+		GLState::DeleteTexture(m_cubemap);
+	ObjectPool<Transform>::Destroy(m_transform);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "Commons.h"
+#include "GLState.h"
+#include "CubeMap.h"
+#include "Transform.h"
+
+// Resolution of a probe when the scene does not give one
+const int BAKED_PROBE_DEFAULT_SIZE = 128;
+// Roughness levels stored for a static probe, from mirror (level 0) to fully rough
+const int BAKED_PROBE_LEVELS = 6;
+// Largest face the prefilter reads from. Rough levels do not need more detail
+const int BAKED_PROBE_PREFILTER_SOURCE = 64;
+// Folder of the baked probes, shared with the other caches
+const std::string CACHE_DIRECTORY = "Cache/";
+
+/*!
+	Reflection probe placed in the scene description.
+
+	The scene around the probe is captured once, the static geometry only, and prefiltered on the CPU into roughness
+	mips: level 0 is the mirror reflection and every next level is convolved with a wider specular lobe. The result is
+	stored in CACHE_DIRECTORY as half floats and loaded instead of baking on the next runs. Objects inside the probe's
+	box sample it with box projection, so the reflection lines up with the walls of the box instead of being at infinity.
+
+	Dynamic probes are not prefiltered nor cached, they are re-rendered by the ProbeScheduler like the real-time spheres.
+*/
+class BakedProbe
+{
+private:
+	int m_index;
+	Transform* m_transform;
+	glm::vec3 m_boxMin;
+	glm::vec3 m_boxMax;
+	GLuint m_size;
+	bool m_dynamic;
+
+	// Cube map the scene is rendered in. Static probes release it once baked
+	CubeMap* m_capture;
+	// Prefiltered cube map of a static probe
+	GLuint m_cubemap;
+	int m_levels;
+
+	std::string _GetCachePath() const;
+	// Reads back the captured faces as RGBA floats
+	std::vector<std::vector<float>> _ReadCapture();
+	// Builds every roughness level from the captured faces. Returns half floats per level and face
+	std::vector<std::vector<unsigned short>> _Prefilter(const std::vector<std::vector<float>>& faces) const;
+	void _Upload(const std::vector<std::vector<unsigned short>>& levels);
+	bool _StoreCache(const std::vector<std::vector<unsigned short>>& levels) const;
+
+public:
+	// Creates a cache folder if it does not exist yet. Shared with the other caches
+	static bool EnsureDirectory(const std::string& directory);
+
+	BakedProbe(int index, glm::vec3 position, glm::vec3 boxMin, glm::vec3 boxMax, GLuint size, bool dynamic);
+
+	Transform* GetTransform() const { return m_transform; }
+	glm::vec3 GetPosition() const;
+	glm::vec3 GetBoxMin() const { return m_boxMin; }
+	glm::vec3 GetBoxMax() const { return m_boxMax; }
+	GLuint GetSize() const { return m_size; }
+	bool IsDynamic() const { return m_dynamic; }
+	// Mip levels that can be sampled. 0 while the probe has nothing to show
+	int GetLevels() const { return m_levels; }
+	// Radius of the sphere around the box
+	float GetRadius() const;
+	// Render target the scene has to be rendered in before FinishBake. Null once a static probe is baked
+	CubeMap* GetCapture() const { return m_capture; }
+
+	bool Contains(glm::vec3 point) const;
+
+	// Loads the bake from the cache. Fails if there is none or it was baked with other settings
+	bool LoadCache();
+
+	/*!
+		\n void BakedProbe::FinishBake(bool store)
+		\param bool store Writes the result to the cache
+
+		Prefilters the faces rendered in the capture cube map and uploads them. Static probes only
+	*/
+	void FinishBake(bool store);
+
+	void Read(GLenum textureUnit);
+
+	// Probe whose box contains the point, the one with the closest center if several do. Null if none
+	static BakedProbe* Find(const std::vector<BakedProbe*>& probes, glm::vec3 point);
+
+	~BakedProbe();
+};
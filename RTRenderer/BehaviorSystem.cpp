@@ -0,0 +1,50 @@
+#include "BehaviorSystem.h"
+
+#include <unordered_set>
+
+#include "Transform.h"
+#include "Camera.h"
+#include "ObjectController.h"
+#include "RotationObjects.h"
+#include "AnimationEngine.h"
+
+std::vector<BehaviorSystem::System> BehaviorSystem::mSystems;
+
+unsigned long long BehaviorSystem::_GetHierarchyVersion()
+{
+	return Transform::GetHierarchyVersion();
+}
+
+bool BehaviorSystem::HasNestedTransforms(const std::vector<Transform*>& transforms)
+{
+	// Two behaviours of a transform move it at once too
+	std::unordered_set<Transform*> set(transforms.begin(), transforms.end());
+	if (set.size() < transforms.size())
+		return true;
+	for (size_t i = 0; i < transforms.size(); i++) {
+		for (Transform* ancestor = transforms[i]->parent; ancestor != nullptr; ancestor = ancestor->parent) {
+			if (set.count(ancestor) > 0)
+				return true;
+		}
+	}
+	return false;
+}
+
+void BehaviorSystem::Initialize()
+{
+	// The behaviours that move transforms, then the ones that read where they are
+	Register<HelicopterController>(true);
+	Register<AnimateKeyFrame>(&AnimationEngine::Update, true);
+	Register<RotatingObject>(true);
+	Register<CameraController>();
+	Register<Camera>();
+	Register<PrintKeyFrame>();
+	Register<ActivateLights>();
+}
+
+void BehaviorSystem::Update(Transform* root)
+{
+	for (size_t i = 0; i < mSystems.size(); i++)
+		mSystems[i].update(mSystems[i].parallel);
+	root->UpdateUnpooled();
+}
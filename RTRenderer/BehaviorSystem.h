@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+
+#include "ObjectPool.h"
+#include "JobSystem.h"
+
+class Transform;
+
+// Slots of a behaviour pool worth a job of their own when a system runs in parallel
+const size_t BEHAVIOR_UPDATE_BATCH = 256;
+
+/*!
+	Updates the behaviours one type at a time.
+
+	Behaviours added with Transform::AddBehavior are components: they live in the chunks of ObjectPool<T>, and the
+	system of T updates all of them in one pass over that memory, calling T::Update directly instead of through the
+	vtable, instead of a tree walk that interleaves every type node by node. Systems run in the order they were
+	registered, so the behaviours that move transforms come before the ones that read them. A parallel system splits its
+	pool between the threads unless one of its behaviours is in the subtree of another, as moving a transform moves its
+	whole subtree. Behaviours added with AddUpdatable are still updated by the tree walk, after the systems.
+*/
+class BehaviorSystem
+{
+private:
+	struct System {
+		void(*update)(bool parallel);
+		bool parallel;
+	};
+
+	static std::vector<System> mSystems;
+
+	template<class T>
+	static bool& _IsRegistered() {
+		static bool registered = false;
+		return registered;
+	}
+
+	// Whether a behaviour of type T is in the subtree of another one. Checked again when behaviours come or go, or
+	// when the tree of transforms changes
+	template<class T>
+	static bool _AreNested() {
+		static bool checked = false;
+		static unsigned long long checkedModifications = 0;
+		static unsigned long long checkedHierarchy = 0;
+		static bool nested = false;
+
+		unsigned long long modifications = ObjectPool<T>::GetModificationCount();
+		unsigned long long hierarchy = _GetHierarchyVersion();
+		if (!checked || modifications != checkedModifications || hierarchy != checkedHierarchy) {
+			std::vector<Transform*> transforms;
+			transforms.reserve(ObjectPool<T>::GetCount());
+			ObjectPool<T>::ForEach([&transforms](T* behavior) { transforms.push_back(behavior->GetTransform()); });
+			nested = HasNestedTransforms(transforms);
+			checked = true;
+			checkedModifications = modifications;
+			checkedHierarchy = hierarchy;
+		}
+		return nested;
+	}
+
+	// Transform::GetHierarchyVersion, which this header cannot include
+	static unsigned long long _GetHierarchyVersion();
+
+	template<class T>
+	static void _Update(bool parallel) {
+		if (!parallel || _AreNested<T>()) {
+			ObjectPool<T>::ForEach([](T* behavior) { behavior->T::Update(); });
+			return;
+		}
+		JobSystem::ParallelFor(ObjectPool<T>::GetCapacity(), BEHAVIOR_UPDATE_BATCH, [](size_t begin, size_t end) {
+			ObjectPool<T>::ForEach(begin, end, [](T* behavior) { behavior->T::Update(); });
+		});
+	}
+
+public:
+	// Registers the behaviours of the engine, in the order they are updated
+	static void Initialize();
+
+	/*!
+		\n void BehaviorSystem::Register<T>(bool parallel)
+		\param bool parallel The behaviours of T only touch their own subtree, so they can be updated in parallel
+
+		Adds the system of T after the ones registered so far. Does nothing if T already has one. AddBehavior registers
+		the types that were not, so they are updated after every known type
+	*/
+	template<class T>
+	static void Register(bool parallel = false) {
+		Register<T>(&_Update<T>, parallel);
+	}
+
+	// Like Register, for a type whose behaviours are updated by a function of its own instead of their Update
+	template<class T>
+	static void Register(void(*update)(bool parallel), bool parallel = false) {
+		if (_IsRegistered<T>())
+			return;
+		_IsRegistered<T>() = true;
+
+		System system = { update, parallel };
+		mSystems.push_back(system);
+	}
+
+	/*!
+		\n void BehaviorSystem::Update(Transform* root)
+		\param Transform* root Root of the tree whose AddUpdatable behaviours are updated after the systems
+
+		Runs every system, in order
+	*/
+	static void Update(Transform* root);
+
+	// Whether a transform of the list is in the subtree of another one, or in the list twice. Such transforms cannot
+	// be moved in parallel
+	static bool HasNestedTransforms(const std::vector<Transform*>& transforms);
+};
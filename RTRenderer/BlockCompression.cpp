@@ -0,0 +1,351 @@
+#include "BlockCompression.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+// BC7 interpolation weights for 4 bit indices
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static unsigned short Pack565(const int color[3])
+{
+	return (unsigned short)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void Unpack565(unsigned short packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Writes bits LSB first into a 128 bit block
+static void WriteBits(unsigned char out[16], int* position, unsigned int value, int count)
+{
+	for (int i = 0; i < count; i++, (*position)++) {
+		if (value & (1u << i))
+			out[*position >> 3] |= (unsigned char)(1 << (*position & 7));
+	}
+}
+
+void BlockCompression::_FetchBlock(const unsigned char * rgba, int width, int height, int x, int y, unsigned char block[64])
+{
+	for (int by = 0; by < 4; by++) {
+		int sy = std::min(y + by, height - 1);
+		for (int bx = 0; bx < 4; bx++) {
+			int sx = std::min(x + bx, width - 1);
+			memcpy(&block[(by * 4 + bx) * 4], &rgba[(sy * width + sx) * 4], 4);
+		}
+	}
+}
+
+void BlockCompression::EncodeBC1Block(const unsigned char block[64], unsigned char out[8])
+{
+	// -- Endpoints: bounding box of the colors, diagonal picked from the covariance sign --
+	int minC[3] = { 255, 255, 255 };
+	int maxC[3] = { 0, 0, 0 };
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			minC[c] = std::min(minC[c], (int)block[i * 4 + c]);
+			maxC[c] = std::max(maxC[c], (int)block[i * 4 + c]);
+			mean[c] += block[i * 4 + c] / 16.0f;
+		}
+	}
+
+	float covRG = 0.0f, covRB = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float r = block[i * 4] - mean[0];
+		covRG += r * (block[i * 4 + 1] - mean[1]);
+		covRB += r * (block[i * 4 + 2] - mean[2]);
+	}
+	if (covRG < 0.0f) std::swap(minC[1], maxC[1]);
+	if (covRB < 0.0f) std::swap(minC[2], maxC[2]);
+
+	// Inset the box a little so the endpoints are not wasted on outliers
+	for (int c = 0; c < 3; c++) {
+		int inset = (maxC[c] - minC[c]) / 16;
+		maxC[c] -= inset;
+		minC[c] += inset;
+	}
+
+	unsigned short c0 = Pack565(maxC);
+	unsigned short c1 = Pack565(minC);
+	// Four color mode requires c0 > c1
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	unsigned int indices = 0;
+	if (c0 != c1) {
+		int palette[4][3];
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 0x7FFFFFFF;
+			for (int p = 0; p < 4; p++) {
+				int error = 0;
+				for (int c = 0; c < 3; c++) {
+					int d = block[i * 4 + c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF;
+	out[6] = (indices >> 16) & 0xFF; out[7] = (indices >> 24) & 0xFF;
+}
+
+void BlockCompression::EncodeBC4Block(const unsigned char * values, int stride, unsigned char out[8])
+{
+	int minV = 255, maxV = 0;
+	for (int i = 0; i < 16; i++) {
+		minV = std::min(minV, (int)values[i * stride]);
+		maxV = std::max(maxV, (int)values[i * stride]);
+	}
+
+	// Eight value mode (a0 > a1)
+	int palette[8];
+	palette[0] = maxV;
+	palette[1] = minV;
+	for (int k = 2; k < 8; k++) {
+		palette[k] = ((8 - k) * maxV + (k - 1) * minV) / 7;
+	}
+
+	unsigned long long indices = 0;
+	if (maxV != minV) {
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 256;
+			for (int p = 0; p < 8; p++) {
+				int error = abs(values[i * stride] - palette[p]);
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+
+	out[0] = (unsigned char)maxV;
+	out[1] = (unsigned char)minV;
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+	}
+}
+
+void BlockCompression::EncodeBC3Block(const unsigned char block[64], unsigned char out[16])
+{
+	EncodeBC4Block(&block[3], 4, out);
+	EncodeBC1Block(block, out + 8);
+}
+
+void BlockCompression::EncodeBC5Block(const unsigned char block[64], unsigned char out[16])
+{
+	EncodeBC4Block(&block[0], 4, out);
+	EncodeBC4Block(&block[1], 4, out + 8);
+}
+
+void BlockCompression::EncodeBC7Block(const unsigned char block[64], unsigned char out[16])
+{
+	// -- Principal axis of the texels (a few power iterations on the covariance) --
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			mean[c] += block[i * 4 + c] / 16.0f;
+		}
+	}
+
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		float d[4];
+		for (int c = 0; c < 4; c++) {
+			d[c] = block[i * 4 + c] - mean[c];
+		}
+		for (int a = 0; a < 4; a++) {
+			for (int b = 0; b < 4; b++) {
+				cov[a][b] += d[a] * d[b];
+			}
+		}
+	}
+
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int it = 0; it < 8; it++) {
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int a = 0; a < 4; a++) {
+			for (int b = 0; b < 4; b++) {
+				next[a] += cov[a][b] * axis[b];
+			}
+		}
+		float len = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (len < 1e-6f)
+			break;
+		for (int c = 0; c < 4; c++) {
+			axis[c] = next[c] / len;
+		}
+	}
+
+	// -- Endpoints are the extreme projections on the axis --
+	float minT = 1e9f, maxT = -1e9f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			t += (block[i * 4 + c] - mean[c]) * axis[c];
+		}
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	float endpoint[2][4];
+	for (int c = 0; c < 4; c++) {
+		endpoint[0][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minT));
+		endpoint[1][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxT));
+	}
+
+	// -- Quantize to 7 bits plus a shared p-bit per endpoint --
+	int quantized[2][4];
+	int pBit[2];
+	int decoded[2][4];
+	for (int e = 0; e < 2; e++) {
+		float bestError = 1e9f;
+		for (int p = 0; p < 2; p++) {
+			int q[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++) {
+				q[c] = std::min(127, std::max(0, (int)floorf((endpoint[e][c] - p) / 2.0f + 0.5f)));
+				float d = endpoint[e][c] - (float)((q[c] << 1) | p);
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				pBit[e] = p;
+				for (int c = 0; c < 4; c++) {
+					quantized[e][c] = q[c];
+					decoded[e][c] = (q[c] << 1) | p;
+				}
+			}
+		}
+	}
+
+	// -- Indices --
+	int indices[16];
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestError = 0x7FFFFFFF;
+		for (int w = 0; w < 16; w++) {
+			int error = 0;
+			for (int c = 0; c < 4; c++) {
+				int value = ((64 - BC7_WEIGHTS4[w]) * decoded[0][c] + BC7_WEIGHTS4[w] * decoded[1][c] + 32) >> 6;
+				int d = block[i * 4 + c] - value;
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				best = w;
+			}
+		}
+		indices[i] = best;
+	}
+
+	// The anchor index (texel 0) is stored without its top bit, so it must be < 8
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; c++) {
+			std::swap(quantized[0][c], quantized[1][c]);
+		}
+		std::swap(pBit[0], pBit[1]);
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	// -- Pack: mode, endpoints per channel, p-bits, indices --
+	memset(out, 0, 16);
+	int position = 0;
+	WriteBits(out, &position, 1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		WriteBits(out, &position, quantized[0][c], 7);
+		WriteBits(out, &position, quantized[1][c], 7);
+	}
+	WriteBits(out, &position, pBit[0], 1);
+	WriteBits(out, &position, pBit[1], 1);
+	WriteBits(out, &position, indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		WriteBits(out, &position, indices[i], 4);
+	}
+}
+
+int BlockCompression::GetBlockSize(BlockFormat format)
+{
+	return format == BF_BC1 ? 8 : 16;
+}
+
+size_t BlockCompression::GetCompressedSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * GetBlockSize(format);
+}
+
+std::vector<unsigned char> BlockCompression::Compress(BlockFormat format, const unsigned char * rgba, int width, int height)
+{
+	std::vector<unsigned char> data(GetCompressedSize(format, width, height));
+	int blockSize = GetBlockSize(format);
+
+	unsigned char block[64];
+	unsigned char* out = data.data();
+	for (int y = 0; y < height; y += 4) {
+		for (int x = 0; x < width; x += 4) {
+			_FetchBlock(rgba, width, height, x, y, block);
+			switch (format) {
+			case BF_BC1:
+				EncodeBC1Block(block, out);
+				break;
+			case BF_BC3:
+				EncodeBC3Block(block, out);
+				break;
+			case BF_BC5:
+				EncodeBC5Block(block, out);
+				break;
+			case BF_BC7:
+				EncodeBC7Block(block, out);
+				break;
+			}
+			out += blockSize;
+		}
+	}
+
+	return data;
+}
+
+std::vector<unsigned char> BlockCompression::Downsample(const unsigned char * rgba, int width, int height, int * outWidth, int * outHeight)
+{
+	*outWidth = std::max(1, width / 2);
+	*outHeight = std::max(1, height / 2);
+
+	std::vector<unsigned char> data((size_t)(*outWidth) * (*outHeight) * 4);
+	for (int y = 0; y < *outHeight; y++) {
+		int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < *outWidth; x++) {
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++) {
+				int sum = rgba[(y0 * width + x0) * 4 + c] + rgba[(y0 * width + x1) * 4 + c] +
+					rgba[(y1 * width + x0) * 4 + c] + rgba[(y1 * width + x1) * 4 + c];
+				data[((size_t)y * (*outWidth) + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+
+	return data;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Block compressed formats produced by the texture cooker
+enum BlockFormat {
+	// RGB, 1 bit alpha. 8 bytes per 4x4 block
+	BF_BC1,
+	// RGBA with interpolated alpha. 16 bytes per 4x4 block
+	BF_BC3,
+	// Two independent channels (normal maps). 16 bytes per 4x4 block
+	BF_BC5,
+	// High quality RGBA. 16 bytes per 4x4 block
+	BF_BC7
+};
+
+// CPU encoders for the BCn formats. All images are tightly packed RGBA8
+class BlockCompression
+{
+private:
+	// Copies the 4x4 block at (x, y) clamping at the image border
+	static void _FetchBlock(const unsigned char* rgba, int width, int height, int x, int y, unsigned char block[64]);
+
+public:
+	// Encodes 16 RGBA texels into a BC1 block (alpha is ignored)
+	static void EncodeBC1Block(const unsigned char block[64], unsigned char out[8]);
+	// Encodes 16 single channel values, read every stride bytes, into a BC4 block
+	static void EncodeBC4Block(const unsigned char* values, int stride, unsigned char out[8]);
+	// Encodes 16 RGBA texels into a BC3 block
+	static void EncodeBC3Block(const unsigned char block[64], unsigned char out[16]);
+	// Encodes the red and green channel of 16 RGBA texels into a BC5 block
+	static void EncodeBC5Block(const unsigned char block[64], unsigned char out[16]);
+	// Encodes 16 RGBA texels into a BC7 block using mode 6 (single subset, 4 bit indices)
+	static void EncodeBC7Block(const unsigned char block[64], unsigned char out[16]);
+
+	static int GetBlockSize(BlockFormat format);
+	static size_t GetCompressedSize(BlockFormat format, int width, int height);
+
+	// Compresses a whole image. Sizes that are not multiple of 4 are padded by repeating the border texels
+	static std::vector<unsigned char> Compress(BlockFormat format, const unsigned char* rgba, int width, int height);
+	// Box filters an RGBA8 image down to the next mip level
+	static std::vector<unsigned char> Downsample(const unsigned char* rgba, int width, int height, int* outWidth, int* outHeight);
+};
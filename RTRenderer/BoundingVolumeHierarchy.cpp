@@ -0,0 +1,397 @@
+#include "BoundingVolumeHierarchy.h"
+
+// Node on the stack of a frustum query, with the planes it still has to be tested against
+struct FrustumEntry {
+	int node;
+	int planes;
+};
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(float margin)
+	: m_root(-1), m_leafCount(0), m_margin(margin)
+{
+}
+
+float BoundingVolumeHierarchy::_Area(glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	glm::vec3 size = boxMax - boxMin;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+float BoundingVolumeHierarchy::_RayDistance(glm::vec3 origin, glm::vec3 inverseDirection, const BVHNode & node, float maxDistance)
+{
+	// Slab test, the ray is inside the box between the last entry and the first exit
+	glm::vec3 t0 = (node.boxMin - origin) * inverseDirection;
+	glm::vec3 t1 = (node.boxMax - origin) * inverseDirection;
+	glm::vec3 nearest = glm::min(t0, t1);
+	glm::vec3 furthest = glm::max(t0, t1);
+	float enter = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+	float exit = std::min(std::min(furthest.x, furthest.y), std::min(furthest.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+int BoundingVolumeHierarchy::_Allocate()
+{
+	int node;
+	if (!m_free.empty()) {
+		node = m_free.back();
+		m_free.pop_back();
+	}
+	else {
+		node = (int)m_nodes.size();
+		m_nodes.push_back(BVHNode());
+	}
+	m_nodes[node].parent = -1;
+	m_nodes[node].children[0] = -1;
+	m_nodes[node].children[1] = -1;
+	m_nodes[node].payload = -1;
+	return node;
+}
+
+void BoundingVolumeHierarchy::_Free(int node)
+{
+	m_free.push_back(node);
+}
+
+void BoundingVolumeHierarchy::_SetBox(int node)
+{
+	const BVHNode& left = m_nodes[m_nodes[node].children[0]];
+	const BVHNode& right = m_nodes[m_nodes[node].children[1]];
+	m_nodes[node].boxMin = glm::min(left.boxMin, right.boxMin);
+	m_nodes[node].boxMax = glm::max(left.boxMax, right.boxMax);
+}
+
+void BoundingVolumeHierarchy::_InsertLeaf(int leaf)
+{
+	if (m_root == -1) {
+		m_root = leaf;
+		m_nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Goes down while pushing the leaf into a child costs less than pairing it with the node, counting the growth of
+	// the boxes it goes through
+	glm::vec3 boxMin = m_nodes[leaf].boxMin;
+	glm::vec3 boxMax = m_nodes[leaf].boxMax;
+	int sibling = m_root;
+	while (!m_nodes[sibling].IsLeaf()) {
+		const BVHNode& node = m_nodes[sibling];
+		float area = _Area(node.boxMin, node.boxMax);
+		float combinedArea = _Area(glm::min(node.boxMin, boxMin), glm::max(node.boxMax, boxMax));
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		for (int i = 0; i < 2; i++) {
+			const BVHNode& child = m_nodes[node.children[i]];
+			childCosts[i] = _Area(glm::min(child.boxMin, boxMin), glm::max(child.boxMax, boxMax)) + inheritance;
+			if (!child.IsLeaf())
+				childCosts[i] -= _Area(child.boxMin, child.boxMax);
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		sibling = node.children[childCosts[0] <= childCosts[1] ? 0 : 1];
+	}
+
+	int oldParent = m_nodes[sibling].parent;
+	int parent = _Allocate();
+	m_nodes[parent].parent = oldParent;
+	m_nodes[parent].children[0] = sibling;
+	m_nodes[parent].children[1] = leaf;
+	m_nodes[sibling].parent = parent;
+	m_nodes[leaf].parent = parent;
+
+	if (oldParent == -1)
+		m_root = parent;
+	else
+		m_nodes[oldParent].children[m_nodes[oldParent].children[0] == sibling ? 0 : 1] = parent;
+
+	_Refit(parent);
+}
+
+void BoundingVolumeHierarchy::_RemoveLeaf(int leaf)
+{
+	if (leaf == m_root) {
+		m_root = -1;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int parent = m_nodes[leaf].parent;
+	int grandParent = m_nodes[parent].parent;
+	int sibling = m_nodes[parent].children[m_nodes[parent].children[0] == leaf ? 1 : 0];
+	m_nodes[sibling].parent = grandParent;
+	_Free(parent);
+
+	if (grandParent == -1) {
+		m_root = sibling;
+	}
+	else {
+		m_nodes[grandParent].children[m_nodes[grandParent].children[0] == parent ? 0 : 1] = sibling;
+		_Refit(grandParent);
+	}
+	m_nodes[leaf].parent = -1;
+}
+
+void BoundingVolumeHierarchy::_Refit(int node)
+{
+	while (node != -1) {
+		_SetBox(node);
+		_Rotate(node);
+		node = m_nodes[node].parent;
+	}
+}
+
+void BoundingVolumeHierarchy::_Rotate(int node)
+{
+	// The node's box holds the same leaves whatever the rotation, only the box of the child that takes the
+	// grandchild changes. Of the four swaps, the one that shrinks that box the most is made
+	float bestGain = 0.0f;
+	int bestChild = -1, bestGrandChild = -1;
+	for (int child = 0; child < 2; child++) {
+		const BVHNode& other = m_nodes[m_nodes[node].children[1 - child]];
+		if (other.IsLeaf())
+			continue;
+
+		const BVHNode& moved = m_nodes[m_nodes[node].children[child]];
+		float area = _Area(other.boxMin, other.boxMax);
+		for (int grandChild = 0; grandChild < 2; grandChild++) {
+			// The child goes under the other child, in place of the grandchild, and is paired with the grandchild left
+			const BVHNode& kept = m_nodes[other.children[1 - grandChild]];
+			float gain = area - _Area(glm::min(moved.boxMin, kept.boxMin), glm::max(moved.boxMax, kept.boxMax));
+			if (gain > bestGain) {
+				bestGain = gain;
+				bestChild = child;
+				bestGrandChild = grandChild;
+			}
+		}
+	}
+
+	if (bestChild == -1)
+		return;
+
+	int moved = m_nodes[node].children[bestChild];
+	int other = m_nodes[node].children[1 - bestChild];
+	int grandChild = m_nodes[other].children[bestGrandChild];
+	m_nodes[node].children[bestChild] = grandChild;
+	m_nodes[grandChild].parent = node;
+	m_nodes[other].children[bestGrandChild] = moved;
+	m_nodes[moved].parent = other;
+	_SetBox(other);
+}
+
+int BoundingVolumeHierarchy::_Build(int* leaves, int count)
+{
+	if (count == 1)
+		return leaves[0];
+
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (int i = 0; i < count; i++) {
+		glm::vec3 centroid = (m_nodes[leaves[i]].boxMin + m_nodes[leaves[i]].boxMax) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	// Bins along the axis the centroids spread the most on
+	glm::vec3 extent = centroidMax - centroidMin;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	// With every centroid in the same place, they are halved as they come
+	int split = count / 2;
+	if (extent[axis] > 0.0f) {
+		int binCounts[BVH_SAH_BINS] = { 0 };
+		glm::vec3 binMins[BVH_SAH_BINS], binMaxs[BVH_SAH_BINS];
+		for (int i = 0; i < BVH_SAH_BINS; i++) {
+			binMins[i] = glm::vec3(FLT_MAX);
+			binMaxs[i] = glm::vec3(-FLT_MAX);
+		}
+
+		float scale = BVH_SAH_BINS / extent[axis];
+		auto binOf = [&](int leaf) {
+			float centroid = (m_nodes[leaf].boxMin[axis] + m_nodes[leaf].boxMax[axis]) * 0.5f;
+			return std::min((int)((centroid - centroidMin[axis]) * scale), BVH_SAH_BINS - 1);
+		};
+		for (int i = 0; i < count; i++) {
+			int bin = binOf(leaves[i]);
+			binCounts[bin]++;
+			binMins[bin] = glm::min(binMins[bin], m_nodes[leaves[i]].boxMin);
+			binMaxs[bin] = glm::max(binMaxs[bin], m_nodes[leaves[i]].boxMax);
+		}
+
+		// Area times leaves below each split, swept from the right then from the left
+		float rightCosts[BVH_SAH_BINS];
+		glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		int sweepCount = 0;
+		for (int i = BVH_SAH_BINS - 1; i > 0; i--) {
+			sweepCount += binCounts[i];
+			sweepMin = glm::min(sweepMin, binMins[i]);
+			sweepMax = glm::max(sweepMax, binMaxs[i]);
+			rightCosts[i] = sweepCount > 0 ? sweepCount * _Area(sweepMin, sweepMax) : 0.0f;
+		}
+
+		float bestCost = FLT_MAX;
+		int bestBin = -1;
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (int i = 0; i < BVH_SAH_BINS - 1; i++) {
+			sweepCount += binCounts[i];
+			sweepMin = glm::min(sweepMin, binMins[i]);
+			sweepMax = glm::max(sweepMax, binMaxs[i]);
+			if (sweepCount == 0 || sweepCount == count)
+				continue;
+			float cost = sweepCount * _Area(sweepMin, sweepMax) + rightCosts[i + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestBin = i;
+			}
+		}
+
+		if (bestBin != -1)
+			split = (int)(std::partition(leaves, leaves + count, [&](int leaf) { return binOf(leaf) <= bestBin; }) - leaves);
+	}
+
+	int left = _Build(leaves, split);
+	int right = _Build(leaves + split, count - split);
+	int node = _Allocate();
+	m_nodes[node].children[0] = left;
+	m_nodes[node].children[1] = right;
+	m_nodes[left].parent = node;
+	m_nodes[right].parent = node;
+	_SetBox(node);
+	return node;
+}
+
+int BoundingVolumeHierarchy::Insert(glm::vec3 boxMin, glm::vec3 boxMax, int payload)
+{
+	int leaf = _Allocate();
+	m_nodes[leaf].boxMin = boxMin - glm::vec3(m_margin);
+	m_nodes[leaf].boxMax = boxMax + glm::vec3(m_margin);
+	m_nodes[leaf].payload = payload;
+	_InsertLeaf(leaf);
+	m_leafCount++;
+	return leaf;
+}
+
+void BoundingVolumeHierarchy::Remove(int proxy)
+{
+	_RemoveLeaf(proxy);
+	_Free(proxy);
+	m_leafCount--;
+}
+
+bool BoundingVolumeHierarchy::Move(int proxy, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	BVHNode& leaf = m_nodes[proxy];
+	if (glm::all(glm::lessThanEqual(leaf.boxMin, boxMin)) && glm::all(glm::greaterThanEqual(leaf.boxMax, boxMax)))
+		return false;
+
+	_RemoveLeaf(proxy);
+	m_nodes[proxy].boxMin = boxMin - glm::vec3(m_margin);
+	m_nodes[proxy].boxMax = boxMax + glm::vec3(m_margin);
+	_InsertLeaf(proxy);
+	return true;
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+	if (m_root == -1)
+		return;
+
+	// The leaves are kept, the internal nodes freed
+	std::vector<int> leaves;
+	leaves.reserve(m_leafCount);
+	std::vector<int> stack(1, m_root);
+	while (!stack.empty()) {
+		int node = stack.back();
+		stack.pop_back();
+		if (m_nodes[node].IsLeaf()) {
+			leaves.push_back(node);
+			continue;
+		}
+		stack.push_back(m_nodes[node].children[0]);
+		stack.push_back(m_nodes[node].children[1]);
+		_Free(node);
+	}
+
+	m_root = _Build(&leaves[0], (int)leaves.size());
+	m_nodes[m_root].parent = -1;
+}
+
+void BoundingVolumeHierarchy::Clear()
+{
+	m_nodes.clear();
+	m_free.clear();
+	m_root = -1;
+	m_leafCount = 0;
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(const Frustum & frustum, FrameVector<int>& payloads) const
+{
+	if (m_root == -1)
+		return;
+
+	FrameVector<FrustumEntry> stack;
+	stack.push_back({ m_root, FRUSTUM_ALL_PLANES });
+	while (!stack.empty()) {
+		FrustumEntry entry = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = m_nodes[entry.node];
+		if (entry.planes != 0 && !frustum.IntersectsBox(node.boxMin, node.boxMax, entry.planes))
+			continue;
+
+		if (node.IsLeaf()) {
+			payloads.push_back(node.payload);
+		}
+		else {
+			stack.push_back({ node.children[1], entry.planes });
+			stack.push_back({ node.children[0], entry.planes });
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QueryBox(glm::vec3 boxMin, glm::vec3 boxMax, FrameVector<int>& payloads) const
+{
+	if (m_root == -1)
+		return;
+
+	FrameVector<int> stack(1, m_root);
+	while (!stack.empty()) {
+		const BVHNode& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (glm::any(glm::lessThan(node.boxMax, boxMin)) || glm::any(glm::greaterThan(node.boxMin, boxMax)))
+			continue;
+
+		if (node.IsLeaf()) {
+			payloads.push_back(node.payload);
+		}
+		else {
+			stack.push_back(node.children[1]);
+			stack.push_back(node.children[0]);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QuerySphere(glm::vec3 center, float radius, FrameVector<int>& payloads) const
+{
+	if (m_root == -1)
+		return;
+
+	FrameVector<int> stack(1, m_root);
+	while (!stack.empty()) {
+		const BVHNode& node = m_nodes[stack.back()];
+		stack.pop_back();
+		// Distance to the nearest point of the box
+		glm::vec3 offset = glm::clamp(center, node.boxMin, node.boxMax) - center;
+		if (glm::dot(offset, offset) > radius * radius)
+			continue;
+
+		if (node.IsLeaf()) {
+			payloads.push_back(node.payload);
+		}
+		else {
+			stack.push_back(node.children[1]);
+			stack.push_back(node.children[0]);
+		}
+	}
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+#include <glm\glm.hpp>
+
+#include "Frustum.h"
+#include "FrameArena.h"
+
+// How far, in world units, a dynamic leaf's box reaches past its object, so small moves do not reinsert it
+const float BVH_DYNAMIC_MARGIN = 0.25f;
+// Centroid bins the SAH build tries to split between
+const int BVH_SAH_BINS = 12;
+
+struct BVHNode {
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	// -1 for the root
+	int parent;
+	// Both -1 for a leaf
+	int children[2];
+	// What a leaf stands for, -1 for an internal node
+	int payload;
+
+	bool IsLeaf() const { return children[0] == -1; }
+};
+
+/*!
+	Binary tree of boxes for culling and scene queries, one leaf per object.
+
+	Leaves are created with Insert and keep their index, the proxy, until they are removed, whatever happens to the
+	nodes above them. A leaf is linked next to the node its box grows the least, and every node refitted on the way
+	up swaps a child with a grandchild when that shrinks its boxes, so a tree built one leaf at a time stays close
+	to a good one. Rebuild throws the internal nodes away and builds them again with a binned surface area heuristic.
+
+	A hierarchy with a margin keeps every leaf's box that much larger than its object, and Move only reinserts a leaf
+	once its object left that box: the static objects are kept in one without a margin that is rebuilt when they
+	change, the dynamic ones in one with a margin. Queries append the payloads of the leaves they hit, nothing is
+	locked, so a tree may be queried from many threads as long as nobody changes it
+*/
+class BoundingVolumeHierarchy
+{
+private:
+	// Node on the stack of a ray query, with the distance the ray enters its box at
+	struct RayEntry {
+		int node;
+		float distance;
+	};
+
+	std::vector<BVHNode> m_nodes;
+	std::vector<int> m_free;
+	int m_root;
+	size_t m_leafCount;
+	float m_margin;
+
+	int _Allocate();
+	void _Free(int node);
+	// Links a leaf next to the sibling whose box grows the least
+	void _InsertLeaf(int leaf);
+	// Unlinks a leaf, which stays allocated
+	void _RemoveLeaf(int leaf);
+	// Refits the boxes from a node up to the root, rotating the children of each one
+	void _Refit(int node);
+	// Swaps a child with a grandchild under the other child when that shrinks the other child's box
+	void _Rotate(int node);
+	// Builds the subtree over count leaves with the SAH, returns its root
+	int _Build(int* leaves, int count);
+	void _SetBox(int node);
+
+	// Half the surface area of a box
+	static float _Area(glm::vec3 boxMin, glm::vec3 boxMax);
+	// Distance the ray enters the box at, FLT_MAX if it misses it before maxDistance
+	static float _RayDistance(glm::vec3 origin, glm::vec3 inverseDirection, const BVHNode& node, float maxDistance);
+
+public:
+	explicit BoundingVolumeHierarchy(float margin = 0.0f);
+
+	// Adds a leaf around a box and returns its proxy
+	int Insert(glm::vec3 boxMin, glm::vec3 boxMax, int payload);
+	void Remove(int proxy);
+	// Gives a leaf its object's new box. Returns true if the object left the leaf's box and the leaf was reinserted
+	bool Move(int proxy, glm::vec3 boxMin, glm::vec3 boxMax);
+	void SetPayload(int proxy, int payload) { m_nodes[proxy].payload = payload; }
+	int GetPayload(int proxy) const { return m_nodes[proxy].payload; }
+	// Box of a leaf, larger than its object in a hierarchy with a margin
+	void GetBox(int proxy, glm::vec3& boxMin, glm::vec3& boxMax) const { boxMin = m_nodes[proxy].boxMin; boxMax = m_nodes[proxy].boxMax; }
+	// Builds every internal node again with the SAH. The proxies stay valid
+	void Rebuild();
+	void Clear();
+	size_t GetLeafCount() const { return m_leafCount; }
+
+	/*!
+		\n void BoundingVolumeHierarchy::QueryFrustum(const Frustum& frustum, FrameVector<int>& payloads) const
+		\param FrameVector<int>& payloads The payloads of the leaves in the frustum are appended to it
+
+		Every node only tests the planes its parent crossed, and the subtree of a node inside all of them is taken
+		without testing anything
+	*/
+	void QueryFrustum(const Frustum& frustum, FrameVector<int>& payloads) const;
+	void QueryBox(glm::vec3 boxMin, glm::vec3 boxMax, FrameVector<int>& payloads) const;
+	void QuerySphere(glm::vec3 center, float radius, FrameVector<int>& payloads) const;
+
+	/*!
+		\n int BoundingVolumeHierarchy::Raycast(glm::vec3 origin, glm::vec3 direction, float& distance, LeafTest test) const
+		\param float& distance How far the ray goes. Set to the distance of the hit
+		\param LeafTest test float(int payload, float boxDistance), the distance the ray hits the leaf's object at, or
+		FLT_MAX for a miss. Returning boxDistance takes the leaf's box as the object
+
+		Returns the payload of the nearest hit, -1 if there is none. The nearer child is visited first, and nodes that
+		start beyond the nearest hit so far are skipped
+	*/
+	template<typename LeafTest>
+	int Raycast(glm::vec3 origin, glm::vec3 direction, float& distance, LeafTest test) const;
+};
+
+template<typename LeafTest>
+int BoundingVolumeHierarchy::Raycast(glm::vec3 origin, glm::vec3 direction, float& distance, LeafTest test) const
+{
+	if (m_root == -1)
+		return -1;
+
+	// Infinite along the axes the ray is parallel to, which the slab test handles
+	glm::vec3 inverseDirection = 1.0f / direction;
+	int hit = -1;
+	FrameVector<RayEntry> stack;
+	float rootDistance = _RayDistance(origin, inverseDirection, m_nodes[m_root], distance);
+	if (rootDistance != FLT_MAX)
+		stack.push_back({ m_root, rootDistance });
+
+	while (!stack.empty()) {
+		RayEntry entry = stack.back();
+		stack.pop_back();
+		if (entry.distance > distance)
+			continue;
+
+		const BVHNode& node = m_nodes[entry.node];
+		if (node.IsLeaf()) {
+			float leafDistance = test(node.payload, entry.distance);
+			if (leafDistance < distance) {
+				distance = leafDistance;
+				hit = node.payload;
+			}
+			continue;
+		}
+
+		RayEntry first = { node.children[0], _RayDistance(origin, inverseDirection, m_nodes[node.children[0]], distance) };
+		RayEntry second = { node.children[1], _RayDistance(origin, inverseDirection, m_nodes[node.children[1]], distance) };
+		if (first.distance > second.distance)
+			std::swap(first, second);
+		// The nearer one on top
+		if (second.distance != FLT_MAX)
+			stack.push_back(second);
+		if (first.distance != FLT_MAX)
+			stack.push_back(first);
+	}
+
+	return hit;
+}
@@ -1,5 +1,7 @@
 #include "Camera.h"
 
+#include <float.h>
+
 constexpr float CAMERA_ANGLE = glm::radians(45.0f);
 
 /* 
@@ -10,7 +12,7 @@ constexpr float CAMERA_ANGLE = glm::radians(45.0f);
 Camera* Camera::camera = 0;
 
 Camera* Camera::CreateInstance(Transform* object, GLWindow* window) {
-	camera = new Camera(object, window);
+	camera = object->AddBehavior<Camera>(window);
 	return camera;
 }
 
@@ -27,6 +29,7 @@ Camera::Camera(Transform* object, GLWindow* window) :
 	AObjectBehavior(object)
 {
 	projectionMatrix = glm::perspective(CAMERA_ANGLE, (GLfloat)window->GetBufferWidht() / (GLfloat)window->GetBufferHeight(), 0.1f, 100.0f);
+	m_focalLength = (GLfloat)window->GetBufferHeight() / (2.0f * glm::tan(CAMERA_ANGLE / 2.0f));
 }
 
 void Camera::SetUp() {}
@@ -55,5 +58,18 @@ bool Camera::PointInsideViewFrustum(glm::vec3* point, float bias) {
 	return Camera::PointInsideViewFrustum(CAMERA_ANGLE, &transform->GetPosition(), &transform->GetFront(), point, bias);
 }
 
+float Camera::GetProjectedSize(glm::vec3 center, float radius)
+{
+	glm::vec4 viewPosition = GetViewMatrix() * glm::vec4(center, 1.0f);
+	// The camera looks down -z in view space
+	if (viewPosition.z - radius > 0.0f)
+		return 0.0f;
+
+	float distance = glm::length(glm::vec3(viewPosition));
+	if (distance <= radius)
+		return FLT_MAX;
+	return 2.0f * radius / distance * m_focalLength;
+}
+
 Camera::~Camera() {
 }
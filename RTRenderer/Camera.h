@@ -15,11 +15,16 @@
 class Camera: public AObjectBehavior
 {
 private:
+	friend class ObjectPool<Camera>;
+
 	static Camera* camera;
 	Camera(Transform* object, GLWindow* window);
 
 	glm::mat4 projectionMatrix;
+	//! Distance, in pixels, from the eye to the image plane
+	float m_focalLength;
 public:
+	// Adds the camera to the object's behaviours. The object owns it
 	static Camera* CreateInstance(Transform* object, GLWindow* window);
 	static Camera* GetInstance();
 
@@ -29,6 +34,15 @@ public:
 	glm::mat4 GetProjectionMatrix();
 
 	bool PointInsideViewFrustum(glm::vec3* point, float bias);
+
+	/*!
+		\n float Camera::GetProjectedSize(glm::vec3 center, float radius)
+		\param glm::vec3 center World position of a bounding sphere
+		\param float radius Radius of the bounding sphere
+
+		Returns the approximate diameter, in pixels, of the sphere on screen. 0 if it is behind the camera
+	*/
+	float GetProjectedSize(glm::vec3 center, float radius);
 	static bool PointInsideViewFrustum(float cameraAngle, glm::vec3* cameraPosition, glm::vec3* cameraFront, glm::vec3* point, float bias);
 
 	void SetUp();
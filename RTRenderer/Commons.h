@@ -3,6 +3,20 @@
 const int MAX_POINT_LIGHTS = 3;
 const int MAX_SPOT_LIGHTS = 3;
 
+// Texture unit reserved for albedo texture arrays, so it never aliases a sampler2D
+const int ALBEDO_ARRAY_UNIT = 15;
+
+// Size of the material table. Must match MAX_MATERIALS in the shaders
+const int MAX_MATERIALS = 256;
+// Uniform buffer binding point of the material table
+const int MATERIAL_TABLE_BINDING = 0;
+// Texture unit of the baked reflection probe of the object being drawn
+const int REFLECTION_PROBE_UNIT = 12;
+// Texture unit of the terrain's height texture
+const int TERRAIN_HEIGHTMAP_UNIT = 13;
+// Texture unit of the texture buffer with the model matrices of the snapshot being drawn
+const int MODEL_MATRIX_UNIT = 14;
+
 enum RenderFilter {
 	R_STATIC, R_DYNAMIC, R_ALL
 };
@@ -1,12 +1,22 @@
 #include "CubeMap.h"
 
+#include <algorithm>
+
 constexpr unsigned int SIZE1 = 1024;
 constexpr unsigned int SIZE2 = 512;
 constexpr unsigned int SIZE3 = 256;
 constexpr float DISTANCE1 = 2.0f;
 constexpr float DISTANCE2 = 4.0f;
-
-CubeMap::CubeMap(GLfloat near, GLfloat far)
+// Fraction past a threshold the camera has to move away before the resolution drops
+constexpr float HYSTERESIS = 0.25f;
+
+CubeMap::CubeMap(GLfloat near, GLfloat far, GLenum colorFormat) :
+	mFBO(0),
+	mColor(nullptr),
+	mDepth(nullptr),
+	mColorFormat(colorFormat),
+	mSWidth(0),
+	mSHeight(0)
 {
 	mNear = near; mFar = far;
 }
@@ -17,39 +27,17 @@ bool CubeMap::Init(GLuint width, GLuint height, GLfloat near, GLfloat far)
 	mNear = near; mFar = far;
 	mAspect = (float)width / (float)height;
 
-	glGenFramebuffers(1, &mFBO);
-
-	glGenTextures(1, &mCubeMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mCubeMap);
-
-	for (size_t i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA32F, mSWidth, mSHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
-	}
-
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	glGenTextures(1, &mDepthMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mDepthMap);
-
-	for (size_t i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, mSWidth, mSHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	}
+	if (!mFBO)
+		glGenFramebuffers(1, &mFBO);
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	RenderTargetPool::Release(mColor);
+	RenderTargetPool::Release(mDepth);
+	mColor = RenderTargetPool::Acquire(GL_TEXTURE_CUBE_MAP, mSWidth, mSHeight, mColorFormat);
+	mDepth = RenderTargetPool::Acquire(GL_TEXTURE_CUBE_MAP, mSWidth, mSHeight, GL_DEPTH_COMPONENT24);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mCubeMap, 0);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthMap, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mFBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mColor->texture, 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepth->texture, 0);
 
 	GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 
@@ -59,51 +47,59 @@ bool CubeMap::Init(GLuint width, GLuint height, GLfloat near, GLfloat far)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	return true;
 }
 
-void CubeMap::Write()
+void CubeMap::WriteFace(int face)
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mColor->texture, 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mDepth->texture, 0);
 }
 
 void CubeMap::Read(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mCubeMap);
+	GLState::BindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, GetCubeMap());
 }
 
-void CubeMap::ReadyCubemap(float distToCamera)
+GLuint CubeMap::_SizeForDistance(float distToCamera)
 {
-	if (mAdaptResolution) {
-		if (distToCamera <= DISTANCE1) {
-			if (mSWidth != SIZE1) {
-				Clear();
-				Init(SIZE1, SIZE1, mNear, mFar);
-			}
-		}
-		else if (distToCamera <= DISTANCE2) {
-			if (mSWidth != SIZE2) {
-				Clear();
-				Init(SIZE2, SIZE2, mNear, mFar);
-			}
-		}
-		else if (mSWidth != SIZE3) {
-			Clear();
-			Init(SIZE3, SIZE3, mNear, mFar);
-		}
-	}
+	if (distToCamera <= DISTANCE1)
+		return SIZE1;
+	if (distToCamera <= DISTANCE2)
+		return SIZE2;
+	return SIZE3;
+}
+
+bool CubeMap::ReadyCubemap(float distToCamera)
+{
+	if (!mAdaptResolution)
+		return false;
+
+	GLuint size = _SizeForDistance(distToCamera);
+	// Only lower the resolution once the camera is clearly past the threshold, so that hovering around it
+	// does not switch sizes every frame
+	if (size < mSWidth)
+		size = std::max(size, _SizeForDistance(distToCamera / (1.0f + HYSTERESIS)));
+
+	if (size == mSWidth)
+		return false;
+
+	return Init(size, size, mNear, mFar);
 }
 
 void CubeMap::Clear()
 {
 	if (mFBO)
-		glDeleteFramebuffers(1, &mFBO);
+		GLState::DeleteFramebuffer(mFBO);
+	mFBO = 0;
 
-	if (mCubeMap)
-		glDeleteTextures(1, &mCubeMap);
+	RenderTargetPool::Release(mColor);
+	RenderTargetPool::Release(mDepth);
+	mColor = nullptr;
+	mDepth = nullptr;
 }
 
 CubeMap::~CubeMap()
@@ -4,12 +4,17 @@
 
 #include <GL\glew.h>
 
+#include "GLState.h"
+#include "RenderTargetPool.h"
+
 class CubeMap
 {
 private:
 	GLuint mFBO;
-	GLuint mCubeMap;
-	GLuint mDepthMap;
+	RenderTarget* mColor;
+	RenderTarget* mDepth;
+	// GL_RGBA16F keeps the alpha the reflections blend with the skybox, GL_R11F_G11F_B10F halves it again without alpha
+	GLenum mColorFormat;
 	GLuint mSWidth;
 	GLuint mSHeight;
 
@@ -19,18 +24,23 @@ private:
 
 	bool mAdaptResolution = true;
 
+	static GLuint _SizeForDistance(float distToCamera);
+
 public:
-	CubeMap(GLfloat near, GLfloat far);
+	CubeMap(GLfloat near, GLfloat far, GLenum colorFormat = GL_RGBA16F);
 
+	// Takes targets of the given size from the RenderTargetPool, giving back the previous ones
 	bool Init(GLuint width, GLuint height, GLfloat near, GLfloat far);
-	void Write();
+	// Binds the framebuffer with a single face attached, so that it can be cleared and rendered on its own
+	void WriteFace(int face);
 	void Read(GLenum textureUnit);
 	void Clear();
 
-	void ReadyCubemap(float distToCamera);
+	// Picks the resolution for the distance to the camera. Returns true if the cube map was reallocated, losing its content
+	bool ReadyCubemap(float distToCamera);
 
 	GLuint GetFBO() { return mFBO; };
-	GLuint GetCubeMap() { return mCubeMap; };
+	GLuint GetCubeMap() { return mColor ? mColor->texture : 0; };
 	GLuint GetShadowWidth() { return mSWidth; };
 	GLuint GetShadowHeight() { return mSHeight; };
 	GLfloat GetFar() { return mFar; };
@@ -38,4 +48,4 @@ public:
 	GLfloat GetAspect() { return mAspect; };
 
 	~CubeMap();
-};
\ No newline at end of file
+};
@@ -0,0 +1,73 @@
+#include "FrameArena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+
+std::mutex FrameArena::mMutex;
+std::vector<FrameArena::ThreadArena*> FrameArena::mArenas;
+
+thread_local FrameArena::ThreadArena* FrameArena::mArena = nullptr;
+
+FrameArena::ThreadArena * FrameArena::_GetArena()
+{
+	if (mArena == nullptr) {
+		mArena = new ThreadArena();
+		mArena->current = 0;
+		mArena->used = 0;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mArenas.push_back(mArena);
+	}
+	return mArena;
+}
+
+void * FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	ThreadArena* arena = _GetArena();
+
+	// First fit from the current block on, earlier blocks were already filled this frame
+	while (arena->current < arena->blocks.size()) {
+		Block& block = arena->blocks[arena->current];
+		uintptr_t start = ((uintptr_t)block.data + arena->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		size_t end = (size_t)(start - (uintptr_t)block.data) + bytes;
+		if (end <= block.size) {
+			arena->used = end;
+			return (void*)start;
+		}
+		arena->current++;
+		arena->used = 0;
+	}
+
+	// A new block, large enough for the allocation and its alignment
+	Block block;
+	block.size = std::max(FRAME_ARENA_BLOCK_SIZE, bytes + alignment);
+	block.data = (char*)malloc(block.size);
+	arena->blocks.push_back(block);
+	arena->current = arena->blocks.size() - 1;
+
+	uintptr_t start = ((uintptr_t)block.data + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	arena->used = (size_t)(start - (uintptr_t)block.data) + bytes;
+	return (void*)start;
+}
+
+void FrameArena::Reset()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (size_t i = 0; i < mArenas.size(); i++) {
+		mArenas[i]->current = 0;
+		mArenas[i]->used = 0;
+	}
+}
+
+void FrameArena::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (size_t i = 0; i < mArenas.size(); i++) {
+		for (size_t j = 0; j < mArenas[i]->blocks.size(); j++)
+			free(mArenas[i]->blocks[j].data);
+		mArenas[i]->blocks.clear();
+		mArenas[i]->current = 0;
+		mArenas[i]->used = 0;
+	}
+}
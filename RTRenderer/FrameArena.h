@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+
+// Bytes each thread reserves at once. Larger allocations get a block of their own
+const size_t FRAME_ARENA_BLOCK_SIZE = 1024 * 1024;
+
+/*!
+	Linear allocator for memory that only lives until the end of the frame.
+
+	Every thread bumps a pointer through blocks of its own, so allocating takes no lock, and nothing is freed one by
+	one: Reset rewinds every thread at the start of the next frame and the blocks are reused. Blocks are only added
+	while a frame needs more than any frame before it, so the steady state does not touch the heap.
+*/
+class FrameArena
+{
+private:
+	struct Block {
+		char* data;
+		size_t size;
+	};
+
+	struct ThreadArena {
+		std::vector<Block> blocks;
+		// Block being filled and how much of it is used
+		size_t current;
+		size_t used;
+	};
+
+	// Every thread's arena, to reset and free them from the main thread
+	static std::mutex mMutex;
+	static std::vector<ThreadArena*> mArenas;
+
+	static thread_local ThreadArena* mArena;
+
+	static ThreadArena* _GetArena();
+
+public:
+	/*!
+		\n void* FrameArena::Allocate(size_t bytes, size_t alignment)
+		\param size_t bytes Size of the allocation
+		\param size_t alignment Power of two the address is a multiple of
+
+		Returns memory that stays valid until the next Reset. Safe to call from any thread
+	*/
+	static void* Allocate(size_t bytes, size_t alignment);
+	// Rewinds every thread's arena. Called between frames, when nothing allocates from it
+	static void Reset();
+	// Frees every block. Once all the threads that used the arena are done
+	static void Clear();
+};
+
+// Allocator of containers that only live for a frame. Deallocating does nothing, the memory comes back with Reset
+template<class T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator() {}
+	template<class U>
+	FrameAllocator(const FrameAllocator<U>&) {}
+
+	T* allocate(size_t count) { return (T*)FrameArena::Allocate(count * sizeof(T), alignof(T)); }
+	void deallocate(T*, size_t) {}
+
+	template<class U>
+	bool operator==(const FrameAllocator<U>&) const { return true; }
+	template<class U>
+	bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+// Vector whose storage lives in the frame arena. Must not outlive the frame
+template<class T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,72 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	// Accepts everything
+	for (int i = 0; i < 6; i++)
+		m_planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// Gribb-Hartmann extraction, rows of the matrix combined two by two
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	m_planes[0] = rows[3] + rows[0];
+	m_planes[1] = rows[3] - rows[0];
+	m_planes[2] = rows[3] + rows[1];
+	m_planes[3] = rows[3] - rows[1];
+	m_planes[4] = rows[3] + rows[2];
+	m_planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++)
+		m_planes[i] /= glm::length(glm::vec3(m_planes[i]));
+}
+
+bool Frustum::IntersectsBox(glm::vec3 boxMin, glm::vec3 boxMax) const
+{
+	for (int i = 0; i < 6; i++) {
+		// Corner of the box furthest along the plane's normal
+		glm::vec3 corner(
+			m_planes[i].x >= 0.0f ? boxMax.x : boxMin.x,
+			m_planes[i].y >= 0.0f ? boxMax.y : boxMin.y,
+			m_planes[i].z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(m_planes[i]), corner) + m_planes[i].w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::IntersectsBox(glm::vec3 boxMin, glm::vec3 boxMax, int & planes) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (!(planes & (1 << i)))
+			continue;
+		glm::vec3 normal(m_planes[i]);
+		glm::vec3 furthest(
+			normal.x >= 0.0f ? boxMax.x : boxMin.x,
+			normal.y >= 0.0f ? boxMax.y : boxMin.y,
+			normal.z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(normal, furthest) + m_planes[i].w < 0.0f)
+			return false;
+		// The nearest corner is inside too, so is the whole box
+		glm::vec3 nearest(
+			normal.x >= 0.0f ? boxMin.x : boxMax.x,
+			normal.y >= 0.0f ? boxMin.y : boxMax.y,
+			normal.z >= 0.0f ? boxMin.z : boxMax.z);
+		if (glm::dot(normal, nearest) + m_planes[i].w >= 0.0f)
+			planes &= ~(1 << i);
+	}
+	return true;
+}
+
+bool Frustum::IntersectsSphere(glm::vec3 center, float radius) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(m_planes[i]), center) + m_planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
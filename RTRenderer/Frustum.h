@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm\glm.hpp>
+
+// Every plane of a frustum, as a plane mask
+const int FRUSTUM_ALL_PLANES = 0x3F;
+
+/*!
+	Six clipping planes taken from a view-projection matrix.
+
+	Works for the camera's perspective projection as well as the orthographic projection of the directional light, so
+	the same test culls both the main pass and the shadow pass. Planes point inwards and are normalized.
+*/
+class Frustum
+{
+private:
+	glm::vec4 m_planes[6];
+
+public:
+	Frustum();
+	Frustum(const glm::mat4& viewProjection);
+
+	// False only if the box is completely outside one of the planes
+	bool IntersectsBox(glm::vec3 boxMin, glm::vec3 boxMax) const;
+	// Only tests the planes set in the mask, and clears from it the planes the box is completely inside of, which no
+	// box inside this one has to be tested against
+	bool IntersectsBox(glm::vec3 boxMin, glm::vec3 boxMax, int& planes) const;
+	bool IntersectsSphere(glm::vec3 center, float radius) const;
+};
@@ -3,12 +3,16 @@
 #define SCREEN_WIDTH	1920
 #define SCREEN_HEIGHT	1080
 
+// Texture memory kept resident by the streamer and bytes it may upload each frame
+#define TEXTURE_BUDGET			(256 * 1024 * 1024)
+#define TEXTURE_UPLOAD_PER_FRAME	(8 * 1024 * 1024)
+
 GLProgram* GLProgram::mInstance = nullptr;
 
 GLCinematicProgram::GLCinematicProgram()
 	: GLProgram(RenderMode::CINEMATIC) 
 {
-	SceneLoader::Load("", mRenderer, mRoot, mWindow, true);
+	SceneLoader::Load(SCENE_FILE, mRenderer, mRoot, mWindow, true);
 
 	if (Camera::GetInstance() == NULL) {
 		printf("Camera has not been setup");
@@ -26,29 +30,54 @@ void GLCinematicProgram::Run()
 
 	mRoot->SetUp();
 
+	// The world around the start is in place before the static scene is baked
+	WorldStreamer::LoadAround(Camera::GetInstance()->GetCameraPosition());
 	mRenderer->BakeStage(mWindow);
 
 	Time::Start();
 
 	// Loop until window closed
 	while (!mWindow->GetShouldClose()) {
+		// Nothing of the last frame's arena memory is in use once its simulation was waited for
+		FrameArena::Reset();
 		Time::Update();
 		Input::NewFrame();
+		TextureStreamer::Update();
+		WorldStreamer::Update();
 		// Get + Handle user input events
 		glfwPollEvents();
-		
-		// Update all objects
-		mRoot->Update();
+		mRenderer->BeginFrame();
+
+		// Update all objects and snapshot them for the next frame while this one is drawn
+		JobCounter simulation;
+		JobSystem::Run([this]() {
+			BehaviorSystem::Update(mRoot);
+			mRenderer->Snapshot();
+		}, &simulation);
+
 		// Render scene
 		mRenderer->Render(mWindow, mRoot, R_ALL);
 		// Set shader to be default
-		glUseProgram(0);
+		GLState::UseProgram(0);
+
+		JobSystem::Wait(&simulation);
+		RenderSnapshot::Publish();
 
 		mWindow->SwapBuffers();
 	}
 
 	delete ErrorShader::GetInstance();
+	WorldStreamer::Shutdown();
+	JobSystem::Shutdown();
+	FrameArena::Clear();
+	OcclusionQueries::Clear();
 	delete mRenderer;
+	ObjectPool<Transform>::Destroy(mRoot);
+	MaterialTable::Clear();
+	ModelMatrixBuffer::Clear();
+	_ClearPools();
+	RenderTargetPool::Clear();
+	TextureStreamer::Shutdown();
 	delete mWindow;
 }
 
@@ -56,7 +85,7 @@ void GLCinematicProgram::Run()
 GLRoamProgram::GLRoamProgram()
 	: GLProgram(RenderMode::ROAM) 
 {
-	SceneLoader::Load("", mRenderer, mRoot, mWindow, false);
+	SceneLoader::Load(SCENE_FILE, mRenderer, mRoot, mWindow, false);
 
 	if (Camera::GetInstance() == NULL) {
 		printf("Camera has not been setup");
@@ -76,14 +105,20 @@ void GLRoamProgram::Run()
 
 	mRoot->SetUp();
 
+	// The world around the start is in place before the static scene is baked
+	WorldStreamer::LoadAround(Camera::GetInstance()->GetCameraPosition());
 	mRenderer->BakeStage(mWindow);
 
 	Time::Start();
 
 	// Loop until window closed
 	while (!mWindow->GetShouldClose()) {
+		// Nothing of the last frame's arena memory is in use once its simulation was waited for
+		FrameArena::Reset();
 		Time::Update();
 		Input::NewFrame();
+		TextureStreamer::Update();
+		WorldStreamer::Update();
 
 		// Get + Handle user input events
 		glfwPollEvents();
@@ -99,10 +134,29 @@ void GLRoamProgram::Run()
 			}
 		}
 
-		if (updateObjects)
-			mRoot->Update();
-		else
-			Camera::GetInstance()->GetTransform()->Update();
+		{
+			bool isPressed = Input::IsKeyPress(GLFW_KEY_O);
+			if (!mOcclusionWasPressed && isPressed) {
+				mOcclusionWasPressed = true;
+				mRenderer->SetOcclusionQueries(!mRenderer->GetOcclusionQueries());
+				printf("Occlusion queries %s\n", mRenderer->GetOcclusionQueries() ? "on" : "off");
+			}
+			else if (mOcclusionWasPressed && !isPressed) {
+				mOcclusionWasPressed = false;
+			}
+		}
+
+		mRenderer->BeginFrame();
+
+		// Update the objects and snapshot them for the next frame while this one is drawn
+		JobCounter simulation;
+		JobSystem::Run([this, updateObjects]() {
+			if (updateObjects)
+				BehaviorSystem::Update(mRoot);
+			else
+				Camera::GetInstance()->GetTransform()->Update();
+			mRenderer->Snapshot();
+		}, &simulation);
 
 		// Clear Window
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -110,14 +164,57 @@ void GLRoamProgram::Run()
 
 		mRenderer->Render(mWindow, mRoot, R_ALL);
 
-		glUseProgram(0);
+		GLState::UseProgram(0);
+
+		JobSystem::Wait(&simulation);
+		RenderSnapshot::Publish();
 
 		mWindow->SwapBuffers();
 	}
 
 	delete ErrorShader::GetInstance();
+	WorldStreamer::Shutdown();
+	JobSystem::Shutdown();
+	FrameArena::Clear();
+	OcclusionQueries::Clear();
+	delete mRenderer;
+	ObjectPool<Transform>::Destroy(mRoot);
+	MaterialTable::Clear();
+	ModelMatrixBuffer::Clear();
+	_ClearPools();
+	RenderTargetPool::Clear();
+	TextureStreamer::Shutdown();
+	delete mWindow;
+}
+
+
+GLBakeProgram::GLBakeProgram()
+	: GLProgram(RenderMode::BAKE)
+{
+	SceneLoader::Load(SCENE_FILE, mRenderer, mRoot, mWindow, false);
+}
+
+void GLBakeProgram::Run()
+{
+	mRoot->SetUp();
+
+	WorldStreamer::LoadAround(Camera::GetInstance()->GetCameraPosition());
+
+	printf("Baking reflection probes...\n");
+	mRenderer->BakeStage(mWindow, true);
+	printf("Done\n");
+
+	delete ErrorShader::GetInstance();
+	WorldStreamer::Shutdown();
+	JobSystem::Shutdown();
+	FrameArena::Clear();
+	OcclusionQueries::Clear();
 	delete mRenderer;
-	delete mRoot;
+	ObjectPool<Transform>::Destroy(mRoot);
+	MaterialTable::Clear();
+	ModelMatrixBuffer::Clear();
+	_ClearPools();
+	RenderTargetPool::Clear();
 	delete mWindow;
 }
 
@@ -133,12 +230,29 @@ GLProgram::GLProgram(RenderMode mode) :
 	mInstance = this;
 
 	mWindow = new GLWindow(SCREEN_WIDTH, SCREEN_HEIGHT);
-	mWindow->Initialize(true);
+	mWindow->Initialize(mode != RenderMode::BAKE, mode != RenderMode::BAKE);
+
+	// The scene is loaded with it already, large levels propagate their matrices in parallel
+	JobSystem::Initialize();
+	// Before the scene adds its behaviours, so the systems run in their order
+	BehaviorSystem::Initialize();
+
+	// The bake reads every texture at full detail, so it loads them synchronously
+	if (mode != RenderMode::BAKE)
+		TextureStreamer::Initialize(TEXTURE_BUDGET, TEXTURE_UPLOAD_PER_FRAME);
 	
-	mRoot = new Transform();
+	mRoot = ObjectPool<Transform>::Create();
 	mRenderer = new GLRenderer(mRoot);
 }
 
+void GLProgram::_ClearPools()
+{
+	// Everything was destroyed with the renderer and the root, a pool that still has objects reports them
+	ObjectPool<GLObject>::Clear();
+	ObjectPool<Transform>::Clear();
+	ObjectPool<Material>::Clear();
+}
+
 GLProgram::~GLProgram() {}
 
 GLProgram* GLProgram::GetInstance() {
@@ -156,6 +270,10 @@ GLProgram* GLProgram::CreateGLProgramInstance(RenderMode mode)
 		return new GLCinematicProgram();
 	case ROAM:
 		return new GLRoamProgram();
+	case BAKE:
+		return new GLBakeProgram();
+	case UNDEFINED:
+		break;
 	}
 	return nullptr;
 }
@@ -6,6 +6,13 @@
 #include "GLRenderer.h"
 #include "SceneLoader.h"
 #include "ObjectController.h"
+#include "TextureStreamer.h"
+#include "WorldStreamer.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+
+// Scene the programs load
+const char SCENE_FILE[] = "Scenes/default.json";
 
 class GLProgram
 {
@@ -21,6 +28,9 @@ protected:
 	bool mError = false;
 
 	GLProgram(RenderMode mode);
+
+	// Frees the memory of the object pools once the scene is gone
+	static void _ClearPools();
 public:
 	static GLProgram* CreateGLProgramInstance(RenderMode mode);
 
@@ -40,11 +50,21 @@ public:
 	void Run();
 };
 
+class GLBakeProgram : public GLProgram {
+	friend class GLProgram;
+
+	GLBakeProgram();
+public:
+	// Bakes every reflection probe of the scene to the cache
+	void Run();
+};
+
 class GLRoamProgram : public GLProgram {
 private:
 	friend class GLProgram;
 
 	bool mPauseWasPressed = false;
+	bool mOcclusionWasPressed = false;
 
 	GLRoamProgram();
 public:
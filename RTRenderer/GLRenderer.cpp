@@ -1,13 +1,15 @@
 #include "GLRenderer.h"
 
-bool RenderMesh(Mesh* mesh, GLObject* meshRenderer, RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr) {
-	if (!meshRenderer->FilterPass(filter))
+bool RenderMesh(Mesh* mesh, const RenderItem& item, RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr) {
+	if (!(filter == R_ALL || (filter == R_DYNAMIC && !item.isStatic) || (filter == R_STATIC && item.isStatic)))
 		return false;
 
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(meshRenderer->GetTransformMatrix()));
+	GLState::Uniform1i(uniformModel, item.matrixIndex);
 	
-	if (shader != nullptr)
-		meshRenderer->UseMaterial(shader);
+	if (shader != nullptr) {
+		shader->SetMaterial(item.material);
+		shader->SetReflectionProbe(item.probe);
+	}
 
 	mesh->Render();
 	return true;
@@ -19,6 +21,12 @@ GLObject::GLObject(Transform *transform, Material* material, size_t modelIndex)
 	m_transform = transform;
 	m_material = material;
 	m_modelIndex = modelIndex;
+	m_probe = nullptr;
+	m_proxy = -1;
+	m_proxyStatic = false;
+	m_occluded = false;
+	m_frustumFrame = 0;
+	m_queryFrame = 0;
 }
 
 bool GLObject::FilterPass(RenderFilter filter)
@@ -31,6 +39,7 @@ bool GLObject::FilterPass(RenderFilter filter)
 void GLObject::UseMaterial(LightedShader * shader)
 {
 	shader->SetMaterial(m_material);
+	shader->SetReflectionProbe(m_probe);
 }
 
 size_t GLObject::GetModelIndex() const
@@ -40,7 +49,21 @@ size_t GLObject::GetModelIndex() const
 
 glm::mat4 GLObject::GetTransformMatrix() const
 {
-	return m_transform->TransformMatrix(true);
+	return m_transform->GetWorldMatrix();
+}
+
+float GLObject::GetProjectedSize(float radius) const
+{
+	glm::mat4 matrix = GetTransformMatrix();
+	float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+	return Camera::GetInstance()->GetProjectedSize(glm::vec3(matrix[3]), radius * scale);
+}
+
+void GLObject::RequestTextureSize(float pixels)
+{
+	Texture* albedo = m_material->GetAlbedo();
+	if (albedo != nullptr)
+		albedo->RequestSize(pixels);
 }
 
 GLObject::~GLObject()
@@ -55,11 +78,232 @@ void GLObjectRenderer::AddMeshRenderer(GLObject * meshRenderer)
 	IncrementVertices();
 }
 
+void GLObjectRenderer::RemoveMeshRenderer(GLObject * meshRenderer)
+{
+	std::vector<GLObject*>::iterator it = std::find(m_objects.begin(), m_objects.end(), meshRenderer);
+	if (it == m_objects.end())
+		return;
+	size_t index = it - m_objects.begin();
+	_RemoveProxy(meshRenderer);
+	_ForgetOcclusion(meshRenderer);
+	m_objects.erase(it);
+	ObjectPool<GLObject>::Destroy(meshRenderer);
+
+	// The objects after it moved down a slot
+	for (size_t i = index; i < m_objects.size(); i++) {
+		if (m_objects[i]->GetProxy() != -1)
+			_GetTree(m_objects[i]).SetPayload(m_objects[i]->GetProxy(), (int)i);
+	}
+}
+
+void GLObjectRenderer::_ForgetOcclusion(GLObject * object)
+{
+	for (int i = 0; i < RENDER_SNAPSHOT_COUNT; i++) {
+		std::vector<OcclusionTest>& tests = m_queues[i].tests;
+		for (size_t j = 0; j < tests.size(); j++) {
+			if (tests[j].object == object)
+				tests[j].object = nullptr;
+		}
+	}
+	OcclusionQueries::Forget(&object, 1);
+}
+
+bool GLObjectRenderer::_TestOcclusion(RenderQueue & queue, size_t index, glm::vec3 boxMin, glm::vec3 boxMax, const QueueCulling & culling)
+{
+	GLObject* object = m_objects[index];
+	if (!culling.occlusionQueries) {
+		object->SetOccluded(false);
+		return true;
+	}
+
+	unsigned long long frame = RenderSnapshot::GetWriteFrame();
+	// An object coming back into the frustum is assumed to be seen, its last result is from another view
+	if (object->GetFrustumFrame() + 1 < frame)
+		object->SetOccluded(false);
+	object->SetFrustumFrame(frame);
+
+	glm::vec3 margin(OCCLUSION_QUERY_NEAR_MARGIN);
+	if (glm::all(glm::greaterThanEqual(culling.position, boxMin - margin)) && glm::all(glm::lessThanEqual(culling.position, boxMax + margin))) {
+		object->SetOccluded(false);
+		return true;
+	}
+
+	// Hidden objects are asked every snapshot, the ones that are seen in turns
+	bool waiting = object->GetQueryFrame() != 0 && frame - object->GetQueryFrame() < (unsigned long long)OCCLUSION_QUERY_TIMEOUT;
+	bool due = object->IsOccluded() || (frame + index) % OCCLUSION_QUERY_INTERVAL == 0;
+	if (due && !waiting) {
+		queue.tests.push_back({ object, boxMin, boxMax, object->IsOccluded() });
+		object->SetQueryFrame(frame);
+	}
+	return !object->IsOccluded();
+}
+
+void GLObjectRenderer::_RemoveProxy(GLObject * object)
+{
+	if (object->GetProxy() == -1)
+		return;
+	_GetTree(object).Remove(object->GetProxy());
+	if (object->IsProxyStatic())
+		m_staticTreeDirty = true;
+	object->SetProxy(-1, false);
+}
+
+void GLObjectRenderer::_PlaceObject(size_t index, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	GLObject* object = m_objects[index];
+	bool isStatic = object->GetTransform()->GetStatic();
+	if (object->GetProxy() != -1 && object->IsProxyStatic() == isStatic) {
+		_GetTree(object).Move(object->GetProxy(), boxMin, boxMax);
+		return;
+	}
+
+	_RemoveProxy(object);
+	BoundingVolumeHierarchy& tree = isStatic ? m_staticTree : m_dynamicTree;
+	object->SetProxy(tree.Insert(boxMin, boxMax, (int)index), isStatic);
+	if (isStatic)
+		m_staticTreeDirty = true;
+}
+
+void GLObjectRenderer::CollectDynamicTransforms(FrameVector<Transform*>& transforms) const
+{
+	for (size_t i = 0; i < m_objects.size(); i++) {
+		if (!m_objects[i]->GetTransform()->GetStatic())
+			transforms.push_back(m_objects[i]->GetTransform());
+	}
+}
+
+void GLObjectRenderer::AssignProbes(const std::vector<BakedProbe*>& probes, bool dynamicOnly)
+{
+	for (size_t i = 0; i < m_objects.size(); i++) {
+		Transform* transform = m_objects[i]->GetTransform();
+		if (dynamicOnly && transform->GetStatic())
+			continue;
+		m_objects[i]->SetProbe(BakedProbe::Find(probes, glm::vec3(transform->GetWorldMatrix()[3])));
+	}
+}
+
+void GLObjectRenderer::BuildQueue(const QueueCulling & culling, size_t firstMatrix)
+{
+	float radius = GetBoundingRadius();
+	glm::vec3 boxMin, boxMax;
+	GetBounds(boxMin, boxMax);
+	size_t count = m_objects.size();
+	RenderQueue& queue = m_queues[RenderSnapshot::GetWriteIndex()];
+	queue.items.resize(count);
+	queue.visible.clear();
+	queue.casters.clear();
+	queue.tests.clear();
+	m_projectedSizes.resize(count);
+	if (count == 0)
+		return;
+
+	// Objects whose leaves have to be placed: the dynamic ones, and the ones that are not in the hierarchy of their kind
+	FrameVector<size_t> moved;
+	glm::mat4* matrices = ModelMatrixBuffer::GetWriteMatrices() + firstMatrix;
+	for (size_t i = 0; i < count; i++) {
+		GLObject* object = m_objects[i];
+		RenderItem& item = queue.items[i];
+		matrices[i] = object->GetTransformMatrix();
+		item.matrixIndex = (int)(firstMatrix + i);
+		item.material = object->GetMaterial();
+		item.probe = object->GetProbe();
+		item.isStatic = object->GetTransform()->GetStatic();
+		item.lights = 0;
+		// Objects just off screen keep their textures, so they do not blur when the camera turns
+		m_projectedSizes[i] = object->GetProjectedSize(radius);
+
+		if (!item.isStatic || object->GetProxy() == -1 || !object->IsProxyStatic())
+			moved.push_back(i);
+	}
+
+	if (!moved.empty()) {
+		// The world boxes of the objects that moved in one pass over their matrices
+		FrameVector<glm::mat4> movedMatrices(moved.size());
+		for (size_t i = 0; i < moved.size(); i++)
+			movedMatrices[i] = matrices[moved[i]];
+		FrameVector<glm::vec3> worldMins(moved.size());
+		FrameVector<glm::vec3> worldMaxs(moved.size());
+		MatrixKernels::TransformBoxes(&movedMatrices[0], sizeof(glm::mat4), boxMin, boxMax, &worldMins[0], &worldMaxs[0], moved.size());
+		for (size_t i = 0; i < moved.size(); i++)
+			_PlaceObject(moved[i], worldMins[i], worldMaxs[i]);
+	}
+
+	if (m_staticTreeDirty) {
+		m_staticTree.Rebuild();
+		m_staticTreeDirty = false;
+	}
+
+	FrameVector<int> found;
+	for (size_t light = 0; light < culling.lightCount; light++) {
+		found.clear();
+		glm::vec3 position(culling.lights[light]);
+		m_staticTree.QuerySphere(position, culling.lights[light].w, found);
+		m_dynamicTree.QuerySphere(position, culling.lights[light].w, found);
+		for (size_t i = 0; i < found.size(); i++)
+			queue.items[found[i]].lights |= 1u << light;
+	}
+
+	// Subtrees out of the frustum are dropped and the ones inside it taken without testing their objects
+	found.clear();
+	m_staticTree.QueryFrustum(culling.camera, found);
+	m_dynamicTree.QueryFrustum(culling.camera, found);
+	unsigned long long occluded = 0;
+	unsigned long long queryOccluded = 0;
+	for (size_t i = 0; i < found.size(); i++) {
+		GLObject* object = m_objects[found[i]];
+		glm::vec3 worldMin, worldMax;
+		_GetTree(object).GetBox(object->GetProxy(), worldMin, worldMax);
+		if (!OcclusionCuller::IsVisible(worldMin, worldMax)) {
+			occluded++;
+			continue;
+		}
+		if (!_TestOcclusion(queue, found[i], worldMin, worldMax, culling)) {
+			queryOccluded++;
+			continue;
+		}
+		queue.visible.push_back(queue.items[found[i]]);
+	}
+	if (occluded > 0)
+		Profiler::Count(PC_OCCLUDED_OBJECTS, occluded);
+	if (queryOccluded > 0)
+		Profiler::Count(PC_QUERY_OCCLUDED_OBJECTS, queryOccluded);
+
+	found.clear();
+	m_staticTree.QueryFrustum(culling.shadow, found);
+	m_dynamicTree.QueryFrustum(culling.shadow, found);
+	for (size_t i = 0; i < found.size(); i++)
+		queue.casters.push_back(queue.items[found[i]]);
+}
+
+void GLObjectRenderer::RenderLit(RenderFilter filter, GLuint uniformModel, unsigned int lights)
+{
+	const std::vector<RenderItem>& items = m_queues[RenderSnapshot::GetReadIndex()].items;
+	m_lit.clear();
+	for (size_t i = 0; i < items.size(); i++) {
+		if (items[i].lights & lights)
+			m_lit.push_back(items[i]);
+	}
+	RenderObjects(m_lit, filter, uniformModel, nullptr);
+}
+
 void GLObjectRenderer::Clear()
 {
+	if (!m_objects.empty())
+		OcclusionQueries::Forget(&m_objects[0], m_objects.size());
 	for (size_t i = 0; i < m_objects.size(); i++)
-		delete m_objects[i];
+		ObjectPool<GLObject>::Destroy(m_objects[i]);
 	m_objects.clear();
+	for (int i = 0; i < RENDER_SNAPSHOT_COUNT; i++) {
+		m_queues[i].items.clear();
+		m_queues[i].visible.clear();
+		m_queues[i].casters.clear();
+		m_queues[i].tests.clear();
+	}
+	m_projectedSizes.clear();
+	m_staticTree.Clear();
+	m_dynamicTree.Clear();
+	m_staticTreeDirty = false;
+	m_lit.clear();
 	if(m_renderable)
 		delete m_renderable;
 	m_renderable = nullptr;
@@ -76,7 +320,7 @@ void GLModelRenderer::SetRenderable(Model * renderable)
 	m_renderable = renderable;
 }
 
-void GLModelRenderer::Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader)
+void GLModelRenderer::RenderObjects(const std::vector<RenderItem>& items, RenderFilter filter, GLuint uniformModel, LightedShader* shader)
 {
 	Model* model = (Model*)m_renderable;
 
@@ -89,11 +333,17 @@ void GLModelRenderer::Render(RenderFilter filter, GLuint uniformModel, LightedSh
 	if (tex != nullptr)
 		tex->UseTexture();
 
+	// Batched models select their albedo per vertex
+	TextureArray* albedoArray = model->GetAlbedoArray();
+	if (albedoArray != nullptr)
+		albedoArray->UseTextureArray();
+
 	// -- Draw first mesh of each model --
-	std::vector<GLObject*> renderableMeshes;
-	for (size_t j = 0; j < m_objects.size(); j++) {
-		if (RenderMesh(mesh, m_objects[j], filter, uniformModel, shader))
-			renderableMeshes.push_back(m_objects[j]);
+	FrameVector<const RenderItem*> renderableMeshes;
+	renderableMeshes.reserve(items.size());
+	for (size_t j = 0; j < items.size(); j++) {
+		if (RenderMesh(mesh, items[j], filter, uniformModel, shader))
+			renderableMeshes.push_back(&items[j]);
 	}
 
 	// -- If there was no draw call don't continue --
@@ -111,7 +361,7 @@ void GLModelRenderer::Render(RenderFilter filter, GLuint uniformModel, LightedSh
 			tex->UseTexture();
 
 		for (size_t j = 0; j < renderableMeshes.size(); j++) {
-			RenderMesh(mesh, renderableMeshes[j], filter, uniformModel, shader);
+			RenderMesh(mesh, *renderableMeshes[j], filter, uniformModel, shader);
 		}
 	}
 }
@@ -128,21 +378,50 @@ void GLModelRenderer::IncrementVertices()
 	}
 }
 
+float GLModelRenderer::GetBoundingRadius() const
+{
+	return ((Model*)m_renderable)->GetBoundingRadius();
+}
+
+void GLModelRenderer::GetBounds(glm::vec3 & boxMin, glm::vec3 & boxMax) const
+{
+	((Model*)m_renderable)->GetBounds(boxMin, boxMax);
+}
+
+void GLModelRenderer::RequestTextureLevels()
+{
+	Model* model = (Model*)m_renderable;
+
+	for (size_t j = 0; j < m_projectedSizes.size(); j++) {
+		float size = m_projectedSizes[j];
+		if (size <= 0.0f)
+			continue;
+
+		for (size_t i = 0; i < model->GetMeshCount(); i++) {
+			Texture* tex = model->GetTextureByMeshIndex(i);
+			float uvScale = model->GetMeshByIndex(i)->GetUVScale();
+			if (tex != nullptr)
+				tex->RequestSize(size / uvScale);
+			m_objects[j]->RequestTextureSize(size / uvScale);
+		}
+	}
+}
+
 
 void GLMeshRenderer::SetRenderable(Mesh * renderable)
 {
 	m_renderable = renderable;
 }
 
-void GLMeshRenderer::Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader)
+void GLMeshRenderer::RenderObjects(const std::vector<RenderItem>& items, RenderFilter filter, GLuint uniformModel, LightedShader* shader)
 {
 	Mesh* mesh = (Mesh*)m_renderable;
 	Texture* tex = mesh->GetTexture();
 	if (tex != nullptr)
 		tex->UseTexture();
 
-	for (size_t i = 0; i < m_objects.size(); i++) {
-		RenderMesh(mesh, m_objects[i], filter, uniformModel, shader);
+	for (size_t i = 0; i < items.size(); i++) {
+		RenderMesh(mesh, items[i], filter, uniformModel, shader);
 	}
 }
 
@@ -151,6 +430,33 @@ void GLMeshRenderer::IncrementVertices()
 	VerticesCounter::ReplicatedMesh((Mesh*)m_renderable);
 }
 
+float GLMeshRenderer::GetBoundingRadius() const
+{
+	return ((Mesh*)m_renderable)->GetBoundingRadius();
+}
+
+void GLMeshRenderer::GetBounds(glm::vec3 & boxMin, glm::vec3 & boxMax) const
+{
+	boxMin = ((Mesh*)m_renderable)->GetBoundsMin();
+	boxMax = ((Mesh*)m_renderable)->GetBoundsMax();
+}
+
+void GLMeshRenderer::RequestTextureLevels()
+{
+	Mesh* mesh = (Mesh*)m_renderable;
+	Texture* tex = mesh->GetTexture();
+
+	for (size_t i = 0; i < m_projectedSizes.size(); i++) {
+		float size = m_projectedSizes[i];
+		if (size <= 0.0f)
+			continue;
+
+		if (tex != nullptr)
+			tex->RequestSize(size / mesh->GetUVScale());
+		m_objects[i]->RequestTextureSize(size / mesh->GetUVScale());
+	}
+}
+
 
 GLCubeMapRenderer::GLCubeMapRenderer(): 
 	m_refractModel(nullptr), 
@@ -158,7 +464,9 @@ GLCubeMapRenderer::GLCubeMapRenderer():
 	m_refractTransform(nullptr),                 
 	m_reflectTransform(nullptr),
 	m_refract(nullptr),                                    
-	m_reflect(nullptr)
+	m_reflect(nullptr),
+	m_refractProbe(nullptr),
+	m_reflectProbe(nullptr)
 {
 	m_cubemapShader = new CubeMapRenderShader();
 	m_cubemapShader->CreateFromFiles("Shaders/envReflection.vert", "Shaders/envReflection.frag",
@@ -166,18 +474,20 @@ GLCubeMapRenderer::GLCubeMapRenderer():
 }
 
 void GLCubeMapRenderer::Initialize(Transform* transform) {
-	Material* mat = new Material(0.8f, 256, 1.0f, 1.0f, 1.0f);
+	Material* mat = MaterialTable::Intern(0.8f, 256, 1.0f, 1.0f, 1.0f);
 
 	Model* mMesh = new Model("Models/Sphere.obj");
 	mMesh->Load();
 	m_refractModel = new GLModelRenderer();
 	m_refractModel->SetRenderable(mMesh);
 
-	m_refractTransform = new Transform(transform);
+	m_refractTransform = ObjectPool<Transform>::Create(transform);
 	m_refractTransform->SetStatic(false);
 	m_refractTransform->Scale(0.2f);
 	m_refractTransform->Translate(glm::vec3(0.0f, 0.5f, 0.0f));
-	m_refractModel->AddMeshRenderer(new GLObject(m_refractTransform, mat, mMesh->GetIndex()));
+	GLObject* refractObject = ObjectPool<GLObject>::Create(m_refractTransform, mat, mMesh->GetIndex());
+	m_refractModel->AddMeshRenderer(refractObject);
+	float refractRadius = mMesh->GetBoundingRadius();
 
 	mMesh = new Model("Models/Sphere.obj");
 	mMesh->Load();
@@ -185,33 +495,62 @@ void GLCubeMapRenderer::Initialize(Transform* transform) {
 	m_reflectModel->SetRenderable(mMesh);
 
 
-	m_reflectTransform = new Transform(transform);
+	m_reflectTransform = ObjectPool<Transform>::Create(transform);
 	m_reflectTransform->SetStatic(false);
 	m_reflectTransform->Scale(0.2f);
 	m_reflectTransform->Translate(glm::vec3(-5.0f, 1.0f, 0.0f));
-	m_reflectModel->AddMeshRenderer(new GLObject(m_reflectTransform, mat, mMesh->GetIndex()));
+	GLObject* reflectObject = ObjectPool<GLObject>::Create(m_reflectTransform, mat, mMesh->GetIndex());
+	m_reflectModel->AddMeshRenderer(reflectObject);
 	
 	m_refract = new CubeMap(0.01f, 100.0f);
 	m_refract->ReadyCubemap(10.0f);
 	m_reflect = new CubeMap(0.01f, 100.0f);
 	m_reflect->ReadyCubemap(10.0f);
+
+	m_refractProbe = m_scheduler.AddProbe(m_refractTransform, m_refract, refractObject, refractRadius);
+	m_reflectProbe = m_scheduler.AddProbe(m_reflectTransform, m_reflect, reflectObject, mMesh->GetBoundingRadius());
 }
 
-void GLCubeMapRenderer::CubeMapPass(GLRenderer* glRenderer)
+void GLCubeMapRenderer::_AdaptResolution(ReflectionProbe * probe)
 {
-	if (Camera::GetInstance()->PointInsideViewFrustum(&(m_refractTransform->GetPosition()), 0.0872665f)) {
-		float distance = glm::distance(Camera::GetInstance()->GetCameraPosition(), m_refractTransform->GetPosition());
-		if (distance < 10.0f)
-			m_refract->ReadyCubemap(distance);			
+	if (Camera::GetInstance()->PointInsideViewFrustum(&(probe->transform->GetPosition()), 0.0872665f)) {
+		float distance = glm::distance(Camera::GetInstance()->GetCameraPosition(), probe->transform->GetPosition());
+		if (distance < 10.0f && probe->cubemap->ReadyCubemap(distance))
+			m_scheduler.ScheduleProbe(probe, m_reallocated);
 	}
-	glRenderer->CubeMapPass(m_refractTransform, m_cubemapShader, m_refract);
+}
 
-	if (Camera::GetInstance()->PointInsideViewFrustum(&(m_reflectTransform->GetPosition()), 0.0872665f)) {
-		float distance = glm::distance(Camera::GetInstance()->GetCameraPosition(), m_reflectTransform->GetPosition());
-		if (distance < 10.0f)
-			m_reflect->ReadyCubemap(distance);
-	}
-	glRenderer->CubeMapPass(m_reflectTransform, m_cubemapShader, m_reflect);
+void GLCubeMapRenderer::AdaptResolution()
+{
+	_AdaptResolution(m_refractProbe);
+	_AdaptResolution(m_reflectProbe);
+}
+
+void GLCubeMapRenderer::Schedule(GLRenderer* glRenderer)
+{
+	FrameVector<Transform*> dynamics;
+	glRenderer->CollectDynamicTransforms(dynamics);
+
+	m_scheduler.Schedule(dynamics, m_updates[RenderSnapshot::GetWriteIndex()]);
+}
+
+void GLCubeMapRenderer::CubeMapPass(GLRenderer* glRenderer)
+{
+	// The new targets hold whatever the pool last used them for, so none of their faces can wait for the budget
+	for (size_t i = 0; i < m_reallocated.size(); i++)
+		glRenderer->CubeMapPass(m_reallocated[i].position, m_cubemapShader, m_reallocated[i].probe->cubemap, m_reallocated[i].face);
+	m_reallocated.clear();
+
+	const std::vector<ProbeFaceUpdate>& updates = m_updates[RenderSnapshot::GetReadIndex()];
+	for (size_t i = 0; i < updates.size(); i++)
+		glRenderer->CubeMapPass(updates[i].position, m_cubemapShader, updates[i].probe->cubemap, updates[i].face);
+}
+
+void GLCubeMapRenderer::BakePass(GLRenderer * glRenderer)
+{
+	std::vector<ProbeFaceUpdate> updates = m_scheduler.ScheduleAll();
+	for (size_t i = 0; i < updates.size(); i++)
+		glRenderer->CubeMapPass(updates[i].position, m_cubemapShader, updates[i].probe->cubemap, updates[i].face);
 }
 
 void GLCubeMapRenderer::RenderModels(RenderFilter filter, GLuint uniformModel, LightedShader* shader)
@@ -220,6 +559,29 @@ void GLCubeMapRenderer::RenderModels(RenderFilter filter, GLuint uniformModel, L
 	m_reflectModel->Render(filter, uniformModel, shader);
 }
 
+size_t GLCubeMapRenderer::GetObjectCount() const
+{
+	return m_refractModel->GetObjects().size() + m_reflectModel->GetObjects().size();
+}
+
+void GLCubeMapRenderer::BuildQueues(const QueueCulling & culling, size_t firstMatrix)
+{
+	m_refractModel->BuildQueue(culling, firstMatrix);
+	m_reflectModel->BuildQueue(culling, firstMatrix + m_refractModel->GetObjects().size());
+}
+
+void GLCubeMapRenderer::IssueOcclusionQueries()
+{
+	m_refractModel->IssueOcclusionQueries();
+	m_reflectModel->IssueOcclusionQueries();
+}
+
+void GLCubeMapRenderer::RequestTextureLevels()
+{
+	m_refractModel->RequestTextureLevels();
+	m_reflectModel->RequestTextureLevels();
+}
+
 void GLCubeMapRenderer::Render(DefaultShader* shader, GLuint uniformModel, GLuint textureUnit)
 {
 	m_refract->Read(GL_TEXTURE0 + textureUnit);
@@ -252,6 +614,9 @@ GLRenderer::GLRenderer(Transform* transform)
 	m_pointLightsCount = 0;
 	m_spotLightsCount = 0;
 
+	m_terrainShader = nullptr;
+	m_terrainSMShader = nullptr;
+
 	m_directionalSMShader = new DirectionalShadowMapShader();
 	m_directionalSMShader->CreateFromFiles("Shaders/dSM.vert", "Shaders/dSM.frag");
 	m_omnidirectionalSMShader = new OmnidirectionalShadowMapShader();
@@ -324,17 +689,43 @@ Light* GLRenderer::GetSpotLightAt(size_t index) {
 	return m_spotLights[index];
 }
 
-void GLRenderer::AddObjectRenderer(GLObjectRenderer * renderer)
+size_t GLRenderer::AddObjectRenderer(GLObjectRenderer * renderer)
+{
+	size_t index = std::find(m_renderables.begin(), m_renderables.end(), nullptr) - m_renderables.begin();
+	if (index == m_renderables.size())
+		m_renderables.push_back(renderer);
+	else
+		m_renderables[index] = renderer;
+	renderer->SetIndex(index);
+	return index;
+}
+
+void GLRenderer::RemoveObjectRenderer(GLObjectRenderer * renderer)
 {
-	m_renderables.push_back(renderer);
-	renderer->SetIndex(m_renderables.size() - 1);
+	std::vector<GLObjectRenderer*>::iterator it = std::find(m_renderables.begin(), m_renderables.end(), renderer);
+	if (it == m_renderables.end())
+		return;
+	*it = nullptr;
+	delete renderer;
 }
 
 void GLRenderer::AddMeshRenderer(GLObject * meshRenderer)
 {
 	size_t index = meshRenderer->GetModelIndex();
-	if (index < m_renderables.size())
-		m_renderables[index]->AddMeshRenderer(meshRenderer);
+	if (index >= m_renderables.size() || m_renderables[index] == nullptr)
+		return;
+
+	m_renderables[index]->AddMeshRenderer(meshRenderer);
+	// Objects added after the bake get their probe straight away
+	if (!m_bakedProbes.empty())
+		meshRenderer->SetProbe(BakedProbe::Find(m_bakedProbes, glm::vec3(meshRenderer->GetTransform()->GetWorldMatrix()[3])));
+}
+
+void GLRenderer::RemoveMeshRenderer(GLObject * meshRenderer)
+{
+	size_t index = meshRenderer->GetModelIndex();
+	if (index < m_renderables.size() && m_renderables[index] != nullptr)
+		m_renderables[index]->RemoveMeshRenderer(meshRenderer);
 }
 
 void GLRenderer::AddShader(DefaultShader * shader)
@@ -342,14 +733,142 @@ void GLRenderer::AddShader(DefaultShader * shader)
 	this->m_shader = shader;
 }
 
+void GLRenderer::AddTerrain(Terrain * terrain)
+{
+	if (m_terrainShader == nullptr) {
+		m_terrainShader = new TerrainShader();
+		m_terrainShader->CreateFromFiles("Shaders/terrain.vert", "Shaders/shader.frag");
+		m_terrainSMShader = new TerrainShadowMapShader();
+		m_terrainSMShader->CreateFromFiles("Shaders/terrainSM.vert", "Shaders/terrainSM.frag");
+	}
+	m_terrains.push_back(terrain);
+	// A page that comes back is not drawn with the chunks it had when it left
+	for (int i = 0; i < RENDER_SNAPSHOT_COUNT; i++)
+		terrain->GetQueue(i).clear();
+}
+
+void GLRenderer::RemoveTerrain(Terrain * terrain)
+{
+	m_terrains.erase(std::remove(m_terrains.begin(), m_terrains.end(), terrain), m_terrains.end());
+}
+
+void GLRenderer::AddBakedProbe(BakedProbe * probe)
+{
+	m_bakedProbes.push_back(probe);
+	if (probe->IsDynamic())
+		m_cubemapRenderer->AddProbe(probe->GetTransform(), probe->GetCapture(), probe->GetRadius());
+}
+
 bool GLRenderer::DynamicMeshes() {
 	// Todo: Fix function
 	return true;
 }
 
-void GLRenderer::RenderScene(RenderFilter filter, GLuint uniformModel, LightedShader* shader) {
-	for (size_t i = 0; i < m_renderables.size(); i++)
-		m_renderables[i]->Render(filter, uniformModel, shader);
+void GLRenderer::RequestTextureLevels()
+{
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->RequestTextureLevels();
+	}
+	m_cubemapRenderer->RequestTextureLevels();
+	for (size_t i = 0; i < m_terrains.size(); i++)
+		m_terrains[i]->RequestTextureLevels();
+}
+
+void GLRenderer::Snapshot()
+{
+	const int snapshot = RenderSnapshot::GetWriteIndex();
+	Camera* camera = Camera::GetInstance();
+	RenderView& view = m_views[snapshot];
+	view.view = camera->GetViewMatrix();
+	view.projection = camera->GetProjectionMatrix();
+	view.position = camera->GetCameraPosition();
+	Frustum frustum(view.projection * view.view);
+
+	m_directionalLight->Snapshot();
+	for (size_t i = 0; i < m_pointLightsCount; i++)
+		m_pointLights[i]->Snapshot();
+	for (size_t i = 0; i < m_spotLightsCount; i++)
+		m_spotLights[i]->Snapshot();
+
+	QueueCulling culling;
+	culling.camera = frustum;
+	culling.shadow = Frustum(m_directionalLight->CalculateLightTransform());
+	culling.lightCount = 0;
+	for (size_t i = 0; i < m_pointLightsCount + m_spotLightsCount; i++) {
+		PointLight* light = i < m_pointLightsCount ? m_pointLights[i] : m_spotLights[i - m_pointLightsCount];
+		culling.lights[culling.lightCount++] = glm::vec4(light->GetTransform()->GetPosition(), light->GetFarPlane());
+	}
+	culling.position = view.position;
+	culling.occlusionQueries = m_occlusionQueries;
+
+	// The terrains hide what is behind them. Rasterized first, so the object batches can test against them
+	OcclusionCuller::Begin(view.projection * view.view);
+	for (size_t i = 0; i < m_terrains.size(); i++) {
+		if (!frustum.IntersectsBox(m_terrains[i]->GetBoxMin(), m_terrains[i]->GetBoxMax()))
+			continue;
+		const std::vector<glm::vec3>& vertices = m_terrains[i]->GetOccluderVertices();
+		const std::vector<unsigned int>& indices = m_terrains[i]->GetOccluderIndices();
+		if (!indices.empty())
+			OcclusionCuller::AddOccluder(&vertices[0], vertices.size(), &indices[0], indices.size());
+	}
+	OcclusionCuller::Rasterize();
+
+	// The terrains are few and large, one job each next to the object batches
+	JobCounter terrains;
+	for (size_t i = 0; i < m_terrains.size(); i++) {
+		Terrain* terrain = m_terrains[i];
+		JobSystem::Run([terrain, snapshot, &frustum, &view]() {
+			std::vector<TerrainChunk>& chunks = terrain->GetQueue(snapshot);
+			chunks.clear();
+			terrain->Select(frustum, view.position, chunks);
+		}, &terrains);
+	}
+
+	// Every object gets a slot in the snapshot's model matrices, renderer after renderer
+	FrameVector<size_t> firstMatrices(m_renderables.size());
+	size_t matrixCount = 0;
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		firstMatrices[i] = matrixCount;
+		if (m_renderables[i] != nullptr)
+			matrixCount += m_renderables[i]->GetObjects().size();
+	}
+	size_t cubemapMatrix = matrixCount;
+	ModelMatrixBuffer::Resize(matrixCount + m_cubemapRenderer->GetObjectCount());
+
+	JobSystem::ParallelFor(m_renderables.size(), 1, [this, &culling, &firstMatrices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			if (m_renderables[i] == nullptr)
+				continue;
+			if (!m_bakedProbes.empty())
+				m_renderables[i]->AssignProbes(m_bakedProbes, true);
+			m_renderables[i]->BuildQueue(culling, firstMatrices[i]);
+		}
+	});
+	m_cubemapRenderer->BuildQueues(culling, cubemapMatrix);
+	m_cubemapRenderer->Schedule(this);
+	JobSystem::Wait(&terrains);
+
+	// Picked up by the texture streamer at the start of the next frame
+	RequestTextureLevels();
+}
+
+void GLRenderer::BeginFrame()
+{
+	m_cubemapRenderer->AdaptResolution();
+	// The queues built next leave out what the queries found hidden
+	OcclusionQueries::Collect();
+}
+
+void GLRenderer::RenderScene(RenderFilter filter, GLuint uniformModel, LightedShader* shader, bool visibleOnly) {
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] == nullptr)
+			continue;
+		if (visibleOnly)
+			m_renderables[i]->RenderVisible(filter, uniformModel, shader);
+		else
+			m_renderables[i]->Render(filter, uniformModel, shader);
+	}
 }
 
 void GLRenderer::DirectionalSMPass(RenderFilter filter)
@@ -360,7 +879,7 @@ void GLRenderer::DirectionalSMPass(RenderFilter filter)
 	}
 
 	// Render back faces to avoid incorrect self-shadowing
-	glCullFace(GL_BACK);
+	GLState::CullFace(GL_BACK);
 
 	// Use the directional light shadow map
 	m_directionalSMShader->UseShader();
@@ -374,7 +893,7 @@ void GLRenderer::DirectionalSMPass(RenderFilter filter)
 	}
 	
 	// Set viewport to be the directional light shadow map
-	glViewport(0, 0, shadowMap->GetShadowWidth(), shadowMap->GetShadowHeight());
+	GLState::Viewport(0, 0, shadowMap->GetShadowWidth(), shadowMap->GetShadowHeight());
 
 	// Bind framebuffer to be the shadow map texture
 	shadowMap->Write();
@@ -389,17 +908,118 @@ void GLRenderer::DirectionalSMPass(RenderFilter filter)
 	
 	ShaderCompiler::ValidateProgram(m_directionalSMShader->GetShaderID());
 
-	// Render scene
-	RenderScene(filter, uniformModel);
+	// Render the objects that can cast into the map
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->RenderCasters(filter, uniformModel);
+	}
 
 	m_cubemapRenderer->RenderModels(filter, uniformModel);
 
+	// The terrain is static
+	if (filter == RenderFilter::R_STATIC)
+		TerrainSMPass();
+
 	// Re-bind framebuffer to the default one
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glCullFace(GL_FRONT);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::CullFace(GL_FRONT);
 }
 
-void GLRenderer::OmnidirectionalSMPass(PointLight* light, RenderFilter filter)
+unsigned long long GLRenderer::StaticGeometryHash() const
+{
+	// Object hashes are summed so the order the renderers and terrains were streamed in does not matter
+	unsigned long long geometryHash = 0;
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] == nullptr)
+			continue;
+
+		// The renderer's objects share its model, whose file is only looked at once
+		Model* model = dynamic_cast<Model*>(m_renderables[i]->GetRenderable());
+		unsigned long long modelHash = SHADOW_CACHE_HASH_SEED;
+		if (model != nullptr)
+			ShadowCache::HashFile(modelHash, model->GetFilename());
+		else
+			ShadowCache::Hash(modelHash, &i, sizeof(i));
+
+		const std::vector<GLObject*>& objects = m_renderables[i]->GetObjects();
+		for (size_t j = 0; j < objects.size(); j++) {
+			if (!objects[j]->GetTransform()->GetStatic())
+				continue;
+			unsigned long long hash = modelHash;
+			glm::mat4 transform = objects[j]->GetTransformMatrix();
+			ShadowCache::Hash(hash, &transform, sizeof(transform));
+			geometryHash += hash;
+		}
+	}
+
+	for (size_t i = 0; i < m_terrains.size(); i++) {
+		unsigned long long hash = SHADOW_CACHE_HASH_SEED;
+		glm::vec4 placement(m_terrains[i]->GetOrigin(), m_terrains[i]->GetSize());
+		float heightScale = m_terrains[i]->GetHeightScale();
+		ShadowCache::HashFile(hash, m_terrains[i]->GetHeightmapLocation());
+		ShadowCache::Hash(hash, &placement, sizeof(placement));
+		ShadowCache::Hash(hash, &heightScale, sizeof(heightScale));
+		geometryHash += hash;
+	}
+
+	return geometryHash;
+}
+
+void GLRenderer::StaticShadowPass(bool useCache)
+{
+	double start = glfwGetTime();
+	unsigned long long geometryHash = useCache ? StaticGeometryHash() : 0;
+	int rendered = 0, cached = 0;
+
+	// Directional Light
+	unsigned long long hash = geometryHash;
+	glm::mat4 lightTransform = m_directionalLight->CalculateLightTransform();
+	ShadowCache::Hash(hash, &lightTransform, sizeof(lightTransform));
+	// The terrain chunks in the map are detailed around the camera
+	if (!m_terrains.empty()) {
+		glm::vec3 camera = GetView().position;
+		ShadowCache::Hash(hash, &camera, sizeof(camera));
+	}
+	if (useCache && ShadowCache::Load("directional", m_directionalLight->GetStaticShadowMap(), hash)) {
+		cached++;
+	}
+	else {
+		DirectionalSMPass(RenderFilter::R_STATIC);
+		if (useCache)
+			ShadowCache::Store("directional", m_directionalLight->GetStaticShadowMap(), hash);
+		rendered++;
+	}
+
+	// Point and spot lights
+	char name[32] = { "\0" };
+	for (size_t i = 0; i < m_pointLightsCount + m_spotLightsCount; i++) {
+		bool isPoint = i < m_pointLightsCount;
+		PointLight* light = isPoint ? m_pointLights[i] : m_spotLights[i - m_pointLightsCount];
+		snprintf(name, sizeof(name), isPoint ? "point_%zu" : "spot_%zu", isPoint ? i : i - m_pointLightsCount);
+
+		hash = geometryHash;
+		CubeMatrices lightTransforms = light->CalculateLightTransform();
+		ShadowCache::Hash(hash, lightTransforms.faces, sizeof(lightTransforms.faces));
+		GLfloat farPlane = light->GetFarPlane();
+		ShadowCache::Hash(hash, &farPlane, sizeof(farPlane));
+		if (useCache && ShadowCache::Load(name, light->GetStaticShadowMap(), hash)) {
+			cached++;
+			continue;
+		}
+
+		OmnidirectionalSMPass(light, i, RenderFilter::R_STATIC);
+		if (useCache)
+			ShadowCache::Store(name, light->GetStaticShadowMap(), hash);
+		rendered++;
+	}
+
+	m_staticShadowsDirty = false;
+
+	if (useCache)
+		printf("Static shadow maps: %d rendered, %d from the cache in %.1f ms\n", rendered, cached, (glfwGetTime() - start) * 1000.0);
+}
+
+void GLRenderer::OmnidirectionalSMPass(PointLight* light, size_t index, RenderFilter filter)
 {
 	if (filter == RenderFilter::R_ALL || filter == RenderFilter::R_DYNAMIC) {
 		printf("Invalid render filter");
@@ -407,7 +1027,7 @@ void GLRenderer::OmnidirectionalSMPass(PointLight* light, RenderFilter filter)
 	}
 
 	// Render back faces to avoid incorrect self-shadowing
-	glCullFace(GL_BACK);
+	GLState::CullFace(GL_BACK);
 
 	// Use the directional light shadow map
 	m_omnidirectionalSMShader->UseShader();
@@ -415,7 +1035,7 @@ void GLRenderer::OmnidirectionalSMPass(PointLight* light, RenderFilter filter)
 	ShadowMap* shadowMap = light->GetStaticShadowMap();
 
 	// Set viewport to be the directional light shadow map
-	glViewport(0, 0, shadowMap->GetShadowWidth(), shadowMap->GetShadowHeight());
+	GLState::Viewport(0, 0, shadowMap->GetShadowWidth(), shadowMap->GetShadowHeight());
 
 	// Bind framebuffer to be the shadow map texture
 	shadowMap->Write();
@@ -426,32 +1046,43 @@ void GLRenderer::OmnidirectionalSMPass(PointLight* light, RenderFilter filter)
 	// Set uniforms
 	GLuint uniformModel = m_omnidirectionalSMShader->GetModelLocation();
 	m_omnidirectionalSMShader->SetLightMatrices(light->CalculateLightTransform());
-	m_omnidirectionalSMShader->SetLightPosition(&light->GetTransform()->GetPosition());
+	m_omnidirectionalSMShader->SetLightPosition(&light->GetPosition());
 	m_omnidirectionalSMShader->SetFarPlane(light->GetFarPlane());
 	m_omnidirectionalSMShader->SetTexture(1);
 
 	ShaderCompiler::ValidateProgram(m_omnidirectionalSMShader->GetShaderID());
 
-	// Render scene
-	RenderScene(filter, uniformModel);
+	// Render the objects within the light's reach
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->RenderLit(filter, uniformModel, 1u << index);
+	}
 
 	m_cubemapRenderer->RenderModels(filter, uniformModel);
 
 	// Re-bind framebuffer to the default one
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glCullFace(GL_FRONT);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::CullFace(GL_FRONT);
 }
 
-void GLRenderer::CubeMapPass(Transform * transport, CubeMapRenderShader* shader, CubeMap * cubemap)
+void GLRenderer::CollectDynamicTransforms(FrameVector<Transform*>& transforms) const
+{
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->CollectDynamicTransforms(transforms);
+	}
+}
+
+void GLRenderer::CubeMapPass(glm::vec3 position, CubeMapRenderShader* shader, CubeMap * cubemap, int face, RenderFilter filter)
 {
 	// Use the directional light shadow map
 	shader->UseShader();
 	
 	// Set viewport to be the directional light shadow map
-	glViewport(0, 0, cubemap->GetShadowWidth(), cubemap->GetShadowHeight());
+	GLState::Viewport(0, 0, cubemap->GetShadowWidth(), cubemap->GetShadowHeight());
 
-	// Bind framebuffer to be the shadow map texture
-	cubemap->Write();
+	// Bind framebuffer to the face of the cube map
+	cubemap->WriteFace(face);
 
 	// Clear buffer
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -459,87 +1090,201 @@ void GLRenderer::CubeMapPass(Transform * transport, CubeMapRenderShader* shader,
 
 	// Set uniforms
 	shader->SetViewProjectMatrices(
-		transport->GetCubeViewProjectionMatrices(
+		Transform::GetCubeViewProjectionMatrices(
+			position,
 			cubemap->GetAspect(), 
 			cubemap->GetNear(), 
 			cubemap->GetFar()));
-	shader->SetCameraPosition(&glm::vec3(transport->GetPosition().x, transport->GetPosition().y, transport->GetPosition().z));
+	shader->SetFace(face);
+	shader->SetCameraPosition(&position);
 	shader->SetAmbientIntensity(m_ambientIntensity);
 	shader->SetDirectionalLight(m_directionalLight);
 
 	shader->SetTexutre(1);
 	shader->SetPointLights(&m_pointLights[0], m_pointLightsCount, 2, 0);
-	shader->SetSpotLights(&m_spotLights[0], m_spotLightsCount, 2 + m_pointLightsCount * 2, m_pointLightsCount);
+	shader->SetSpotLights(&m_spotLights[0], m_spotLightsCount, 2 + m_pointLightsCount, m_pointLightsCount);
 
 	GLuint uniformModel = shader->GetModelLocation();
 
 	ShaderCompiler::ValidateProgram(shader->GetShaderID());
 	
 	// Render scene
-	RenderScene(RenderFilter::R_ALL, uniformModel, shader);
+	RenderScene(filter, uniformModel, shader);
 
 	// Re-bind framebuffer to the default one
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void GLRenderer::RenderPass(RenderFilter filter)
+void GLRenderer::BakeReflectionProbes(bool store)
 {
-	// Clear buffer
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	for (size_t i = 0; i < m_bakedProbes.size(); i++) {
+		BakedProbe* probe = m_bakedProbes[i];
+		if (probe->IsDynamic())
+			continue;
+		if (!store && probe->LoadCache())
+			continue;
+		if (!store)
+			printf("Reflection probe %zu is not in the cache, baking it. Run the bake mode to store it\n", i);
 
-	// Draw skybox
-	m_skybox->Draw(&Camera::GetInstance()->GetViewMatrix(), &Camera::GetInstance()->GetProjectionMatrix());
+		// Only the static scene is baked, dynamic objects would be frozen in the reflection
+		for (int face = 0; face < 6; face++)
+			CubeMapPass(probe->GetTransform()->GetPosition(), m_cubemapRenderer->GetShader(), probe->GetCapture(), face, RenderFilter::R_STATIC);
+		probe->FinishBake(store);
+	}
+}
 
-	// Use the developed default shader
-	m_shader->UseShader();
+void GLRenderer::AssignProbes(bool dynamicOnly)
+{
+	if (m_bakedProbes.empty())
+		return;
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->AssignProbes(m_bakedProbes, dynamicOnly);
+	}
+}
+
+GLuint GLRenderer::UseDefaultShader(DefaultShader * shader)
+{
+	shader->UseShader();
 
 	// Set uniforms
-	m_shader->SetProjectionMatrix(&Camera::GetInstance()->GetProjectionMatrix());
-	m_shader->SetViewMatrix(&Camera::GetInstance()->GetViewMatrix());
-	m_shader->SetCameraPosition(&Camera::GetInstance()->GetCameraPosition());
-	m_shader->SetAmbientIntensity(m_ambientIntensity);
-	m_shader->SetReflectionFactor(0.0f);
-	m_shader->SetRefractionFactor(0.0f);
-	m_shader->SetFresnelValues(0.0f, 0.0f, 0.0f);
+	RenderView view = GetView();
+	shader->SetProjectionMatrix(&view.projection);
+	shader->SetViewMatrix(&view.view);
+	shader->SetCameraPosition(&view.position);
+	shader->SetAmbientIntensity(m_ambientIntensity);
+	shader->SetReflectionFactor(0.0f);
+	shader->SetRefractionFactor(0.0f);
+	shader->SetFresnelValues(0.0f, 0.0f, 0.0f);
 
 	int textureUnit = 1;
-	m_shader->SetTexutre(textureUnit);
+	shader->SetTexutre(textureUnit);
 
 	textureUnit++;
 	m_directionalLight->GetStaticShadowMap()->Read(GL_TEXTURE0 + textureUnit);
-	m_shader->SetDirectionalStaticSM(textureUnit);
+	shader->SetDirectionalStaticSM(textureUnit);
 
 	textureUnit++;
 	m_directionalLight->GetDynamicShadowMap()->Read(GL_TEXTURE0 + textureUnit);
-	m_shader->SetDirectionalDynamicSM(textureUnit);
+	shader->SetDirectionalDynamicSM(textureUnit);
 
 	textureUnit++;
 	m_skybox->BindSkybox(textureUnit);
-	m_shader->SetSkybox(textureUnit);
+	shader->SetSkybox(textureUnit);
 
 	textureUnit++;
-	const size_t worldReflectionUnit = textureUnit;
-	m_shader->SetWorldReflection(worldReflectionUnit);
+	const GLuint worldReflectionUnit = textureUnit;
+	shader->SetWorldReflection(worldReflectionUnit);
 
 	textureUnit++;
-	m_shader->SetPointLights(&m_pointLights[0], m_pointLightsCount, textureUnit, 0);
-	m_shader->SetSpotLights(&m_spotLights[0], m_spotLightsCount, textureUnit + m_pointLightsCount * 2, m_pointLightsCount);
-	m_shader->SetDirectionalLightTransform(&m_directionalLight->CalculateLightTransform());
-	m_shader->SetDirectionalLight(m_directionalLight);
+	shader->SetPointLights(&m_pointLights[0], m_pointLightsCount, textureUnit, 0);
+	shader->SetSpotLights(&m_spotLights[0], m_spotLightsCount, textureUnit + m_pointLightsCount, m_pointLightsCount);
+	shader->SetDirectionalLightTransform(&m_directionalLight->CalculateLightTransform());
+	shader->SetDirectionalLight(m_directionalLight);
 
-	const GLuint uniformModel = m_shader->GetModelLocation();
+	ShaderCompiler::ValidateProgram(shader->GetShaderID());
+
+	return worldReflectionUnit;
+}
+
+void GLRenderer::TerrainPass()
+{
+	glm::vec3 camera = GetView().position;
+	bool shaderInUse = false;
+
+	for (size_t i = 0; i < m_terrains.size(); i++) {
+		const std::vector<TerrainChunk>& chunks = m_terrains[i]->GetQueue(RenderSnapshot::GetReadIndex());
+		if (chunks.empty())
+			continue;
+
+		if (!shaderInUse) {
+			UseDefaultShader(m_terrainShader);
+			m_terrainShader->SetReflectionProbe(nullptr);
+			shaderInUse = true;
+		}
+		m_terrainShader->SetMaterial(m_terrains[i]->GetMaterial());
+		m_terrains[i]->Render(m_terrainShader->GetTerrainUniforms(), camera, chunks);
+	}
+}
 
-	ShaderCompiler::ValidateProgram(m_shader->GetShaderID());
+void GLRenderer::TerrainSMPass()
+{
+	// Chunks that can cast a shadow into the light's view, detailed like the ones the camera sees
+	glm::mat4 lightTransform = m_directionalLight->CalculateLightTransform();
+	glm::vec3 camera = GetView().position;
+	Frustum frustum(lightTransform);
+	std::vector<TerrainChunk> chunks;
+	bool shaderInUse = false;
+
+	for (size_t i = 0; i < m_terrains.size(); i++) {
+		chunks.clear();
+		m_terrains[i]->Select(frustum, camera, chunks);
+		if (chunks.empty())
+			continue;
+
+		if (!shaderInUse) {
+			// A heightfield has no back faces to cast the shadow, the bias of the lighting shader handles the acne
+			GLState::CullFace(GL_FRONT);
+			m_terrainSMShader->UseShader();
+			m_terrainSMShader->SetDirectionalLightTransform(&lightTransform);
+			shaderInUse = true;
+		}
+		m_terrains[i]->Render(m_terrainSMShader->GetTerrainUniforms(), camera, chunks);
+	}
+
+	if (shaderInUse)
+		GLState::CullFace(GL_BACK);
+}
+
+void GLRenderer::RenderPass(RenderFilter filter)
+{
+	// Clear buffer
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Draw skybox
+	RenderView view = GetView();
+	m_skybox->Draw(&view.view, &view.projection);
+
+	// Use the developed default shader
+	const GLuint worldReflectionUnit = UseDefaultShader(m_shader);
+	const GLuint uniformModel = m_shader->GetModelLocation();
 	
-	// Render scene
-	RenderScene(filter, uniformModel, m_shader);
+	// Render what the queues kept
+	RenderScene(filter, uniformModel, m_shader, true);
 
 	m_cubemapRenderer->Render(m_shader, uniformModel, worldReflectionUnit);
+
+	if (filter != RenderFilter::R_DYNAMIC)
+		TerrainPass();
+
+	if (m_occlusionQueries)
+		OcclusionQueryPass();
+}
+
+void GLRenderer::OcclusionQueryPass()
+{
+	// Against everything the pass drew, so a box only passes where it is in front of the scene
+	RenderView view = GetView();
+	OcclusionQueries::Begin(view.projection * view.view);
+	for (size_t i = 0; i < m_renderables.size(); i++) {
+		if (m_renderables[i] != nullptr)
+			m_renderables[i]->IssueOcclusionQueries();
+	}
+	m_cubemapRenderer->IssueOcclusionQueries();
+	OcclusionQueries::End();
 }
 
 void GLRenderer::Render(GLWindow* glWindow, Transform* root, RenderFilter filter)
 {
+	MaterialTable::Update();
+	ModelMatrixBuffer::Update();
+
+	if (m_staticShadowsDirty && RenderSnapshot::GetReadFrame() >= m_staticShadowsFrame) {
+		StaticShadowPass(false);
+		glWindow->SetViewport();
+	}
+
 	if (filter != RenderFilter::R_STATIC && DynamicMeshes()) {
 		// Only calculate dynamic shadow map if there are dynamic objects to display
 		DirectionalSMPass(RenderFilter::R_DYNAMIC);
@@ -552,20 +1297,25 @@ void GLRenderer::Render(GLWindow* glWindow, Transform* root, RenderFilter filter
 	RenderPass(filter);
 }
 
-void GLRenderer::BakeStage(GLWindow * glWindow)
+void GLRenderer::BakeStage(GLWindow * glWindow, bool storeProbes)
 {
-	// Directional Light
-	DirectionalSMPass(RenderFilter::R_STATIC);
-	// Point Lights
-	for (size_t i = 0; i < m_pointLightsCount; i++) {
-		OmnidirectionalSMPass(m_pointLights[i], RenderFilter::R_STATIC);
-	}
-	// Spot Lights
-	for (size_t i = 0; i < m_spotLightsCount; i++) {
-		OmnidirectionalSMPass(m_spotLights[i], RenderFilter::R_STATIC);
-	}
+	// Nothing runs yet, the scene as it was loaded is drawn
+	Snapshot();
+	RenderSnapshot::Publish();
+	MaterialTable::Update();
+	ModelMatrixBuffer::Update();
 
-	m_cubemapRenderer->CubeMapPass(this);
+	StaticShadowPass(true);
+
+	// Probes reflect the lit scene, so they go after the shadow maps
+	BakeReflectionProbes(storeProbes);
+	AssignProbes(false);
+	// The static objects reflect their probes from the first frame
+	Snapshot();
+	RenderSnapshot::Publish();
+	ModelMatrixBuffer::Update();
+
+	m_cubemapRenderer->BakePass(this);
 
 	glWindow->SetViewport();
 }
@@ -592,4 +1342,10 @@ GLRenderer::~GLRenderer()
 			continue;
 		delete m_renderables[i];
 	}
+
+	for (size_t i = 0; i < m_bakedProbes.size(); i++)
+		delete m_bakedProbes[i];
+
+	delete m_terrainShader;
+	delete m_terrainSMShader;
 }
\ No newline at end of file
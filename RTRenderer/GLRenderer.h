@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 
 #include <GL\glew.h>
 
@@ -12,9 +13,37 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Material.h"
+#include "MaterialTable.h"
 #include "Light.h"
 #include "CubeMap.h"
 #include "SkyBox.h"
+#include "ProbeScheduler.h"
+#include "BakedProbe.h"
+#include "Terrain.h"
+#include "Frustum.h"
+#include "ShadowCache.h"
+#include "JobSystem.h"
+#include "RenderSnapshot.h"
+#include "FrameArena.h"
+#include "MatrixKernels.h"
+#include "ModelMatrixBuffer.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+
+// What the queues of a snapshot are culled against
+struct QueueCulling {
+	// The camera's frustum, for the visible lists
+	Frustum camera;
+	// The directional light's, for the shadow casters
+	Frustum shadow;
+	// Position and reach of every point and spot light, the point lights first
+	glm::vec4 lights[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+	size_t lightCount;
+	// The camera's position, and whether the objects' last occlusion queries leave them out
+	glm::vec3 position;
+	bool occlusionQueries;
+};
 
 class GLObject
 {
@@ -22,13 +51,44 @@ private:
 	Transform* m_transform;
 	Material* m_material;
 	size_t m_modelIndex;
+	// Baked reflection probe whose box holds the object
+	BakedProbe* m_probe;
+	// Leaf of the object in its renderer's hierarchies, -1 until a queue inserted it
+	int m_proxy;
+	// Whether the leaf is in the static hierarchy
+	bool m_proxyStatic;
+	// Occlusion query state, only touched while a queue is built and between frames
+	// Whether the last query had the object hidden
+	bool m_occluded;
+	// Snapshot the object was last in the camera's frustum at
+	unsigned long long m_frustumFrame;
+	// Snapshot that asked for the query in flight, 0 if there is none
+	unsigned long long m_queryFrame;
 public:
 	GLObject(Transform *transform, Material* material, size_t modelIndex);
 
 	bool FilterPass(RenderFilter filter);
 	void UseMaterial(LightedShader* shader);
 	size_t GetModelIndex() const;
+	Transform* GetTransform() const { return m_transform; }
+	Material* GetMaterial() const { return m_material; }
+	BakedProbe* GetProbe() const { return m_probe; }
+	void SetProbe(BakedProbe* probe) { m_probe = probe; }
+	int GetProxy() const { return m_proxy; }
+	bool IsProxyStatic() const { return m_proxyStatic; }
+	void SetProxy(int proxy, bool isStatic) { m_proxy = proxy; m_proxyStatic = isStatic; }
+	bool IsOccluded() const { return m_occluded; }
+	// Result of the object's query. Ends the wait for it
+	void SetOccluded(bool occluded) { m_occluded = occluded; m_queryFrame = 0; }
+	unsigned long long GetFrustumFrame() const { return m_frustumFrame; }
+	void SetFrustumFrame(unsigned long long frame) { m_frustumFrame = frame; }
+	unsigned long long GetQueryFrame() const { return m_queryFrame; }
+	void SetQueryFrame(unsigned long long frame) { m_queryFrame = frame; }
 	glm::mat4 GetTransformMatrix() const;
+	// On screen size, in pixels, of a sphere of the given local radius around this object
+	float GetProjectedSize(float radius) const;
+	// Requests the material's texture at the given on screen size
+	void RequestTextureSize(float pixels);
 
 	~GLObject();
 };
@@ -39,33 +99,98 @@ protected:
 	
 	IRenderable* m_renderable;
 	std::vector<GLObject*> m_objects;
+
+	// The objects as of each render snapshot, built by BuildQueue. Drawing only reads the snapshot being drawn
+	RenderQueue m_queues[RENDER_SNAPSHOT_COUNT];
+	// On screen size of every object, in pixels, as of the last queue. 0 when it is behind the camera
+	std::vector<float> m_projectedSizes;
+
+	// World boxes of the objects, whose payloads are their indices. The static objects' are rebuilt with the SAH by
+	// the next queue when some came or went, the dynamic ones' are refitted as they move
+	BoundingVolumeHierarchy m_staticTree;
+	BoundingVolumeHierarchy m_dynamicTree{ BVH_DYNAMIC_MARGIN };
+	bool m_staticTreeDirty = false;
+	// Items drawn by the last RenderLit
+	std::vector<RenderItem> m_lit;
+
+	// Whether an object in the camera's frustum is drawn, and whether its box is queried. Asks for the query
+	bool _TestOcclusion(RenderQueue& queue, size_t index, glm::vec3 boxMin, glm::vec3 boxMax, const QueueCulling& culling);
+	// Leaves a removed object out of the queries
+	void _ForgetOcclusion(GLObject* object);
+
+	// Inserts the object in the hierarchy of its kind, or moves its leaf there
+	void _PlaceObject(size_t index, glm::vec3 boxMin, glm::vec3 boxMax);
+	void _RemoveProxy(GLObject* object);
+	BoundingVolumeHierarchy& _GetTree(GLObject* object) { return object->IsProxyStatic() ? m_staticTree : m_dynamicTree; }
+
+	virtual void RenderObjects(const std::vector<RenderItem>& items, RenderFilter filter, GLuint uniformModel, LightedShader* shader) = 0;
 public:
-	virtual void Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr) = 0;
+	void Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr) { RenderObjects(m_queues[RenderSnapshot::GetReadIndex()].items, filter, uniformModel, shader); }
+	// Renders the objects that were in the camera's frustum when the snapshot was built
+	void RenderVisible(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr) { RenderObjects(m_queues[RenderSnapshot::GetReadIndex()].visible, filter, uniformModel, shader); }
+	// Renders the objects that were in the directional light's frustum
+	void RenderCasters(RenderFilter filter, GLuint uniformModel) { RenderObjects(m_queues[RenderSnapshot::GetReadIndex()].casters, filter, uniformModel, nullptr); }
+	// Renders the objects that were within reach of the lights of the mask
+	void RenderLit(RenderFilter filter, GLuint uniformModel, unsigned int lights);
+	// Issues the occlusion queries the snapshot asked for. Between OcclusionQueries::Begin and End
+	void IssueOcclusionQueries() { OcclusionQueries::Issue(m_queues[RenderSnapshot::GetReadIndex()].tests); }
 	virtual void IncrementVertices() = 0;
+	// Radius of the renderable's bounding sphere around the object's origin
+	virtual float GetBoundingRadius() const = 0;
+	// Box around the renderable, in the object's own space
+	virtual void GetBounds(glm::vec3& boxMin, glm::vec3& boxMax) const = 0;
+	// Reports to the texture streamer how big each texture is on screen, with the sizes of the last queue
+	virtual void RequestTextureLevels() = 0;
+	/*!
+		\n void GLObjectRenderer::BuildQueue(const QueueCulling& culling, size_t firstMatrix)
+		\param size_t firstMatrix ModelMatrixBuffer slot of the first object
+
+		Copies the objects into the snapshot being written and their matrices into their slots, moves the leaves of
+		the objects that moved, and collects the visible objects, the shadow casters and the lights each object is in
+		reach of from the hierarchies. Visible objects that the CPU depth buffer or their last occlusion query have
+		hidden are left out. Measures the objects' size on screen. Does not touch GL
+	*/
+	void BuildQueue(const QueueCulling& culling, size_t firstMatrix);
 
 	void AddMeshRenderer(GLObject* meshRenderer);
+	// Removes and deletes an object. Its transform is left to the caller
+	void RemoveMeshRenderer(GLObject* meshRenderer);
+	// Appends the transforms of the objects that are not static
+	void CollectDynamicTransforms(FrameVector<Transform*>& transforms) const;
+	// Gives every object the probe whose box contains it. Only the dynamic objects if dynamicOnly is set
+	void AssignProbes(const std::vector<BakedProbe*>& probes, bool dynamicOnly);
 	void SetIndex(size_t index) { m_renderable->SetIndex(index); }
+	IRenderable* GetRenderable() const { return m_renderable; }
+	const std::vector<GLObject*>& GetObjects() const { return m_objects; }
 	void Clear();
 
-	~GLObjectRenderer();
+	virtual ~GLObjectRenderer();
 };
 
 class GLModelRenderer 
 	: public GLObjectRenderer
 {
+protected:
+	void RenderObjects(const std::vector<RenderItem>& items, RenderFilter filter, GLuint uniformModel, LightedShader* shader) override;
 public:
 	void SetRenderable(Model* renderable);
-	void Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr);
 	void IncrementVertices() override;
+	float GetBoundingRadius() const override;
+	void GetBounds(glm::vec3& boxMin, glm::vec3& boxMax) const override;
+	void RequestTextureLevels() override;
 };
 
 class GLMeshRenderer
 	: public GLObjectRenderer
 {
+protected:
+	void RenderObjects(const std::vector<RenderItem>& items, RenderFilter filter, GLuint uniformModel, LightedShader* shader) override;
 public:
 	void SetRenderable(Mesh* renderable);
-	void Render(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr);
 	void IncrementVertices() override;
+	float GetBoundingRadius() const override;
+	void GetBounds(glm::vec3& boxMin, glm::vec3& boxMax) const override;
+	void RequestTextureLevels() override;
 };
 
 class GLRenderer;
@@ -79,6 +204,17 @@ private:
 	Transform* m_reflectTransform;
 	CubeMap* m_refract;
 	CubeMap* m_reflect;
+
+	ProbeScheduler m_scheduler;
+	ReflectionProbe* m_refractProbe;
+	ReflectionProbe* m_reflectProbe;
+	// Faces picked by the scheduler for each render snapshot
+	std::vector<ProbeFaceUpdate> m_updates[RENDER_SNAPSHOT_COUNT];
+	// Every face of the probes reallocated since the last pass, drawn before the new cube maps are read
+	std::vector<ProbeFaceUpdate> m_reallocated;
+
+	// Raises the probe's resolution as the camera gets closer. A new cube map has all of its faces drawn that frame
+	void _AdaptResolution(ReflectionProbe* probe);
 	
 public:
 	GLCubeMapRenderer();
@@ -92,8 +228,24 @@ public:
 		return m_reflectTransform;
 	};
 
+	// Resizes the probes the camera got close to. Has to see the same scene as the simulation, so it runs between frames
+	void AdaptResolution();
+	// Lets the scheduler pick the faces to refresh, within the per-frame face budget, for the snapshot being written
+	void Schedule(GLRenderer* glRenderer);
+	// Renders the probe faces picked for the snapshot being drawn
 	void CubeMapPass(GLRenderer* glRenderer);
+	// Renders every face of every probe
+	void BakePass(GLRenderer* glRenderer);
+	void SetFaceBudget(int faces) { m_scheduler.SetFaceBudget(faces); }
+	// Lets the scheduler refresh a probe that is not displayed by a model of its own
+	void AddProbe(Transform* transform, CubeMap* cubemap, float radius) { m_scheduler.AddProbe(transform, cubemap, nullptr, radius); }
+	CubeMapRenderShader* GetShader() const { return m_cubemapShader; }
 	void RenderModels(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr);
+	// Objects of the sphere models, which take that many model matrix slots
+	size_t GetObjectCount() const;
+	void BuildQueues(const QueueCulling& culling, size_t firstMatrix);
+	void IssueOcclusionQueries();
+	void RequestTextureLevels();
 	void Render(DefaultShader* shader, GLuint uniformModel, GLuint textureUnit);
 	
 	~GLCubeMapRenderer();
@@ -123,6 +275,23 @@ private:
 	PointLight* m_pointLights[MAX_POINT_LIGHTS];
 	size_t m_spotLightsCount = 0;
 	SpotLight* m_spotLights[MAX_SPOT_LIGHTS];
+
+	std::vector<BakedProbe*> m_bakedProbes;
+
+	// Terrain pages, not owned
+	std::vector<Terrain*> m_terrains;
+	TerrainShader* m_terrainShader;
+	TerrainShadowMapShader* m_terrainSMShader;
+
+	// The static shadow maps miss geometry that was streamed in or out since they were rendered
+	bool m_staticShadowsDirty = false;
+	// They are re-rendered from the first snapshot written after the geometry changed
+	unsigned long long m_staticShadowsFrame = 0;
+
+	// Whether the main pass queries the boxes of the visible objects and leaves the hidden ones out of later snapshots
+	bool m_occlusionQueries = true;
+
+	RenderView m_views[RENDER_SNAPSHOT_COUNT];
 public:
 	GLRenderer(Transform* transform);
 
@@ -135,19 +304,73 @@ public:
 	void SetDirectionalLight(DirectionalLight* light);
 	void AddPointLight(PointLight* light);
 	void AddSpotLight(SpotLight* light);
-	void AddObjectRenderer(GLObjectRenderer* renderer);
+	// Returns the renderer's index, which reuses the slot of a removed renderer if there is one
+	size_t AddObjectRenderer(GLObjectRenderer* renderer);
+	// Deletes the renderer and frees its slot. The indices of the other renderers do not change
+	void RemoveObjectRenderer(GLObjectRenderer* renderer);
+	size_t GetObjectRendererCount() const { return m_renderables.size(); }
+	// Null for the slot of a removed renderer
+	GLObjectRenderer* GetObjectRendererAt(size_t index) const { return m_renderables[index]; }
 	void AddMeshRenderer(GLObject * meshRenderer);
+	void RemoveMeshRenderer(GLObject * meshRenderer);
 	void AddShader(DefaultShader* shader);
+	void AddBakedProbe(BakedProbe* probe);
+	const std::vector<BakedProbe*>& GetBakedProbes() const { return m_bakedProbes; }
+	// The terrain has to stay alive until it is removed
+	void AddTerrain(Terrain* terrain);
+	void RemoveTerrain(Terrain* terrain);
+	// Takes effect with the next snapshot. Objects hidden by earlier queries are drawn again when turned off
+	void SetOcclusionQueries(bool enabled) { m_occlusionQueries = enabled; }
+	bool GetOcclusionQueries() const { return m_occlusionQueries; }
+	// Re-renders the static shadow maps once a snapshot holds the change
+	void InvalidateStaticShadows() { m_staticShadowsDirty = true; m_staticShadowsFrame = RenderSnapshot::GetWriteFrame(); }
+	/*!
+		\n void GLRenderer::Snapshot()
+
+		Copies what the next frame draws into the snapshot being written: the camera, the lights, the objects' matrices
+		and materials, the visible and shadow caster lists, the terrain chunks and the probe faces to refresh. Culling, probe assignment
+		and chunk selection run as jobs. Does not touch GL, so it runs with the simulation while the last frame is drawn
+	*/
+	void Snapshot();
+	// The GL work that has to see the scene as the simulation left it. Called between frames, when nothing is running
+	void BeginFrame();
+	// Draws the snapshot last published. Reads nothing from the live scene
 	void Render(GLWindow* glWindow, Transform* root, RenderFilter filter);
-	void BakeStage(GLWindow* glWindow);
+	/*!
+		\n void GLRenderer::BakeStage(GLWindow* glWindow, bool storeProbes)
+		\param GLWindow* glWindow Window whose viewport is restored at the end
+		\param bool storeProbes Bakes every static reflection probe and writes it to the cache instead of loading it
+
+		Renders everything that only depends on the static scene: shadow maps, reflection probes and the probe spheres
+	*/
+	void BakeStage(GLWindow* glWindow, bool storeProbes = false);
 
 	~GLRenderer();
 
 private:
 	bool DynamicMeshes();
-	void RenderScene(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr);
+	void CollectDynamicTransforms(FrameVector<Transform*>& transforms) const;
+	void RequestTextureLevels();
+	// Camera of the snapshot being drawn
+	const RenderView& GetView() const { return m_views[RenderSnapshot::GetReadIndex()]; }
+	// Only the objects of the render queues if visibleOnly is set
+	void RenderScene(RenderFilter filter, GLuint uniformModel, LightedShader* shader = nullptr, bool visibleOnly = false);
 	void DirectionalSMPass(RenderFilter filter);
-	void OmnidirectionalSMPass(PointLight* light, RenderFilter filter);
-	void CubeMapPass(Transform* transport, CubeMapRenderShader* shader, CubeMap* cubemap);
+	// Hash of everything the static shadow maps are rendered from but the lights, the model and heightmap files included
+	unsigned long long StaticGeometryHash() const;
+	// Static shadow maps of every light. With useCache, maps are loaded from the shadow cache when their light and the
+	// static geometry did not change, and the rendered ones are stored
+	void StaticShadowPass(bool useCache);
+	// index is the light's among the point and spot lights, the point lights first
+	void OmnidirectionalSMPass(PointLight* light, size_t index, RenderFilter filter);
+	void CubeMapPass(glm::vec3 position, CubeMapRenderShader* shader, CubeMap* cubemap, int face, RenderFilter filter = RenderFilter::R_ALL);
+	void BakeReflectionProbes(bool store);
+	void AssignProbes(bool dynamicOnly);
+	// Draws the boxes of the objects the snapshot tests against the depth buffer of the main pass
+	void OcclusionQueryPass();
+	// Sets the camera, light and shadow map uniforms of a default shader. Returns the world reflection's texture unit
+	GLuint UseDefaultShader(DefaultShader* shader);
+	void TerrainPass();
+	void TerrainSMPass();
 	void RenderPass(RenderFilter filter);
 };
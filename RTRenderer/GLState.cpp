@@ -0,0 +1,255 @@
+#include "GLState.h"
+
+// Value that no GL object or state can have, so the first call always reaches the driver
+constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+
+GLuint GLState::mProgram = UNKNOWN;
+GLuint GLState::mVAO = UNKNOWN;
+GLuint GLState::mActiveUnit = UNKNOWN;
+GLuint GLState::mTextures[MAX_TEXTURE_UNITS][TT_COUNT];
+GLuint GLState::mDrawFBO = UNKNOWN;
+GLuint GLState::mReadFBO = UNKNOWN;
+GLint GLState::mViewport[4] = { -1, -1, -1, -1 };
+GLenum GLState::mCullFace = UNKNOWN;
+GLint GLState::mCullEnabled = -1;
+GLint GLState::mDepthTestEnabled = -1;
+GLint GLState::mBlendEnabled = -1;
+GLint GLState::mDepthMask = -1;
+std::unordered_map<unsigned long long, GLState::UniformValue> GLState::mUniforms;
+
+int GLState::_TargetIndex(GLenum target)
+{
+	switch (target) {
+	case GL_TEXTURE_2D:
+		return TT_2D;
+	case GL_TEXTURE_CUBE_MAP:
+		return TT_CUBE_MAP;
+	case GL_TEXTURE_2D_ARRAY:
+		return TT_2D_ARRAY;
+	case GL_TEXTURE_BUFFER:
+		return TT_BUFFER;
+	}
+	return -1;
+}
+
+bool GLState::_Issue(bool changed)
+{
+	Profiler::Count(changed ? PC_GL_CALLS_ISSUED : PC_GL_CALLS_SKIPPED);
+	return changed;
+}
+
+bool GLState::_UniformChanged(GLint location, const void * data, GLsizei size)
+{
+	// Inactive uniforms are ignored by GL anyway
+	if (location < 0 || mProgram == UNKNOWN)
+		return _Issue(location >= 0);
+
+	unsigned long long key = ((unsigned long long)mProgram << 32) | (unsigned int)location;
+	UniformValue& cached = mUniforms[key];
+	if (cached.size == size && memcmp(cached.data, data, size * sizeof(GLfloat)) == 0)
+		return _Issue(false);
+
+	cached.size = size;
+	memcpy(cached.data, data, size * sizeof(GLfloat));
+	return _Issue(true);
+}
+
+void GLState::Invalidate()
+{
+	mProgram = UNKNOWN;
+	mVAO = UNKNOWN;
+	mActiveUnit = UNKNOWN;
+	for (size_t i = 0; i < MAX_TEXTURE_UNITS; i++) {
+		for (size_t j = 0; j < TT_COUNT; j++) {
+			mTextures[i][j] = UNKNOWN;
+		}
+	}
+	mDrawFBO = UNKNOWN;
+	mReadFBO = UNKNOWN;
+	mViewport[0] = mViewport[1] = mViewport[2] = mViewport[3] = -1;
+	mCullFace = UNKNOWN;
+	mCullEnabled = -1;
+	mDepthTestEnabled = -1;
+	mBlendEnabled = -1;
+	mDepthMask = -1;
+	mUniforms.clear();
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (_Issue(mProgram != program)) {
+		mProgram = program;
+		glUseProgram(program);
+	}
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (_Issue(mVAO != vao)) {
+		mVAO = vao;
+		glBindVertexArray(vao);
+	}
+}
+
+void GLState::ActiveTexture(GLuint unit)
+{
+	if (_Issue(mActiveUnit != unit)) {
+		mActiveUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+}
+
+void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int targetIndex = _TargetIndex(target);
+	if (unit >= MAX_TEXTURE_UNITS || targetIndex < 0) {
+		// Not tracked, forward it and forget what we knew about the unit
+		ActiveTexture(unit);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	// The unit is made active even when the binding is cached, the glTex* calls that follow edit its texture
+	ActiveTexture(unit);
+	if (!_Issue(mTextures[unit][targetIndex] != texture))
+		return;
+
+	mTextures[unit][targetIndex] = texture;
+	glBindTexture(target, texture);
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint fbo)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+
+	if (!_Issue((draw && mDrawFBO != fbo) || (read && mReadFBO != fbo)))
+		return;
+
+	if (draw) mDrawFBO = fbo;
+	if (read) mReadFBO = fbo;
+	glBindFramebuffer(target, fbo);
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (_Issue(mViewport[0] != x || mViewport[1] != y || mViewport[2] != width || mViewport[3] != height)) {
+		mViewport[0] = x; mViewport[1] = y; mViewport[2] = width; mViewport[3] = height;
+		glViewport(x, y, width, height);
+	}
+}
+
+void GLState::CullFace(GLenum mode)
+{
+	if (_Issue(mCullFace != mode)) {
+		mCullFace = mode;
+		glCullFace(mode);
+	}
+}
+
+void GLState::SetCapability(GLenum capability, bool enabled)
+{
+	GLint* cached = nullptr;
+	switch (capability) {
+	case GL_CULL_FACE:
+		cached = &mCullEnabled;
+		break;
+	case GL_DEPTH_TEST:
+		cached = &mDepthTestEnabled;
+		break;
+	case GL_BLEND:
+		cached = &mBlendEnabled;
+		break;
+	}
+
+	if (cached != nullptr && !_Issue(*cached != (GLint)enabled))
+		return;
+
+	if (cached != nullptr)
+		*cached = enabled;
+
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void GLState::DepthMask(bool write)
+{
+	if (_Issue(mDepthMask != (GLint)write)) {
+		mDepthMask = write;
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLState::Uniform1i(GLint location, GLint value)
+{
+	if (_UniformChanged(location, &value, 1))
+		glUniform1i(location, value);
+}
+
+void GLState::Uniform1f(GLint location, GLfloat value)
+{
+	if (_UniformChanged(location, &value, 1))
+		glUniform1f(location, value);
+}
+
+void GLState::Uniform2f(GLint location, GLfloat x, GLfloat y)
+{
+	GLfloat value[2] = { x, y };
+	if (_UniformChanged(location, value, 2))
+		glUniform2f(location, x, y);
+}
+
+void GLState::Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat value[3] = { x, y, z };
+	if (_UniformChanged(location, value, 3))
+		glUniform3f(location, x, y, z);
+}
+
+void GLState::UniformMatrix4fv(GLint location, const GLfloat * value)
+{
+	if (_UniformChanged(location, value, 16))
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	for (auto it = mUniforms.begin(); it != mUniforms.end();) {
+		if ((GLuint)(it->first >> 32) == program)
+			it = mUniforms.erase(it);
+		else
+			it++;
+	}
+	if (mProgram == program)
+		mProgram = UNKNOWN;
+	glDeleteProgram(program);
+}
+
+void GLState::DeleteTexture(GLuint texture)
+{
+	for (size_t i = 0; i < MAX_TEXTURE_UNITS; i++) {
+		for (size_t j = 0; j < TT_COUNT; j++) {
+			if (mTextures[i][j] == texture)
+				mTextures[i][j] = UNKNOWN;
+		}
+	}
+	glDeleteTextures(1, &texture);
+}
+
+void GLState::DeleteVertexArray(GLuint vao)
+{
+	if (mVAO == vao)
+		mVAO = UNKNOWN;
+	glDeleteVertexArrays(1, &vao);
+}
+
+void GLState::DeleteFramebuffer(GLuint fbo)
+{
+	if (mDrawFBO == fbo)
+		mDrawFBO = UNKNOWN;
+	if (mReadFBO == fbo)
+		mReadFBO = UNKNOWN;
+	glDeleteFramebuffers(1, &fbo);
+}
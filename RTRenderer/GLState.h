@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string.h>
+#include <unordered_map>
+
+#include <GL\glew.h>
+
+#include "Profiler.h"
+
+// This class mirrors the parts of the GL context that change during a frame and drops calls that would not change it.
+// Every bind, state change and uniform upload of the renderer should go through here, otherwise the cache goes stale.
+class GLState
+{
+private:
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+	enum TextureTarget {
+		TT_2D, TT_CUBE_MAP, TT_2D_ARRAY, TT_BUFFER, TT_COUNT
+	};
+
+	// Last value uploaded to a uniform location. Ints are stored bitwise in the same storage
+	struct UniformValue {
+		GLsizei size;
+		GLfloat data[16];
+	};
+
+	static GLuint mProgram;
+	static GLuint mVAO;
+	static GLuint mActiveUnit;
+	static GLuint mTextures[MAX_TEXTURE_UNITS][TT_COUNT];
+	static GLuint mDrawFBO;
+	static GLuint mReadFBO;
+	static GLint mViewport[4];
+	static GLenum mCullFace;
+	static GLint mCullEnabled;
+	static GLint mDepthTestEnabled;
+	static GLint mBlendEnabled;
+	static GLint mDepthMask;
+
+	//! Uniform values keyed by (program << 32 | location)
+	static std::unordered_map<unsigned long long, UniformValue> mUniforms;
+
+	static int _TargetIndex(GLenum target);
+	static bool _Issue(bool changed);
+	static bool _UniformChanged(GLint location, const void* data, GLsizei size);
+
+public:
+	// Forgets everything that is cached. The next call of each kind will reach the driver
+	static void Invalidate();
+
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vao);
+	static void ActiveTexture(GLuint unit);
+	// Binds the texture to the given unit (0 based, not GL_TEXTURE0 based) and leaves that unit active
+	static void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	// GL_FRAMEBUFFER binds both the draw and the read framebuffer
+	static void BindFramebuffer(GLenum target, GLuint fbo);
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	static void CullFace(GLenum mode);
+	// Supports GL_CULL_FACE, GL_DEPTH_TEST and GL_BLEND
+	static void SetCapability(GLenum capability, bool enabled);
+	static void DepthMask(bool write);
+
+	static void Uniform1i(GLint location, GLint value);
+	static void Uniform1f(GLint location, GLfloat value);
+	static void Uniform2f(GLint location, GLfloat x, GLfloat y);
+	static void Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+	static void UniformMatrix4fv(GLint location, const GLfloat* value);
+
+	// Deletes the GL object and removes it from the cache so a recycled name is not mistaken for it
+	static void DeleteProgram(GLuint program);
+	static void DeleteTexture(GLuint texture);
+	static void DeleteVertexArray(GLuint vao);
+	static void DeleteFramebuffer(GLuint fbo);
+};
@@ -8,7 +8,7 @@ GLWindow::GLWindow(GLint windowWidth, GLint windowHeight) {
 	height = windowHeight;
 }
 
-bool GLWindow::Initialize(bool fullscreen) {
+bool GLWindow::Initialize(bool fullscreen, bool visible) {
 	// Initialize GLFW
 	if (!glfwInit()) {
 		printf("GLFW initialization failed.");
@@ -25,6 +25,7 @@ bool GLWindow::Initialize(bool fullscreen) {
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	// Allow forward compatibility
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLU_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
 	mainWindow = glfwCreateWindow(width, height, "Test Window", fullscreen ? glfwGetPrimaryMonitor() : nullptr, nullptr);
 	if (!mainWindow) {
@@ -53,13 +54,19 @@ bool GLWindow::Initialize(bool fullscreen) {
 		return false;
 	}
 
-	glCullFace(GL_FRONT);
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
+	// GLEW is ready, nothing of the context is known yet
+	GLState::Invalidate();
+
+	GLState::CullFace(GL_FRONT);
+	GLState::SetCapability(GL_CULL_FACE, true);
+	GLState::SetCapability(GL_DEPTH_TEST, true);
+	GLState::SetCapability(GL_BLEND, true);
 	//glEnable(GL_FRAMEBUFFER_SRGB);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// Meshes without a layer attribute (LAYER_ATTRIBUTE in Mesh.h) read this value, a negative layer selects their 2D texture
+	glVertexAttrib1f(3, -1.0f);
+
 	// Setup viewport
 	SetViewport();
 
@@ -71,7 +78,7 @@ bool GLWindow::Initialize(bool fullscreen) {
 
 void GLWindow::SetViewport()
 {
-	glViewport(0, 0, bufferWidth, bufferHeight);
+	GLState::Viewport(0, 0, bufferWidth, bufferHeight);
 }
 
 GLuint GLWindow::GetBufferWidht() {
@@ -8,6 +8,7 @@
 #include <GLFW\glfw3native.h>
 
 #include "Input.h"
+#include "GLState.h"
 
 class GLWindow
 {
@@ -21,7 +22,8 @@ private:
 public:
 	GLWindow(GLint windowWidth, GLint windowHeight);
 
-	bool Initialize(bool fullScreen);
+	// Hidden windows only provide a context, e.g. for baking
+	bool Initialize(bool fullScreen, bool visible = true);
 	void SetViewport();
 
 	GLuint GetBufferWidht();
@@ -14,5 +14,5 @@ public:
 	virtual void Render() = 0;
 	virtual void Clear() = 0;
 
-	~IRenderable() {};
+	virtual ~IRenderable() {};
 };
\ No newline at end of file
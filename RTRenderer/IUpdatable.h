@@ -5,4 +5,6 @@ class IUpdatable
 public:
 	virtual void SetUp() = 0;
 	virtual void Update() = 0;
+
+	virtual ~IUpdatable() {}
 };
@@ -0,0 +1,227 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+bool JobSystem::mInitialized = false;
+
+std::vector<std::thread> JobSystem::mWorkers;
+std::vector<JobSystem::JobQueue*> JobSystem::mQueues;
+std::atomic<int> JobSystem::mQueuedCount(0);
+std::mutex JobSystem::mSleepMutex;
+std::condition_variable JobSystem::mSleepCondition;
+bool JobSystem::mStop = false;
+
+thread_local int JobSystem::mThreadIndex = -1;
+
+void JobSystem::Initialize(unsigned int workerCount)
+{
+	if (mInitialized)
+		return;
+
+	// The main thread works too while it waits
+	if (workerCount == 0)
+		workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	mQueues.resize(workerCount + 1);
+	for (size_t i = 0; i < mQueues.size(); i++)
+		mQueues[i] = new JobQueue();
+
+	mThreadIndex = 0;
+	mStop = false;
+	for (unsigned int i = 0; i < workerCount; i++)
+		mWorkers.push_back(std::thread(_WorkerLoop, (int)i + 1));
+
+	mInitialized = true;
+}
+
+bool JobSystem::IsInitialized()
+{
+	return mInitialized;
+}
+
+unsigned int JobSystem::GetThreadCount()
+{
+	return mInitialized ? (unsigned int)mQueues.size() : 1;
+}
+
+void JobSystem::_WorkerLoop(int index)
+{
+	mThreadIndex = index;
+
+	while (true) {
+		JobEntry entry;
+		if (_Pop(index, entry)) {
+			_Execute(entry);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleepCondition.wait(lock, [] { return mStop || mQueuedCount.load() > 0; });
+		if (mStop)
+			return;
+	}
+}
+
+void JobSystem::_Push(JobEntry & entry)
+{
+	// Threads the system does not own hand their jobs to the main thread's deque, where anyone can steal them
+	JobQueue* queue = mQueues[std::max(mThreadIndex, 0)];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (queue->count == queue->jobs.size()) {
+			// Unrolls the ring into a buffer twice as large
+			std::vector<JobEntry> jobs(std::max(queue->jobs.size() * 2, (size_t)64));
+			for (size_t i = 0; i < queue->count; i++)
+				jobs[i] = std::move(queue->jobs[(queue->head + i) % queue->jobs.size()]);
+			queue->jobs.swap(jobs);
+			queue->head = 0;
+		}
+		queue->jobs[(queue->head + queue->count) % queue->jobs.size()] = std::move(entry);
+		queue->count++;
+	}
+	mQueuedCount.fetch_add(1);
+
+	// Taking the lock orders the wake up after the check of a worker that is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mSleepCondition.notify_one();
+}
+
+bool JobSystem::_Pop(int index, JobEntry & entry)
+{
+	{
+		JobQueue* queue = mQueues[index];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (queue->count > 0) {
+			queue->count--;
+			entry = std::move(queue->jobs[(queue->head + queue->count) % queue->jobs.size()]);
+			mQueuedCount.fetch_sub(1);
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < mQueues.size(); i++) {
+		JobQueue* victim = mQueues[(index + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (victim->count > 0) {
+			entry = std::move(victim->jobs[victim->head]);
+			victim->head = (victim->head + 1) % victim->jobs.size();
+			victim->count--;
+			mQueuedCount.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::_Hold(JobEntry & entry, JobCounter * after)
+{
+	std::lock_guard<std::mutex> lock(after->m_mutex);
+	if (after->m_count.load() == 0)
+		return false;
+	after->m_continuations.push_back(std::move(entry));
+	return true;
+}
+
+void JobSystem::_Schedule(JobEntry & entry)
+{
+	if (!mInitialized)
+		_Execute(entry);
+	else
+		_Push(entry);
+}
+
+void JobSystem::_Execute(JobEntry & entry)
+{
+	entry.job();
+	_Finish(entry.counter);
+}
+
+void JobSystem::_Finish(JobCounter * counter)
+{
+	if (counter == nullptr)
+		return;
+
+	std::vector<JobEntry> released;
+	{
+		// A waiter takes the lock before it lets the counter go, so it cannot be destroyed under us
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (counter->m_count.fetch_sub(1) == 1)
+			released.swap(counter->m_continuations);
+	}
+	for (size_t i = 0; i < released.size(); i++)
+		_Schedule(released[i]);
+}
+
+void JobSystem::Run(Job job, JobCounter * counter, JobCounter * after)
+{
+	if (counter != nullptr)
+		counter->m_count.fetch_add(1);
+
+	JobEntry entry = { std::move(job), counter };
+	if (after != nullptr && _Hold(entry, after))
+		return;
+	_Schedule(entry);
+}
+
+void JobSystem::Wait(JobCounter * counter)
+{
+	while (counter->m_count.load() > 0) {
+		JobEntry entry;
+		if (mInitialized && mThreadIndex >= 0 && _Pop(mThreadIndex, entry))
+			_Execute(entry);
+		else
+			std::this_thread::yield();
+	}
+
+	// The thread that finished the last job may still be releasing its continuations
+	std::lock_guard<std::mutex> lock(counter->m_mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0)
+		return;
+
+	size_t batches = GetThreadCount() * JOB_BATCHES_PER_THREAD;
+	size_t batch = std::max(std::max(minBatch, (size_t)1), (count + batches - 1) / batches);
+	if (!mInitialized || mThreadIndex < 0 || batch >= count) {
+		body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (size_t begin = batch; begin < count; begin += batch) {
+		size_t end = std::min(begin + batch, count);
+		Run([&body, begin, end]() { body(begin, end); }, &counter);
+	}
+	body(0, batch);
+	Wait(&counter);
+}
+
+void JobSystem::Shutdown()
+{
+	if (!mInitialized)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStop = true;
+	}
+	mSleepCondition.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+
+	// Whatever was left queued runs here, on the main thread
+	mInitialized = false;
+	for (size_t i = 0; i < mQueues.size(); i++) {
+		JobQueue* queue = mQueues[i];
+		for (size_t j = 0; j < queue->count; j++)
+			_Execute(queue->jobs[(queue->head + j) % queue->jobs.size()]);
+		delete queue;
+	}
+	mQueues.clear();
+	mQueuedCount.store(0);
+}
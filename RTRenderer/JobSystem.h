@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Ranges of a parallel for are split in about this many batches per thread, so faster threads steal the rest
+const size_t JOB_BATCHES_PER_THREAD = 4;
+
+typedef std::function<void()> Job;
+
+class JobCounter;
+
+struct JobEntry {
+	Job job;
+	// Decremented once the job ran. Can be null
+	JobCounter* counter;
+};
+
+/*!
+	Number of unfinished jobs of a group.
+
+	Jobs count themselves in when they are scheduled, so Wait covers the ones that are still held by a dependency. The
+	counter has to outlive its jobs, which is what waiting on it before it goes out of scope guarantees.
+*/
+class JobCounter
+{
+private:
+	friend class JobSystem;
+
+	std::atomic<int> m_count;
+	// Guards the continuations and the last decrement
+	std::mutex m_mutex;
+	// Jobs held until the count reaches zero
+	std::vector<JobEntry> m_continuations;
+
+public:
+	JobCounter() : m_count(0) {}
+
+	bool IsDone() const { return m_count.load() == 0; }
+};
+
+/*!
+	Runs the per-frame CPU work on every core.
+
+	Every thread has its own deque of jobs: it pushes and pops at the back, where the work is still warm in its cache,
+	and the idle threads steal from the front of the others. The main thread is thread 0 and takes part whenever it
+	waits. Jobs do not touch GL, which stays on the main thread. Before Initialize, and on threads the system does not
+	own, jobs run inline.
+*/
+class JobSystem
+{
+private:
+	// Ring buffer that only grows, so a steady frame does not allocate
+	struct JobQueue {
+		std::mutex mutex;
+		std::vector<JobEntry> jobs;
+		size_t head;
+		size_t count;
+
+		JobQueue() : head(0), count(0) {}
+	};
+
+	static bool mInitialized;
+
+	static std::vector<std::thread> mWorkers;
+	// One per thread, the main thread's first
+	static std::vector<JobQueue*> mQueues;
+	// Jobs in the deques, the workers sleep while it is zero
+	static std::atomic<int> mQueuedCount;
+	static std::mutex mSleepMutex;
+	static std::condition_variable mSleepCondition;
+	static bool mStop;
+
+	// Index of the calling thread in mQueues, -1 for threads the system does not own
+	static thread_local int mThreadIndex;
+
+	static void _WorkerLoop(int index);
+	static void _Push(JobEntry& entry);
+	// Pops from the thread's own deque or steals from another one
+	static bool _Pop(int index, JobEntry& entry);
+	// Holds the job until after is done. Returns false if it already is
+	static bool _Hold(JobEntry& entry, JobCounter* after);
+	static void _Schedule(JobEntry& entry);
+	static void _Execute(JobEntry& entry);
+	// Decrements the counter and releases the jobs held by it once it reaches zero
+	static void _Finish(JobCounter* counter);
+
+public:
+	/*!
+		\n void JobSystem::Initialize(unsigned int workerCount)
+		\param unsigned int workerCount Threads besides the main one. One less than the cores when 0
+
+		Has to be called from the main thread, which becomes thread 0
+	*/
+	static void Initialize(unsigned int workerCount = 0);
+	static bool IsInitialized();
+	// Workers plus the main thread
+	static unsigned int GetThreadCount();
+
+	/*!
+		\n void JobSystem::Run(Job job, JobCounter* counter, JobCounter* after)
+		\param Job job Work to run on any thread
+		\param JobCounter* counter Counts the job until it ran. Can be null
+		\param JobCounter* after The job is held until every job of this counter ran. Can be null
+	*/
+	static void Run(Job job, JobCounter* counter = nullptr, JobCounter* after = nullptr);
+	// Runs other jobs until the counter's jobs are done
+	static void Wait(JobCounter* counter);
+
+	/*!
+		\n void JobSystem::ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t, size_t)>& body)
+		\param size_t count Size of the range
+		\param size_t minBatch Smallest number of items worth a job
+		\param const std::function<void(size_t, size_t)>& body Called with the begin and end of each batch
+
+		Splits [0, count) in batches that run in parallel and returns once all of them ran. The caller runs the first one
+	*/
+	static void ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t, size_t)>& body);
+
+	static void Shutdown();
+};
@@ -0,0 +1,153 @@
+#include "KTXFile.h"
+
+#include <string.h>
+
+static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+static const unsigned int KTX_ENDIANNESS = 0x04030201;
+
+struct KTXHeader {
+	unsigned int endianness;
+	unsigned int glType;
+	unsigned int glTypeSize;
+	unsigned int glFormat;
+	unsigned int glInternalFormat;
+	unsigned int glBaseInternalFormat;
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	unsigned int pixelDepth;
+	unsigned int numberOfArrayElements;
+	unsigned int numberOfFaces;
+	unsigned int numberOfMipmapLevels;
+	unsigned int bytesOfKeyValueData;
+};
+
+KTXFile::KTXFile() :
+	internalFormat(0),
+	baseInternalFormat(0),
+	width(0),
+	height(0)
+{
+}
+
+bool KTXFile::Read(const char * path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	unsigned char identifier[12];
+	KTXHeader header;
+	if (fread(identifier, sizeof(identifier), 1, file) != 1 || fread(&header, sizeof(header), 1, file) != 1 ||
+		memcmp(identifier, KTX_IDENTIFIER, sizeof(identifier)) != 0) {
+		printf("Invalid KTX file: %s\n", path);
+		fclose(file);
+		return false;
+	}
+
+	// Only compressed, little endian, single 2D images are produced by the cooker
+	if (header.endianness != KTX_ENDIANNESS || header.glType != 0 || header.numberOfFaces != 1 ||
+		header.numberOfArrayElements != 0 || header.pixelDepth != 0) {
+		printf("Unsupported KTX file: %s\n", path);
+		fclose(file);
+		return false;
+	}
+
+	fseek(file, header.bytesOfKeyValueData, SEEK_CUR);
+
+	internalFormat = header.glInternalFormat;
+	baseInternalFormat = header.glBaseInternalFormat;
+	width = header.pixelWidth;
+	height = header.pixelHeight;
+
+	unsigned int levelCount = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+	levels.resize(levelCount);
+	for (unsigned int i = 0; i < levelCount; i++) {
+		unsigned int imageSize = 0;
+		if (fread(&imageSize, sizeof(imageSize), 1, file) != 1) {
+			printf("Truncated KTX file: %s\n", path);
+			fclose(file);
+			return false;
+		}
+
+		levels[i].width = width >> i > 0 ? width >> i : 1;
+		levels[i].height = height >> i > 0 ? height >> i : 1;
+		levels[i].data.resize(imageSize);
+		if (imageSize > 0 && fread(levels[i].data.data(), imageSize, 1, file) != 1) {
+			printf("Truncated KTX file: %s\n", path);
+			fclose(file);
+			return false;
+		}
+
+		// Mip padding to 4 bytes
+		fseek(file, (4 - imageSize % 4) % 4, SEEK_CUR);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool KTXFile::Write(const char * path) const
+{
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		printf("Failed to open %s for writing\n", path);
+		return false;
+	}
+
+	KTXHeader header;
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = 0;
+	header.glTypeSize = 1;
+	header.glFormat = 0;
+	header.glInternalFormat = internalFormat;
+	header.glBaseInternalFormat = baseInternalFormat;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = (unsigned int)levels.size();
+	header.bytesOfKeyValueData = 0;
+
+	fwrite(KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER), 1, file);
+	fwrite(&header, sizeof(header), 1, file);
+
+	const unsigned char padding[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < levels.size(); i++) {
+		unsigned int imageSize = (unsigned int)levels[i].data.size();
+		fwrite(&imageSize, sizeof(imageSize), 1, file);
+		fwrite(levels[i].data.data(), imageSize, 1, file);
+		fwrite(padding, (4 - imageSize % 4) % 4, 1, file);
+	}
+
+	bool success = ferror(file) == 0;
+	fclose(file);
+	return success;
+}
+
+GLenum KTXFile::GetInternalFormat(BlockFormat format)
+{
+	switch (format) {
+	case BF_BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BF_BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BF_BC5:
+		return GL_COMPRESSED_RG_RGTC2;
+	case BF_BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return 0;
+}
+
+GLenum KTXFile::GetBaseInternalFormat(BlockFormat format)
+{
+	switch (format) {
+	case BF_BC1:
+		return GL_RGB;
+	case BF_BC5:
+		return GL_RG;
+	default:
+		return GL_RGBA;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "BlockCompression.h"
+
+struct KTXLevel {
+	int width;
+	int height;
+	std::vector<unsigned char> data;
+};
+
+// Reads and writes KTX 1.1 containers holding a single 2D texture with its whole mip chain.
+// https://www.khronos.org/opengles/sdk/tools/KTX/file_format_spec/
+class KTXFile
+{
+public:
+	GLenum internalFormat;
+	GLenum baseInternalFormat;
+	int width;
+	int height;
+	std::vector<KTXLevel> levels;
+
+	KTXFile();
+
+	bool Read(const char* path);
+	bool Write(const char* path) const;
+
+	static GLenum GetInternalFormat(BlockFormat format);
+	static GLenum GetBaseInternalFormat(BlockFormat format);
+};
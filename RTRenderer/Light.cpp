@@ -14,10 +14,12 @@ Light::Light(Transform * transform,
 	specularColor = glm::vec3(specRed, specGreen, specBlue);
 	specularIntensity = specIntensity;
 
-	m_staticSM = new ShadowMap();
-	
 	m_staticSM = new ShadowMap();
 	m_staticSM->Init(staticShadowWidth, staticShadowHeight);
+
+	// Usable before the first snapshot
+	for (int i = 0; i < RENDER_SNAPSHOT_COUNT; i++)
+		m_states[i] = { transform->GetPosition(), transform->GetUp(), isActive };
 }
 
 Transform * Light::GetTransform() const
@@ -58,19 +60,24 @@ void Light::SetActive(bool active) {
 	isActive = active;
 }
 
+void Light::Snapshot()
+{
+	m_states[RenderSnapshot::GetWriteIndex()] = { transform->GetPosition(), transform->GetUp(), isActive };
+}
+
 void Light::UseLight(GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation)
 {
-	if (!isActive) {
-		glUniform3f(diffuseColorLocation, 0, 0, 0);
-		glUniform3f(diffuseFactorLocation, 0, 0, 0);
-		glUniform3f(specularColorLocation, 0, 0, 0);
-		glUniform3f(specularFactorLocation, 0, 0, 0);
+	if (!_GetState().active) {
+		GLState::Uniform3f(diffuseColorLocation, 0, 0, 0);
+		GLState::Uniform3f(diffuseFactorLocation, 0, 0, 0);
+		GLState::Uniform3f(specularColorLocation, 0, 0, 0);
+		GLState::Uniform3f(specularFactorLocation, 0, 0, 0);
 		return;
 	}
-	glUniform3f(diffuseColorLocation, diffuseColor.r, diffuseColor.g, diffuseColor.b);
-	glUniform3f(diffuseFactorLocation, diffuseIntensity, diffuseIntensity, diffuseIntensity);
-	glUniform3f(specularColorLocation, specularColor.r, specularColor.g, specularColor.b);
-	glUniform3f(specularFactorLocation, specularIntensity, specularIntensity, specularIntensity);
+	GLState::Uniform3f(diffuseColorLocation, diffuseColor.r, diffuseColor.g, diffuseColor.b);
+	GLState::Uniform3f(diffuseFactorLocation, diffuseIntensity, diffuseIntensity, diffuseIntensity);
+	GLState::Uniform3f(specularColorLocation, specularColor.r, specularColor.g, specularColor.b);
+	GLState::Uniform3f(specularFactorLocation, specularIntensity, specularIntensity, specularIntensity);
 }
 
 
@@ -109,9 +116,9 @@ glm::vec3 GetDirection(glm::vec3 upVector) {
 
 void DirectionalLight::UseLight(GLuint directionLocation, GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation)
 {
-	glm::vec3 dir = glm::vec3(transform->GetUp());
+	glm::vec3 dir = _GetState().up;
 	dir = glm::normalize(-dir);
-	glUniform3f(directionLocation, dir.x, dir.y, dir.z);
+	GLState::Uniform3f(directionLocation, dir.x, dir.y, dir.z);
 	Light::UseLight(diffuseColorLocation, diffuseFactorLocation, specularColorLocation, specularFactorLocation);
 }
 
@@ -142,6 +149,8 @@ PointLight::PointLight(Transform* transform,
 	float aspect = (float)staticShadowWidth / (float)staticShadowHeight;
 	lightProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
 
+	// Replaces the 2D map created by Light, so that its target goes back to the pool
+	delete m_staticSM;
 	m_staticSM = new OmniShadowMap();
 	m_staticSM->Init(staticShadowWidth, staticShadowHeight);
 }
@@ -166,32 +175,37 @@ GLfloat PointLight::GetFarPlane() const
 	return farPlane;
 }
 
+glm::vec3 PointLight::GetPosition() const
+{
+	return _GetState().position;
+}
+
 void PointLight::UseLight(GLuint positionLocation, GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation, GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation)
 {
-	glm::vec3 position = transform->GetPosition();
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	glm::vec3 position = _GetState().position;
+	GLState::Uniform3f(positionLocation, position.x, position.y, position.z);
+	GLState::Uniform1f(constantLocation, constant);
+	GLState::Uniform1f(linearLocation, linear);
+	GLState::Uniform1f(exponentLocation, exponent);
 	Light::UseLight(diffuseColorLocation, diffuseFactorLocation, specularColorLocation, specularFactorLocation);
 }
 
-std::vector<glm::mat4> PointLight::CalculateLightTransform()
-{
-	glm::vec3 position = transform->GetPosition();
-	std::vector<glm::mat4> lightTransforms;
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(position, position + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0)));
+CubeMatrices PointLight::CalculateLightTransform()
+{
+	glm::vec3 position = _GetState().position;
+	CubeMatrices lightTransforms;
+	lightTransforms.faces[0] = lightProj *
+		glm::lookAt(position, position + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[1] = lightProj *
+		glm::lookAt(position, position + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[2] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
+	lightTransforms.faces[3] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0));
+	lightTransforms.faces[4] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[5] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
 	return lightTransforms;
 }
 
@@ -229,8 +243,8 @@ void SpotLight::UseLight(GLuint directionLocation, GLuint edgeLocation,
 	GLuint positionLocation, GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
 	GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation)
 {
-	glm::vec3 dir = glm::normalize(-transform->GetUp());
-	glUniform3f(directionLocation, dir.x, dir.y, dir.z);
-	glUniform1f(edgeLocation, procEdge);
+	glm::vec3 dir = glm::normalize(-_GetState().up);
+	GLState::Uniform3f(directionLocation, dir.x, dir.y, dir.z);
+	GLState::Uniform1f(edgeLocation, procEdge);
 	PointLight::UseLight(positionLocation, constantLocation, linearLocation, exponentLocation, diffuseColorLocation, diffuseFactorLocation, specularColorLocation, specularFactorLocation);
 }
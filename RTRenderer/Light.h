@@ -4,7 +4,16 @@
 #include <glm\glm.hpp>
 
 #include "Transform.h"
+#include "GLState.h"
 #include "ShadowMap.h"
+#include "RenderSnapshot.h"
+
+// What the lighting reads of a light, copied with every render snapshot
+struct LightState {
+	glm::vec3 position;
+	glm::vec3 up;
+	bool active;
+};
 
 class Light {
 protected:
@@ -20,6 +29,11 @@ protected:
 	glm::mat4 lightProj;
 
 	ShadowMap* m_staticSM;
+
+	LightState m_states[RENDER_SNAPSHOT_COUNT];
+
+	// State of the snapshot being drawn
+	const LightState& _GetState() const { return m_states[RenderSnapshot::GetReadIndex()]; }
 public:
 	Light(Transform* transform,
 		GLuint staticShadowWidth, GLuint staticShadowHeight,
@@ -36,6 +50,8 @@ public:
 
 	bool IsActive() const;
 	void SetActive(bool active);
+	// Copies the transform and the active flag into the snapshot being written
+	void Snapshot();
 
 	void UseLight(GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation);
 };
@@ -79,10 +95,12 @@ public:
 	GLfloat GetLinear() const;
 	GLfloat GetExponent() const;
 	GLfloat GetFarPlane() const;
+	// Position in the snapshot being drawn
+	glm::vec3 GetPosition() const;
 
 	void UseLight(GLuint positionLocation, GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation, GLuint diffuseColorLocation, GLuint diffuseFactorLocation, GLuint specularColorLocation, GLuint specularFactorLocation);
 
-	std::vector<glm::mat4> CalculateLightTransform();
+	CubeMatrices CalculateLightTransform();
 };
 
 class SpotLight : public PointLight
@@ -2,34 +2,34 @@
 
 Material::Material()
 {
+	m_id = -1;
 	specularIntensity = 0;
 	shininess = 0;
 	albedoRed = 1.0f;
 	albedoGreen = 1.0f;
 	albedoBlue = 1.0f;
 	albedoAlpha = 1.0f;
+	reflectivity = 0.0f;
+	albedo = nullptr;
 }
 
-Material::Material(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue, Texture* albedo)
+Material::Material(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue, Texture* albedo, GLfloat reflectivity)
 {
+	m_id = -1;
 	this->specularIntensity = specularIntensity;
 	this->shininess = shininess;
 	albedoRed = red;
 	albedoGreen = green;
 	albedoBlue = blue;
 	albedoAlpha = 1.0f;
+	this->reflectivity = reflectivity;
 	this->albedo = albedo;
 }
 
-void Material::SetAlbedo(Texture* albedo) {
-	this->albedo = albedo;
-}
-
-void Material::UseMaterial(unsigned int specularIntensityLocation, unsigned int shininessLocation, unsigned int albedoLocation)
+void Material::UseMaterial(GLint materialIDLocation)
 {
-	glUniform1f(specularIntensityLocation, specularIntensity);
-	glUniform1f(shininessLocation, shininess);
-	glUniform3f(albedoLocation, albedoRed, albedoGreen, albedoBlue);
+	// The parameters live in the material table, consecutive draws with the same material skip this upload
+	GLState::Uniform1i(materialIDLocation, m_id);
 
 	if(this->albedo != nullptr)
 		this->albedo->UseTexture();
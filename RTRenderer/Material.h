@@ -3,24 +3,41 @@
 #include <GL\glew.h>
 
 #include "Texture.h"
+#include "GLState.h"
 
+// Materials are created through MaterialTable::Intern, which shares identical materials and uploads their
+// parameters to the GPU. A material is then selected in the shaders by its ID alone
 class Material
 {
 private:
+	friend class MaterialTable;
+
+	// Index in the material table, -1 until interned
+	int m_id;
+
 	GLfloat specularIntensity;
 	GLfloat shininess;
 	GLfloat albedoRed;
 	GLfloat albedoGreen;
 	GLfloat albedoBlue;
 	GLfloat albedoAlpha;
+	// How much of the baked reflection probe shows on the surface
+	GLfloat reflectivity;
 	Texture* albedo;
 
 public:
 	Material();
-	Material(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue, Texture* albedo = nullptr);
+	Material(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue, Texture* albedo = nullptr, GLfloat reflectivity = 0.0f);
 
-	void SetAlbedo(Texture* albedo);
-	void UseMaterial(unsigned int specularIntensityLocation, unsigned int shininessLocation, unsigned int albedoLocation);
+	int GetID() const { return m_id; }
+	Texture* GetAlbedo() const { return albedo; }
+	GLfloat GetSpecularIntensity() const { return specularIntensity; }
+	GLfloat GetShininess() const { return shininess; }
+	GLfloat GetRed() const { return albedoRed; }
+	GLfloat GetGreen() const { return albedoGreen; }
+	GLfloat GetBlue() const { return albedoBlue; }
+	GLfloat GetReflectivity() const { return reflectivity; }
+	void UseMaterial(GLint materialIDLocation);
 
 	~Material();
-};
\ No newline at end of file
+};
@@ -0,0 +1,89 @@
+#include "MaterialTable.h"
+
+#include <stdio.h>
+
+std::vector<Material*> MaterialTable::mMaterials;
+GLuint MaterialTable::mBuffer = 0;
+size_t MaterialTable::mUploaded = 0;
+
+bool MaterialTable::_Equals(const Material * material, GLfloat specularIntensity, GLfloat shininess,
+	GLfloat red, GLfloat green, GLfloat blue, Texture * albedo, GLfloat reflectivity)
+{
+	return material->specularIntensity == specularIntensity &&
+		material->shininess == shininess &&
+		material->albedoRed == red &&
+		material->albedoGreen == green &&
+		material->albedoBlue == blue &&
+		material->albedo == albedo &&
+		material->reflectivity == reflectivity;
+}
+
+Material * MaterialTable::Intern(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue,
+	Texture * albedo, GLfloat reflectivity)
+{
+	for (size_t i = 0; i < mMaterials.size(); i++) {
+		if (_Equals(mMaterials[i], specularIntensity, shininess, red, green, blue, albedo, reflectivity))
+			return mMaterials[i];
+	}
+
+	if (mMaterials.size() >= (size_t)MAX_MATERIALS) {
+		printf("Material table is full (%d materials), reusing the first material\n", MAX_MATERIALS);
+		return mMaterials[0];
+	}
+
+	Material* material = ObjectPool<Material>::Create(specularIntensity, shininess, red, green, blue, albedo, reflectivity);
+	material->m_id = (int)mMaterials.size();
+	mMaterials.push_back(material);
+	return material;
+}
+
+void MaterialTable::Update()
+{
+	if (mBuffer == 0) {
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialData) * MAX_MATERIALS, nullptr, GL_STATIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TABLE_BINDING, mBuffer);
+	}
+
+	if (mUploaded == mMaterials.size())
+		return;
+
+	// Materials never change once interned, only the new ones are sent
+	std::vector<MaterialData> data(mMaterials.size() - mUploaded);
+	for (size_t i = 0; i < data.size(); i++) {
+		Material* material = mMaterials[mUploaded + i];
+		data[i].albedo[0] = material->albedoRed;
+		data[i].albedo[1] = material->albedoGreen;
+		data[i].albedo[2] = material->albedoBlue;
+		data[i].albedo[3] = material->albedoAlpha;
+		data[i].parameters[0] = material->specularIntensity;
+		data[i].parameters[1] = material->shininess;
+		data[i].parameters[2] = material->reflectivity;
+		data[i].parameters[3] = 0.0f;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(MaterialData) * mUploaded, sizeof(MaterialData) * data.size(), data.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	mUploaded = mMaterials.size();
+}
+
+void MaterialTable::Clear()
+{
+	for (size_t i = 0; i < mMaterials.size(); i++)
+		ObjectPool<Material>::Destroy(mMaterials[i]);
+	mMaterials.clear();
+	mUploaded = 0;
+
+	if (mBuffer != 0)
+		glDeleteBuffers(1, &mBuffer);
+	mBuffer = 0;
+}
+
+void MaterialTable::BindBlock(GLuint program)
+{
+	GLuint blockIndex = glGetUniformBlockIndex(program, "MaterialTable");
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, blockIndex, MATERIAL_TABLE_BINDING);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "Commons.h"
+#include "Material.h"
+#include "Texture.h"
+#include "ObjectPool.h"
+
+// One entry of the MaterialTable uniform block, laid out with std140
+struct MaterialData {
+	// rgb: albedo, a: alpha
+	GLfloat albedo[4];
+	// x: specular intensity, y: shininess, z: reflectivity
+	GLfloat parameters[4];
+};
+
+/*!
+	Owns every material of the scene.
+
+	Materials with the same parameters and albedo texture are created once and shared. Their parameters are kept in
+	a uniform buffer bound to MATERIAL_TABLE_BINDING, which the shaders index with u_materialID, so switching
+	material only changes one integer uniform (and the albedo texture, when it has one).
+*/
+class MaterialTable
+{
+private:
+	static std::vector<Material*> mMaterials;
+	static GLuint mBuffer;
+	// First entry that has not been uploaded yet
+	static size_t mUploaded;
+
+	static bool _Equals(const Material* material, GLfloat specularIntensity, GLfloat shininess,
+		GLfloat red, GLfloat green, GLfloat blue, Texture* albedo, GLfloat reflectivity);
+public:
+	/*!
+		\n Material* MaterialTable::Intern(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue, Texture* albedo, GLfloat reflectivity)
+
+		Returns the material with these parameters, creating it if there is none yet. The table owns the material,
+		it must not be deleted nor modified by the caller
+	*/
+	static Material* Intern(GLfloat specularIntensity, GLfloat shininess, GLfloat red, GLfloat green, GLfloat blue,
+		Texture* albedo = nullptr, GLfloat reflectivity = 0.0f);
+
+	static size_t GetCount() { return mMaterials.size(); }
+
+	// Uploads the materials added since the last call and binds the table. Call before rendering
+	static void Update();
+
+	// Deletes every material and the uniform buffer
+	static void Clear();
+
+	// Points the MaterialTable block of a program at MATERIAL_TABLE_BINDING. Does nothing if the program does not use it
+	static void BindBlock(GLuint program);
+};
@@ -0,0 +1,128 @@
+#include "MatrixBenchmark.h"
+
+#include <stdio.h>
+#include <float.h>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include <glm\gtx\component_wise.hpp>
+
+#include "MatrixKernels.h"
+#include "Transform.h"
+
+double MatrixBenchmark::_Lap()
+{
+	static std::chrono::high_resolution_clock::time_point last = std::chrono::high_resolution_clock::now();
+	std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+	double nanoseconds = std::chrono::duration<double, std::nano>(now - last).count();
+	last = now;
+	return nanoseconds;
+}
+
+float MatrixBenchmark::_Difference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+{
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.size(); i++) {
+		for (int j = 0; j < 4; j++)
+			difference = std::max(difference, glm::compMax(glm::abs(a[i][j] - b[i][j])));
+	}
+	return difference;
+}
+
+float MatrixBenchmark::_Difference(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b)
+{
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.size(); i++)
+		difference = std::max(difference, glm::compMax(glm::abs(a[i] - b[i])));
+	return difference;
+}
+
+void MatrixBenchmark::Run(size_t count)
+{
+	// A scene's worth of placements, parented to a moved and scaled root
+	std::vector<glm::vec3> positions(count);
+	std::vector<glm::quat> rotations(count);
+	std::vector<float> scales(count);
+	std::vector<glm::mat4> locals(count);
+	for (size_t i = 0; i < count; i++) {
+		float angle = (float)i * 0.01f;
+		positions[i] = glm::vec3(std::sin(angle) * 50.0f, (float)(i % 100), std::cos(angle) * 50.0f);
+		rotations[i] = Transform::EulerToQuaternion(angle * 0.3f, angle, angle * 0.7f);
+		scales[i] = 0.5f + (float)(i % 7) * 0.25f;
+		locals[i] = glm::translate(glm::mat4(), positions[i]) * glm::mat4_cast(rotations[i]);
+	}
+	glm::mat4 parent = glm::scale(glm::translate(glm::mat4(), glm::vec3(10.0f, -2.0f, 4.0f)) *
+		glm::mat4_cast(Transform::EulerToQuaternion(0.2f, 1.1f, 0.0f)), glm::vec3(2.0f));
+	glm::vec3 boxMin(-1.0f, 0.0f, -0.5f), boxMax(1.0f, 3.0f, 0.5f);
+
+	std::vector<const glm::mat4*> localPointers(count);
+	std::vector<glm::mat4*> resultPointers(count);
+	std::vector<glm::mat4> products(count), composed(count), results(count);
+	std::vector<glm::vec3> boxMins(count), boxMaxs(count), resultMins(count), resultMaxs(count);
+	for (size_t i = 0; i < count; i++) {
+		localPointers[i] = &locals[i];
+		resultPointers[i] = &results[i];
+	}
+	double matrices = (double)count * MATRIX_BENCHMARK_REPEATS;
+
+	printf("Matrix kernels, %zu matrices, %d times, in ns per matrix:\n", count, MATRIX_BENCHMARK_REPEATS);
+	printf("  %-8s %10s %10s %10s\n", "", "multiply", "compose", "boxes");
+
+	// The way the hierarchy and the culling did it, one glm call at a time
+	_Lap();
+	for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++) {
+		for (size_t i = 0; i < count; i++)
+			products[i] = parent * locals[i];
+	}
+	double multiply = _Lap() / matrices;
+	for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++) {
+		for (size_t i = 0; i < count; i++)
+			composed[i] = glm::scale(glm::translate(glm::mat4(), positions[i]) * glm::mat4_cast(rotations[i]), glm::vec3(scales[i]));
+	}
+	double compose = _Lap() / matrices;
+	for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++) {
+		for (size_t i = 0; i < count; i++) {
+			glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec3 point((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+				glm::vec3 world = glm::vec3(products[i] * glm::vec4(point, 1.0f));
+				lower = glm::min(lower, world);
+				upper = glm::max(upper, world);
+			}
+			boxMins[i] = lower;
+			boxMaxs[i] = upper;
+		}
+	}
+	double boxes = _Lap() / matrices;
+	printf("  %-8s %10.2f %10.2f %10.2f\n", "glm", multiply, compose, boxes);
+
+	MatrixInstructionSet supported = MatrixKernels::GetSupportedInstructionSet();
+	for (int set = MATRIX_SCALAR; set <= supported; set++) {
+		MatrixKernels::SetInstructionSet((MatrixInstructionSet)set);
+
+		_Lap();
+		for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++)
+			MatrixKernels::Multiply(parent, &localPointers[0], &resultPointers[0], count);
+		multiply = _Lap() / matrices;
+		float multiplyError = _Difference(results, products);
+
+		_Lap();
+		for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++)
+			MatrixKernels::Compose(&positions[0], &rotations[0], &scales[0], &results[0], count);
+		compose = _Lap() / matrices;
+		float composeError = _Difference(results, composed);
+
+		_Lap();
+		for (int repeat = 0; repeat < MATRIX_BENCHMARK_REPEATS; repeat++)
+			MatrixKernels::TransformBoxes(&products[0], sizeof(glm::mat4), boxMin, boxMax, &resultMins[0], &resultMaxs[0], count);
+		boxes = _Lap() / matrices;
+		float boxError = std::max(_Difference(resultMins, boxMins), _Difference(resultMaxs, boxMaxs));
+
+		printf("  %-8s %10.2f %10.2f %10.2f   (largest difference to glm %g)\n", MatrixKernels::GetName((MatrixInstructionSet)set),
+			multiply, compose, boxes, std::max(multiplyError, std::max(composeError, boxError)));
+	}
+
+	MatrixKernels::SetInstructionSet(supported);
+	printf("The renderer uses the %s kernels\n", MatrixKernels::GetName(supported));
+}
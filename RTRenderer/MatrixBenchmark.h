@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+// Matrices every step of the matrix benchmark goes through
+const size_t MATRIX_BENCHMARK_MATRICES = 100000;
+// Times each step runs, so the timings are not just the first cache misses
+const int MATRIX_BENCHMARK_REPEATS = 20;
+
+/*!
+	Micro-benchmark of MatrixKernels, run from the menu instead of a program.
+
+	Times the products of a parent with many local matrices, the composition of positions and rotations into
+	matrices and the boxes moved by many matrices, first the way glm does them one at a time, then with the kernels of
+	every instruction set the CPU supports. Prints nanoseconds per matrix and how far each set is from glm. Needs no
+	window nor GL context.
+*/
+class MatrixBenchmark
+{
+private:
+	// Nanoseconds since the last call
+	static double _Lap();
+	// Largest difference between the elements of two lists of matrices
+	static float _Difference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b);
+	static float _Difference(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b);
+public:
+	static void Run(size_t count = MATRIX_BENCHMARK_MATRICES);
+};
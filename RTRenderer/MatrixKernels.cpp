@@ -0,0 +1,322 @@
+#include "MatrixKernels.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MATRIX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC emits AVX instructions for the intrinsics of any function
+#define AVX_FUNCTION
+#else
+#include <cpuid.h>
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+#endif
+
+// -- Scalar --
+
+static void MultiplyScalar(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		*results[i] = parent * *locals[i];
+}
+
+static void ComposeScalar(const glm::vec3* positions, const glm::quat* rotations, const float* scales, glm::mat4* results,
+	size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		glm::mat4 matrix = glm::mat4_cast(rotations[i]);
+		if (scales != nullptr) {
+			matrix[0] *= scales[i];
+			matrix[1] *= scales[i];
+			matrix[2] *= scales[i];
+		}
+		matrix[3] = glm::vec4(positions[i], 1.0f);
+		results[i] = matrix;
+	}
+}
+
+static void TransformBoxesScalar(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3* resultMins,
+	glm::vec3* resultMaxs, size_t count)
+{
+	// The center moves with the matrix, the half extents with its absolute value
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+	for (size_t i = 0; i < count; i++) {
+		const glm::mat4& matrix = *reinterpret_cast<const glm::mat4*>(reinterpret_cast<const char*>(matrices) + i * stride);
+		glm::vec3 worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+		glm::vec3 worldExtent = glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y +
+			glm::abs(glm::vec3(matrix[2])) * extent.z;
+		resultMins[i] = worldCenter - worldExtent;
+		resultMaxs[i] = worldCenter + worldExtent;
+	}
+}
+
+#ifdef MATRIX_KERNELS_X86
+
+// -- SSE --
+
+static void MultiplySSE(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count)
+{
+	const float* a = &parent[0][0];
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	for (size_t i = 0; i < count; i++) {
+		const float* b = &(*locals[i])[0][0];
+		float* result = &(*results[i])[0][0];
+		__m128 b0 = _mm_loadu_ps(b);
+		__m128 b1 = _mm_loadu_ps(b + 4);
+		__m128 b2 = _mm_loadu_ps(b + 8);
+		__m128 b3 = _mm_loadu_ps(b + 12);
+
+		// Every column of the product is the parent's columns weighted by a column of the local matrix
+		__m128 columns[4] = { b0, b1, b2, b3 };
+		for (int j = 0; j < 4; j++) {
+			__m128 column = columns[j];
+			__m128 sum = _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(result + j * 4, sum);
+		}
+	}
+}
+
+static void ComposeSSE(const glm::vec3* positions, const glm::quat* rotations, const float* scales, glm::mat4* results,
+	size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	// Four rotations at a time, one lane each
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(&rotations[i].x);
+		__m128 y = _mm_loadu_ps(&rotations[i + 1].x);
+		__m128 z = _mm_loadu_ps(&rotations[i + 2].x);
+		__m128 w = _mm_loadu_ps(&rotations[i + 3].x);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 scale = scales != nullptr ? _mm_loadu_ps(scales + i) : one;
+		__m128 twoScale = _mm_mul_ps(two, scale);
+
+		// Rows of the columns, as glm::mat3_cast builds them
+		__m128 m00 = _mm_sub_ps(scale, _mm_mul_ps(twoScale, _mm_add_ps(yy, zz)));
+		__m128 m01 = _mm_mul_ps(twoScale, _mm_add_ps(xy, wz));
+		__m128 m02 = _mm_mul_ps(twoScale, _mm_sub_ps(xz, wy));
+		__m128 m10 = _mm_mul_ps(twoScale, _mm_sub_ps(xy, wz));
+		__m128 m11 = _mm_sub_ps(scale, _mm_mul_ps(twoScale, _mm_add_ps(xx, zz)));
+		__m128 m12 = _mm_mul_ps(twoScale, _mm_add_ps(yz, wx));
+		__m128 m20 = _mm_mul_ps(twoScale, _mm_add_ps(xz, wy));
+		__m128 m21 = _mm_mul_ps(twoScale, _mm_sub_ps(yz, wx));
+		__m128 m22 = _mm_sub_ps(scale, _mm_mul_ps(twoScale, _mm_add_ps(xx, yy)));
+
+		// Back to one matrix per register set
+		__m128 zero0 = zero, zero1 = zero, zero2 = zero;
+		_MM_TRANSPOSE4_PS(m00, m01, m02, zero0);
+		_MM_TRANSPOSE4_PS(m10, m11, m12, zero1);
+		_MM_TRANSPOSE4_PS(m20, m21, m22, zero2);
+		__m128 columns0[4] = { m00, m01, m02, zero0 };
+		__m128 columns1[4] = { m10, m11, m12, zero1 };
+		__m128 columns2[4] = { m20, m21, m22, zero2 };
+		for (int j = 0; j < 4; j++) {
+			float* result = &results[i + j][0][0];
+			_mm_storeu_ps(result, columns0[j]);
+			_mm_storeu_ps(result + 4, columns1[j]);
+			_mm_storeu_ps(result + 8, columns2[j]);
+			results[i + j][3] = glm::vec4(positions[i + j], 1.0f);
+		}
+	}
+
+	ComposeScalar(positions + i, rotations + i, scales != nullptr ? scales + i : nullptr, results + i, count - i);
+}
+
+static void TransformBoxesSSE(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3* resultMins,
+	glm::vec3* resultMaxs, size_t count)
+{
+	const __m128 signs = _mm_set1_ps(-0.0f);
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+
+	for (size_t i = 0; i < count; i++) {
+		const float* matrix = reinterpret_cast<const float*>(reinterpret_cast<const char*>(matrices) + i * stride);
+		__m128 m0 = _mm_loadu_ps(matrix);
+		__m128 m1 = _mm_loadu_ps(matrix + 4);
+		__m128 m2 = _mm_loadu_ps(matrix + 8);
+		__m128 m3 = _mm_loadu_ps(matrix + 12);
+
+		__m128 worldCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, cx), _mm_mul_ps(m1, cy)), _mm_add_ps(_mm_mul_ps(m2, cz), m3));
+		__m128 worldExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signs, m0), ex), _mm_mul_ps(_mm_andnot_ps(signs, m1), ey)),
+			_mm_mul_ps(_mm_andnot_ps(signs, m2), ez));
+
+		float lower[4], upper[4];
+		_mm_storeu_ps(lower, _mm_sub_ps(worldCenter, worldExtent));
+		_mm_storeu_ps(upper, _mm_add_ps(worldCenter, worldExtent));
+		resultMins[i] = glm::vec3(lower[0], lower[1], lower[2]);
+		resultMaxs[i] = glm::vec3(upper[0], upper[1], upper[2]);
+	}
+}
+
+// -- AVX --
+
+AVX_FUNCTION static void MultiplyAVX(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count)
+{
+	// The parent's columns in both halves, so two columns of the product are built at once
+	const float* a = &parent[0][0];
+	__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a));
+	__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 4));
+	__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 8));
+	__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 12));
+
+	for (size_t i = 0; i < count; i++) {
+		const float* b = &(*locals[i])[0][0];
+		float* result = &(*results[i])[0][0];
+		__m256 b01 = _mm256_loadu_ps(b);
+		__m256 b23 = _mm256_loadu_ps(b + 8);
+
+		__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(0, 0, 0, 0)));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(1, 1, 1, 1))));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(2, 2, 2, 2))));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(3, 3, 3, 3))));
+
+		__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(0, 0, 0, 0)));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(1, 1, 1, 1))));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(2, 2, 2, 2))));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_shuffle_ps(b23, b23, _MM_SHUFFLE(3, 3, 3, 3))));
+
+		_mm256_storeu_ps(result, r01);
+		_mm256_storeu_ps(result + 8, r23);
+	}
+	_mm256_zeroupper();
+}
+
+AVX_FUNCTION static void TransformBoxesAVX(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax,
+	glm::vec3* resultMins, glm::vec3* resultMaxs, size_t count)
+{
+	const __m256 signs = _mm256_set1_ps(-0.0f);
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+	__m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y), cz = _mm256_set1_ps(center.z);
+	__m256 ex = _mm256_set1_ps(extent.x), ey = _mm256_set1_ps(extent.y), ez = _mm256_set1_ps(extent.z);
+
+	// Two matrices at a time, one per half
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const float* first = reinterpret_cast<const float*>(reinterpret_cast<const char*>(matrices) + i * stride);
+		const float* second = reinterpret_cast<const float*>(reinterpret_cast<const char*>(matrices) + (i + 1) * stride);
+		__m256 m[4];
+		for (int j = 0; j < 4; j++)
+			m[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(first + j * 4)), _mm_loadu_ps(second + j * 4), 1);
+
+		__m256 worldCenter = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], cx), _mm256_mul_ps(m[1], cy)),
+			_mm256_add_ps(_mm256_mul_ps(m[2], cz), m[3]));
+		__m256 worldExtent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signs, m[0]), ex),
+			_mm256_mul_ps(_mm256_andnot_ps(signs, m[1]), ey)), _mm256_mul_ps(_mm256_andnot_ps(signs, m[2]), ez));
+
+		float lower[8], upper[8];
+		_mm256_storeu_ps(lower, _mm256_sub_ps(worldCenter, worldExtent));
+		_mm256_storeu_ps(upper, _mm256_add_ps(worldCenter, worldExtent));
+		resultMins[i] = glm::vec3(lower[0], lower[1], lower[2]);
+		resultMaxs[i] = glm::vec3(upper[0], upper[1], upper[2]);
+		resultMins[i + 1] = glm::vec3(lower[4], lower[5], lower[6]);
+		resultMaxs[i + 1] = glm::vec3(upper[4], upper[5], upper[6]);
+	}
+	_mm256_zeroupper();
+
+	if (i < count) {
+		const glm::mat4* last = reinterpret_cast<const glm::mat4*>(reinterpret_cast<const char*>(matrices) + i * stride);
+		TransformBoxesSSE(last, stride, boxMin, boxMax, resultMins + i, resultMaxs + i, 1);
+	}
+}
+
+#endif
+
+MatrixInstructionSet MatrixKernels::mSupported = MatrixKernels::_Detect();
+MatrixKernels::MultiplyKernel MatrixKernels::mMultiply = MultiplyScalar;
+MatrixKernels::ComposeKernel MatrixKernels::mCompose = ComposeScalar;
+MatrixKernels::BoxKernel MatrixKernels::mTransformBoxes = TransformBoxesScalar;
+// Initialized last, so the kernels of the best set are in place before the first transform is made
+MatrixInstructionSet MatrixKernels::mInstructionSet = MatrixKernels::SetInstructionSet(MatrixKernels::mSupported);
+
+MatrixInstructionSet MatrixKernels::_Detect()
+{
+#ifdef MATRIX_KERNELS_X86
+	unsigned int features[4] = { 0, 0, 0, 0 };
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	for (int i = 0; i < 4; i++)
+		features[i] = (unsigned int)info[i];
+#else
+	__get_cpuid(1, &features[0], &features[1], &features[2], &features[3]);
+#endif
+
+	bool sse = (features[3] & (1u << 25)) != 0;
+	// AVX needs the OS to save the upper halves of the registers, which it says through OSXSAVE and XCR0
+	bool avx = (features[2] & (1u << 28)) != 0 && (features[2] & (1u << 27)) != 0;
+	if (avx) {
+#if defined(_MSC_VER)
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+		avx = (xcr0 & 6) == 6;
+	}
+
+	if (avx)
+		return MATRIX_AVX;
+	if (sse)
+		return MATRIX_SSE;
+#endif
+	return MATRIX_SCALAR;
+}
+
+MatrixInstructionSet MatrixKernels::SetInstructionSet(MatrixInstructionSet instructionSet)
+{
+	if (instructionSet > mSupported)
+		instructionSet = mSupported;
+
+	mMultiply = MultiplyScalar;
+	mCompose = ComposeScalar;
+	mTransformBoxes = TransformBoxesScalar;
+#ifdef MATRIX_KERNELS_X86
+	if (instructionSet == MATRIX_SSE) {
+		mMultiply = MultiplySSE;
+		mCompose = ComposeSSE;
+		mTransformBoxes = TransformBoxesSSE;
+	}
+	else if (instructionSet == MATRIX_AVX) {
+		// A rotation is too small for eight lanes, composing stays on SSE
+		mMultiply = MultiplyAVX;
+		mCompose = ComposeSSE;
+		mTransformBoxes = TransformBoxesAVX;
+	}
+#endif
+
+	mInstructionSet = instructionSet;
+	return instructionSet;
+}
+
+const char* MatrixKernels::GetName(MatrixInstructionSet instructionSet)
+{
+	switch (instructionSet) {
+	case MATRIX_SSE:
+		return "SSE";
+	case MATRIX_AVX:
+		return "AVX";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+// Instruction sets the kernels are written for, from the slowest
+enum MatrixInstructionSet {
+	// Plain glm, which every CPU runs
+	MATRIX_SCALAR,
+	MATRIX_SSE,
+	MATRIX_AVX
+};
+
+/*!
+	Batched 4x4 matrix math for the hierarchy and culling.
+
+	Every kernel works on a whole batch, so the function behind it is picked once per batch: the scalar ones use glm,
+	the SSE ones keep a matrix column per register and the AVX ones two, or two matrices side by side. The fastest set
+	the CPU and the OS support is picked when the program starts and can be lowered with SetInstructionSet, which is
+	how the matrix benchmark compares them. Matrices are read and written unaligned, as glm lays them out
+*/
+class MatrixKernels
+{
+private:
+	typedef void(*MultiplyKernel)(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count);
+	typedef void(*ComposeKernel)(const glm::vec3* positions, const glm::quat* rotations, const float* scales, glm::mat4* results,
+		size_t count);
+	typedef void(*BoxKernel)(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3* resultMins,
+		glm::vec3* resultMaxs, size_t count);
+
+	static MatrixInstructionSet mSupported;
+	static MatrixInstructionSet mInstructionSet;
+	static MultiplyKernel mMultiply;
+	static ComposeKernel mCompose;
+	static BoxKernel mTransformBoxes;
+
+	// Best set the CPU has and the OS saves the registers of
+	static MatrixInstructionSet _Detect();
+
+public:
+	// Picks the kernels of an instruction set, or of the best supported one below it. Returns the set picked
+	static MatrixInstructionSet SetInstructionSet(MatrixInstructionSet instructionSet);
+	static MatrixInstructionSet GetInstructionSet() { return mInstructionSet; }
+	static MatrixInstructionSet GetSupportedInstructionSet() { return mSupported; }
+	static const char* GetName(MatrixInstructionSet instructionSet);
+
+	/*!
+		\n void MatrixKernels::Multiply(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count)
+		\param const glm::mat4& parent Left matrix of every product
+		\param const glm::mat4* const* locals Right matrix of each product
+		\param glm::mat4* const* results Where each product is written. Can be the local matrix itself
+
+		results[i] = parent * locals[i]. The matrices are reached through pointers, so they can live in the transforms
+	*/
+	static void Multiply(const glm::mat4& parent, const glm::mat4* const* locals, glm::mat4* const* results, size_t count) {
+		mMultiply(parent, locals, results, count);
+	}
+
+	/*!
+		\n void MatrixKernels::Compose(const glm::vec3* positions, const glm::quat* rotations, const float* scales, glm::mat4* results, size_t count)
+		\param const float* scales Uniform scale of each matrix. Null for no scale
+		\param const glm::quat* rotations Unit quaternions
+
+		results[i] = translate(positions[i]) * mat4_cast(rotations[i]) * scale(scales[i])
+	*/
+	static void Compose(const glm::vec3* positions, const glm::quat* rotations, const float* scales, glm::mat4* results, size_t count) {
+		mCompose(positions, rotations, scales, results, count);
+	}
+
+	/*!
+		\n void MatrixKernels::TransformBoxes(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3* resultMins, glm::vec3* resultMaxs, size_t count)
+		\param const glm::mat4* matrices First affine matrix
+		\param size_t stride Bytes from one matrix to the next, so they can be read out of larger structs
+		\param glm::vec3 boxMin Corner of the box every matrix moves
+
+		Axis aligned box around the box moved by each matrix
+	*/
+	static void TransformBoxes(const glm::mat4* matrices, size_t stride, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3* resultMins,
+		glm::vec3* resultMaxs, size_t count) {
+		mTransformBoxes(matrices, stride, boxMin, boxMax, resultMins, resultMaxs, count);
+	}
+};
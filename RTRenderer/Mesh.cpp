@@ -1,5 +1,8 @@
 #include "Mesh.h"
 
+#include <float.h>
+#include <algorithm>
+
 const int InfoInVertex = 8;
 
 int VerticesCounter::nNumTriangles = 0;
@@ -21,9 +24,14 @@ Mesh::Mesh(MeshInfo * info) :
 	VAO(0),
 	VBO(0),
 	EBO(0),
+	LBO(0),
 	indexCount(0),
 	triangleCounter(0),
 	texture(nullptr),
+	m_boundingRadius(0.0f),
+	m_boundsMin(0.0f),
+	m_boundsMax(0.0f),
+	m_uvScale(1.0f),
 	meshInfo(info)
 {
 	
@@ -45,12 +53,33 @@ void Mesh::SetTexture(Texture * tex)
 }
 
 void Mesh::Load() {
+	if (meshInfo == nullptr)
+		return;
+
 	indexCount = meshInfo->numOfIndices;
 	triangleCounter = meshInfo->numOfIndices / 3;
 
+	// Bounds used to estimate how big the mesh, and its texture, are on screen
+	glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (unsigned int i = 0; i + InfoInVertex <= meshInfo->numOfVertices; i += InfoInVertex) {
+		const GLfloat* vertex = &meshInfo->vertices[i];
+		glm::vec3 position(vertex[0], vertex[1], vertex[2]);
+		m_boundingRadius = std::max(m_boundingRadius, glm::length(position));
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+		uvMin = glm::min(uvMin, glm::vec2(vertex[3], vertex[4]));
+		uvMax = glm::max(uvMax, glm::vec2(vertex[3], vertex[4]));
+	}
+	if (meshInfo->numOfVertices >= InfoInVertex) {
+		m_uvScale = std::max(std::max(uvMax.x - uvMin.x, uvMax.y - uvMin.y), 0.001f);
+		m_boundsMin = boundsMin;
+		m_boundsMax = boundsMax;
+	}
+
 	// Bind mesh values
 	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	GLState::BindVertexArray(VAO);
 
 	glGenBuffers(1, &EBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -67,11 +96,22 @@ void Mesh::Load() {
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(meshInfo->vertices[0]) * InfoInVertex, (void*)(sizeof(meshInfo->vertices[0]) * 5));
 	glEnableVertexAttribArray(2);
 
-	// Unbind this mesh's values
+	if (meshInfo->layers != nullptr) {
+		glGenBuffers(1, &LBO);
+		glBindBuffer(GL_ARRAY_BUFFER, LBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(meshInfo->layers[0]) * (meshInfo->numOfVertices / InfoInVertex), meshInfo->layers, GL_STATIC_DRAW);
+		glVertexAttribPointer(LAYER_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, 0, 0);
+		glEnableVertexAttribArray(LAYER_ATTRIBUTE);
+	}
+
+	// Unbind this mesh's values. The element buffer binding is part of the VAO so it must stay bound until the VAO is unbound
+	GLState::BindVertexArray(0);
+
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	glBindVertexArray(0);
+	// The GPU has its own copy, and the info does not outlive the caller's scope
+	meshInfo = nullptr;
 }
 
 void Mesh::Render() {
@@ -82,11 +122,10 @@ void Mesh::Render() {
 	if (texture)
 		texture->UseTexture();
 
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	// The VAO stays bound after the draw, the next mesh rebinds only if it is a different one
+	GLState::BindVertexArray(VAO);
 	glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	Profiler::Count(PC_DRAW_CALLS);
 }
 
 void Mesh::Clear() {
@@ -98,8 +137,12 @@ void Mesh::Clear() {
 		glDeleteBuffers(1, &VBO);
 		VBO = 0;
 	}
+	if (LBO != 0) {
+		glDeleteBuffers(1, &LBO);
+		LBO = 0;
+	}
 	if (VAO != 0) {
-		glDeleteVertexArrays(1, &VAO);
+		GLState::DeleteVertexArray(VAO);
 		VAO = 0;
 	}
 
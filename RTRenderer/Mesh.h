@@ -8,11 +8,16 @@
 #include "Camera.h"
 #include "Texture.h"
 
+// Vertex attribute holding the texture array layer of each vertex
+const GLuint LAYER_ATTRIBUTE = 3;
+
 struct MeshInfo {
 	GLfloat *vertices;
 	unsigned int *indices;
 	unsigned int numOfVertices;
 	unsigned int numOfIndices;
+	// Optional texture array layer of every vertex. Meshes without it sample their own 2D texture
+	GLfloat *layers = nullptr;
 };
 
 class Mesh;
@@ -38,25 +43,40 @@ private:
 	GLuint VBO;
 	//! Element buffer
 	GLuint EBO;
+	//! Layer buffer
+	GLuint LBO;
 	//! Number of indices
 	GLsizei indexCount;
 	// ! Number of vertices
 	unsigned int triangleCounter;
 	//! Shader to be applied to this model
 	Texture* texture;
+	//! Distance from the origin to the farthest vertex
+	float m_boundingRadius;
+	//! Box around the vertices
+	glm::vec3 m_boundsMin;
+	glm::vec3 m_boundsMax;
+	//! Largest texture coordinate range, i.e. how many times the texture repeats across the mesh
+	float m_uvScale;
 
+	//! Vertices to upload. Usually on the caller's stack, so only valid until Load, which clears it
 	MeshInfo* meshInfo;
 public:
-	//! Constructor
+	//! Constructor. info has to stay alive until Load
 	Mesh(MeshInfo* info);
 
 	Texture* GetTexture() const;
 
 	GLsizei GetTriangleCounter() const;
 
+	float GetBoundingRadius() const { return m_boundingRadius; }
+	glm::vec3 GetBoundsMin() const { return m_boundsMin; }
+	glm::vec3 GetBoundsMax() const { return m_boundsMax; }
+	float GetUVScale() const { return m_uvScale; }
+
 	void SetTexture(Texture* tex);
 
-	//! This function is responsible for creating a proper Mesh out of vertices and the respective index order
+	//! This function is responsible for creating a proper Mesh out of vertices and the respective index order. Only once
 	void Load();
 	//! This function renders the Mesh (if it exists) onto the scene
 	void Render();
@@ -1,10 +1,15 @@
 #include "Model.h"
-#include "Model.h"
 
-Model::Model(const char * filename)
-	: IRenderable()
+#include <climits>
+#include <algorithm>
+
+Model::Model(const char * filename, bool batchMaterials) :
+	IRenderable(),
+	filename(filename),
+	m_byteSize(0),
+	m_batchMaterials(batchMaterials),
+	m_albedoArray(nullptr)
 {
-	this->filename = filename;
 }
 
 Mesh * Model::GetMeshByIndex(size_t index)
@@ -14,11 +19,29 @@ Mesh * Model::GetMeshByIndex(size_t index)
 
 Texture * Model::GetTextureByMeshIndex(size_t meshIndex)
 {
-	if(meshIndex > meshList.size()) return nullptr;
+	if(meshIndex >= meshList.size() || meshIndex >= meshToTex.size()) return nullptr;
 	unsigned int materialIndex = meshToTex[meshIndex];
 	return (materialIndex < textureList.size() && textureList[materialIndex]) ? textureList[materialIndex] : nullptr;
 }
 
+float Model::GetBoundingRadius() const
+{
+	float radius = 0.0f;
+	for (size_t i = 0; i < meshList.size(); i++)
+		radius = std::max(radius, meshList[i]->GetBoundingRadius());
+	return radius;
+}
+
+void Model::GetBounds(glm::vec3 & boxMin, glm::vec3 & boxMax) const
+{
+	boxMin = glm::vec3(0.0f);
+	boxMax = glm::vec3(0.0f);
+	for (size_t i = 0; i < meshList.size(); i++) {
+		boxMin = i == 0 ? meshList[i]->GetBoundsMin() : glm::min(boxMin, meshList[i]->GetBoundsMin());
+		boxMax = i == 0 ? meshList[i]->GetBoundsMax() : glm::max(boxMax, meshList[i]->GetBoundsMax());
+	}
+}
+
 void Model::LoadNode(aiNode * node, const aiScene * scene)
 {
 	for (size_t i = 0; i < node->mNumMeshes; i++)
@@ -34,8 +57,10 @@ void Model::LoadNode(aiNode * node, const aiScene * scene)
 
 void Model::LoadMesh(aiMesh * mesh, const aiScene * scene)
 {
-	std::vector<GLfloat> vertices;
-	std::vector<unsigned int> indices;
+	ImportedMesh imported;
+	imported.materialIndex = mesh->mMaterialIndex;
+	std::vector<GLfloat>& vertices = imported.vertices;
+	std::vector<unsigned int>& indices = imported.indices;
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++)
 	{
@@ -58,69 +83,150 @@ void Model::LoadMesh(aiMesh * mesh, const aiScene * scene)
 			indices.push_back(face.mIndices[j]);
 		}
 	}
-	
-	MeshInfo *info = new MeshInfo(); info->vertices = &vertices[0]; info->indices = &indices[0]; 
-	info->numOfVertices = vertices.size(); info->numOfIndices = indices.size();
 
-	Mesh* newMesh = new Mesh(info);
+	m_byteSize += sizeof(GLfloat) * vertices.size() + sizeof(unsigned int) * indices.size();
+	m_importedMeshes.push_back(std::move(imported));
+}
+
+std::string Model::GetDiffusePath(aiMaterial * material)
+{
+	aiString path;
+	if (material->GetTextureCount(aiTextureType_DIFFUSE) && material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS &&
+		path.length > 0)
+	{
+		int idx = std::string(path.data).rfind("\\");
+		return std::string("Textures/") + std::string(path.data).substr(idx + 1);
+	}
+	return "";
+}
+
+void Model::LoadBatch()
+{
+	// Batched meshes are merged in a single one
+	std::vector<GLfloat> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> materialIndices;
+	for (size_t i = 0; i < m_importedMeshes.size(); i++) {
+		const ImportedMesh& mesh = m_importedMeshes[i];
+		unsigned int firstVertex = (unsigned int)(vertices.size() / 8);
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		for (size_t j = 0; j < mesh.indices.size(); j++)
+			indices.push_back(firstVertex + mesh.indices[j]);
+		materialIndices.insert(materialIndices.end(), mesh.vertices.size() / 8, mesh.materialIndex);
+	}
+
+	if (indices.empty())
+		return;
+
+	// Materials sharing a texture share a layer
+	m_albedoArray = new TextureArray();
+	std::vector<GLfloat> materialLayers(m_materialPaths.size());
+	for (size_t i = 0; i < m_materialPaths.size(); i++)
+		materialLayers[i] = (GLfloat)m_albedoArray->AddLayer(m_materialPaths[i].empty() ? "Textures/transparent.png" : m_materialPaths[i]);
+
+	if (!m_albedoArray->Build()) {
+		printf("Failed to build the texture array of %s\n", filename.c_str());
+		delete m_albedoArray;
+		m_albedoArray = nullptr;
+	}
+
+	std::vector<GLfloat> layers(materialIndices.size());
+	for (size_t i = 0; i < layers.size(); i++)
+		layers[i] = m_albedoArray ? materialLayers[materialIndices[i]] : 0.0f;
+
+	MeshInfo info;
+	info.vertices = &vertices[0]; info.indices = &indices[0];
+	info.numOfVertices = vertices.size(); info.numOfIndices = indices.size();
+	info.layers = m_albedoArray ? &layers[0] : nullptr;
+
+	Mesh* newMesh = new Mesh(&info);
 	newMesh->Load();
 
 	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
+	meshToTex.push_back(UINT_MAX);
 }
 
-void Model::LoadMaterials(const aiScene * scene)
+void Model::LoadMaterials()
 {
-	textureList.resize(scene->mNumMaterials);
+	textureList.resize(m_materialPaths.size());
 
-	for (size_t i = 0; i < scene->mNumMaterials; i++)
+	for (size_t i = 0; i < m_materialPaths.size(); i++)
 	{
-		aiMaterial* material = scene->mMaterials[i];
-
 		textureList[i] = nullptr;
 
-		if (material->GetTextureCount(aiTextureType_DIFFUSE))
+		if (!m_materialPaths[i].empty())
 		{
-			aiString path;
-			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
-			{
-				int idx = std::string(path.data).rfind("\\");
-				std::string filename = std::string(path.data).substr(idx + 1);
-
-				std::string texPath = std::string("Textures/") + filename;
+			std::string texPath = m_materialPaths[i];
 
-				textureList[i] = new Texture(texPath.c_str());
+			textureList[i] = new Texture(texPath.c_str());
 
-				if (!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", &texPath[0]);
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
+			if (!textureList[i]->LoadTextureAsync())
+			{
+				printf("Failed to load texture at: %s\n", &texPath[0]);
+				delete textureList[i];
+				textureList[i] = nullptr;
 			}
 		}
 
 		if (!textureList[i]) {
 			Texture* tex = new Texture("Textures/transparent.png");
-			tex->LoadTexture();
+			tex->LoadTextureAsync();
 			textureList[i] = tex;
 		}
 	}
 }
 
-void Model::Load() {
+bool Model::Import()
+{
 	Assimp::Importer importer;
 	const aiScene *scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices | aiProcess_FlipWindingOrder);
 
 	if (!scene)
 	{
-		printf("Model (%s) failed to load: %s", filename, importer.GetErrorString());
-		return;
+		printf("Model (%s) failed to load: %s", filename.c_str(), importer.GetErrorString());
+		return false;
 	}
 
 	LoadNode(scene->mRootNode, scene);
 
-	LoadMaterials(scene);
+	m_materialPaths.resize(scene->mNumMaterials);
+	for (size_t i = 0; i < scene->mNumMaterials; i++)
+		m_materialPaths[i] = GetDiffusePath(scene->mMaterials[i]);
+
+	return true;
+}
+
+void Model::Upload()
+{
+	if (m_batchMaterials) {
+		LoadBatch();
+	}
+	else {
+		for (size_t i = 0; i < m_importedMeshes.size(); i++) {
+			ImportedMesh& mesh = m_importedMeshes[i];
+			if (mesh.indices.empty())
+				continue;
+
+			MeshInfo info;
+			info.vertices = &mesh.vertices[0]; info.indices = &mesh.indices[0];
+			info.numOfVertices = mesh.vertices.size(); info.numOfIndices = mesh.indices.size();
+
+			Mesh* newMesh = new Mesh(&info);
+			newMesh->Load();
+
+			meshList.push_back(newMesh);
+			meshToTex.push_back(mesh.materialIndex);
+		}
+		LoadMaterials();
+	}
+
+	// The GPU has its own copy now
+	m_importedMeshes.clear(); m_importedMeshes.shrink_to_fit();
+}
+
+void Model::Load() {
+	if (Import())
+		Upload();
 }
 
 void Model::Render() {
@@ -155,6 +261,12 @@ void Model::Clear() {
 			textureList[i] = nullptr;
 		}
 	}
+
+	if (m_albedoArray)
+	{
+		delete m_albedoArray;
+		m_albedoArray = nullptr;
+	}
 }
 
 Model::~Model()
@@ -9,6 +9,14 @@
 
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureArray.h"
+
+// Geometry of a mesh read from the model file, waiting to be uploaded
+struct ImportedMesh {
+	std::vector<GLfloat> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int materialIndex;
+};
 
 class Model : public IRenderable
 {
@@ -17,17 +25,56 @@ private:
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
 
-	const char* filename;
+	std::string filename;
+
+	// -- Imported, not uploaded yet --
+	std::vector<ImportedMesh> m_importedMeshes;
+	// Diffuse texture of every material, empty if it has none
+	std::vector<std::string> m_materialPaths;
+	// Bytes of vertex and index data, known once imported
+	size_t m_byteSize;
+
+	// -- Material batching --
+	// When set, all meshes are merged into a single one whose vertices select their albedo layer in m_albedoArray
+	bool m_batchMaterials;
+	TextureArray* m_albedoArray;
 
 	void LoadNode(aiNode *node, const aiScene *scene);
 	void LoadMesh(aiMesh *mesh, const aiScene *scene);
-	void LoadMaterials(const aiScene *scene);
+	void LoadMaterials();
+	// Returns the texture path of a material, empty if it has none
+	std::string GetDiffusePath(aiMaterial* material);
+	// Packs the materials' albedo textures in a texture array and uploads the merged mesh
+	void LoadBatch();
 public:
-	Model(const char* filename);
+	/*!
+		\n Model::Model(const char* filename, bool batchMaterials)
+		\param const char* filename Path of the model file
+		\param bool batchMaterials Merge all meshes in one draw, packing their albedo textures in a texture array
+
+		Constructor
+	*/
+	Model(const char* filename, bool batchMaterials = false);
+
+	// Texture array of a batched model, null otherwise
+	TextureArray* GetAlbedoArray() const { return m_albedoArray; }
 
 	Mesh* GetMeshByIndex(size_t index);
 	Texture* GetTextureByMeshIndex(size_t meshIndex);
+	size_t GetMeshCount() const { return meshList.size(); }
+	float GetBoundingRadius() const;
+	// Box around every mesh
+	void GetBounds(glm::vec3& boxMin, glm::vec3& boxMax) const;
+	const std::string& GetFilename() const { return filename; }
+	bool IsBatched() const { return m_batchMaterials; }
+	// Bytes of geometry of the model, 0 until it is imported
+	size_t GetByteSize() const { return m_byteSize; }
 
+	// Reads the file into CPU memory. Does not touch GL, so it can run on any thread. Returns false if the file failed to load
+	bool Import();
+	// Creates the meshes and textures of an imported model. Main thread only
+	void Upload();
+	// Import and Upload
 	void Load();
 	void Render();
 	void Clear();
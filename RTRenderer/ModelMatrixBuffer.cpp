@@ -0,0 +1,72 @@
+#include "ModelMatrixBuffer.h"
+
+#include <algorithm>
+
+#include "GLState.h"
+
+std::vector<glm::mat4> ModelMatrixBuffer::mMatrices[RENDER_SNAPSHOT_COUNT];
+GLuint ModelMatrixBuffer::mBuffer = 0;
+GLuint ModelMatrixBuffer::mTexture = 0;
+size_t ModelMatrixBuffer::mCapacity = 0;
+unsigned long long ModelMatrixBuffer::mUploadedFrame = 0;
+bool ModelMatrixBuffer::mUploaded = false;
+
+void ModelMatrixBuffer::Resize(size_t count)
+{
+	mMatrices[RenderSnapshot::GetWriteIndex()].resize(count);
+}
+
+glm::mat4 * ModelMatrixBuffer::GetWriteMatrices()
+{
+	std::vector<glm::mat4>& matrices = mMatrices[RenderSnapshot::GetWriteIndex()];
+	return matrices.empty() ? nullptr : &matrices[0];
+}
+
+void ModelMatrixBuffer::Update()
+{
+	if (mBuffer == 0) {
+		glGenBuffers(1, &mBuffer);
+		glGenTextures(1, &mTexture);
+	}
+
+	const std::vector<glm::mat4>& matrices = mMatrices[RenderSnapshot::GetReadIndex()];
+	if (!(mUploaded && mUploadedFrame == RenderSnapshot::GetReadFrame()) && !matrices.empty()) {
+		glBindBuffer(GL_TEXTURE_BUFFER, mBuffer);
+		if (matrices.size() > mCapacity) {
+			// Grows by half again, so a streamed in tile does not reallocate it every frame
+			mCapacity = std::max(matrices.size(), mCapacity + mCapacity / 2);
+			glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * mCapacity, nullptr, GL_STREAM_DRAW);
+			// The texture has to be bound on the active unit to be pointed at the new storage
+			GLState::BindTexture(MODEL_MATRIX_UNIT, GL_TEXTURE_BUFFER, mTexture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mBuffer);
+		}
+		else {
+			// Orphaned, so the draws of the last frame that still read it do not stall the upload
+			glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * mCapacity, nullptr, GL_STREAM_DRAW);
+		}
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::mat4) * matrices.size(), &matrices[0]);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		mUploadedFrame = RenderSnapshot::GetReadFrame();
+		mUploaded = true;
+	}
+
+	GLState::BindTexture(MODEL_MATRIX_UNIT, GL_TEXTURE_BUFFER, mTexture);
+}
+
+void ModelMatrixBuffer::Clear()
+{
+	for (int i = 0; i < RENDER_SNAPSHOT_COUNT; i++) {
+		mMatrices[i].clear();
+		mMatrices[i].shrink_to_fit();
+	}
+
+	if (mTexture != 0)
+		GLState::DeleteTexture(mTexture);
+	if (mBuffer != 0)
+		glDeleteBuffers(1, &mBuffer);
+	mTexture = 0;
+	mBuffer = 0;
+	mCapacity = 0;
+	mUploaded = false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "Commons.h"
+#include "RenderSnapshot.h"
+
+/*!
+	World matrix of every drawn object, computed once per snapshot and shared by every pass.
+
+	Building a snapshot gives every object a slot, renderer after renderer, and fills it with the object's world
+	matrix. Before drawing, the matrices of the snapshot being drawn are uploaded once to a texture buffer that stays
+	bound to MODEL_MATRIX_UNIT, and the shaders fetch the matrix of u_modelIndex from u_modelMatrices. A draw then
+	only changes one integer uniform, whichever pass it belongs to.
+*/
+class ModelMatrixBuffer
+{
+private:
+	// Matrices of each snapshot, by slot
+	static std::vector<glm::mat4> mMatrices[RENDER_SNAPSHOT_COUNT];
+
+	static GLuint mBuffer;
+	static GLuint mTexture;
+	// Matrices the buffer has room for
+	static size_t mCapacity;
+	// Frame of the snapshot in the buffer
+	static unsigned long long mUploadedFrame;
+	static bool mUploaded;
+
+public:
+	// Gives the snapshot being written count slots. Called before its queues are built
+	static void Resize(size_t count);
+	// Slots of the snapshot being written. The queues write their objects' matrices in their own ranges
+	static glm::mat4* GetWriteMatrices();
+	static const std::vector<glm::mat4>& GetMatrices(int snapshot) { return mMatrices[snapshot]; }
+
+	// Uploads the matrices of the snapshot being drawn, if they were not yet, and binds them. Call before rendering
+	static void Update();
+
+	// Deletes the texture buffer
+	static void Clear();
+};
@@ -1,10 +1,6 @@
 #include "ObjectController.h"
 
 
-glm::vec3 Interpolate(glm::vec3 v1, glm::vec3 v2, float percentage) {
-	return v1 * (1.0f - percentage) + v2 * percentage;
-}
-
 CameraController::CameraController(Transform* container, GLfloat moveSpeed, GLfloat turnSpeed)
 	: AObjectBehavior(container)
 {
@@ -51,63 +47,47 @@ AnimateKeyFrame::AnimateKeyFrame(Transform * container, std::vector<KeyFrame>* k
 	: AObjectBehavior(container)
 {
 	m_keyframes = *keyFrames;
+
+	std::vector<glm::vec3> positions(m_keyframes.size());
+	std::vector<glm::vec3> rotations(m_keyframes.size());
+	std::vector<float> durations(m_keyframes.size());
+	for (size_t i = 0; i < m_keyframes.size(); i++) {
+		positions[i] = m_keyframes[i].position;
+		rotations[i] = m_keyframes[i].rotation;
+		durations[i] = m_keyframes[i].deltaTime;
+	}
+	m_track = AnimationEngine::AddTrack(container, positions, rotations, durations);
 }
 
 void AnimateKeyFrame::SetUp()
 {
-	m_index = 0;
-	m_deltaTime = 0;
-
-	if (m_keyframes.size() > 0) {
-		// Go to first key frame
-		{
-			glm::vec3 deltaTranslate = m_keyframes[0].position - transform->GetPosition();
-			transform->TranslateLocal(deltaTranslate);
-		}
-		{
-			glm::vec3 deltaRotation = m_keyframes[0].rotation - transform->GetRotation();
-			transform->Rotate(deltaRotation.x, deltaRotation.y, deltaRotation.z);
-		}
-	}
+	// Go to first key frame
+	AnimationEngine::Restart(m_track);
 }
 
 void AnimateKeyFrame::Update()
 {
-	// End of behavior
-	if (m_index + 1 >= m_keyframes.size())
-		return;
-
-	m_deltaTime += (GLfloat)Time::GetDeltaTime();
+	// AnimationEngine::Update moves every track once per frame, whichever way the transform is updated
+}
 
-	float residue;
-	do {
-		residue = 0.0f;
-		float percentage = m_deltaTime / m_keyframes[m_index + 1].deltaTime;
-		if (percentage > 1.0f)
-		{
-			residue = percentage - 1.0f;
-			percentage = 1.0f;
-		}
-		
-		{
-			// Go to position
-			glm::vec3 position = Interpolate(m_keyframes[m_index].position, m_keyframes[m_index + 1].position, percentage);
-			glm::vec3 deltaTranslate = position - transform->GetPosition();
-			transform->TranslateLocal(deltaTranslate);
-		}
-		{
-			// Go to rotation
-			glm::vec3 rotation = Interpolate(m_keyframes[m_index].rotation, m_keyframes[m_index + 1].rotation, percentage);
-			glm::vec3 deltaRotation = rotation - transform->GetRotation();
-			transform->Rotate(deltaRotation.x, deltaRotation.y, deltaRotation.z);
-		}
+void AnimateKeyFrame::GetUpcomingPositions(float seconds, float step, std::vector<glm::vec3>& positions) const
+{
+	if (m_keyframes.empty())
+		return;
 
-		if (residue > 0.0f) {
-			m_index++;
-			m_deltaTime = m_deltaTime - m_keyframes[m_index].deltaTime;
-		}
-	} while (residue > 0.0f && m_index >= m_keyframes.size());
+	float time = AnimationEngine::GetTime(m_track);
+	float duration = AnimationEngine::GetDuration(m_track);
+	for (float elapsed = step; elapsed <= seconds; elapsed += step) {
+		positions.push_back(AnimationEngine::SamplePosition(m_track, time + elapsed));
+		// The path ends there
+		if (time + elapsed >= duration)
+			return;
+	}
+}
 
+AnimateKeyFrame::~AnimateKeyFrame()
+{
+	AnimationEngine::RemoveTrack(m_track);
 }
 
 PrintKeyFrame::PrintKeyFrame(Transform * container) :
@@ -6,6 +6,7 @@
 #include "Time.h"
 #include "Input.h"
 #include "Camera.h"
+#include "AnimationEngine.h"
 
 struct KeyFrame {
 	// Wanted positon
@@ -28,21 +29,39 @@ private:
 public:
 	CameraController(Transform* container, GLfloat moveSpeed, GLfloat turnSpeed);
 
+	GLfloat GetMoveSpeed() const { return moveSpeed; }
+	GLfloat GetTurnSpeed() const { return turnSpeed; }
+
 	void SetUp();
 	void Update();
 };
 
+// Plays keyframes through the AnimationEngine, whose pass moves every animated transform at once
 class AnimateKeyFrame : public AObjectBehavior {
 private:
-	size_t m_index;
-	float m_deltaTime;
+	int m_track;
+	// As loaded, to store the scene back
 	std::vector<KeyFrame> m_keyframes;
 
 public:
 	AnimateKeyFrame(Transform* contanier, std::vector<KeyFrame>* keyFrames);
 
+	const std::vector<KeyFrame>& GetKeyFrames() const { return m_keyframes; }
+
+	/*!
+		\n void AnimateKeyFrame::GetUpcomingPositions(float seconds, float step, std::vector<glm::vec3>& positions) const
+		\param float seconds How far ahead to look
+		\param float step Time between two samples
+
+		Appends the positions the animation goes through in the next seconds. Used to prefetch what the path leads to
+	*/
+	void GetUpcomingPositions(float seconds, float step, std::vector<glm::vec3>& positions) const;
+
 	void SetUp();
+	// Does nothing, the track is moved by the animation engine
 	void Update();
+
+	~AnimateKeyFrame();
 };
 
 class PrintKeyFrame : public AObjectBehavior {
@@ -73,6 +92,9 @@ private:
 public:
 	HelicopterController(Transform* container, float vel, float rotVel);
 
+	float GetMoveSpeed() const { return moveSpeed; }
+	float GetRotationSpeed() const { return rotSpeed; }
+
 	void SetUp();
 	void Update();
 };
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// Objects a pool allocates at once. Chunks never move, so pointers to pooled objects stay valid
+const size_t OBJECT_POOL_CHUNK_SIZE = 1024;
+
+/*!
+	Reference to a pooled object that knows when the object is gone.
+
+	Slots are reused, so every slot counts how many times it was freed. A handle holds the count of when it was taken
+	and stops resolving once the slot was freed, instead of pointing at whatever object took the slot next.
+*/
+struct PoolHandle {
+	uint32_t index;
+	// 0 for the null handle, live slots start at 1
+	uint32_t generation;
+
+	PoolHandle() : index(0), generation(0) {}
+	PoolHandle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+
+	bool IsNull() const { return generation == 0; }
+	bool operator==(const PoolHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const PoolHandle& other) const { return !(*this == other); }
+};
+
+/*!
+	Storage for every object of type T.
+
+	Objects live in chunks of OBJECT_POOL_CHUNK_SIZE contiguous slots instead of one heap block each, so objects
+	created together, like the transforms and objects of a scene, are next to each other when they are iterated. Freed
+	slots go to a free list and are reused first. The pool holds exactly T, not types derived from it.
+
+	Create and Destroy can be called from any thread. T's constructor and destructor run outside the pool's lock, so
+	they can create and destroy other objects of the same pool, like a transform destroying its children
+*/
+template<class T>
+class ObjectPool
+{
+private:
+	struct Slot {
+		// First, so a pointer to the object is a pointer to its slot
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+		uint32_t index;
+		uint32_t generation;
+		// Next slot of the free list while this one is free
+		uint32_t nextFree;
+		bool alive;
+	};
+
+	static const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+	static std::mutex mMutex;
+	static std::vector<Slot*> mChunks;
+	static uint32_t mFirstFree;
+	static size_t mCount;
+	// Objects created and destroyed so far, so a pool that lost and gained as many is still seen as changed
+	static unsigned long long mModifications;
+
+	static Slot& _GetSlot(uint32_t index) { return mChunks[index / OBJECT_POOL_CHUNK_SIZE][index % OBJECT_POOL_CHUNK_SIZE]; }
+
+	// Takes a slot off the free list, adding a chunk if it is empty
+	static Slot* _Acquire() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFirstFree == NO_SLOT) {
+			uint32_t first = (uint32_t)(mChunks.size() * OBJECT_POOL_CHUNK_SIZE);
+			Slot* chunk = new Slot[OBJECT_POOL_CHUNK_SIZE];
+			for (uint32_t i = 0; i < OBJECT_POOL_CHUNK_SIZE; i++) {
+				chunk[i].index = first + i;
+				chunk[i].generation = 1;
+				chunk[i].nextFree = i + 1 < OBJECT_POOL_CHUNK_SIZE ? first + i + 1 : NO_SLOT;
+				chunk[i].alive = false;
+			}
+			mChunks.push_back(chunk);
+			mFirstFree = first;
+		}
+
+		Slot* slot = &_GetSlot(mFirstFree);
+		mFirstFree = slot->nextFree;
+		mCount++;
+		mModifications++;
+		return slot;
+	}
+
+	static void _SetAlive(Slot* slot, bool alive) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		slot->alive = alive;
+	}
+
+	static void _Release(Slot* slot) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		// Handles to the old object stop resolving. 0 is the null handle's
+		if (++slot->generation == 0)
+			slot->generation = 1;
+		slot->nextFree = mFirstFree;
+		mFirstFree = slot->index;
+		mCount--;
+		mModifications++;
+	}
+
+public:
+	/*!
+		\n T* ObjectPool<T>::Create(Args&&... args)
+
+		Constructs a T with the given arguments in a free slot. It is freed with Destroy, never with delete
+	*/
+	template<class... Args>
+	static T* Create(Args&&... args) {
+		Slot* slot = _Acquire();
+		T* object = new (&slot->object) T(std::forward<Args>(args)...);
+		_SetAlive(slot, true);
+		return object;
+	}
+
+	// Destroys an object made by Create. Does nothing for null
+	static void Destroy(T* object) {
+		if (object == nullptr)
+			return;
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		// Handles stop resolving before the object goes
+		_SetAlive(slot, false);
+		object->~T();
+		_Release(slot);
+	}
+
+	static PoolHandle GetHandle(const T* object) {
+		if (object == nullptr)
+			return PoolHandle();
+		const Slot* slot = reinterpret_cast<const Slot*>(object);
+		return PoolHandle(slot->index, slot->generation);
+	}
+
+	// The object the handle was taken from, or null if it was destroyed
+	static T* Get(PoolHandle handle) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (handle.IsNull() || handle.index >= mChunks.size() * OBJECT_POOL_CHUNK_SIZE)
+			return nullptr;
+		Slot& slot = _GetSlot(handle.index);
+		if (!slot.alive || slot.generation != handle.generation)
+			return nullptr;
+		return reinterpret_cast<T*>(&slot.object);
+	}
+
+	// Destroys the object the handle was taken from, if it is still alive
+	static void Destroy(PoolHandle handle) { Destroy(Get(handle)); }
+
+	// Objects alive
+	static size_t GetCount() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mCount;
+	}
+
+	// Changes whenever an object is created or destroyed
+	static unsigned long long GetModificationCount() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mModifications;
+	}
+
+	// Slots in the chunks, alive or free. The range of slot indices ForEach can be split over
+	static size_t GetCapacity() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mChunks.size() * OBJECT_POOL_CHUNK_SIZE;
+	}
+
+	/*!
+		\n void ObjectPool<T>::ForEach(Function function)
+
+		Calls function with every live object, in storage order. Objects must not be created or destroyed meanwhile
+	*/
+	template<class Function>
+	static void ForEach(Function function) {
+		for (size_t i = 0; i < mChunks.size(); i++) {
+			Slot* chunk = mChunks[i];
+			for (size_t j = 0; j < OBJECT_POOL_CHUNK_SIZE; j++) {
+				if (chunk[j].alive)
+					function(reinterpret_cast<T*>(&chunk[j].object));
+			}
+		}
+	}
+
+	// Calls function with the live objects of the slots [begin, end), which has to be within the capacity
+	template<class Function>
+	static void ForEach(size_t begin, size_t end, Function function) {
+		for (size_t i = begin; i < end; i++) {
+			Slot& slot = _GetSlot((uint32_t)i);
+			if (slot.alive)
+				function(reinterpret_cast<T*>(&slot.object));
+		}
+	}
+
+	// Frees the chunks once every object was destroyed. Objects still alive are reported and kept
+	static void Clear() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mCount > 0) {
+			printf("Object pool still has %zu objects alive, its memory is kept\n", mCount);
+			return;
+		}
+		for (size_t i = 0; i < mChunks.size(); i++)
+			delete[] mChunks[i];
+		mChunks.clear();
+		mFirstFree = NO_SLOT;
+	}
+};
+
+template<class T>
+std::mutex ObjectPool<T>::mMutex;
+template<class T>
+std::vector<typename ObjectPool<T>::Slot*> ObjectPool<T>::mChunks;
+template<class T>
+uint32_t ObjectPool<T>::mFirstFree = ObjectPool<T>::NO_SLOT;
+template<class T>
+size_t ObjectPool<T>::mCount = 0;
+template<class T>
+unsigned long long ObjectPool<T>::mModifications = 0;
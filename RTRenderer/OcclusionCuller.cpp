@@ -0,0 +1,360 @@
+#include "OcclusionCuller.h"
+
+#include <float.h>
+#include <cmath>
+#include <algorithm>
+
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "MatrixKernels.h"
+#include "Profiler.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define OCCLUSION_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+// MSVC emits AVX instructions for the intrinsics of any function
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+#endif
+
+// Rows of the band the triangle reaches, false if none
+static bool TriangleRows(const OccluderTriangle& triangle, int firstRow, int lastRow, int& minY, int& maxY)
+{
+	minY = std::max(triangle.minY, firstRow);
+	maxY = std::min(triangle.maxY, lastRow);
+	return minY <= maxY;
+}
+
+// -- Scalar --
+
+static void RasterizeRowsScalar(const OccluderTriangle* triangles, size_t count, int firstRow, int lastRow, float* depth)
+{
+	for (size_t i = 0; i < count; i++) {
+		const OccluderTriangle& triangle = triangles[i];
+		int minY, maxY;
+		if (!TriangleRows(triangle, firstRow, lastRow, minY, maxY))
+			continue;
+
+		for (int y = minY; y <= maxY; y++) {
+			float centerY = (float)y + 0.5f;
+			float rows[3];
+			for (int j = 0; j < 3; j++)
+				rows[j] = triangle.edgeB[j] * centerY + triangle.edgeC[j];
+			float depthRow = triangle.depthB * centerY + triangle.depthC;
+
+			float* row = depth + y * OCCLUSION_WIDTH;
+			for (int x = triangle.minX; x <= triangle.maxX; x++) {
+				float centerX = (float)x + 0.5f;
+				if (triangle.edgeA[0] * centerX + rows[0] < 0.0f || triangle.edgeA[1] * centerX + rows[1] < 0.0f ||
+					triangle.edgeA[2] * centerX + rows[2] < 0.0f)
+					continue;
+				row[x] = std::min(row[x], triangle.depthA * centerX + depthRow);
+			}
+		}
+	}
+}
+
+#ifdef OCCLUSION_X86
+
+// -- SSE --
+
+static void RasterizeRowsSSE(const OccluderTriangle* triangles, size_t count, int firstRow, int lastRow, float* depth)
+{
+	const __m128 centers = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < count; i++) {
+		const OccluderTriangle& triangle = triangles[i];
+		int minY, maxY;
+		if (!TriangleRows(triangle, firstRow, lastRow, minY, maxY))
+			continue;
+
+		__m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+		__m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+		__m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+		__m128 depthA = _mm_set1_ps(triangle.depthA);
+		// Four pixels at a time from a multiple of four, the width is one too
+		int minX = triangle.minX & ~3;
+
+		for (int y = minY; y <= maxY; y++) {
+			float centerY = (float)y + 0.5f;
+			__m128 row0 = _mm_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+			__m128 row1 = _mm_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+			__m128 row2 = _mm_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+			__m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+			float* row = depth + y * OCCLUSION_WIDTH;
+			for (int x = minX; x <= triangle.maxX; x += 4) {
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), centers);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, centerX), row0), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, centerX), row1), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, centerX), row2), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+}
+
+// -- AVX --
+
+AVX_FUNCTION static void RasterizeRowsAVX(const OccluderTriangle* triangles, size_t count, int firstRow, int lastRow, float* depth)
+{
+	const __m256 centers = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (size_t i = 0; i < count; i++) {
+		const OccluderTriangle& triangle = triangles[i];
+		int minY, maxY;
+		if (!TriangleRows(triangle, firstRow, lastRow, minY, maxY))
+			continue;
+
+		__m256 edgeA0 = _mm256_set1_ps(triangle.edgeA[0]);
+		__m256 edgeA1 = _mm256_set1_ps(triangle.edgeA[1]);
+		__m256 edgeA2 = _mm256_set1_ps(triangle.edgeA[2]);
+		__m256 depthA = _mm256_set1_ps(triangle.depthA);
+		int minX = triangle.minX & ~7;
+
+		for (int y = minY; y <= maxY; y++) {
+			float centerY = (float)y + 0.5f;
+			__m256 row0 = _mm256_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+			__m256 row1 = _mm256_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+			__m256 row2 = _mm256_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+			__m256 depthRow = _mm256_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+			float* row = depth + y * OCCLUSION_WIDTH;
+			for (int x = minX; x <= triangle.maxX; x += 8) {
+				__m256 centerX = _mm256_add_ps(_mm256_set1_ps((float)x), centers);
+				__m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA0, centerX), row0), zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA1, centerX), row1), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA2, centerX), row2), zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(inside) == 0)
+					continue;
+
+				__m256 current = _mm256_loadu_ps(row + x);
+				__m256 nearest = _mm256_min_ps(current, _mm256_add_ps(_mm256_mul_ps(depthA, centerX), depthRow));
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, nearest, inside));
+			}
+		}
+	}
+}
+
+#endif
+
+float OcclusionCuller::mDepth[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+float OcclusionCuller::mTileDepths[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+glm::mat4 OcclusionCuller::mViewProjection;
+std::vector<OccluderTriangle> OcclusionCuller::mTriangles;
+bool OcclusionCuller::mReady = false;
+std::chrono::high_resolution_clock::time_point OcclusionCuller::mStart;
+
+void OcclusionCuller::Begin(const glm::mat4 & viewProjection)
+{
+	mStart = std::chrono::high_resolution_clock::now();
+	mViewProjection = viewProjection;
+	mTriangles.clear();
+	mReady = false;
+}
+
+void OcclusionCuller::AddOccluder(const glm::vec3 * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount)
+{
+	FrameVector<glm::vec4> clip(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		clip[i] = mViewProjection * glm::vec4(vertices[i], 1.0f);
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+		_AddTriangle(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+}
+
+void OcclusionCuller::_AddTriangle(const glm::vec4 & a, const glm::vec4 & b, const glm::vec4 & c)
+{
+	// Entirely outside one of the side or far planes
+	for (int axis = 0; axis < 3; axis++) {
+		if (a[axis] > a.w && b[axis] > b.w && c[axis] > c.w)
+			return;
+		if (axis < 2 && a[axis] < -a.w && b[axis] < -b.w && c[axis] < -c.w)
+			return;
+	}
+
+	// Distances to the near plane, z = -w
+	const glm::vec4* vertices[3] = { &a, &b, &c };
+	float distances[3] = { a.z + a.w, b.z + b.w, c.z + c.w };
+	if (distances[0] >= 0.0f && distances[1] >= 0.0f && distances[2] >= 0.0f) {
+		_SetupTriangle(a, b, c);
+		return;
+	}
+
+	// Keeps the part in front, a triangle or a quad
+	glm::vec4 polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		int next = (i + 1) % 3;
+		if (distances[i] >= 0.0f)
+			polygon[count++] = *vertices[i];
+		if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+			float t = distances[i] / (distances[i] - distances[next]);
+			polygon[count++] = glm::mix(*vertices[i], *vertices[next], t);
+		}
+	}
+
+	for (int i = 1; i + 1 < count; i++)
+		_SetupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+}
+
+void OcclusionCuller::_SetupTriangle(const glm::vec4 & a, const glm::vec4 & b, const glm::vec4 & c)
+{
+	// Screen position and depth in [0, 1]
+	glm::vec3 screen[3];
+	const glm::vec4* vertices[3] = { &a, &b, &c };
+	for (int i = 0; i < 3; i++) {
+		// On the near plane when clipped there, so w is positive
+		glm::vec3 ndc = glm::vec3(*vertices[i]) / std::max(vertices[i]->w, 1e-6f);
+		screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * OCCLUSION_WIDTH, (ndc.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+			ndc.z * 0.5f + 0.5f);
+	}
+
+	float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+	if (std::abs(area) < 1e-6f)
+		return;
+	// Counter clockwise, so the inside is on the positive side of every edge
+	if (area < 0.0f) {
+		std::swap(screen[1], screen[2]);
+		area = -area;
+	}
+
+	OccluderTriangle triangle;
+	float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+	float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+	float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+	float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+	triangle.minX = std::max((int)std::floor(minX), 0);
+	triangle.maxX = std::min((int)std::floor(maxX), OCCLUSION_WIDTH - 1);
+	triangle.minY = std::max((int)std::floor(minY), 0);
+	triangle.maxY = std::min((int)std::floor(maxY), OCCLUSION_HEIGHT - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3& from = screen[i];
+		const glm::vec3& to = screen[(i + 1) % 3];
+		triangle.edgeA[i] = from.y - to.y;
+		triangle.edgeB[i] = to.x - from.x;
+		triangle.edgeC[i] = from.x * to.y - to.x * from.y;
+	}
+
+	glm::vec3 first = screen[1] - screen[0];
+	glm::vec3 second = screen[2] - screen[0];
+	triangle.depthA = (first.z * second.y - second.z * first.y) / area;
+	triangle.depthB = (first.x * second.z - second.x * first.z) / area;
+	triangle.depthC = screen[0].z - triangle.depthA * screen[0].x - triangle.depthB * screen[0].y;
+
+	mTriangles.push_back(triangle);
+}
+
+void OcclusionCuller::_RasterizeBand(int band)
+{
+	int firstRow = band * OCCLUSION_BAND_HEIGHT;
+	int lastRow = firstRow + OCCLUSION_BAND_HEIGHT - 1;
+	float* rows = mDepth + firstRow * OCCLUSION_WIDTH;
+	std::fill(rows, rows + OCCLUSION_BAND_HEIGHT * OCCLUSION_WIDTH, 1.0f);
+
+	const OccluderTriangle* triangles = mTriangles.empty() ? nullptr : &mTriangles[0];
+	switch (MatrixKernels::GetInstructionSet()) {
+#ifdef OCCLUSION_X86
+	case MATRIX_AVX:
+		RasterizeRowsAVX(triangles, mTriangles.size(), firstRow, lastRow, mDepth);
+		break;
+	case MATRIX_SSE:
+		RasterizeRowsSSE(triangles, mTriangles.size(), firstRow, lastRow, mDepth);
+		break;
+#endif
+	default:
+		RasterizeRowsScalar(triangles, mTriangles.size(), firstRow, lastRow, mDepth);
+		break;
+	}
+
+	// The farthest depth of each tile: a box in front of it is in front of every pixel
+	for (int tileY = firstRow / OCCLUSION_TILE_SIZE; tileY <= lastRow / OCCLUSION_TILE_SIZE; tileY++) {
+		for (int tileX = 0; tileX < OCCLUSION_TILES_X; tileX++) {
+			float farthest = 0.0f;
+			for (int y = tileY * OCCLUSION_TILE_SIZE; y < (tileY + 1) * OCCLUSION_TILE_SIZE; y++) {
+				const float* row = mDepth + y * OCCLUSION_WIDTH + tileX * OCCLUSION_TILE_SIZE;
+				for (int x = 0; x < OCCLUSION_TILE_SIZE; x++)
+					farthest = std::max(farthest, row[x]);
+			}
+			mTileDepths[tileY * OCCLUSION_TILES_X + tileX] = farthest;
+		}
+	}
+}
+
+void OcclusionCuller::Rasterize()
+{
+	JobSystem::ParallelFor(OCCLUSION_HEIGHT / OCCLUSION_BAND_HEIGHT, 1, [](size_t begin, size_t end) {
+		for (size_t band = begin; band < end; band++)
+			_RasterizeBand((int)band);
+	});
+	mReady = true;
+
+	Profiler::Count(PC_OCCLUDER_TRIANGLES, mTriangles.size());
+	Profiler::Count(PC_OCCLUSION_MICROSECONDS, (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::high_resolution_clock::now() - mStart).count());
+}
+
+bool OcclusionCuller::IsVisible(glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	if (!mReady)
+		return true;
+
+	// Screen rectangle around the box and its nearest depth
+	glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+	float nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 point((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+		glm::vec4 clip = mViewProjection * glm::vec4(point, 1.0f);
+		// Crosses the near plane, nothing can be in front of it
+		if (clip.z < -clip.w)
+			return true;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 screen((ndc.x * 0.5f + 0.5f) * OCCLUSION_WIDTH, (ndc.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT);
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	int minX = std::max((int)std::floor(screenMin.x), 0);
+	int maxX = std::min((int)std::floor(screenMax.x), OCCLUSION_WIDTH - 1);
+	int minY = std::max((int)std::floor(screenMin.y), 0);
+	int maxY = std::min((int)std::floor(screenMax.y), OCCLUSION_HEIGHT - 1);
+	// Off screen, which is for the frustum to tell
+	if (minX > maxX || minY > maxY)
+		return true;
+
+	for (int tileY = minY / OCCLUSION_TILE_SIZE; tileY <= maxY / OCCLUSION_TILE_SIZE; tileY++) {
+		for (int tileX = minX / OCCLUSION_TILE_SIZE; tileX <= maxX / OCCLUSION_TILE_SIZE; tileX++) {
+			if (nearest > mTileDepths[tileY * OCCLUSION_TILES_X + tileX])
+				continue;
+
+			// In front of some pixel of the tile, maybe not of those the box covers
+			int fromX = std::max(minX, tileX * OCCLUSION_TILE_SIZE);
+			int toX = std::min(maxX, tileX * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+			int fromY = std::max(minY, tileY * OCCLUSION_TILE_SIZE);
+			int toY = std::min(maxY, tileY * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+			for (int y = fromY; y <= toY; y++) {
+				const float* row = mDepth + y * OCCLUSION_WIDTH;
+				for (int x = fromX; x <= toX; x++) {
+					if (nearest <= row[x])
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <chrono>
+
+#include <glm\glm.hpp>
+
+// Pixels of the CPU depth buffer. Coarse, it only has to tell which boxes are hidden. The width is a multiple of 8
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+// Side of the hierarchical-Z tiles, in pixels
+const int OCCLUSION_TILE_SIZE = 8;
+// Rows rasterized by one job. A multiple of the tile size
+const int OCCLUSION_BAND_HEIGHT = 16;
+const int OCCLUSION_TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE;
+const int OCCLUSION_TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE;
+
+// Occluder triangle set up in screen space
+struct OccluderTriangle {
+	// Edge functions a * x + b * y + c, the pixel centers inside have all three >= 0
+	float edgeA[3];
+	float edgeB[3];
+	float edgeC[3];
+	// Depth plane, depth = depthA * x + depthB * y + depthC
+	float depthA, depthB, depthC;
+	// Pixels whose centers may be inside
+	int minX, maxX, minY, maxY;
+};
+
+/*!
+	CPU depth buffer of the occluders the camera sees, to leave out the objects they hide before they are drawn.
+
+	Every snapshot, Begin takes the camera, AddOccluder clips the occluders' triangles against the near plane and sets
+	them up in screen space, and Rasterize splits the buffer in bands of rows that are filled on the worker threads,
+	each with every triangle that reaches it. The pixels are filled four or eight at a time with the SSE or AVX
+	kernels, whichever MatrixKernels picked. Each band then keeps the farthest depth of each of its tiles, so IsVisible
+	only reads the pixels of the tiles the box could be in front of.
+
+	Occluders have to be inside what they stand for, or they hide what can be seen. The buffer has no GPU side and
+	needs no readback
+*/
+class OcclusionCuller
+{
+private:
+	// Nearest occluder depth of every pixel, row after row from the bottom of the screen, 1 where there is none
+	static float mDepth[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+	// Farthest depth of every tile
+	static float mTileDepths[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+	static glm::mat4 mViewProjection;
+	static std::vector<OccluderTriangle> mTriangles;
+	// Whether the buffer holds the occluders of the view, IsVisible keeps everything until then
+	static bool mReady;
+	static std::chrono::high_resolution_clock::time_point mStart;
+
+	// Clips a triangle in clip space against the near plane
+	static void _AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	// Sets up a triangle in front of the near plane
+	static void _SetupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	// Clears, rasterizes and builds the tiles of the rows of one band
+	static void _RasterizeBand(int band);
+
+public:
+	// Starts an empty buffer for a camera
+	static void Begin(const glm::mat4& viewProjection);
+	/*!
+		\n void OcclusionCuller::AddOccluder(const glm::vec3* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+		\param const glm::vec3* vertices World positions
+		\param const unsigned int* indices Three per triangle, either winding
+
+		Sets up the triangles the camera of Begin can see. Not thread safe
+	*/
+	static void AddOccluder(const glm::vec3* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+	// Rasterizes every occluder added since Begin on the worker threads. Returns once the buffer is complete
+	static void Rasterize();
+
+	// False if the box is hidden behind the occluders at every pixel it covers. Safe from any thread after Rasterize
+	static bool IsVisible(glm::vec3 boxMin, glm::vec3 boxMax);
+	// Depth of a pixel, counted from the bottom left of the screen
+	static float GetDepth(int x, int y) { return mDepth[y * OCCLUSION_WIDTH + x]; }
+};
@@ -0,0 +1,152 @@
+#include "OcclusionQueries.h"
+
+#include <algorithm>
+
+#include "GLRenderer.h"
+#include "Shader.h"
+#include "GLState.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+
+OcclusionBoxShader* OcclusionQueries::mShader = nullptr;
+GLuint OcclusionQueries::mVAO = 0;
+std::vector<GLuint> OcclusionQueries::mFree;
+std::vector<OcclusionQueries::PendingQuery> OcclusionQueries::mPending;
+std::vector<GLObject*> OcclusionQueries::mObjects;
+
+void OcclusionQueries::Begin(const glm::mat4 & viewProjection)
+{
+	if (mShader == nullptr) {
+		mShader = new OcclusionBoxShader();
+		mShader->CreateFromFiles("Shaders/occlusionBox.vert", "Shaders/occlusionBox.frag");
+		glGenVertexArrays(1, &mVAO);
+	}
+
+	mShader->UseShader();
+	mShader->SetViewProjectionMatrix(viewProjection);
+	GLState::BindVertexArray(mVAO);
+	// The boxes are only tested, and both of their sides count
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	GLState::DepthMask(false);
+	GLState::SetCapability(GL_CULL_FACE, false);
+}
+
+void OcclusionQueries::Issue(const std::vector<OcclusionTest>& tests)
+{
+	FrameVector<const OcclusionTest*> occluded;
+	for (size_t i = 0; i < tests.size(); i++) {
+		if (tests[i].object == nullptr)
+			continue;
+		if (tests[i].occluded) {
+			occluded.push_back(&tests[i]);
+			continue;
+		}
+		// Seen objects are asked one by one, a batch that shows would not tell which of them is
+		const OcclusionTest* test = &tests[i];
+		_Issue(&test, 1);
+	}
+
+	for (size_t i = 0; i < occluded.size(); i += OCCLUSION_QUERY_BATCH_SIZE)
+		_Issue(&occluded[i], std::min(occluded.size() - i, (size_t)OCCLUSION_QUERY_BATCH_SIZE));
+}
+
+void OcclusionQueries::_Issue(const OcclusionTest * const * tests, size_t count)
+{
+	GLuint query;
+	if (mFree.empty()) {
+		glGenQueries(1, &query);
+	}
+	else {
+		query = mFree.back();
+		mFree.pop_back();
+	}
+
+	glm::vec3 boxMins[OCCLUSION_QUERY_BATCH_SIZE];
+	glm::vec3 boxMaxs[OCCLUSION_QUERY_BATCH_SIZE];
+	PendingQuery pending = { query, mObjects.size(), count };
+	for (size_t i = 0; i < count; i++) {
+		boxMins[i] = tests[i]->boxMin;
+		boxMaxs[i] = tests[i]->boxMax;
+		mObjects.push_back(tests[i]->object);
+	}
+	mPending.push_back(pending);
+
+	mShader->SetBoxes(boxMins, boxMaxs, (GLsizei)count);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 14, (GLsizei)count);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	Profiler::Count(PC_DRAW_CALLS);
+	Profiler::Count(PC_OCCLUSION_QUERIES);
+}
+
+void OcclusionQueries::End()
+{
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	GLState::DepthMask(true);
+	GLState::SetCapability(GL_CULL_FACE, true);
+}
+
+void OcclusionQueries::Collect()
+{
+	// The queries still in flight are moved to the front, with their objects
+	size_t kept = 0;
+	size_t keptObjects = 0;
+	for (size_t i = 0; i < mPending.size(); i++) {
+		PendingQuery pending = mPending[i];
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			std::copy(mObjects.begin() + pending.first, mObjects.begin() + pending.first + pending.count, mObjects.begin() + keptObjects);
+			pending.first = keptObjects;
+			keptObjects += pending.count;
+			mPending[kept++] = pending;
+			continue;
+		}
+
+		GLuint samples = 0;
+		glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT, &samples);
+		for (size_t j = pending.first; j < pending.first + pending.count; j++) {
+			if (mObjects[j] != nullptr)
+				mObjects[j]->SetOccluded(samples == 0);
+		}
+		mFree.push_back(pending.query);
+	}
+	mPending.resize(kept);
+	mObjects.resize(keptObjects);
+}
+
+void OcclusionQueries::Forget(GLObject * const * objects, size_t count)
+{
+	if (mObjects.empty())
+		return;
+	if (count == 1) {
+		std::replace(mObjects.begin(), mObjects.end(), objects[0], (GLObject*)nullptr);
+		return;
+	}
+
+	// A whole renderer at once, looked up in order
+	FrameVector<GLObject*> sorted(count);
+	std::copy(objects, objects + count, sorted.begin());
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t i = 0; i < mObjects.size(); i++) {
+		if (mObjects[i] != nullptr && std::binary_search(sorted.begin(), sorted.end(), mObjects[i]))
+			mObjects[i] = nullptr;
+	}
+}
+
+void OcclusionQueries::Clear()
+{
+	for (size_t i = 0; i < mPending.size(); i++)
+		mFree.push_back(mPending[i].query);
+	if (!mFree.empty())
+		glDeleteQueries((GLsizei)mFree.size(), &mFree[0]);
+	mFree.clear();
+	mPending.clear();
+	mObjects.clear();
+
+	if (mVAO != 0)
+		GLState::DeleteVertexArray(mVAO);
+	mVAO = 0;
+	delete mShader;
+	mShader = nullptr;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "RenderSnapshot.h"
+
+class GLObject;
+class OcclusionBoxShader;
+
+// Snapshots between the queries of an object that is seen. Staggered over the objects, so as many are asked every frame
+const int OCCLUSION_QUERY_INTERVAL = 8;
+// Boxes of hidden objects drawn under one query. Must match MAX_BOXES in occlusionBox.vert
+const int OCCLUSION_QUERY_BATCH_SIZE = 8;
+// Snapshots after which an object whose query never came back is asked again
+const int OCCLUSION_QUERY_TIMEOUT = 8;
+// Boxes the camera is this close to are always drawn, the near plane would cut their query open
+const float OCCLUSION_QUERY_NEAR_MARGIN = 0.5f;
+
+/*!
+	Hardware occlusion queries of the objects' boxes, with their results used one frame later (coherent hierarchical
+	culling, CHC++).
+
+	Objects are drawn as long as their last query saw them, and only queried every OCCLUSION_QUERY_INTERVAL snapshots.
+	Objects found hidden are left out of the visible lists and queried every snapshot, OCCLUSION_QUERY_BATCH_SIZE
+	boxes per query, so a group that stays hidden costs one query; when a batch shows, all of its objects are drawn
+	again until their own queries hide them. BuildQueue decides what is tested, the main pass draws the boxes against
+	its depth buffer after the scene, and Collect reads the results that are available at the start of the next frame
+	without waiting for the others. Main thread only
+*/
+class OcclusionQueries
+{
+private:
+	struct PendingQuery {
+		GLuint query;
+		// Objects of the query in mObjects
+		size_t first;
+		size_t count;
+	};
+
+	static OcclusionBoxShader* mShader;
+	// Empty, the boxes are made in the vertex shader
+	static GLuint mVAO;
+	static std::vector<GLuint> mFree;
+	static std::vector<PendingQuery> mPending;
+	static std::vector<GLObject*> mObjects;
+
+	// Draws the boxes of up to OCCLUSION_QUERY_BATCH_SIZE tests under one query
+	static void _Issue(const OcclusionTest* const* tests, size_t count);
+
+public:
+	// Sets up the box drawing against the depth buffer of the pass just drawn
+	static void Begin(const glm::mat4& viewProjection);
+	// Issues the queries of a queue's tests. Between Begin and End
+	static void Issue(const std::vector<OcclusionTest>& tests);
+	// Restores the state of the main pass
+	static void End();
+	// Hands the results that came back to their objects
+	static void Collect();
+	// Drops objects that are about to be destroyed from the queries in flight
+	static void Forget(GLObject* const* objects, size_t count);
+	// Queries in flight, whose results were not collected yet
+	static size_t GetPendingCount() { return mPending.size(); }
+	static void Clear();
+};
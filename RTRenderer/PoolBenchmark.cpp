@@ -0,0 +1,112 @@
+#include "PoolBenchmark.h"
+
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+
+#include "Transform.h"
+#include "GLRenderer.h"
+#include "MaterialTable.h"
+
+double PoolBenchmark::_Lap()
+{
+	static std::chrono::high_resolution_clock::time_point last = std::chrono::high_resolution_clock::now();
+	std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+	double milliseconds = std::chrono::duration<double, std::milli>(now - last).count();
+	last = now;
+	return milliseconds;
+}
+
+void PoolBenchmark::_RunPools(size_t count)
+{
+	Material* material = MaterialTable::Intern(0.5f, 32.0f, 1.0f, 1.0f, 1.0f);
+	std::vector<Transform*> transforms(count);
+	std::vector<GLObject*> objects(count);
+	_Lap();
+
+	for (size_t i = 0; i < count; i++) {
+		transforms[i] = ObjectPool<Transform>::Create();
+		transforms[i]->TranslateLocal(glm::vec3((float)i, 0.0f, 0.0f));
+		objects[i] = ObjectPool<GLObject>::Create(transforms[i], material, 0);
+	}
+	printf("  create:  %8.2f ms\n", _Lap());
+
+	// Every other object goes and comes back, reusing the freed slots
+	for (size_t i = 0; i < count; i += 2) {
+		ObjectPool<GLObject>::Destroy(objects[i]);
+		ObjectPool<Transform>::Destroy(transforms[i]);
+	}
+	for (size_t i = 0; i < count; i += 2) {
+		transforms[i] = ObjectPool<Transform>::Create();
+		transforms[i]->TranslateLocal(glm::vec3((float)i, 0.0f, 0.0f));
+		objects[i] = ObjectPool<GLObject>::Create(transforms[i], material, 0);
+	}
+	printf("  churn:   %8.2f ms\n", _Lap());
+
+	float sum = 0.0f;
+	ObjectPool<GLObject>::ForEach([&sum](GLObject* object) { sum += object->GetTransformMatrix()[3][0]; });
+	printf("  iterate: %8.2f ms (%g)\n", _Lap(), sum);
+
+	for (size_t i = 0; i < count; i++) {
+		ObjectPool<GLObject>::Destroy(objects[i]);
+		ObjectPool<Transform>::Destroy(transforms[i]);
+	}
+	printf("  destroy: %8.2f ms\n", _Lap());
+
+	// A whole hierarchy goes with its root
+	Transform* root = ObjectPool<Transform>::Create();
+	for (size_t i = 0; i < count; i++)
+		ObjectPool<Transform>::Create(root);
+	ObjectPool<Transform>::Destroy(root);
+	printf("  tree:    %8.2f ms\n", _Lap());
+
+	printf("  alive: %zu transforms, %zu objects\n", ObjectPool<Transform>::GetCount(), ObjectPool<GLObject>::GetCount());
+	ObjectPool<GLObject>::Clear();
+	ObjectPool<Transform>::Clear();
+}
+
+void PoolBenchmark::_RunHeap(size_t count)
+{
+	Material* material = MaterialTable::Intern(0.5f, 32.0f, 1.0f, 1.0f, 1.0f);
+	std::vector<Transform*> transforms(count);
+	std::vector<GLObject*> objects(count);
+	_Lap();
+
+	for (size_t i = 0; i < count; i++) {
+		transforms[i] = new Transform();
+		transforms[i]->TranslateLocal(glm::vec3((float)i, 0.0f, 0.0f));
+		objects[i] = new GLObject(transforms[i], material, 0);
+	}
+	printf("  create:  %8.2f ms\n", _Lap());
+
+	for (size_t i = 0; i < count; i += 2) {
+		delete objects[i];
+		delete transforms[i];
+	}
+	for (size_t i = 0; i < count; i += 2) {
+		transforms[i] = new Transform();
+		transforms[i]->TranslateLocal(glm::vec3((float)i, 0.0f, 0.0f));
+		objects[i] = new GLObject(transforms[i], material, 0);
+	}
+	printf("  churn:   %8.2f ms\n", _Lap());
+
+	float sum = 0.0f;
+	for (size_t i = 0; i < count; i++)
+		sum += objects[i]->GetTransformMatrix()[3][0];
+	printf("  iterate: %8.2f ms (%g)\n", _Lap(), sum);
+
+	for (size_t i = 0; i < count; i++) {
+		delete objects[i];
+		delete transforms[i];
+	}
+	printf("  destroy: %8.2f ms\n", _Lap());
+}
+
+void PoolBenchmark::Run(size_t count)
+{
+	printf("Object pools, %zu transforms and objects:\n", count);
+	_RunPools(count);
+	printf("new and delete, %zu transforms and objects:\n", count);
+	_RunHeap(count);
+	MaterialTable::Clear();
+}
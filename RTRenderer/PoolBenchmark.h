@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+// Objects the pool benchmark creates and destroys
+const size_t POOL_BENCHMARK_OBJECTS = 100000;
+
+/*!
+	Stress test of the object pools, run from the menu instead of a program.
+
+	Creates and destroys POOL_BENCHMARK_OBJECTS transforms and objects, first through their pools and then with new
+	and delete, and prints how long each step took. Half of the objects are destroyed and created again in between, so
+	the pools also run from their free lists. Needs no window nor GL context.
+*/
+class PoolBenchmark
+{
+private:
+	// Milliseconds since the last call
+	static double _Lap();
+	static void _RunPools(size_t count);
+	static void _RunHeap(size_t count);
+public:
+	static void Run(size_t count = POOL_BENCHMARK_OBJECTS);
+};
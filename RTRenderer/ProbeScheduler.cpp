@@ -0,0 +1,126 @@
+#include "ProbeScheduler.h"
+#include "GLRenderer.h"
+
+#include <algorithm>
+
+ProbeScheduler::ProbeScheduler() :
+	m_faceBudget(PROBE_DEFAULT_FACE_BUDGET)
+{
+}
+
+glm::vec3 ProbeScheduler::_GetPosition(Transform * transform)
+{
+	return glm::vec3(transform->GetWorldMatrix()[3]);
+}
+
+bool ProbeScheduler::_MovedNear(glm::vec3 position, const FrameVector<Transform*>& dynamics) const
+{
+	for (size_t i = 0; i < dynamics.size(); i++) {
+		glm::vec3 current = _GetPosition(dynamics[i]);
+		if (glm::distance(current, position) > PROBE_INFLUENCE_RADIUS)
+			continue;
+
+		auto last = m_lastPositions.find(dynamics[i]);
+		if (last == m_lastPositions.end() || glm::distance(current, last->second) > PROBE_MOTION_EPSILON)
+			return true;
+	}
+	return false;
+}
+
+ReflectionProbe * ProbeScheduler::AddProbe(Transform * transform, CubeMap * cubemap, GLObject * object, float radius)
+{
+	ReflectionProbe* probe = new ReflectionProbe();
+	probe->transform = transform;
+	probe->cubemap = cubemap;
+	probe->object = object;
+	probe->radius = radius;
+	probe->nextFace = 0;
+	probe->staleFaces = 6;
+	probe->priority = 0.0f;
+	probe->lastPosition = _GetPosition(transform);
+	m_probes.push_back(probe);
+	return probe;
+}
+
+void ProbeScheduler::SetFaceBudget(int faces)
+{
+	m_faceBudget = std::max(faces, 0);
+}
+
+void ProbeScheduler::ScheduleProbe(ReflectionProbe * probe, std::vector<ProbeFaceUpdate>& updates)
+{
+	for (int face = 0; face < 6; face++)
+		updates.push_back({ probe, face, probe->transform->GetPosition() });
+
+	probe->staleFaces = 0;
+	probe->priority = 0.0f;
+	probe->lastPosition = _GetPosition(probe->transform);
+	Profiler::Count(PC_PROBE_FACES_RENDERED, 6);
+}
+
+void ProbeScheduler::Schedule(const FrameVector<Transform*>& dynamics, std::vector<ProbeFaceUpdate>& updates)
+{
+	glm::vec3 cameraPosition = Camera::GetInstance()->GetCameraPosition();
+
+	FrameVector<ReflectionProbe*> candidates;
+	candidates.reserve(m_probes.size());
+	for (size_t i = 0; i < m_probes.size(); i++) {
+		ReflectionProbe* probe = m_probes[i];
+
+		glm::vec3 position = _GetPosition(probe->transform);
+		bool moved = glm::distance(position, probe->lastPosition) > PROBE_MOTION_EPSILON || _MovedNear(position, dynamics);
+		probe->lastPosition = position;
+		if (moved)
+			probe->staleFaces = 6;
+
+		if (probe->staleFaces == 0)
+			continue;
+
+		// A probe whose object the last occlusion query had hidden is as off-screen as one behind the camera
+		float coverage = probe->object ? probe->object->GetProjectedSize(probe->radius) :
+			Camera::GetInstance()->GetProjectedSize(position, probe->radius);
+		if (coverage <= 0.0f || (probe->object && probe->object->IsOccluded()))
+			continue;
+
+		float distance = std::max(glm::distance(cameraPosition, position), 1.0f);
+		probe->priority += std::min(coverage, 4096.0f) / distance * (moved ? PROBE_MOTION_WEIGHT : 1.0f);
+		candidates.push_back(probe);
+	}
+
+	for (size_t i = 0; i < dynamics.size(); i++)
+		m_lastPositions[dynamics[i]] = _GetPosition(dynamics[i]);
+
+	updates.clear();
+	while ((int)updates.size() < m_faceBudget && !candidates.empty()) {
+		auto best = std::max_element(candidates.begin(), candidates.end(),
+			[](ReflectionProbe* a, ReflectionProbe* b) { return a->priority < b->priority; });
+		ReflectionProbe* probe = *best;
+
+		updates.push_back({ probe, probe->nextFace, probe->transform->GetPosition() });
+		probe->nextFace = (probe->nextFace + 1) % 6;
+		probe->staleFaces--;
+
+		// Spending half of the priority on each face lets other probes take their turn
+		probe->priority *= 0.5f;
+		if (probe->staleFaces == 0) {
+			probe->priority = 0.0f;
+			candidates.erase(best);
+		}
+	}
+
+	Profiler::Count(PC_PROBE_FACES_RENDERED, updates.size());
+}
+
+std::vector<ProbeFaceUpdate> ProbeScheduler::ScheduleAll()
+{
+	std::vector<ProbeFaceUpdate> updates;
+	for (size_t i = 0; i < m_probes.size(); i++)
+		ScheduleProbe(m_probes[i], updates);
+	return updates;
+}
+
+ProbeScheduler::~ProbeScheduler()
+{
+	for (size_t i = 0; i < m_probes.size(); i++)
+		delete m_probes[i];
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include <glm\glm.hpp>
+
+#include "CubeMap.h"
+#include "Transform.h"
+#include "Camera.h"
+#include "Profiler.h"
+#include "FrameArena.h"
+
+class GLObject;
+
+// Cube map faces rendered per frame unless changed with SetFaceBudget
+const int PROBE_DEFAULT_FACE_BUDGET = 2;
+// Dynamic objects closer than this to a probe are considered to show up in its reflection
+const float PROBE_INFLUENCE_RADIUS = 20.0f;
+// Priority multiplier of probes that have something moving near them
+const float PROBE_MOTION_WEIGHT = 4.0f;
+// Smallest displacement in a frame that counts as movement
+const float PROBE_MOTION_EPSILON = 0.0001f;
+
+// Environment cube map rendered around a point of the scene
+struct ReflectionProbe {
+	Transform* transform;
+	CubeMap* cubemap;
+	// Object that displays the probe, used to measure how much of the screen it covers.
+	// Null for probes that are only sampled by other objects
+	GLObject* object;
+	// Local bounding radius of that object, or the world radius of the probe when there is no object
+	float radius;
+
+	// Next face to render, faces are refreshed round-robin
+	int nextFace;
+	// Faces still showing an outdated environment
+	int staleFaces;
+	// Accumulates every frame the probe is waiting on screen and is spent as its faces are rendered
+	float priority;
+	glm::vec3 lastPosition;
+};
+
+struct ProbeFaceUpdate {
+	ReflectionProbe* probe;
+	int face;
+	// Local position of the probe when the face was scheduled, where the face is rendered from
+	glm::vec3 position;
+};
+
+/*!
+	Decides which reflection probe faces are rendered each frame.
+
+	A probe only needs its faces re-rendered when it moved or a dynamic object moved close to it. Stale probes that
+	are visible gain priority every frame according to their screen coverage, their distance to the camera and
+	whether something is moving near them, and the face budget is spent on the most urgent ones, one face at a time.
+	Probes off-screen, or whose object is hidden behind the scene, keep their stale faces until they are seen again.
+*/
+class ProbeScheduler
+{
+private:
+	std::vector<ReflectionProbe*> m_probes;
+	// Positions of the dynamic objects on the previous frame
+	std::unordered_map<Transform*, glm::vec3> m_lastPositions;
+	int m_faceBudget;
+
+	static glm::vec3 _GetPosition(Transform* transform);
+	bool _MovedNear(glm::vec3 position, const FrameVector<Transform*>& dynamics) const;
+public:
+	ProbeScheduler();
+
+	ReflectionProbe* AddProbe(Transform* transform, CubeMap* cubemap, GLObject* object, float radius);
+
+	void SetFaceBudget(int faces);
+	int GetFaceBudget() const { return m_faceBudget; }
+
+	// Appends every face of the probe, regardless of the budget, and marks it up to date. For a probe whose cube map
+	// was just reallocated, which has nothing to show until all of its faces are drawn again
+	void ScheduleProbe(ReflectionProbe* probe, std::vector<ProbeFaceUpdate>& updates);
+
+	/*!
+		\n void ProbeScheduler::Schedule(const FrameVector<Transform*>& dynamics, std::vector<ProbeFaceUpdate>& updates)
+		\param const FrameVector<Transform*>& dynamics Transforms of the dynamic objects of the scene
+		\param std::vector<ProbeFaceUpdate>& updates Replaced with the faces to render this frame, at most the face budget
+	*/
+	void Schedule(const FrameVector<Transform*>& dynamics, std::vector<ProbeFaceUpdate>& updates);
+	// Returns every face of every probe, regardless of the budget and visibility
+	std::vector<ProbeFaceUpdate> ScheduleAll();
+
+	~ProbeScheduler();
+};
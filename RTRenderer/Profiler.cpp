@@ -0,0 +1,98 @@
+#include "Profiler.h"
+
+#include <stdlib.h>
+#include <new>
+
+const char* Profiler::COUNTER_NAMES[PC_COUNT] = {
+	"GL calls issued",
+	"GL calls skipped",
+	"Draw calls",
+	"Texture upload bytes",
+	"Probe faces rendered",
+	"Render target allocations",
+	"Terrain triangles",
+	"Heap allocations",
+	"Occluded objects",
+	"Occluder triangles",
+	"Occlusion microseconds",
+	"Occlusion queries",
+	"Query occluded objects"
+};
+
+const char* Profiler::GAUGE_NAMES[PG_COUNT] = {
+	"Resident texture bytes",
+	"Live render target bytes",
+	"Pooled render target bytes"
+};
+
+std::atomic<unsigned long long> Profiler::mCounters[PC_COUNT];
+std::atomic<unsigned long long> Profiler::mGauges[PG_COUNT];
+int Profiler::mFrames = 0;
+
+void Profiler::Count(ProfilerCounter counter, unsigned long long amount)
+{
+	mCounters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Profiler::SetGauge(ProfilerGauge gauge, unsigned long long value)
+{
+	mGauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+void Profiler::NewFrame()
+{
+	mFrames++;
+}
+
+void Profiler::Report()
+{
+	if (mFrames == 0)
+		return;
+
+	for (size_t i = 0; i < PC_COUNT; i++) {
+		unsigned long long value = mCounters[i].exchange(0, std::memory_order_relaxed);
+		printf("  %s: %llu/frame\n", COUNTER_NAMES[i], value / mFrames);
+	}
+
+	for (size_t i = 0; i < PG_COUNT; i++) {
+		printf("  %s: %llu\n", GAUGE_NAMES[i], mGauges[i].load(std::memory_order_relaxed));
+	}
+
+	mFrames = 0;
+}
+
+// Every allocation through new is counted, so the per-frame report shows what the hot paths still allocate
+void* operator new(size_t size)
+{
+	Profiler::Count(PC_HEAP_ALLOCATIONS);
+	void* memory = malloc(size > 0 ? size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+// C++14 sized deletes, which would otherwise go to the library's and free memory that did not come from it
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
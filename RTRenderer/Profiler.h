@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+
+// Counters accumulated during a frame and reported as per-frame averages
+enum ProfilerCounter {
+	// GL state changes and uniform uploads sent to the driver
+	PC_GL_CALLS_ISSUED,
+	// GL state changes and uniform uploads filtered by the state cache
+	PC_GL_CALLS_SKIPPED,
+	// glDraw* calls
+	PC_DRAW_CALLS,
+	// Bytes of texture data streamed to the GPU
+	PC_TEXTURE_UPLOAD_BYTES,
+	// Reflection probe cube map faces rendered
+	PC_PROBE_FACES_RENDERED,
+	// Render target textures created by the pool
+	PC_RENDER_TARGET_ALLOCATIONS,
+	// Triangles of the terrain chunks drawn, over every pass
+	PC_TERRAIN_TRIANGLES,
+	// Calls to the global operator new, from any thread. Should be 0 once the scene is streamed in
+	PC_HEAP_ALLOCATIONS,
+	// Objects in the camera's frustum left out because the CPU depth buffer has them behind the occluders
+	PC_OCCLUDED_OBJECTS,
+	// Occluder triangles rasterized into the CPU depth buffer
+	PC_OCCLUDER_TRIANGLES,
+	// Microseconds spent setting up and rasterizing the occluders
+	PC_OCCLUSION_MICROSECONDS,
+	// Hardware occlusion queries issued, each with one or a batch of boxes
+	PC_OCCLUSION_QUERIES,
+	// Objects in the camera's frustum left out because their last occlusion query had them hidden
+	PC_QUERY_OCCLUDED_OBJECTS,
+	PC_COUNT
+};
+
+// Values that are sampled, not accumulated. The last value set is reported
+enum ProfilerGauge {
+	// Bytes of texture mip levels resident on the GPU through the streamer
+	PG_TEXTURE_RESIDENT_BYTES,
+	// Bytes of render targets in use
+	PG_RENDER_TARGET_LIVE_BYTES,
+	// Bytes of released render targets kept for reuse
+	PG_RENDER_TARGET_POOLED_BYTES,
+	PG_COUNT
+};
+
+// This class gathers per-frame statistics and prints them once per second, next to the FPS
+class Profiler
+{
+private:
+	static const char* COUNTER_NAMES[PC_COUNT];
+	static const char* GAUGE_NAMES[PG_COUNT];
+
+	static std::atomic<unsigned long long> mCounters[PC_COUNT];
+	static std::atomic<unsigned long long> mGauges[PG_COUNT];
+	static int mFrames;
+
+public:
+	// Adds amount to the given counter. Safe to call from any thread
+	static void Count(ProfilerCounter counter, unsigned long long amount = 1);
+	// Sets the current value of a gauge. Safe to call from any thread
+	static void SetGauge(ProfilerGauge gauge, unsigned long long value);
+	// Marks the beginning of a new frame
+	static void NewFrame();
+	// Prints the per-frame average of every counter since the last report, resets them and prints the gauges
+	static void Report();
+};
@@ -5,6 +5,8 @@ enum RenderMode {
 	CINEMATIC,
 	// User is allowed to control the camera
 	ROAM,
+	// Bakes the reflection probes to the cache and exits
+	BAKE,
 	// Undefined mode - doesn't run
 	UNDEFINED
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#include "RenderSnapshot.h"
+
+int RenderSnapshot::mWriteIndex = 0;
+int RenderSnapshot::mReadIndex = RENDER_SNAPSHOT_COUNT - 1;
+unsigned long long RenderSnapshot::mFrames[RENDER_SNAPSHOT_COUNT];
+unsigned long long RenderSnapshot::mFrame = 0;
+
+void RenderSnapshot::Publish()
+{
+	mFrames[mWriteIndex] = mFrame++;
+	mReadIndex = mWriteIndex;
+	mWriteIndex = (mWriteIndex + 1) % RENDER_SNAPSHOT_COUNT;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+class Material;
+class BakedProbe;
+class GLObject;
+
+// Snapshots in flight. The simulation writes one while the renderer draws the other, so the latency is one frame
+const int RENDER_SNAPSHOT_COUNT = 2;
+
+// What a draw needs of an object, copied when the snapshot is built so drawing never reads a live transform
+struct RenderItem {
+	// Slot of the object's world matrix in the snapshot's ModelMatrixBuffer
+	int matrixIndex;
+	Material* material;
+	BakedProbe* probe;
+	bool isStatic;
+	// Bit i is set when the object is within reach of point or spot light i, the point lights first
+	unsigned int lights;
+};
+
+// Object whose box is drawn in an occlusion query after the main pass
+struct OcclusionTest {
+	// Null once the object was removed
+	GLObject* object;
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	// Whether the object was left out of the snapshot. Hidden objects share their queries
+	bool occluded;
+};
+
+// Objects of a renderer as of one snapshot
+struct RenderQueue {
+	std::vector<RenderItem> items;
+	// The items in the camera's frustum
+	std::vector<RenderItem> visible;
+	// The items in the directional light's frustum, the only ones that can cast into its shadow map
+	std::vector<RenderItem> casters;
+	// The items in the camera's frustum whose visibility is asked to the GPU
+	std::vector<OcclusionTest> tests;
+};
+
+// The main camera as of one snapshot
+struct RenderView {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 position;
+};
+
+/*!
+	Which buffer of the per-snapshot state is written and which one is drawn.
+
+	Everything the renderer reads from the scene (the model matrices, visible lists, the camera, light positions and the
+	probe faces to refresh) is kept once per snapshot by its owner. The simulation of frame N+1 fills the write buffers
+	while the main thread draws frame N from the read buffers, and Publish swaps them once both are done. Whatever is
+	added to the renderer in between shows up with the next snapshot.
+*/
+class RenderSnapshot
+{
+private:
+	static int mWriteIndex;
+	static int mReadIndex;
+	// Frame each buffer was written on
+	static unsigned long long mFrames[RENDER_SNAPSHOT_COUNT];
+	// Frame of the snapshot being written
+	static unsigned long long mFrame;
+
+public:
+	static int GetWriteIndex() { return mWriteIndex; }
+	static int GetReadIndex() { return mReadIndex; }
+	static unsigned long long GetWriteFrame() { return mFrame; }
+	static unsigned long long GetReadFrame() { return mFrames[mReadIndex]; }
+
+	// Makes the snapshot just written the one drawn and moves on to the next buffer. Neither side may be running
+	static void Publish();
+};
@@ -0,0 +1,143 @@
+#include "RenderTargetPool.h"
+
+std::vector<RenderTarget*> RenderTargetPool::mFree;
+size_t RenderTargetPool::mLiveBytes = 0;
+size_t RenderTargetPool::mPooledBytes = 0;
+size_t RenderTargetPool::mPoolBudget = RENDER_TARGET_POOL_BUDGET;
+
+size_t RenderTargetPool::GetBytesPerPixel(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_RGBA32F:
+		return 16;
+	case GL_RGBA16F:
+		return 8;
+	case GL_RGB16F:
+		return 6;
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_R11F_G11F_B10F:
+	case GL_RGBA8:
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32F:
+	default:
+		return 4;
+	}
+}
+
+bool RenderTargetPool::IsDepthFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT16 ||
+		internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F;
+}
+
+RenderTarget * RenderTargetPool::_Create(GLenum target, GLsizei width, GLsizei height, GLenum internalFormat)
+{
+	bool depth = IsDepthFormat(internalFormat);
+	GLenum format = depth ? GL_DEPTH_COMPONENT : (internalFormat == GL_R11F_G11F_B10F || internalFormat == GL_RGB16F ? GL_RGB : GL_RGBA);
+	GLenum type = (internalFormat == GL_RGBA8) ? GL_UNSIGNED_BYTE : GL_FLOAT;
+	GLint filter = depth ? GL_NEAREST : GL_LINEAR;
+
+	RenderTarget* renderTarget = new RenderTarget();
+	renderTarget->target = target;
+	renderTarget->width = width;
+	renderTarget->height = height;
+	renderTarget->internalFormat = internalFormat;
+	renderTarget->bytes = (size_t)width * height * GetBytesPerPixel(internalFormat) * (target == GL_TEXTURE_CUBE_MAP ? 6 : 1);
+
+	glGenTextures(1, &renderTarget->texture);
+	GLState::BindTexture(0, target, renderTarget->texture);
+
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		for (GLenum i = 0; i < 6; ++i)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, width, height, 0, format, type, nullptr);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else {
+		glTexImage2D(target, 0, internalFormat, width, height, 0, format, type, nullptr);
+	}
+
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	Profiler::Count(PC_RENDER_TARGET_ALLOCATIONS);
+	return renderTarget;
+}
+
+void RenderTargetPool::_Destroy(RenderTarget * renderTarget)
+{
+	GLState::DeleteTexture(renderTarget->texture);
+	delete renderTarget;
+}
+
+void RenderTargetPool::_Trim()
+{
+	size_t count = 0;
+	while (count < mFree.size() && mPooledBytes > mPoolBudget) {
+		mPooledBytes -= mFree[count]->bytes;
+		_Destroy(mFree[count]);
+		count++;
+	}
+	mFree.erase(mFree.begin(), mFree.begin() + count);
+}
+
+void RenderTargetPool::_Report()
+{
+	Profiler::SetGauge(PG_RENDER_TARGET_LIVE_BYTES, mLiveBytes);
+	Profiler::SetGauge(PG_RENDER_TARGET_POOLED_BYTES, mPooledBytes);
+}
+
+RenderTarget * RenderTargetPool::Acquire(GLenum target, GLsizei width, GLsizei height, GLenum internalFormat)
+{
+	RenderTarget* renderTarget = nullptr;
+
+	// Most recently released first, it is the most likely to be requested again
+	for (size_t i = mFree.size(); i-- > 0; ) {
+		RenderTarget* candidate = mFree[i];
+		if (candidate->target == target && candidate->width == width && candidate->height == height &&
+			candidate->internalFormat == internalFormat) {
+			renderTarget = candidate;
+			mFree.erase(mFree.begin() + i);
+			mPooledBytes -= renderTarget->bytes;
+			break;
+		}
+	}
+
+	if (renderTarget == nullptr)
+		renderTarget = _Create(target, width, height, internalFormat);
+
+	mLiveBytes += renderTarget->bytes;
+	_Report();
+	return renderTarget;
+}
+
+void RenderTargetPool::Release(RenderTarget * renderTarget)
+{
+	if (renderTarget == nullptr)
+		return;
+
+	mLiveBytes -= renderTarget->bytes;
+	mPooledBytes += renderTarget->bytes;
+	mFree.push_back(renderTarget);
+	_Trim();
+	_Report();
+}
+
+void RenderTargetPool::SetPoolBudget(size_t bytes)
+{
+	mPoolBudget = bytes;
+	_Trim();
+	_Report();
+}
+
+void RenderTargetPool::Clear()
+{
+	for (size_t i = 0; i < mFree.size(); i++)
+		_Destroy(mFree[i]);
+	mFree.clear();
+	mPooledBytes = 0;
+	_Report();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "GLState.h"
+#include "Profiler.h"
+
+// Bytes of released targets kept for reuse before the oldest ones are deleted
+const size_t RENDER_TARGET_POOL_BUDGET = 64 * 1024 * 1024;
+
+// Texture that is rendered to. Owned by the RenderTargetPool
+struct RenderTarget {
+	GLuint texture;
+	// GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	GLenum target;
+	GLsizei width;
+	GLsizei height;
+	GLenum internalFormat;
+	size_t bytes;
+};
+
+/*!
+	Hands out 2D and cube map render targets and keeps the released ones to be reused.
+
+	Targets are matched by (type, size, internal format), so an object that switches between a few resolutions only
+	allocates each of them once. Released targets are kept up to RENDER_TARGET_POOL_BUDGET bytes, oldest deleted first.
+	Live and pooled bytes are reported by the Profiler.
+*/
+class RenderTargetPool
+{
+private:
+	// Released targets, oldest first
+	static std::vector<RenderTarget*> mFree;
+	static size_t mLiveBytes;
+	static size_t mPooledBytes;
+	static size_t mPoolBudget;
+
+	static RenderTarget* _Create(GLenum target, GLsizei width, GLsizei height, GLenum internalFormat);
+	static void _Destroy(RenderTarget* renderTarget);
+	static void _Trim();
+	static void _Report();
+
+public:
+	/*!
+		\n RenderTarget* RenderTargetPool::Acquire(GLenum target, GLsizei width, GLsizei height, GLenum internalFormat)
+		\param GLenum target GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+		\param GLenum internalFormat Sized format, e.g. GL_RGBA16F, GL_R11F_G11F_B10F or GL_DEPTH_COMPONENT24
+
+		Returns a target with undefined content. It is created with clamp to edge wrapping and linear filtering
+		(nearest for depth formats); callers that need other parameters set them after every Acquire
+	*/
+	static RenderTarget* Acquire(GLenum target, GLsizei width, GLsizei height, GLenum internalFormat);
+	// Gives the target back to the pool. Accepts null
+	static void Release(RenderTarget* renderTarget);
+
+	static void SetPoolBudget(size_t bytes);
+	static size_t GetLiveBytes() { return mLiveBytes; }
+	static size_t GetPooledBytes() { return mPooledBytes; }
+
+	static size_t GetBytesPerPixel(GLenum internalFormat);
+	static bool IsDepthFormat(GLenum internalFormat);
+
+	// Deletes the pooled targets. Live targets stay valid
+	static void Clear();
+};
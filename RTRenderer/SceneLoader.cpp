@@ -1,11 +1,18 @@
 #include "SceneLoader.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <set>
+
 enum LightType {
 	SPOT, POINT, DIRECTIONAL
 };
 
 const std::string TRANSFORMS_KEY = "transforms";
-const std::string TRANSFORM_KEY = "transform";
+const std::string CHILDREN_KEY = "children";
+const std::string NODE_KEY = "node";
+const std::string STATIC_KEY = "static";
 
 const std::string POSITION_KEY = "translation";
 const std::string ROTATION_KEY = "rotation";
@@ -35,11 +42,64 @@ const std::string SPOT_LIGHTS_KEY = "slights";
 const std::string SPOT_LIGHT_KEY = "slight_%d";
 
 const std::string MODELS_KEY = "models";
+const std::string BATCHED_MODELS_KEY = "batched";
+
+const std::string MATERIALS_KEY = "materials";
+const std::string MATERIAL_KEY = "material";
+const std::string SHININESS_KEY = "shininess";
+const std::string COLOR_KEY = "color";
+const std::string TEXTURE_KEY = "texture";
+const std::string REFLECTIVITY_KEY = "reflectivity";
+
+const std::string PROBES_KEY = "probes";
+const std::string BOX_MIN_KEY = "boxmin";
+const std::string BOX_MAX_KEY = "boxmax";
+const std::string SIZE_KEY = "size";
+const std::string DYNAMIC_KEY = "dynamic";
+
+const std::string WORLD_KEY = "world";
+const std::string ORIGIN_KEY = "origin";
+const std::string TILE_SIZE_KEY = "tilesize";
+const std::string TILES_KEY = "tiles";
+const std::string PAGES_KEY = "pages";
+const std::string HEIGHT_SCALE_KEY = "heightscale";
+const std::string TILING_KEY = "tiling";
+const std::string LOAD_RADIUS_KEY = "loadradius";
+const std::string UNLOAD_RADIUS_KEY = "unloadradius";
+const std::string BUDGET_KEY = "budget";
+const std::string OBJECTS_KEY = "objects";
+const std::string MODEL_KEY = "model";
 
 const std::string SHADERS_KEY = "shaders";
 const std::string SHADER_KEY = "shader_%d";
 const std::string VERTEX_SHADER_KEY = "vertex";
 const std::string FRAGMENT_SHADER_KEY = "fragment";
+// The renderer does not keep the files of its shader, Store writes these
+const std::string DEFAULT_VERTEX_SHADER = "Shaders/shader.vert";
+const std::string DEFAULT_FRAGMENT_SHADER = "Shaders/shader.frag";
+
+const std::string BEHAVIORS_KEY = "behaviors";
+const std::string TYPE_KEY = "type";
+const std::string MODE_KEY = "mode";
+const std::string SPEED_KEY = "speed";
+const std::string TURN_KEY = "turn";
+const std::string FRAMES_KEY = "frames";
+const std::string TIME_KEY = "time";
+const std::string PREFETCH_KEY = "prefetch";
+
+const std::string HELICOPTER_BEHAVIOR = "helicopter";
+const std::string CAMERA_BEHAVIOR = "camera";
+const std::string CAMERA_CONTROLLER_BEHAVIOR = "cameracontroller";
+const std::string KEYFRAMES_BEHAVIOR = "keyframes";
+const std::string PRINT_KEYFRAME_BEHAVIOR = "printkeyframe";
+const std::string ACTIVATE_LIGHTS_BEHAVIOR = "activatelights";
+
+// Behaviors with a mode are only added in the program of that mode
+const std::string CINEMATIC_MODE = "cinematic";
+const std::string ROAM_MODE = "roam";
+
+const std::string REFRACT_NODE = "refract";
+const std::string REFLECT_NODE = "reflect";
 
 void LoadLight(LightType type, nlohmann::json light, GLRenderer * meshRenderer, Transform* rootObject) {
 	GLfloat diffIntensity = light[DIFFUSE_INTENSITY_KEY];
@@ -68,7 +128,7 @@ void LoadLight(LightType type, nlohmann::json light, GLRenderer * meshRenderer,
 		pitch = light[ROTATION_KEY][X_KEY];
 		yaw = light[ROTATION_KEY][Y_KEY];
 		roll = light[ROTATION_KEY][Z_KEY];
-		lt = new Transform(rootObject);
+		lt = ObjectPool<Transform>::Create(rootObject);
 		lt->Rotate(pitch, yaw, roll);
 		meshRenderer->SetDirectionalLight(
 			new DirectionalLight(lt, 
@@ -84,7 +144,7 @@ void LoadLight(LightType type, nlohmann::json light, GLRenderer * meshRenderer,
 		constant = light[CONSTANT_KEY];
 		linear = light[LINEAR_KEY];
 		exponent = light[EXPONENT_KEY];
-		lt = new Transform(rootObject);
+		lt = ObjectPool<Transform>::Create(rootObject);
 		lt->Translate(glm::vec3(xPos, yPos, zPos));
 		meshRenderer->AddPointLight(
 			new PointLight(lt,
@@ -106,7 +166,7 @@ void LoadLight(LightType type, nlohmann::json light, GLRenderer * meshRenderer,
 		linear = light[LINEAR_KEY];
 		exponent = light[EXPONENT_KEY];
 		edge = light[EDGE_KEY];
-		lt = new Transform(rootObject);
+		lt = ObjectPool<Transform>::Create(rootObject);
 		lt->Translate(glm::vec3(xPos, yPos, zPos));
 		lt->Rotate(pitch, yaw, roll);
 		meshRenderer->AddSpotLight(
@@ -121,26 +181,80 @@ void LoadLight(LightType type, nlohmann::json light, GLRenderer * meshRenderer,
 	}
 }
 
-void LoadModels(nlohmann::json jsonObject, GLRenderer * meshRenderer) {
-	std::vector<std::string> modelLocations = jsonObject[MODELS_KEY];
+void LoadLights(nlohmann::json& lights, GLRenderer* meshRenderer, Transform* rootObject) {
+	// -- Parse direct lights --
+	nlohmann::json obj_1 = lights[DIRECTIONAL_LIGHT_KEY];
+
+	if(strcmp(obj_1.type_name(), "null") != 0) {
+		LoadLight(DIRECTIONAL, obj_1, meshRenderer, rootObject);
+	}
+
+	// -- Parse point lights --
+	int i = 0;
+	char locBuff[100] = { "\0" };
+	obj_1 = lights[POINT_LIGHTS_KEY];
+
+	snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
+	nlohmann::json obj_2 = obj_1[locBuff];
+
+	while (strcmp(obj_2.type_name(), "null") != 0) {
+		LoadLight(POINT, obj_2, meshRenderer, rootObject);
+
+		i++;
+		snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
+		obj_2 = obj_1[locBuff];
+	}
+
+	// -- Parse spot lights --
+	i = 0;
+	obj_1 = lights[SPOT_LIGHTS_KEY];
+
+	snprintf(locBuff, sizeof(locBuff), SPOT_LIGHT_KEY.c_str(), i);
+	obj_2 = obj_1[locBuff];
+
+	while (strcmp(obj_2.type_name(), "null") != 0) {
+		LoadLight(SPOT, obj_2, meshRenderer, rootObject);
+
+		i++;
+		snprintf(locBuff, sizeof(locBuff), SPOT_LIGHT_KEY.c_str(), i);
+		obj_2 = obj_1[locBuff];
+	}
+}
+
+std::vector<std::string> LoadBatchedModels(nlohmann::json& settings) {
+	// Models whose meshes are merged in a single draw, with their albedo textures packed in an array
+	std::vector<std::string> batchedModels;
+	if (settings.find(BATCHED_MODELS_KEY) != settings.end())
+		batchedModels = settings[BATCHED_MODELS_KEY].get<std::vector<std::string>>();
+	return batchedModels;
+}
+
+// Returns the renderer index of every model, in the order of the scene
+std::vector<size_t> LoadModels(nlohmann::json& settings, const std::vector<std::string>& batchedModels, GLRenderer * meshRenderer) {
+	std::vector<size_t> indices;
+	if (settings.find(MODELS_KEY) == settings.end())
+		return indices;
+
+	std::vector<std::string> modelLocations = settings[MODELS_KEY];
 	for (size_t i = 0; i < modelLocations.size(); i++) {
-		Model *model = new Model(modelLocations[i].c_str());
+		bool batch = std::find(batchedModels.begin(), batchedModels.end(), modelLocations[i]) != batchedModels.end();
+		Model *model = new Model(modelLocations[i].c_str(), batch);
 		model->Load();
 		GLModelRenderer* modelRenderer = new GLModelRenderer();
 		modelRenderer->SetRenderable(model);
-		meshRenderer->AddObjectRenderer(modelRenderer);
+		indices.push_back(meshRenderer->AddObjectRenderer(modelRenderer));
 	}
+	return indices;
 }
 
 void LoadShaders(nlohmann::json shaders, GLRenderer* meshRenderer) {
-	std::string jsonStr = shaders.dump();
 	int i = 0;
 	char locBuff[100] = { "\0" };
 	snprintf(locBuff, sizeof(locBuff), SHADER_KEY.c_str(), i);
 
 	nlohmann::json obj = shaders[locBuff];
 
-	while (obj.type_name() != "null") {
+	while (strcmp(obj.type_name(), "null") != 0) {
 		DefaultShader *shader = new DefaultShader();
 		std::string vertexLocation = obj[VERTEX_SHADER_KEY];
 		std::string fragmentLocation = obj[FRAGMENT_SHADER_KEY];
@@ -148,430 +262,654 @@ void LoadShaders(nlohmann::json shaders, GLRenderer* meshRenderer) {
 		meshRenderer->AddShader(shader);
 
 		i++;
-		snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
+		snprintf(locBuff, sizeof(locBuff), SHADER_KEY.c_str(), i);
 		obj = shaders[locBuff];
 	}
 }
 
-void LoadTransforms(nlohmann::json transform, GLRenderer* meshRenderer, Transform* rootObject) {
-
+glm::vec3 LoadVector(nlohmann::json vector) {
+	return glm::vec3(vector[X_KEY].get<float>(), vector[Y_KEY].get<float>(), vector[Z_KEY].get<float>());
 }
 
-std::string SimulateJSONObject() {
-	nlohmann::json simulateScene;
-	simulateScene["ambient"] = 0.05f;
-
-	nlohmann::json simulateDLight;
-	simulateDLight["diffintensity"] = 0.8f;
-	simulateDLight["specintensity"] = 0.8f;
-	simulateDLight["diffcolor"]["red"] = 0.9f;
-	simulateDLight["diffcolor"]["green"] = 0.9f;
-	simulateDLight["diffcolor"]["blue"] = 1.0f;
-	simulateDLight["speccolor"]["red"] = 0.9f;
-	simulateDLight["speccolor"]["green"] = 0.9f;
-	simulateDLight["speccolor"]["blue"] = 1.0f;
-	simulateDLight["rotation"]["x"] = -0.5f;
-	simulateDLight["rotation"]["y"] = -0.5f;
-	simulateDLight["rotation"]["z"] = 0.0f;
-	
-	nlohmann::json simulatePLight0;
-	simulatePLight0["diffintensity"] = 0.6f;
-	simulatePLight0["specintensity"] = 0.6f;
-	simulatePLight0["diffcolor"]["red"] = 0.9f;
-	simulatePLight0["diffcolor"]["green"] = 1.0f;
-	simulatePLight0["diffcolor"]["blue"] = 0.9f;
-	simulatePLight0["speccolor"]["red"] = 0.9f;
-	simulatePLight0["speccolor"]["green"] = 1.0f;
-	simulatePLight0["speccolor"]["blue"] = 0.9f;
-	simulatePLight0["translation"]["x"] = 8.0f;
-	simulatePLight0["translation"]["y"] = 0.5f;
-	simulatePLight0["translation"]["z"] = 0.0f;
-	simulatePLight0["constant"] = 0.1f;
-	simulatePLight0["linear"] = 0.05f;
-	simulatePLight0["exponent"] = 0.02f;
-
-	nlohmann::json simulatePLight1;
-	simulatePLight1["diffintensity"] = 0.6f;
-	simulatePLight1["specintensity"] = 0.6f;
-	simulatePLight1["diffcolor"]["red"] = 0.9f;
-	simulatePLight1["diffcolor"]["green"] = 1.0f;
-	simulatePLight1["diffcolor"]["blue"] = 0.9f;
-	simulatePLight1["speccolor"]["red"] = 0.8f;
-	simulatePLight1["speccolor"]["green"] = 1.0f;
-	simulatePLight1["speccolor"]["blue"] = 0.8f;
-	simulatePLight1["translation"]["x"] = -2.0f;
-	simulatePLight1["translation"]["y"] = 0.5f;
-	simulatePLight1["translation"]["z"] = -2.0f;
-	simulatePLight1["constant"] = 0.1f;
-	simulatePLight1["linear"] = 0.05f;
-	simulatePLight1["exponent"] = 0.02f;
-	
-	nlohmann::json simulateLights;
-	simulateLights["dlight"] = simulateDLight;
-	simulateLights["plights"]["plight_0"] = simulatePLight0;
-	simulateLights["plights"]["plight_1"] = simulatePLight1;
+void LoadProbes(nlohmann::json probes, GLRenderer* meshRenderer) {
+	for (size_t i = 0; i < probes.size(); i++) {
+		nlohmann::json probe = probes[i];
+		GLuint size = BAKED_PROBE_DEFAULT_SIZE;
+		if (probe.find(SIZE_KEY) != probe.end())
+			size = probe[SIZE_KEY];
+		bool dynamic = probe.find(DYNAMIC_KEY) != probe.end() && probe[DYNAMIC_KEY].get<bool>();
 
-	simulateScene["lights"] = simulateLights;
+		meshRenderer->AddBakedProbe(new BakedProbe((int)i, LoadVector(probe[POSITION_KEY]),
+			LoadVector(probe[BOX_MIN_KEY]), LoadVector(probe[BOX_MAX_KEY]), size, dynamic));
+	}
+}
 
-	// https://free3d.com/3d-model/mountain-6839.html
-	simulateScene["models"] = { "Models/uh60.obj", "Models/Tree.obj", "Models/Tree_02.obj", "Models/everest.obj" };
+std::vector<Material*> LoadMaterials(nlohmann::json materials) {
+	std::vector<Material*> result;
+	// Materials with the same texture file share its texture
+	std::map<std::string, Texture*> textures;
+
+	for (size_t i = 0; i < materials.size(); i++) {
+		nlohmann::json material = materials[i];
+		GLfloat specularIntensity = material.value(SPECULAR_INTENSITY_KEY, 1.0f);
+		GLfloat shininess = material.value(SHININESS_KEY, 32.0f);
+		GLfloat reflectivity = material.value(REFLECTIVITY_KEY, 0.0f);
+		GLfloat red = 1.0f, green = 1.0f, blue = 1.0f;
+		if (material.find(COLOR_KEY) != material.end()) {
+			red = material[COLOR_KEY][RED_KEY];
+			green = material[COLOR_KEY][GREEN_KEY];
+			blue = material[COLOR_KEY][BLUE_KEY];
+		}
+
+		Texture* texture = nullptr;
+		if (material.find(TEXTURE_KEY) != material.end()) {
+			std::string location = material[TEXTURE_KEY];
+			std::map<std::string, Texture*>::iterator it = textures.find(location);
+			if (it != textures.end()) {
+				texture = it->second;
+			}
+			else {
+				texture = new Texture(location.c_str());
+				texture->LoadTextureAsync();
+				textures[location] = texture;
+			}
+		}
+
+		result.push_back(MaterialTable::Intern(specularIntensity, shininess, red, green, blue, texture, reflectivity));
+	}
+	return result;
+}
 
-	nlohmann::json simulatedShader;
-	simulatedShader["shader_0"]["vertex"] = "Shaders/shader.vert";
-	simulatedShader["shader_0"]["fragment"] = "Shaders/shader.frag";
+// Objects without a material, or with one the scene does not have, are plain white
+Material* GetMaterial(const std::vector<Material*>& materials, int index) {
+	if (index >= 0 && (size_t)index < materials.size())
+		return materials[index];
+	if (index >= 0)
+		printf("Material %d is not in the scene\n", index);
+	return MaterialTable::Intern(1.0f, 32.0f, 1.0f, 1.0f, 1.0f);
+}
 
-	simulateScene["shaders"] = simulatedShader;
+// The page pattern goes to snprintf with the tile's x and z, so it may hold two %d, with a width, and nothing else
+bool IsPagePattern(const std::string& pattern) {
+	int conversions = 0;
+	for (size_t i = 0; i < pattern.size(); i++) {
+		if (pattern[i] != '%')
+			continue;
+		if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+			i++;
+			continue;
+		}
+		i++;
+		while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9')
+			i++;
+		if (i == pattern.size() || pattern[i] != 'd')
+			return false;
+		conversions++;
+	}
+	return conversions == 2;
+}
 
-	return simulateScene.dump();
+void LoadWorld(nlohmann::json world, const SceneDescription& scene, const std::vector<Material*>& materials,
+	const std::vector<std::string>& batchedModels, GLRenderer* meshRenderer, Transform* rootObject) {
+	WorldSettings settings;
+	settings.origin = LoadVector(world[ORIGIN_KEY]);
+	settings.tileSize = world[TILE_SIZE_KEY];
+	settings.tilesX = world[TILES_KEY][X_KEY];
+	settings.tilesZ = world[TILES_KEY][Z_KEY];
+	settings.pagePattern = world[PAGES_KEY].get<std::string>();
+	if (!IsPagePattern(settings.pagePattern)) {
+		printf("World page pattern %s needs a %%d for x and one for z, and no other conversion\n", settings.pagePattern.c_str());
+		return;
+	}
+	settings.heightScale = world[HEIGHT_SCALE_KEY];
+	settings.tiling = world[TILING_KEY];
+	// The pages share a material, its texture repeats over the page borders
+	settings.terrainMaterial = GetMaterial(materials, world.value(MATERIAL_KEY, -1));
+	settings.loadRadius = world[LOAD_RADIUS_KEY];
+	settings.unloadRadius = world[UNLOAD_RADIUS_KEY];
+	settings.memoryBudget = WORLD_MEMORY_BUDGET;
+	if (world.find(BUDGET_KEY) != world.end())
+		settings.memoryBudget = world[BUDGET_KEY].get<size_t>() * 1024 * 1024;
+	WorldStreamer::Initialize(meshRenderer, rootObject, settings);
+
+	std::vector<bool> batched(scene.worldModels.size());
+	for (size_t i = 0; i < scene.worldModels.size(); i++)
+		batched[i] = std::find(batchedModels.begin(), batchedModels.end(), scene.worldModels[i]) != batchedModels.end();
+
+	for (size_t i = 0; i < scene.worldObjects.size(); i++) {
+		const SceneWorldRecord& record = scene.worldObjects[i];
+		if (record.model < 0) {
+			printf("World object %zu has no model\n", i);
+			continue;
+		}
+		WorldObject object;
+		object.model = scene.worldModels[record.model];
+		object.batched = batched[record.model];
+		object.position = record.position;
+		object.rotation = record.rotation;
+		object.scale = record.scale;
+		object.material = GetMaterial(materials, record.material);
+		WorldStreamer::AddObject(object);
+	}
 }
 
-void BuildScene(GLRenderer * meshRenderer, Transform* root, GLWindow* glWindow, bool isCinematic) {
-	// -- Helicopter --
-	Transform *transform = new Transform(root);
-	transform->SetStatic(false);
-	transform->Scale(0.5f);
-	transform->Translate(glm::vec3(0.0f, 10.0f, 0.0f));
-	transform->Rotate(-1.57f, 3.14f, 0.0f);
-	Material* mat = new Material(1.0f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 0));
-	transform->AddUpdatable(new HelicopterController(transform, 7.0f, 1.0f));
-
-	// -- Type 1 trees --
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(10.0f, 0.0f, 0.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(-5.0f, 0.0f, -5.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(-1.0f, 0.0f, 5.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(2.0f, 0.0f, -3.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(2.0f, 0.0f, 10.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(-5.0f, 0.0f, -5.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(5.0f, 0.0f, 5.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 1));
-
-	// -- Type 2 trees --
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(0.0f, 0.0f, 2.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(3.0f, 0.0f, -1.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(-5.0f, 0.0f, 1.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(2.0f, 0.0f, -5.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	transform = new Transform(root);
-	transform->Translate(glm::vec3(3.0f, 0.0f, 8.0f));
-	mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(7.0f, 0.0f, -2.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(8.0f, 0.0f, 2.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	//transform = new Transform(root);
-	//transform->Translate(glm::vec3(6.0f, 0.0f, -5.0f));
-	//mat = new Material(0.8f, 50, 1.0f, 1.0f, 1.0f);
-	//meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 2));
-
-	// Moutain
-	transform = new Transform(root);
-	transform->Scale(40.0f);
-	transform->Translate(glm::vec3(10.0f, -1.0f, -10.0f));
-	Texture* tex = new Texture("Textures/mountainTex.png");
-	tex->LoadTexture();
-	mat = new Material(1.0f, 100, 1.0f, 1.0f, 1.0f, tex);
-	meshRenderer->AddMeshRenderer(new GLObject(transform, mat, 3));
-
-	{
-		// -- Terrain --
-		TerrainMesh* terrain = TerrainMesh::CreateInstance();
-		GLMeshRenderer* renderer = new GLMeshRenderer();
-		renderer->SetRenderable(terrain);
-		meshRenderer->AddObjectRenderer(renderer);
-		transform = new Transform(root);
-		mat = new Material(0.2f, 2.0f, 1.0f, 1.0f, 1.0f);
-		meshRenderer->AddMeshRenderer(new GLObject(transform, mat, terrain->GetIndex()));
-	}
-
-	// Camera object is not static
-	transform = new Transform(root);
-	transform->SetStatic(false);
-	transform->Translate(glm::vec3(0.0f, 5.0f, -5.0f));
-	transform->AddUpdatable(Camera::CreateInstance(transform, glWindow));
-
-	if(!isCinematic)
-		transform->AddUpdatable(new CameraController(transform, 5.0f, 5.0f));
+void LoadBehavior(nlohmann::json behavior, Transform* transform, GLWindow* glWindow, bool isCinematic) {
+	if (behavior.find(MODE_KEY) != behavior.end() && (behavior[MODE_KEY] == CINEMATIC_MODE) != isCinematic)
+		return;
+
+	std::string type = behavior.value(TYPE_KEY, "");
+	if (type == HELICOPTER_BEHAVIOR) {
+		transform->AddBehavior<HelicopterController>((float)behavior[SPEED_KEY], (float)behavior[TURN_KEY]);
+	}
+	else if (type == CAMERA_BEHAVIOR) {
+		Camera::CreateInstance(transform, glWindow);
+	}
+	else if (type == CAMERA_CONTROLLER_BEHAVIOR) {
+		transform->AddBehavior<CameraController>((GLfloat)behavior[SPEED_KEY], (GLfloat)behavior[TURN_KEY]);
+	}
+	else if (type == KEYFRAMES_BEHAVIOR) {
+		nlohmann::json frames = behavior[FRAMES_KEY];
+		std::vector<KeyFrame> keyFrames(frames.size());
+		for (size_t i = 0; i < frames.size(); i++) {
+			keyFrames[i].deltaTime = frames[i][TIME_KEY];
+			keyFrames[i].position = LoadVector(frames[i][POSITION_KEY]);
+			keyFrames[i].rotation = LoadVector(frames[i][ROTATION_KEY]);
+		}
+		AnimateKeyFrame* animation = transform->AddBehavior<AnimateKeyFrame>(&keyFrames);
+		// The world is prefetched along the path
+		if (behavior.value(PREFETCH_KEY, false))
+			WorldStreamer::SetPrefetchPath(animation);
+	}
+	else if (type == PRINT_KEYFRAME_BEHAVIOR) {
+		transform->AddBehavior<PrintKeyFrame>();
+	}
+	else if (type == ACTIVATE_LIGHTS_BEHAVIOR) {
+		transform->AddBehavior<ActivateLights>();
+	}
 	else {
-		std::vector<KeyFrame>* keyFrames = new std::vector<KeyFrame>();
-		KeyFrame* kf = new KeyFrame(); kf->deltaTime = 0.0f;
-		kf->position = glm::vec3(-28.875362f, 2.862897f, -18.041098f); kf->rotation = glm::vec3(0.046448f, -5.315226f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-15.327765f, 1.731312f, -5.199117f); kf->rotation = glm::vec3(-0.115507f, -4.878115f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-7.341257f, 1.202060f, -1.114085f); kf->rotation = glm::vec3(0.092232f, -5.395631f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-5.010897f, 1.067676f, -1.449261f); kf->rotation = glm::vec3(0.091000f, -6.191921f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-2.262272f, 1.067676f, -0.195358f); kf->rotation = glm::vec3(0.152200f, -7.645885f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-2.262272f, 1.067676f, -0.195358f); kf->rotation = glm::vec3(0.152367f, -5.006465f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-1.783493f, 0.552925f, -0.074246f); kf->rotation = glm::vec3(0.079541f, -4.985230f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-0.030454f, 0.454973f, -0.810777f); kf->rotation = glm::vec3(0.064178f, -6.256577f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(1.409825f, 0.454973f, -0.080610f); kf->rotation = glm::vec3(0.028798f, -7.496764f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(4.626716f, 0.498400f, 2.444399f); kf->rotation = glm::vec3(0.017401f, -8.480882f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(7.982166f, 0.702529f, 8.565200f); kf->rotation = glm::vec3(-0.097604f, -9.598670f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(6.796952f, 0.892327f, 1.489373f); kf->rotation = glm::vec3(0.047980f, -8.563046f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 0.5f;
-		kf->position = glm::vec3(6.796952f, 0.892327f, 1.489373f); kf->rotation = glm::vec3(0.047980f, -8.563046f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(10.646914f, 3.687983f, -5.437775f); kf->rotation = glm::vec3(-0.399553f, -9.763049f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(15.224915f, 13.397384f, -15.589467f); kf->rotation = glm::vec3(-0.726606f, -9.851732f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(22.064701f, 19.724745f, -25.869707f); kf->rotation = glm::vec3(0.468682f, -13.301495f, 0.000000f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(15.891579f, 12.788266f, -11.988614f); kf->rotation = glm::vec3(0.210817f, -13.278668f, 0.000000f);
-		keyFrames->push_back(*kf);
-		transform->AddUpdatable(new AnimateKeyFrame(transform, keyFrames));
-
-		// -- Animate Spheres --
-		GLCubeMapRenderer* cubemapRenderer = meshRenderer->GetCubemapRenderer();
-		// -- Refract sphere --
-		keyFrames = new std::vector<KeyFrame>();
-		kf = new KeyFrame(); kf->deltaTime = 0.0f;
-		kf->position = glm::vec3(0.0f, 0.5f, 1.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 10.0f;
-		kf->position = glm::vec3(0.0f, 0.5f, 1.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 10.0f;
-		kf->position = glm::vec3(0.0f, 0.5f, 1.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 10.0f;
-		kf->position = glm::vec3(0.0f, 0.5f, 1.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 15.0f;
-		kf->position = glm::vec3(0.0f, 0.5f, 1.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(7.0f, 0.5f, 3.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(5.0f, 0.5f, 0.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		cubemapRenderer->GetRefractTransform()->AddUpdatable(new AnimateKeyFrame(cubemapRenderer->GetRefractTransform(), keyFrames));
-		// -- Reflect sphere --
-		keyFrames = new std::vector<KeyFrame>();
-		glm::vec3(0.0f, 0.5f, 0.0f);
-		kf = new KeyFrame(); kf->deltaTime = 0.0f;
-		kf->position = glm::vec3(-5.0f, 1.0f, 0.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 5.0f;
-		kf->position = glm::vec3(-5.0f, 1.0f, 0.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 20.0f;
-		kf->position = glm::vec3(-5.0f, 1.0f, 0.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 10.0f;
-		kf->position = glm::vec3(-2.0f, 1.0f, -2.0f); kf->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-		keyFrames->push_back(*kf);
-		kf = new KeyFrame(); kf->deltaTime = 10.0f;
-		kf->position = glm::vec3(2.0f, 1.0f, -5.0f); kf->rotation = glm::vec3(0.0f, 3.14f, 0.0f);
-		keyFrames->push_back(*kf);
-		cubemapRenderer->GetReflectTransform()->AddUpdatable(new AnimateKeyFrame(cubemapRenderer->GetReflectTransform(), keyFrames));
-	}
-
-	root->AddUpdatable(new ActivateLights(transform));
+		printf("Unknown behavior: %s\n", type.c_str());
+	}
+}
+
+void LoadTransforms(const SceneDescription& scene, const std::vector<size_t>& models, const std::vector<Material*>& materials,
+	GLRenderer* meshRenderer, Transform* rootObject, GLWindow* glWindow, bool isCinematic) {
+	GLCubeMapRenderer* cubemapRenderer = meshRenderer->GetCubemapRenderer();
+
+	// Parents come before their children, so the hierarchy is built in a single pass
+	std::vector<Transform*> transforms(scene.transforms.size());
+	for (size_t i = 0; i < scene.transforms.size(); i++) {
+		const SceneTransformRecord& record = scene.transforms[i];
+
+		// The spheres are placed by the cube map renderer, their records only add behaviors and children
+		if (record.node == SN_REFRACT_SPHERE) {
+			transforms[i] = cubemapRenderer->GetRefractTransform();
+			continue;
+		}
+		if (record.node == SN_REFLECT_SPHERE) {
+			transforms[i] = cubemapRenderer->GetReflectTransform();
+			continue;
+		}
+
+		Transform* transform = ObjectPool<Transform>::Create(record.parent < 0 ? rootObject : transforms[record.parent]);
+		if (!record.isStatic)
+			transform->SetStatic(false);
+		transform->Translate(record.position);
+		transform->Rotate(record.rotation.x, record.rotation.y, record.rotation.z);
+		transform->Scale(record.scale);
+		transforms[i] = transform;
+
+		if (record.model < 0)
+			continue;
+		if ((size_t)record.model >= models.size()) {
+			printf("Model %d is not in the scene\n", record.model);
+			continue;
+		}
+		meshRenderer->AddMeshRenderer(ObjectPool<GLObject>::Create(transform, GetMaterial(materials, record.material), models[record.model]));
+	}
+
+	for (size_t i = 0; i < scene.behaviors.size(); i++)
+		LoadBehavior(scene.behaviors[i].second, transforms[scene.behaviors[i].first], glWindow, isCinematic);
 }
 
 void SceneLoader::Load(const char* filename, GLRenderer * meshRenderer, Transform* rootObject, GLWindow* glWindow, bool isCinematic) {
-	// Todo: Read from file
-	std::string fileText = SimulateJSONObject();
+	double start = glfwGetTime();
+
+	// The snapshot skips parsing. It is made on the first load and whenever the scene file changes
+	SceneDescription scene;
+	bool fromSnapshot = SceneSnapshot::Load(filename, &scene);
+	if (!fromSnapshot) {
+		if (!SceneParser::Parse(filename, &scene)) {
+			printf("Failed to load scene: %s\n", filename);
+			return;
+		}
+		SceneSnapshot::Store(filename, scene);
+	}
 
-	nlohmann::json sceneDescription = nlohmann::json::parse(fileText);
-	float ambientIntensity = sceneDescription[AMBIENT_KEY];
+	nlohmann::json& settings = scene.settings;
+	float ambientIntensity = settings.value(AMBIENT_KEY, 0.0f);
 	meshRenderer->SetAmbient(ambientIntensity);
-	nlohmann::json lights = sceneDescription[LIGHTS_KEY];
-	
-	// -- Parse direct lights --
-	nlohmann::json obj_1 = lights[DIRECTIONAL_LIGHT_KEY];
 
-	if(obj_1.type_name() != "null") {
-		LoadLight(DIRECTIONAL, obj_1, meshRenderer, rootObject);
+	// -- Parse lights --
+	if (settings.find(LIGHTS_KEY) != settings.end())
+		LoadLights(settings[LIGHTS_KEY], meshRenderer, rootObject);
+
+	// -- Parse materials --
+	std::vector<Material*> materials;
+	if (settings.find(MATERIALS_KEY) != settings.end())
+		materials = LoadMaterials(settings[MATERIALS_KEY]);
+
+	// -- Parse models --
+	std::vector<std::string> batchedModels = LoadBatchedModels(settings);
+	std::vector<size_t> models = LoadModels(settings, batchedModels, meshRenderer);
+
+	// -- Parse streamed world --
+	if (settings.find(WORLD_KEY) != settings.end())
+		LoadWorld(settings[WORLD_KEY], scene, materials, batchedModels, meshRenderer, rootObject);
+
+	// -- Parse shaders --
+	LoadShaders(settings[SHADERS_KEY], meshRenderer);
+
+	// -- Parse transforms --
+	LoadTransforms(scene, models, materials, meshRenderer, rootObject, glWindow, isCinematic);
+
+	// -- Parse reflection probes --
+	nlohmann::json probes = settings[PROBES_KEY];
+	if (strcmp(probes.type_name(), "null") != 0) LoadProbes(probes, meshRenderer);
+
+	printf("Loaded %s%s in %.1f ms: %zu transforms, %zu world objects\n", filename, fromSnapshot ? " from its snapshot" : "",
+		(glfwGetTime() - start) * 1000.0, scene.transforms.size(), scene.worldObjects.size());
+}
+
+// What Store needs to turn the live scene back into records
+struct SceneStoreState {
+	SceneDescription* scene;
+	// Transforms that are written elsewhere or not at all: lights and streamed world objects
+	std::set<Transform*> skipped;
+	std::map<Transform*, GLObject*> objects;
+	// Index in the stored models of each renderer index
+	std::map<size_t, int> models;
+	std::vector<Material*> materials;
+	Transform* refract;
+	Transform* reflect;
+};
+
+nlohmann::json StoreVector(glm::vec3 vector) {
+	nlohmann::json stored;
+	stored[X_KEY] = vector.x;
+	stored[Y_KEY] = vector.y;
+	stored[Z_KEY] = vector.z;
+	return stored;
+}
+
+nlohmann::json StoreColor(glm::vec3 color) {
+	nlohmann::json stored;
+	stored[RED_KEY] = color.r;
+	stored[GREEN_KEY] = color.g;
+	stored[BLUE_KEY] = color.b;
+	return stored;
+}
+
+nlohmann::json StoreLight(LightType type, Light* light) {
+	nlohmann::json stored;
+	stored[DIFFUSE_INTENSITY_KEY] = light->GetDiffuseIntensity();
+	stored[DIFFUSE_COLOR_KEY] = StoreColor(light->GetDiffuseColor());
+	stored[SPECULAR_INTENSITY_KEY] = light->GetSpecularIntensity();
+	stored[SPECULAR_COLOR_KEY] = StoreColor(light->GetSpecularColor());
+
+	Transform* transform = light->GetTransform();
+	if (type != POINT)
+		stored[ROTATION_KEY] = StoreVector(transform->GetRotation());
+	if (type != DIRECTIONAL) {
+		PointLight* pointLight = (PointLight*)light;
+		stored[POSITION_KEY] = StoreVector(transform->GetPosition());
+		stored[CONSTANT_KEY] = pointLight->GetConstant();
+		stored[LINEAR_KEY] = pointLight->GetLinear();
+		stored[EXPONENT_KEY] = pointLight->GetExponent();
 	}
+	if (type == SPOT)
+		stored[EDGE_KEY] = ((SpotLight*)light)->GetEdge();
+	return stored;
+}
 
-	// -- Parse point lights --
-	int i = 0;
-	char locBuff[100] = { "\0" };
-	obj_1 = lights[POINT_LIGHTS_KEY];
+// Returns null for the updatables the format does not know
+nlohmann::json StoreBehavior(IUpdatable* updatable) {
+	nlohmann::json behavior;
 
-	snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
-	nlohmann::json obj_2 = obj_1[locBuff];
+	HelicopterController* helicopter = dynamic_cast<HelicopterController*>(updatable);
+	if (helicopter != nullptr) {
+		behavior[TYPE_KEY] = HELICOPTER_BEHAVIOR;
+		behavior[SPEED_KEY] = helicopter->GetMoveSpeed();
+		behavior[TURN_KEY] = helicopter->GetRotationSpeed();
+		return behavior;
+	}
 
-	while (obj_2.type_name() != "null") {
-		LoadLight(POINT, obj_2, meshRenderer, rootObject);
+	if (dynamic_cast<Camera*>(updatable) != nullptr) {
+		behavior[TYPE_KEY] = CAMERA_BEHAVIOR;
+		return behavior;
+	}
 
-		i++;
-		snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
-		obj_2 = obj_1[locBuff];
+	// The controller is only added when roaming and the animations only in the cinematic
+	CameraController* controller = dynamic_cast<CameraController*>(updatable);
+	if (controller != nullptr) {
+		behavior[TYPE_KEY] = CAMERA_CONTROLLER_BEHAVIOR;
+		behavior[MODE_KEY] = ROAM_MODE;
+		behavior[SPEED_KEY] = controller->GetMoveSpeed();
+		behavior[TURN_KEY] = controller->GetTurnSpeed();
+		return behavior;
 	}
 
-	// -- Parse spot lights --
-	i = 0;
-	obj_1 = lights[SPOT_LIGHTS_KEY];
+	AnimateKeyFrame* animation = dynamic_cast<AnimateKeyFrame*>(updatable);
+	if (animation != nullptr) {
+		behavior[TYPE_KEY] = KEYFRAMES_BEHAVIOR;
+		behavior[MODE_KEY] = CINEMATIC_MODE;
+		if (WorldStreamer::GetPrefetchPath() == animation)
+			behavior[PREFETCH_KEY] = true;
+		const std::vector<KeyFrame>& keyFrames = animation->GetKeyFrames();
+		nlohmann::json frames = nlohmann::json::array();
+		for (size_t i = 0; i < keyFrames.size(); i++) {
+			nlohmann::json frame;
+			frame[TIME_KEY] = keyFrames[i].deltaTime;
+			frame[POSITION_KEY] = StoreVector(keyFrames[i].position);
+			frame[ROTATION_KEY] = StoreVector(keyFrames[i].rotation);
+			frames.push_back(frame);
+		}
+		behavior[FRAMES_KEY] = frames;
+		return behavior;
+	}
 
-	snprintf(locBuff, sizeof(locBuff), SPOT_LIGHT_KEY.c_str(), i);
-	obj_2 = obj_1[locBuff];
+	if (dynamic_cast<PrintKeyFrame*>(updatable) != nullptr) {
+		behavior[TYPE_KEY] = PRINT_KEYFRAME_BEHAVIOR;
+		return behavior;
+	}
 
-	while (obj_2.type_name() != "null") {
-		LoadLight(SPOT, obj_2, meshRenderer, rootObject);
+	if (dynamic_cast<ActivateLights*>(updatable) != nullptr) {
+		behavior[TYPE_KEY] = ACTIVATE_LIGHTS_BEHAVIOR;
+		return behavior;
+	}
 
-		i++;
-		snprintf(locBuff, sizeof(locBuff), SPOT_LIGHT_KEY.c_str(), i);
-		obj_2 = obj_1[locBuff];
+	return behavior;
+}
+
+int StoreMaterial(SceneStoreState& state, Material* material) {
+	// Materials are interned, so equal materials are the same pointer
+	for (size_t i = 0; i < state.materials.size(); i++) {
+		if (state.materials[i] == material)
+			return (int)i;
 	}
+	state.materials.push_back(material);
+	return (int)state.materials.size() - 1;
+}
 
-	// -- Parse models --
-	LoadModels(sceneDescription, meshRenderer);
+// Appends the records of a transform and its descendants, parents first
+void StoreTransform(SceneStoreState& state, Transform* transform, int parent) {
+	if (state.skipped.find(transform) != state.skipped.end())
+		return;
+
+	SceneTransformRecord record;
+	record.parent = parent;
+	record.node = transform == state.refract ? SN_REFRACT_SPHERE : transform == state.reflect ? SN_REFLECT_SPHERE : SN_NONE;
+	record.position = transform->GetPosition();
+	record.rotation = transform->GetRotation();
+	record.scale = transform->GetScale();
+	record.isStatic = transform->GetStatic();
+	record.model = -1;
+	record.material = -1;
+
+	std::map<Transform*, GLObject*>::iterator object = state.objects.find(transform);
+	if (record.node == SN_NONE && object != state.objects.end()) {
+		std::map<size_t, int>::iterator model = state.models.find(object->second->GetModelIndex());
+		if (model != state.models.end()) {
+			record.model = model->second;
+			record.material = StoreMaterial(state, object->second->GetMaterial());
+		}
+	}
 
-	// -- Parse shaders --
-	LoadShaders(sceneDescription[SHADERS_KEY], meshRenderer);
+	int index = (int)state.scene->transforms.size();
+	state.scene->transforms.push_back(record);
 
-	// -- Parse transforms --
-	nlohmann::json transforms = sceneDescription[TRANSFORMS_KEY];
-	if(transforms.type_name() != "null") LoadTransforms(transforms, meshRenderer, rootObject);
+	const std::vector<IUpdatable*>& updatables = transform->GetUpdatables();
+	for (size_t i = 0; i < updatables.size(); i++) {
+		nlohmann::json behavior = StoreBehavior(updatables[i]);
+		if (!behavior.is_null())
+			state.scene->behaviors.push_back(std::make_pair(index, behavior));
+	}
 
-	BuildScene(meshRenderer, rootObject, glWindow, isCinematic);
+	const std::vector<Transform*>& children = transform->GetChildren();
+	for (size_t i = 0; i < children.size(); i++)
+		StoreTransform(state, children[i], index);
 }
 
-void SceneLoader::Store(const char* filename, GLRenderer * meshRenderer, Transform * transform) {
-	nlohmann::json simulateScene;
-	simulateScene["ambient"] = meshRenderer->GetAmbient();
+void WriteVector(FILE* file, const std::string& key, glm::vec3 vector) {
+	fprintf(file, "\"%s\": { \"x\": %.9g, \"y\": %.9g, \"z\": %.9g }", key.c_str(), vector.x, vector.y, vector.z);
+}
 
+void WriteWorldObjects(FILE* file, const SceneDescription& scene) {
+	fprintf(file, "\t\t\"%s\": [", OBJECTS_KEY.c_str());
+	for (size_t i = 0; i < scene.worldObjects.size(); i++) {
+		const SceneWorldRecord& record = scene.worldObjects[i];
+		fprintf(file, "%s\t\t\t{ \"%s\": %s, ", i == 0 ? "\n" : ",\n", MODEL_KEY.c_str(), nlohmann::json(scene.worldModels[record.model]).dump().c_str());
+		WriteVector(file, POSITION_KEY, record.position);
+		fprintf(file, ", ");
+		WriteVector(file, ROTATION_KEY, record.rotation);
+		fprintf(file, ", \"%s\": %.9g, \"%s\": %d }", SCALE_KEY.c_str(), record.scale, MATERIAL_KEY.c_str(), record.material);
+	}
+	fprintf(file, "\n\t\t]\n");
+}
+
+void WriteTransforms(FILE* file, const SceneDescription& scene) {
+	fprintf(file, "\t\"%s\": [", TRANSFORMS_KEY.c_str());
+
+	// Records whose children array is open, innermost last
+	std::vector<int> open;
+	// Behaviors are in the order of their records
+	size_t behavior = 0;
+	bool sibling = false;
+	for (size_t i = 0; i < scene.transforms.size(); i++) {
+		const SceneTransformRecord& record = scene.transforms[i];
+		while (!open.empty() && open.back() != record.parent) {
+			fprintf(file, "] }");
+			open.pop_back();
+			sibling = true;
+		}
+
+		fprintf(file, "%s%s{ ", sibling ? ",\n" : "\n", std::string(open.size() + 2, '\t').c_str());
+		if (record.node != SN_NONE) {
+			fprintf(file, "\"%s\": \"%s\", ", NODE_KEY.c_str(), record.node == SN_REFRACT_SPHERE ? REFRACT_NODE.c_str() : REFLECT_NODE.c_str());
+		}
+		else {
+			WriteVector(file, POSITION_KEY, record.position);
+			fprintf(file, ", ");
+			WriteVector(file, ROTATION_KEY, record.rotation);
+			fprintf(file, ", \"%s\": %.9g, \"%s\": %s, ", SCALE_KEY.c_str(), record.scale, STATIC_KEY.c_str(), record.isStatic ? "true" : "false");
+			if (record.model >= 0)
+				fprintf(file, "\"%s\": %d, \"%s\": %d, ", MODEL_KEY.c_str(), record.model, MATERIAL_KEY.c_str(), record.material);
+		}
+
+		fprintf(file, "\"%s\": [", BEHAVIORS_KEY.c_str());
+		for (bool first = true; behavior < scene.behaviors.size() && scene.behaviors[behavior].first == (int)i; behavior++, first = false)
+			fprintf(file, "%s%s", first ? "" : ", ", scene.behaviors[behavior].second.dump().c_str());
+		fprintf(file, "], \"%s\": [", CHILDREN_KEY.c_str());
+
+		open.push_back((int)i);
+		sibling = false;
+	}
+	for (size_t i = 0; i < open.size(); i++)
+		fprintf(file, "] }");
+
+	fprintf(file, "\n\t]\n");
+}
+
+bool WriteScene(const char* filename, const SceneDescription& scene) {
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) {
+		printf("Failed to write: %s\n", filename);
+		return false;
+	}
+
+	// The small entries are written whole, the records one at a time
+	fprintf(file, "{\n");
+	for (nlohmann::json::const_iterator it = scene.settings.begin(); it != scene.settings.end(); it++) {
+		if (it.key() != WORLD_KEY)
+			fprintf(file, "\t\"%s\": %s,\n", it.key().c_str(), it.value().dump().c_str());
+	}
+
+	nlohmann::json::const_iterator world = scene.settings.find(WORLD_KEY);
+	if (world != scene.settings.end()) {
+		fprintf(file, "\t\"%s\": {\n", WORLD_KEY.c_str());
+		for (nlohmann::json::const_iterator it = world->begin(); it != world->end(); it++)
+			fprintf(file, "\t\t\"%s\": %s,\n", it.key().c_str(), it.value().dump().c_str());
+		WriteWorldObjects(file, scene);
+		fprintf(file, "\t},\n");
+	}
+
+	WriteTransforms(file, scene);
+	fprintf(file, "}\n");
+
+	bool written = ferror(file) == 0;
+	fclose(file);
+	if (!written)
+		printf("Failed to write: %s\n", filename);
+	return written;
+}
+
+void SceneLoader::Store(const char* filename, GLRenderer * meshRenderer, Transform * rootObject) {
+	SceneDescription scene;
+	SceneStoreState state;
+	state.scene = &scene;
+	state.refract = meshRenderer->GetCubemapRenderer()->GetRefractTransform();
+	state.reflect = meshRenderer->GetCubemapRenderer()->GetReflectTransform();
+
+	nlohmann::json& settings = scene.settings;
+	settings[AMBIENT_KEY] = meshRenderer->GetAmbient();
+
+	// -- Lights --
+	nlohmann::json lights = nlohmann::json::object();
+	char locBuff[100] = { "\0" };
 	DirectionalLight* dLight = meshRenderer->GetDirectionalLight();
-	nlohmann::json simulateDLight;
-	simulateDLight["diffintensity"] = dLight->GetDiffuseIntensity();
-	simulateDLight["specintensity"] = dLight->GetSpecularIntensity();
-	glm::vec3 tmpVec3 = dLight->GetDiffuseColor();
-	simulateDLight["diffcolor"]["red"] = tmpVec3.r;
-	simulateDLight["diffcolor"]["green"] = tmpVec3.g;
-	simulateDLight["diffcolor"]["blue"] = tmpVec3.b;
-	tmpVec3 = dLight->GetSpecularColor();
-	simulateDLight["speccolor"]["red"] = tmpVec3.r;
-	simulateDLight["speccolor"]["green"] = tmpVec3.g;
-	simulateDLight["speccolor"]["blue"] = tmpVec3.b;
-	tmpVec3 = dLight->GetTransform()->GetRotation();
-	simulateDLight["rotation"]["x"] = tmpVec3.x;
-	simulateDLight["rotation"]["y"] = tmpVec3.y;
-	simulateDLight["rotation"]["z"] = tmpVec3.z;
-
-	nlohmann::json simulatePLight0;
-	simulatePLight0["diffintensity"] = 0.7f;
-	simulatePLight0["specintensity"] = 0.7f;
-	simulatePLight0["diffcolor"]["red"] = 0.0f;
-	simulatePLight0["diffcolor"]["green"] = 1.0f;
-	simulatePLight0["diffcolor"]["blue"] = 0.0f;
-	simulatePLight0["speccolor"]["red"] = 1.0f;
-	simulatePLight0["speccolor"]["green"] = 0.0f;
-	simulatePLight0["speccolor"]["blue"] = 0.0f;
-	simulatePLight0["translation"]["x"] = 0.0f;
-	simulatePLight0["translation"]["y"] = 1.0f;
-	simulatePLight0["translation"]["z"] = 0.0f;
-	simulatePLight0["constant"] = 0.3f;
-	simulatePLight0["linear"] = 0.2f;
-	simulatePLight0["exponent"] = 0.1f;
-
-	nlohmann::json simulatePLight1;
-	simulatePLight1["diffintensity"] = 0.7f;
-	simulatePLight1["specintensity"] = 0.7f;
-	simulatePLight1["diffcolor"]["red"] = 1.0f;
-	simulatePLight1["diffcolor"]["green"] = 1.0f;
-	simulatePLight1["diffcolor"]["blue"] = 1.0f;
-	simulatePLight1["speccolor"]["red"] = 1.0f;
-	simulatePLight1["speccolor"]["green"] = 1.0f;
-	simulatePLight1["speccolor"]["blue"] = 1.0f;
-	simulatePLight1["translation"]["x"] = 2.0f;
-	simulatePLight1["translation"]["y"] = 1.0f;
-	simulatePLight1["translation"]["z"] = 4.0f;
-	simulatePLight1["constant"] = 0.1f;
-	simulatePLight1["linear"] = 0.05f;
-	simulatePLight1["exponent"] = 0.02f;
-
-	nlohmann::json simulateLights;
-	simulateLights["dlight"] = simulateDLight;
-	simulateLights["plights"]["plight_0"] = simulatePLight0;
-	simulateLights["plights"]["plight_1"] = simulatePLight1;
-
-	simulateScene["lights"] = simulateLights;
-
-	simulateScene["models"] = { "Models/uh60.obj", "Models/Tree.obj", "Models/Tree_02.obj" };
-
-	nlohmann::json simulatedShader;
-	simulatedShader["shader_0"]["vertex"] = "Shaders/shader.vert";
-	simulatedShader["shader_0"]["fragment"] = "Shaders/shader.frag";
-
-	simulateScene["shaders"] = simulatedShader;
+	if (dLight != nullptr) {
+		lights[DIRECTIONAL_LIGHT_KEY] = StoreLight(DIRECTIONAL, dLight);
+		state.skipped.insert(dLight->GetTransform());
+	}
+	for (int i = 0; meshRenderer->GetPointLightAt(i) != nullptr; i++) {
+		snprintf(locBuff, sizeof(locBuff), POINT_LIGHT_KEY.c_str(), i);
+		lights[POINT_LIGHTS_KEY][locBuff] = StoreLight(POINT, meshRenderer->GetPointLightAt(i));
+		state.skipped.insert(meshRenderer->GetPointLightAt(i)->GetTransform());
+	}
+	for (int i = 0; meshRenderer->GetSpotLightAt(i) != nullptr; i++) {
+		snprintf(locBuff, sizeof(locBuff), SPOT_LIGHT_KEY.c_str(), i);
+		lights[SPOT_LIGHTS_KEY][locBuff] = StoreLight(SPOT, meshRenderer->GetSpotLightAt(i));
+		state.skipped.insert(meshRenderer->GetSpotLightAt(i)->GetTransform());
+	}
+	settings[LIGHTS_KEY] = lights;
+
+	// -- Models --
+	nlohmann::json models = nlohmann::json::array();
+	std::vector<std::string> batchedModels;
+	for (size_t i = 0; i < meshRenderer->GetObjectRendererCount(); i++) {
+		GLObjectRenderer* renderer = meshRenderer->GetObjectRendererAt(i);
+		if (renderer == nullptr)
+			continue;
+
+		const std::vector<GLObject*>& objects = renderer->GetObjects();
+		// Streamed objects are written with the world
+		bool streamed = WorldStreamer::IsInitialized() && WorldStreamer::OwnsRenderer(renderer);
+		for (size_t j = 0; j < objects.size(); j++) {
+			if (streamed)
+				state.skipped.insert(objects[j]->GetTransform());
+			else
+				state.objects[objects[j]->GetTransform()] = objects[j];
+		}
+
+		Model* model = dynamic_cast<Model*>(renderer->GetRenderable());
+		if (streamed || model == nullptr)
+			continue;
+		state.models[i] = (int)models.size();
+		models.push_back(model->GetFilename());
+		if (model->IsBatched())
+			batchedModels.push_back(model->GetFilename());
+	}
+	settings[MODELS_KEY] = models;
+
+	// -- Shaders --
+	snprintf(locBuff, sizeof(locBuff), SHADER_KEY.c_str(), 0);
+	settings[SHADERS_KEY][locBuff][VERTEX_SHADER_KEY] = DEFAULT_VERTEX_SHADER;
+	settings[SHADERS_KEY][locBuff][FRAGMENT_SHADER_KEY] = DEFAULT_FRAGMENT_SHADER;
+
+	// -- Reflection probes --
+	nlohmann::json probes = nlohmann::json::array();
+	const std::vector<BakedProbe*>& bakedProbes = meshRenderer->GetBakedProbes();
+	for (size_t i = 0; i < bakedProbes.size(); i++) {
+		nlohmann::json probe;
+		probe[POSITION_KEY] = StoreVector(bakedProbes[i]->GetPosition());
+		probe[BOX_MIN_KEY] = StoreVector(bakedProbes[i]->GetBoxMin());
+		probe[BOX_MAX_KEY] = StoreVector(bakedProbes[i]->GetBoxMax());
+		probe[SIZE_KEY] = bakedProbes[i]->GetSize();
+		if (bakedProbes[i]->IsDynamic())
+			probe[DYNAMIC_KEY] = true;
+		probes.push_back(probe);
+	}
+	settings[PROBES_KEY] = probes;
+
+	// -- Transforms --
+	const std::vector<Transform*>& children = rootObject->GetChildren();
+	for (size_t i = 0; i < children.size(); i++)
+		StoreTransform(state, children[i], -1);
+
+	// -- Streamed world --
+	if (WorldStreamer::IsInitialized()) {
+		const WorldSettings& worldSettings = WorldStreamer::GetSettings();
+		nlohmann::json world;
+		world[ORIGIN_KEY] = StoreVector(worldSettings.origin);
+		world[TILE_SIZE_KEY] = worldSettings.tileSize;
+		world[TILES_KEY][X_KEY] = worldSettings.tilesX;
+		world[TILES_KEY][Z_KEY] = worldSettings.tilesZ;
+		world[PAGES_KEY] = worldSettings.pagePattern;
+		world[HEIGHT_SCALE_KEY] = worldSettings.heightScale;
+		world[TILING_KEY] = worldSettings.tiling;
+		world[MATERIAL_KEY] = StoreMaterial(state, worldSettings.terrainMaterial);
+		world[LOAD_RADIUS_KEY] = worldSettings.loadRadius;
+		world[UNLOAD_RADIUS_KEY] = worldSettings.unloadRadius;
+		world[BUDGET_KEY] = worldSettings.memoryBudget / (1024 * 1024);
+		settings[WORLD_KEY] = world;
+
+		std::vector<WorldObject> objects;
+		WorldStreamer::GetObjects(objects);
+		std::map<std::string, int> worldModels;
+		scene.worldObjects.resize(objects.size());
+		for (size_t i = 0; i < objects.size(); i++) {
+			std::map<std::string, int>::iterator model = worldModels.find(objects[i].model);
+			if (model == worldModels.end()) {
+				model = worldModels.insert(std::make_pair(objects[i].model, (int)scene.worldModels.size())).first;
+				scene.worldModels.push_back(objects[i].model);
+				if (objects[i].batched && std::find(batchedModels.begin(), batchedModels.end(), objects[i].model) == batchedModels.end())
+					batchedModels.push_back(objects[i].model);
+			}
+
+			SceneWorldRecord& record = scene.worldObjects[i];
+			record.model = model->second;
+			record.material = StoreMaterial(state, objects[i].material);
+			record.position = objects[i].position;
+			record.rotation = objects[i].rotation;
+			record.scale = objects[i].scale;
+		}
+	}
+	settings[BATCHED_MODELS_KEY] = batchedModels;
+
+	// -- Materials --
+	nlohmann::json materials = nlohmann::json::array();
+	for (size_t i = 0; i < state.materials.size(); i++) {
+		Material* material = state.materials[i];
+		nlohmann::json stored;
+		stored[SPECULAR_INTENSITY_KEY] = material->GetSpecularIntensity();
+		stored[SHININESS_KEY] = material->GetShininess();
+		stored[COLOR_KEY] = StoreColor(glm::vec3(material->GetRed(), material->GetGreen(), material->GetBlue()));
+		if (material->GetAlbedo() != nullptr)
+			stored[TEXTURE_KEY] = material->GetAlbedo()->GetFileLocation();
+		if (material->GetReflectivity() > 0.0f)
+			stored[REFLECTIVITY_KEY] = material->GetReflectivity();
+		materials.push_back(stored);
+	}
+	settings[MATERIALS_KEY] = materials;
 
+	WriteScene(filename, scene);
 }
@@ -8,8 +8,11 @@
 #include "GLWindow.h"
 #include "Transform.h"
 #include "Model.h"
-#include "TerrainMesh.h"
+#include "Terrain.h"
+#include "WorldStreamer.h"
 #include "ObjectController.h"
+#include "SceneParser.h"
+#include "SceneSnapshot.h"
 
 
 class SceneLoader
@@ -0,0 +1,312 @@
+#include "SceneParser.h"
+
+#include <stdio.h>
+#include <fstream>
+
+SceneParser::SceneParser(SceneDescription * scene) :
+	m_scene(scene),
+	m_captureTarget(nullptr)
+{
+	m_scene->settings = nlohmann::json::object();
+}
+
+int SceneParser::_GetModelIndex(const std::string & path)
+{
+	// Worlds use a handful of models, a linear search is enough
+	for (size_t i = 0; i < m_scene->worldModels.size(); i++) {
+		if (m_scene->worldModels[i] == path)
+			return (int)i;
+	}
+	m_scene->worldModels.push_back(path);
+	return (int)m_scene->worldModels.size() - 1;
+}
+
+void SceneParser::_Capture(nlohmann::json * target)
+{
+	m_captureTarget = target;
+	m_contexts.push_back({ CT_CAPTURE, -1, nullptr });
+}
+
+nlohmann::json* SceneParser::_Store(const nlohmann::json & value)
+{
+	if (m_captures.empty()) {
+		*m_captureTarget = value;
+		return m_captureTarget;
+	}
+
+	nlohmann::json* container = m_captures.back();
+	if (container->is_object()) {
+		nlohmann::json& slot = (*container)[m_key];
+		slot = value;
+		return &slot;
+	}
+	container->push_back(value);
+	return &container->back();
+}
+
+bool SceneParser::_Value(const nlohmann::json & value)
+{
+	if (m_contexts.empty())
+		return true;
+
+	const Context& context = m_contexts.back();
+	switch (context.type) {
+	case CT_CAPTURE:
+		_Store(value);
+		break;
+	case CT_SCENE:
+		m_scene->settings[m_key] = value;
+		break;
+	case CT_WORLD:
+		m_scene->settings["world"][m_key] = value;
+		break;
+	case CT_TRANSFORM: {
+		SceneTransformRecord& record = m_scene->transforms[context.record];
+		if (m_key == "scale" && value.is_number())
+			record.scale = value.get<float>();
+		else if (m_key == "static" && value.is_boolean())
+			record.isStatic = value.get<bool>();
+		else if (m_key == "model" && value.is_number())
+			record.model = value.get<int>();
+		else if (m_key == "material" && value.is_number())
+			record.material = value.get<int>();
+		else if (m_key == "node" && value.is_string())
+			record.node = value == "refract" ? SN_REFRACT_SPHERE : value == "reflect" ? SN_REFLECT_SPHERE : SN_NONE;
+		break;
+	}
+	case CT_WORLD_OBJECT: {
+		SceneWorldRecord& record = m_scene->worldObjects[context.record];
+		if (m_key == "model" && value.is_string())
+			record.model = _GetModelIndex(value.get<std::string>());
+		else if (m_key == "material" && value.is_number())
+			record.material = value.get<int>();
+		else if (m_key == "scale" && value.is_number())
+			record.scale = value.get<float>();
+		break;
+	}
+	case CT_VECTOR:
+		if (!value.is_number())
+			break;
+		if (m_key == "x")
+			context.vector->x = value.get<float>();
+		else if (m_key == "y")
+			context.vector->y = value.get<float>();
+		else if (m_key == "z")
+			context.vector->z = value.get<float>();
+		break;
+	default:
+		// Stray values in arrays of objects
+		break;
+	}
+	return true;
+}
+
+bool SceneParser::_Start(bool isObject)
+{
+	nlohmann::json empty = isObject ? nlohmann::json::object() : nlohmann::json::array();
+
+	if (m_contexts.empty()) {
+		if (!isObject) {
+			printf("A scene file has to hold an object\n");
+			return false;
+		}
+		m_contexts.push_back({ CT_SCENE, -1, nullptr });
+		return true;
+	}
+
+	// Copied, pushing a context invalidates references to the stack
+	Context context = m_contexts.back();
+	switch (context.type) {
+	case CT_CAPTURE:
+		m_captures.push_back(_Store(empty));
+		return true;
+
+	case CT_SCENE:
+		if (m_key == "transforms" && !isObject) {
+			m_contexts.push_back({ CT_TRANSFORM_LIST, -1, nullptr });
+			return true;
+		}
+		if (m_key == "world" && isObject) {
+			m_scene->settings["world"] = nlohmann::json::object();
+			m_contexts.push_back({ CT_WORLD, -1, nullptr });
+			return true;
+		}
+		_Capture(&m_scene->settings[m_key]);
+		break;
+
+	case CT_WORLD:
+		if (m_key == "objects" && !isObject) {
+			m_contexts.push_back({ CT_WORLD_OBJECT_LIST, -1, nullptr });
+			return true;
+		}
+		_Capture(&m_scene->settings["world"][m_key]);
+		break;
+
+	case CT_TRANSFORM_LIST:
+		if (isObject) {
+			SceneTransformRecord record;
+			record.parent = context.record;
+			record.node = SN_NONE;
+			record.position = glm::vec3(0.0f);
+			record.rotation = glm::vec3(0.0f);
+			record.scale = 1.0f;
+			record.isStatic = true;
+			record.model = -1;
+			record.material = -1;
+			m_scene->transforms.push_back(record);
+			m_contexts.push_back({ CT_TRANSFORM, (int)m_scene->transforms.size() - 1, nullptr });
+			return true;
+		}
+		_Capture(&m_ignored);
+		break;
+
+	case CT_TRANSFORM: {
+		SceneTransformRecord& record = m_scene->transforms[context.record];
+		if (isObject && (m_key == "translation" || m_key == "rotation")) {
+			m_contexts.push_back({ CT_VECTOR, context.record, m_key == "translation" ? &record.position : &record.rotation });
+			return true;
+		}
+		if (!isObject && m_key == "behaviors") {
+			m_contexts.push_back({ CT_BEHAVIOR_LIST, context.record, nullptr });
+			return true;
+		}
+		if (!isObject && m_key == "children") {
+			m_contexts.push_back({ CT_TRANSFORM_LIST, context.record, nullptr });
+			return true;
+		}
+		_Capture(&m_ignored);
+		break;
+	}
+
+	case CT_BEHAVIOR_LIST:
+		if (isObject) {
+			m_scene->behaviors.push_back(std::make_pair(context.record, nlohmann::json()));
+			_Capture(&m_scene->behaviors.back().second);
+		}
+		else {
+			_Capture(&m_ignored);
+		}
+		break;
+
+	case CT_WORLD_OBJECT_LIST:
+		if (isObject) {
+			SceneWorldRecord record;
+			record.model = -1;
+			record.material = -1;
+			record.position = glm::vec3(0.0f);
+			record.rotation = glm::vec3(0.0f);
+			record.scale = 1.0f;
+			m_scene->worldObjects.push_back(record);
+			m_contexts.push_back({ CT_WORLD_OBJECT, (int)m_scene->worldObjects.size() - 1, nullptr });
+			return true;
+		}
+		_Capture(&m_ignored);
+		break;
+
+	case CT_WORLD_OBJECT: {
+		SceneWorldRecord& record = m_scene->worldObjects[context.record];
+		if (isObject && (m_key == "translation" || m_key == "rotation")) {
+			m_contexts.push_back({ CT_VECTOR, context.record, m_key == "translation" ? &record.position : &record.rotation });
+			return true;
+		}
+		_Capture(&m_ignored);
+		break;
+	}
+
+	case CT_VECTOR:
+		_Capture(&m_ignored);
+		break;
+	}
+
+	// A capture was started, the container is its first value
+	m_captures.push_back(_Store(empty));
+	return true;
+}
+
+bool SceneParser::_End()
+{
+	if (m_contexts.empty())
+		return false;
+
+	if (m_contexts.back().type == CT_CAPTURE) {
+		m_captures.pop_back();
+		if (!m_captures.empty())
+			return true;
+	}
+	m_contexts.pop_back();
+	return true;
+}
+
+bool SceneParser::null()
+{
+	return _Value(nlohmann::json());
+}
+
+bool SceneParser::boolean(bool val)
+{
+	return _Value(val);
+}
+
+bool SceneParser::number_integer(number_integer_t val)
+{
+	return _Value(val);
+}
+
+bool SceneParser::number_unsigned(number_unsigned_t val)
+{
+	return _Value(val);
+}
+
+bool SceneParser::number_float(number_float_t val, const string_t &)
+{
+	return _Value(val);
+}
+
+bool SceneParser::string(string_t & val)
+{
+	return _Value(val);
+}
+
+bool SceneParser::start_object(std::size_t)
+{
+	return _Start(true);
+}
+
+bool SceneParser::key(string_t & val)
+{
+	m_key = val;
+	return true;
+}
+
+bool SceneParser::end_object()
+{
+	return _End();
+}
+
+bool SceneParser::start_array(std::size_t)
+{
+	return _Start(false);
+}
+
+bool SceneParser::end_array()
+{
+	return _End();
+}
+
+bool SceneParser::parse_error(std::size_t position, const std::string &, const nlohmann::detail::exception & ex)
+{
+	printf("Scene parse error at byte %zu: %s\n", position, ex.what());
+	return false;
+}
+
+bool SceneParser::Parse(const char * filename, SceneDescription * scene)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		printf("Failed to find: %s\n", filename);
+		return false;
+	}
+
+	SceneParser parser(scene);
+	return nlohmann::json::sax_parse(file, &parser);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <glm\glm.hpp>
+#include <nlohmann/json.hpp>
+
+// Built-in transforms a scene record can refer to instead of creating its own
+enum SceneNode {
+	SN_NONE, SN_REFRACT_SPHERE, SN_REFLECT_SPHERE
+};
+
+// Transform of the scene hierarchy, in the order of the file: parents always come before their children
+struct SceneTransformRecord {
+	// Index of the parent record, -1 for children of the root
+	int parent;
+	SceneNode node;
+	glm::vec3 position;
+	glm::vec3 rotation;
+	float scale;
+	bool isStatic;
+	// Index in the scene's models and materials, -1 if the transform draws nothing
+	int model;
+	int material;
+};
+
+// Object of the streamed world
+struct SceneWorldRecord {
+	// Index in SceneDescription::worldModels
+	int model;
+	int material;
+	glm::vec3 position;
+	glm::vec3 rotation;
+	float scale;
+};
+
+// Everything read from a scene file
+struct SceneDescription {
+	// Every top level entry but the transforms, and the world without its objects. These are small
+	nlohmann::json settings;
+
+	std::vector<SceneTransformRecord> transforms;
+	// Behaviors with the index of the record they belong to
+	std::vector<std::pair<int, nlohmann::json>> behaviors;
+
+	std::vector<std::string> worldModels;
+	std::vector<SceneWorldRecord> worldObjects;
+};
+
+/*!
+	SAX handler that reads a scene file in a single pass.
+
+	The transform hierarchy and the world objects, which make up nearly all of a large scene, are written straight
+	into the record arrays of a SceneDescription as their values are read; no document is built for them. The small
+	entries (lights, models, shaders, probes, materials, world settings and the behaviors) are gathered in json
+	values and handed to the loader as they are.
+*/
+class SceneParser : public nlohmann::json_sax<nlohmann::json>
+{
+private:
+	enum ContextType {
+		// Top level object
+		CT_SCENE,
+		// World object, everything but its objects is captured
+		CT_WORLD,
+		// Array of transforms, the top level one or the children of a transform
+		CT_TRANSFORM_LIST,
+		CT_TRANSFORM,
+		CT_BEHAVIOR_LIST,
+		CT_WORLD_OBJECT_LIST,
+		CT_WORLD_OBJECT,
+		// x, y, z object read into a vector
+		CT_VECTOR,
+		// Value gathered in a json
+		CT_CAPTURE
+	};
+
+	struct Context {
+		ContextType type;
+		// Record of a transform or world object context, parent record of a transform list
+		int record;
+		glm::vec3* vector;
+	};
+
+	SceneDescription* m_scene;
+	std::vector<Context> m_contexts;
+	std::string m_key;
+
+	// Containers being captured, innermost last. They belong to m_scene, which does not grow while they are open
+	std::vector<nlohmann::json*> m_captures;
+	// Destination of the next captured value
+	nlohmann::json* m_captureTarget;
+	// Sink of the entries the format does not know
+	nlohmann::json m_ignored;
+
+	// Routes a value that is not an object nor an array
+	bool _Value(const nlohmann::json& value);
+	bool _Start(bool isObject);
+	bool _End();
+	// Starts capturing the value that comes next into target
+	void _Capture(nlohmann::json* target);
+	// Stores a captured value in the innermost capture. Returns the stored value
+	nlohmann::json* _Store(const nlohmann::json& value);
+	int _GetModelIndex(const std::string& path);
+
+public:
+	SceneParser(SceneDescription* scene);
+
+	bool null() override;
+	bool boolean(bool val) override;
+	bool number_integer(number_integer_t val) override;
+	bool number_unsigned(number_unsigned_t val) override;
+	bool number_float(number_float_t val, const string_t& s) override;
+	bool string(string_t& val) override;
+	bool start_object(std::size_t elements) override;
+	bool key(string_t& val) override;
+	bool end_object() override;
+	bool start_array(std::size_t elements) override;
+	bool end_array() override;
+	bool parse_error(std::size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) override;
+
+	/*!
+		\n bool SceneParser::Parse(const char* filename, SceneDescription* scene)
+		\param const char* filename Scene file
+		\param SceneDescription* scene Filled with the content of the file
+
+		Returns false if the file cannot be opened or is not valid json
+	*/
+	static bool Parse(const char* filename, SceneDescription* scene);
+};
@@ -0,0 +1,166 @@
+#include "SceneSnapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Identifies a snapshot file
+const char SCENE_SNAPSHOT_MAGIC[4] = { 'R', 'S', 'S', 'N' };
+
+const std::string SNAPSHOT_SETTINGS_KEY = "settings";
+const std::string SNAPSHOT_BEHAVIORS_KEY = "behaviors";
+const std::string SNAPSHOT_WORLD_MODELS_KEY = "worldmodels";
+
+// Followed by the CBOR sections, the transform records and the world object records
+struct SceneSnapshotHeader {
+	char magic[4];
+	unsigned int version;
+	// Layout of the records, which are stored as they are in memory
+	unsigned int transformRecordSize;
+	unsigned int worldRecordSize;
+	// Scene file the snapshot was made from
+	long long sourceSize;
+	long long sourceTime;
+	unsigned int sectionBytes;
+	unsigned int transformCount;
+	unsigned int worldObjectCount;
+};
+
+std::string SceneSnapshot::_GetPath(const char * sceneFile)
+{
+	std::string name = sceneFile;
+	std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == ':'; }, '_');
+	return CACHE_DIRECTORY + name + ".rss";
+}
+
+bool SceneSnapshot::_GetSourceStamp(const char * sceneFile, long long & size, long long & time)
+{
+	struct stat info;
+	if (stat(sceneFile, &info) != 0)
+		return false;
+	size = (long long)info.st_size;
+	time = (long long)info.st_mtime;
+	return true;
+}
+
+bool SceneSnapshot::_IsConsistent(const SceneDescription & scene)
+{
+	for (size_t i = 0; i < scene.transforms.size(); i++) {
+		if (scene.transforms[i].parent >= (int)i)
+			return false;
+	}
+	for (size_t i = 0; i < scene.worldObjects.size(); i++) {
+		if (scene.worldObjects[i].model >= (int)scene.worldModels.size())
+			return false;
+	}
+	for (size_t i = 0; i < scene.behaviors.size(); i++) {
+		if (scene.behaviors[i].first < 0 || (size_t)scene.behaviors[i].first >= scene.transforms.size())
+			return false;
+	}
+	return true;
+}
+
+bool SceneSnapshot::Load(const char * sceneFile, SceneDescription * scene)
+{
+	long long sourceSize, sourceTime;
+	if (!_GetSourceStamp(sceneFile, sourceSize, sourceTime))
+		return false;
+
+	std::string path = _GetPath(sceneFile);
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	SceneSnapshotHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, SCENE_SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == SCENE_SNAPSHOT_VERSION &&
+		header.transformRecordSize == sizeof(SceneTransformRecord) && header.worldRecordSize == sizeof(SceneWorldRecord) &&
+		header.sourceSize == sourceSize && header.sourceTime == sourceTime;
+
+	// One read per array, straight into the records
+	std::vector<uint8_t> sections;
+	if (valid) {
+		sections.resize(header.sectionBytes);
+		scene->transforms.resize(header.transformCount);
+		scene->worldObjects.resize(header.worldObjectCount);
+		valid = fread(sections.data(), 1, sections.size(), file) == sections.size() &&
+			fread(scene->transforms.data(), sizeof(SceneTransformRecord), scene->transforms.size(), file) == scene->transforms.size() &&
+			fread(scene->worldObjects.data(), sizeof(SceneWorldRecord), scene->worldObjects.size(), file) == scene->worldObjects.size();
+	}
+	fclose(file);
+
+	nlohmann::json small;
+	if (valid) {
+		small = nlohmann::json::from_cbor(sections, true, false);
+		valid = small.is_object();
+	}
+	if (!valid) {
+		printf("Scene snapshot %s is out of date\n", path.c_str());
+		*scene = SceneDescription();
+		return false;
+	}
+
+	scene->settings = small[SNAPSHOT_SETTINGS_KEY];
+	scene->worldModels = small[SNAPSHOT_WORLD_MODELS_KEY].get<std::vector<std::string>>();
+	nlohmann::json& behaviors = small[SNAPSHOT_BEHAVIORS_KEY];
+	scene->behaviors.reserve(behaviors.size());
+	for (size_t i = 0; i < behaviors.size(); i++)
+		scene->behaviors.push_back(std::make_pair(behaviors[i][0].get<int>(), behaviors[i][1]));
+
+	// The layout and the source stamp matched, but the records themselves are read as they are
+	if (!_IsConsistent(*scene)) {
+		printf("Scene snapshot %s is corrupt\n", path.c_str());
+		*scene = SceneDescription();
+		return false;
+	}
+	return true;
+}
+
+bool SceneSnapshot::Store(const char * sceneFile, const SceneDescription & scene)
+{
+	SceneSnapshotHeader header;
+	if (!_GetSourceStamp(sceneFile, header.sourceSize, header.sourceTime))
+		return false;
+
+	nlohmann::json small;
+	small[SNAPSHOT_SETTINGS_KEY] = scene.settings;
+	small[SNAPSHOT_WORLD_MODELS_KEY] = scene.worldModels;
+	nlohmann::json behaviors = nlohmann::json::array();
+	for (size_t i = 0; i < scene.behaviors.size(); i++)
+		behaviors.push_back(nlohmann::json::array({ scene.behaviors[i].first, scene.behaviors[i].second }));
+	small[SNAPSHOT_BEHAVIORS_KEY] = behaviors;
+	std::vector<uint8_t> sections = nlohmann::json::to_cbor(small);
+
+	memcpy(header.magic, SCENE_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SCENE_SNAPSHOT_VERSION;
+	header.transformRecordSize = sizeof(SceneTransformRecord);
+	header.worldRecordSize = sizeof(SceneWorldRecord);
+	header.sectionBytes = (unsigned int)sections.size();
+	header.transformCount = (unsigned int)scene.transforms.size();
+	header.worldObjectCount = (unsigned int)scene.worldObjects.size();
+
+	BakedProbe::EnsureDirectory(CACHE_DIRECTORY);
+	std::string path = _GetPath(sceneFile);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		printf("Failed to write the scene snapshot %s\n", path.c_str());
+		return false;
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(sections.data(), 1, sections.size(), file) == sections.size() &&
+		fwrite(scene.transforms.data(), sizeof(SceneTransformRecord), scene.transforms.size(), file) == scene.transforms.size() &&
+		fwrite(scene.worldObjects.data(), sizeof(SceneWorldRecord), scene.worldObjects.size(), file) == scene.worldObjects.size();
+	fclose(file);
+
+	// A truncated snapshot fails to load anyway, but do not leave it around
+	if (!success) {
+		printf("Failed to write the scene snapshot %s\n", path.c_str());
+		remove(path.c_str());
+	}
+	return success;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "SceneParser.h"
+#include "BakedProbe.h"
+
+// Bumped when the snapshot layout changes
+const unsigned int SCENE_SNAPSHOT_VERSION = 1;
+
+/*!
+	Binary copy of a parsed scene file, kept in CACHE_DIRECTORY.
+
+	The transform and world object records only refer to each other, to models and to materials by index, so they are
+	written as they are in memory and read back with one read per array, without parsing nor fix-ups. The small sections
+	(lights, materials, models, probes, world settings and behaviors) are stored as CBOR. A snapshot is made on the first
+	load of a scene and is rebuilt when the scene file or the layout of the records changes.
+*/
+class SceneSnapshot
+{
+private:
+	static std::string _GetPath(const char* sceneFile);
+	// Size and modification time of the scene file. Returns false if it does not exist
+	static bool _GetSourceStamp(const char* sceneFile, long long& size, long long& time);
+	// Whether the records only point at records before them and at entries of the scene's tables, so a truncated or
+	// edited snapshot is not indexed out of range
+	static bool _IsConsistent(const SceneDescription& scene);
+
+public:
+	/*!
+		\n bool SceneSnapshot::Load(const char* sceneFile, SceneDescription* scene)
+		\param const char* sceneFile Scene file the snapshot was made from
+		\param SceneDescription* scene Filled with the snapshot's content
+
+		Returns false if there is no snapshot or it is out of date, in which case the scene is left empty
+	*/
+	static bool Load(const char* sceneFile, SceneDescription* scene);
+	static bool Store(const char* sceneFile, const SceneDescription& scene);
+};
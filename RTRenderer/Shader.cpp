@@ -34,7 +34,7 @@ void Shader::UseShader() {
 		printf("No initialized shader has been found");
 		return;
 	}
-	glUseProgram(shaderID);
+	GLState::UseProgram(shaderID);
 }
 
 void Shader::ClearShader() {
@@ -63,6 +63,29 @@ bool StandardShader::CreateFromString(const char* vertexCode, const char* fragme
 
 	if (shaderID) {
 		GetShaderUniforms();
+
+		// The albedo array never moves from its unit, set it once
+		GLint uniformAlbedoArray = glGetUniformLocation(shaderID, "u_albedoArray");
+		if (uniformAlbedoArray != -1) {
+			GLState::UseProgram(shaderID);
+			GLState::Uniform1i(uniformAlbedoArray, ALBEDO_ARRAY_UNIT);
+		}
+
+		// Same for the baked reflection probe
+		GLint uniformProbeCubemap = glGetUniformLocation(shaderID, "u_probe.cubemap");
+		if (uniformProbeCubemap != -1) {
+			GLState::UseProgram(shaderID);
+			GLState::Uniform1i(uniformProbeCubemap, REFLECTION_PROBE_UNIT);
+		}
+
+		// And for the model matrices, which a draw picks from with u_modelIndex
+		GLint uniformModelMatrices = glGetUniformLocation(shaderID, "u_modelMatrices");
+		if (uniformModelMatrices != -1) {
+			GLState::UseProgram(shaderID);
+			GLState::Uniform1i(uniformModelMatrices, MODEL_MATRIX_UNIT);
+		}
+
+		MaterialTable::BindBlock(shaderID);
 	}
 
 	return success;
@@ -109,26 +132,32 @@ LightedShader::LightedShader()
 	uniformDirectionalLight.uniformSpecularColor = 0;
 	uniformDirectionalLight.uniformSpecularFactor = 0;
 	uniformDirectionalLight.uniformDirection = 0;
-	uniformMaterial.uniformSpecularIntensity = 0;
-	uniformMaterial.uniformShininess = 0;
-	uniformMaterial.uniformAlbedo = 0;
+	uniformMaterialID = 0;
+	uniformProbe.uniformPosition = 0;
+	uniformProbe.uniformBoxMin = 0;
+	uniformProbe.uniformBoxMax = 0;
+	uniformProbe.uniformLevels = 0;
 	uniformPointLightCount = 0;
 	uniformSpotLightCount = 0;
 }
 
 void LightedShader::GetShaderUniforms()
 {
-	uniformModel = GetUniformLocation("u_modelMatrix");
+	uniformModel = GetUniformLocation("u_modelIndex");
 
 	uniformCameraPosition = GetUniformLocation("u_cameraPosition");
 	uniformAmbientIntensity = GetUniformLocation("u_ambientFactor");
 
 	// -- Material Uniforms -- 
-	uniformMaterial.uniformSpecularIntensity = GetUniformLocation("u_material.specularIntensity");
-	uniformMaterial.uniformShininess = GetUniformLocation("u_material.shininess");
-	uniformMaterial.uniformAlbedo = GetUniformLocation("u_material.albedo");
+	uniformMaterialID = GetUniformLocation("u_materialID");
 	uniformTexture = GetUniformLocation("u_material.albedoTexture");
 
+	// -- Reflection Probe Uniforms --
+	uniformProbe.uniformPosition = GetUniformLocation("u_probe.position");
+	uniformProbe.uniformBoxMin = GetUniformLocation("u_probe.boxMin");
+	uniformProbe.uniformBoxMax = GetUniformLocation("u_probe.boxMax");
+	uniformProbe.uniformLevels = GetUniformLocation("u_probe.levels");
+
 	// -- Directional Light Uniforms --
 	uniformDirectionalLight.uniformDiffuseColor = GetUniformLocation("u_directionalLight.light.diffuseColor");
 	uniformDirectionalLight.uniformDiffuseFactor = GetUniformLocation("u_directionalLight.light.diffuseFactor");
@@ -191,12 +220,12 @@ GLuint LightedShader::GetModelLocation() {
 
 void LightedShader::SetCameraPosition(glm::vec3 * cPosition)
 {
-	glUniform3f(uniformCameraPosition, cPosition->x, cPosition->y, cPosition->z);
+	GLState::Uniform3f(uniformCameraPosition, cPosition->x, cPosition->y, cPosition->z);
 }
 
 void LightedShader::SetAmbientIntensity(GLfloat aIntensity)
 {
-	glUniform1f(uniformAmbientIntensity, aIntensity);
+	GLState::Uniform1f(uniformAmbientIntensity, aIntensity);
 }
 
 void LightedShader::SetDirectionalLight(DirectionalLight * light)
@@ -208,7 +237,7 @@ void LightedShader::SetPointLights(PointLight **pLight, unsigned int lightCount,
 {
 	if (lightCount > MAX_POINT_LIGHTS)
 		lightCount = MAX_POINT_LIGHTS;
-	glUniform1i(uniformPointLightCount, lightCount);
+	GLState::Uniform1i(uniformPointLightCount, lightCount);
 	for (size_t i = 0; i < lightCount; i++) {
 		pLight[i]->UseLight(uniformPointLights[i].uniformPosition, uniformPointLights[i].uniformConstant,
 			uniformPointLights[i].uniformLinear, uniformPointLights[i].uniformExponent, uniformPointLights[i].uniformDiffuseColor,
@@ -221,7 +250,7 @@ void LightedShader::SetSpotLights(SpotLight **sLight, unsigned int lightCount, u
 {
 	if (lightCount > MAX_SPOT_LIGHTS)
 		lightCount = MAX_SPOT_LIGHTS;
-	glUniform1i(uniformSpotLightCount, lightCount);
+	GLState::Uniform1i(uniformSpotLightCount, lightCount);
 	for (size_t i = 0; i < lightCount; i++) {
 		sLight[i]->UseLight(uniformSpotLights[i].uniformDirection, uniformSpotLights[i].uniformEdge,
 			uniformSpotLights[i].uniformPosition, uniformSpotLights[i].uniformConstant, uniformSpotLights[i].uniformLinear, uniformSpotLights[i].uniformExponent,
@@ -233,12 +262,33 @@ void LightedShader::SetSpotLights(SpotLight **sLight, unsigned int lightCount, u
 
 void LightedShader::SetMaterial(Material * mat)
 {
-	mat->UseMaterial(uniformMaterial.uniformSpecularIntensity, uniformMaterial.uniformShininess, uniformMaterial.uniformAlbedo);
+	mat->UseMaterial(uniformMaterialID);
 }
 
 void LightedShader::SetTexutre(GLuint textureUnit)
 {
-	glUniform1i(uniformTexture, textureUnit);
+	GLState::Uniform1i(uniformTexture, textureUnit);
+}
+
+void LightedShader::SetReflectionProbe(BakedProbe * probe)
+{
+	// Shaders that do not sample probes
+	if ((GLint)uniformProbe.uniformLevels == -1)
+		return;
+
+	if (!probe || probe->GetLevels() == 0) {
+		GLState::Uniform1f(uniformProbe.uniformLevels, 0.0f);
+		return;
+	}
+
+	glm::vec3 position = probe->GetPosition();
+	glm::vec3 boxMin = probe->GetBoxMin();
+	glm::vec3 boxMax = probe->GetBoxMax();
+	GLState::Uniform3f(uniformProbe.uniformPosition, position.x, position.y, position.z);
+	GLState::Uniform3f(uniformProbe.uniformBoxMin, boxMin.x, boxMin.y, boxMin.z);
+	GLState::Uniform3f(uniformProbe.uniformBoxMax, boxMax.x, boxMax.y, boxMax.z);
+	GLState::Uniform1f(uniformProbe.uniformLevels, (GLfloat)probe->GetLevels());
+	probe->Read(GL_TEXTURE0 + REFLECTION_PROBE_UNIT);
 }
 
 
@@ -299,26 +349,26 @@ void DefaultShader::GetShaderUniforms()
 
 void DefaultShader::SetProjectionMatrix(glm::mat4 * pMatrix)
 {
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(*pMatrix));
+	GLState::UniformMatrix4fv(uniformProjection, glm::value_ptr(*pMatrix));
 }
 
 void DefaultShader::SetViewMatrix(glm::mat4 * vMatrix)
 {
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(*vMatrix));
+	GLState::UniformMatrix4fv(uniformView, glm::value_ptr(*vMatrix));
 }
 
 void DefaultShader::SetPointLights(PointLight **pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset)
 {
 	if (lightCount > MAX_POINT_LIGHTS)
 		lightCount = MAX_POINT_LIGHTS;
-	glUniform1i(uniformPointLightCount, lightCount);
+	GLState::Uniform1i(uniformPointLightCount, lightCount);
 	for (size_t i = 0; i < lightCount; i++) {
 		pLight[i]->UseLight(uniformPointLights[i].uniformPosition, uniformPointLights[i].uniformConstant,
 			uniformPointLights[i].uniformLinear, uniformPointLights[i].uniformExponent, uniformPointLights[i].uniformDiffuseColor,
 			uniformPointLights[i].uniformDiffuseFactor, uniformPointLights[i].uniformSpecularColor, uniformPointLights[i].uniformSpecularFactor);
 		pLight[i]->GetStaticShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniSM[i + offset].uniformStaticShadowMap, textureUnit + i);
-		glUniform1f(uniformOmniSM[i + offset].uniformFarPlane, pLight[i]->GetFarPlane());
+		GLState::Uniform1i(uniformOmniSM[i + offset].uniformStaticShadowMap, textureUnit + i);
+		GLState::Uniform1f(uniformOmniSM[i + offset].uniformFarPlane, pLight[i]->GetFarPlane());
 	}
 }
 
@@ -326,62 +376,64 @@ void DefaultShader::SetSpotLights(SpotLight **sLight, unsigned int lightCount, u
 {
 	if (lightCount > MAX_SPOT_LIGHTS)
 		lightCount = MAX_SPOT_LIGHTS;
-	glUniform1i(uniformSpotLightCount, lightCount);
+	GLState::Uniform1i(uniformSpotLightCount, lightCount);
 	for (size_t i = 0; i < lightCount; i++) {
 		sLight[i]->UseLight(uniformSpotLights[i].uniformDirection, uniformSpotLights[i].uniformEdge,
 			uniformSpotLights[i].uniformPosition, uniformSpotLights[i].uniformConstant, uniformSpotLights[i].uniformLinear, uniformSpotLights[i].uniformExponent,
 			uniformSpotLights[i].uniformDiffuseColor, uniformSpotLights[i].uniformDiffuseFactor,
 			uniformSpotLights[i].uniformSpecularColor, uniformSpotLights[i].uniformSpecularFactor);
 		sLight[i]->GetStaticShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniSM[i + offset].uniformStaticShadowMap, textureUnit + i);
-		glUniform1f(uniformOmniSM[i + offset].uniformFarPlane, sLight[i]->GetFarPlane());
+		GLState::Uniform1i(uniformOmniSM[i + offset].uniformStaticShadowMap, textureUnit + i);
+		GLState::Uniform1f(uniformOmniSM[i + offset].uniformFarPlane, sLight[i]->GetFarPlane());
 	}
 }
 
 void DefaultShader::SetDirectionalStaticSM(GLuint textureUnit)
 {
-	glUniform1i(uniformDirectionalSM.uniformStaticShadowMap, textureUnit);
+	GLState::Uniform1i(uniformDirectionalSM.uniformStaticShadowMap, textureUnit);
 }
 
 void DefaultShader::SetDirectionalDynamicSM(GLuint textureUnit)
 {
-	glUniform1i(uniformDirectionalSM.uniformDynamicShadowMap, textureUnit);
+	GLState::Uniform1i(uniformDirectionalSM.uniformDynamicShadowMap, textureUnit);
 }
 
 void DefaultShader::SetDirectionalLightTransform(glm::mat4 * lTransform)
 {
-	glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
+	GLState::UniformMatrix4fv(uniformDirectionalLightTransform, glm::value_ptr(*lTransform));
 }
 
 void DefaultShader::SetSkybox(GLuint textureUnit)
 {
-	glUniform1i(uniformSkybox, textureUnit);
+	GLState::Uniform1i(uniformSkybox, textureUnit);
 }
 
 void DefaultShader::SetWorldReflection(GLuint textureUnit) {
-	glUniform1i(uniformWorldReflection, textureUnit);
+	GLState::Uniform1i(uniformWorldReflection, textureUnit);
 }
 
 void DefaultShader::SetReflectionFactor(GLfloat factor) {
-	glUniform1f(uniformReflectionFactor, factor);
+	GLState::Uniform1f(uniformReflectionFactor, factor);
 }
 
 void DefaultShader::SetRefractionFactor(GLfloat factor) {
-	glUniform1f(uniformRefractionFactor, factor);
+	GLState::Uniform1f(uniformRefractionFactor, factor);
 }
 
 void DefaultShader::SetFresnelValues(GLfloat bias, GLfloat power, GLfloat scale) {
-	glUniform3f(uniformFresnelValues, bias, power, scale);
+	GLState::Uniform3f(uniformFresnelValues, bias, power, scale);
 }
 
 void DefaultShader::SetIORValue(GLfloat x, GLfloat y, GLfloat z) {
-	glUniform3f(uniformIORValues, x, y, z);
+	GLState::Uniform3f(uniformIORValues, x, y, z);
 }
 
 
 CubeMapRenderShader::CubeMapRenderShader() :
 	LightedShader()
-{}
+{
+	uniformFace = 0;
+}
 
 void CubeMapRenderShader::GetShaderUniforms()
 {
@@ -393,14 +445,20 @@ void CubeMapRenderShader::GetShaderUniforms()
 		snprintf(locBuff, sizeof(locBuff), "u_viewProjectionMatrices[%d]", i);
 		uniformViewProjectionMatrices[i] = GetUniformLocation(locBuff);
 	}
+	uniformFace = GetUniformLocation("u_face");
 }
 
-void CubeMapRenderShader::SetViewProjectMatrices(std::vector<glm::mat4> viewProjectionMatrices) {
+void CubeMapRenderShader::SetViewProjectMatrices(const CubeMatrices& viewProjectionMatrices) {
 	for (size_t i = 0; i < 6; i++) {
-		glUniformMatrix4fv(uniformViewProjectionMatrices[i], 1, GL_FALSE, glm::value_ptr(viewProjectionMatrices[i]));
+		GLState::UniformMatrix4fv(uniformViewProjectionMatrices[i], glm::value_ptr(viewProjectionMatrices.faces[i]));
 	}
 }
 
+void CubeMapRenderShader::SetFace(int face)
+{
+	GLState::Uniform1i(uniformFace, face);
+}
+
 
 DirectionalShadowMapShader::DirectionalShadowMapShader() :
 	StandardShader()
@@ -411,7 +469,7 @@ DirectionalShadowMapShader::DirectionalShadowMapShader() :
 
 void DirectionalShadowMapShader::GetShaderUniforms()
 {
-	uniformModel = GetUniformLocation("u_modelMatrix");
+	uniformModel = GetUniformLocation("u_modelIndex");
 	uniformDirectionalLightTransform = GetUniformLocation("u_directionalLightTransform");
 	uniformTexture = GetUniformLocation("u_texture");
 }
@@ -421,19 +479,85 @@ GLuint DirectionalShadowMapShader::GetModelLocation()
 	return uniformModel;
 }
 
-void DirectionalShadowMapShader::SetModel(glm::mat4 * mMatrix)
+void DirectionalShadowMapShader::SetModelIndex(GLint index)
 {
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(*mMatrix));
+	GLState::Uniform1i(uniformModel, index);
 }
 
 void DirectionalShadowMapShader::SetDirectionalLightTransform(glm::mat4 * lTransform)
 {
-	glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
+	GLState::UniformMatrix4fv(uniformDirectionalLightTransform, glm::value_ptr(*lTransform));
 }
 
 void DirectionalShadowMapShader::SetTexture(GLuint textureUnit)
 {
-	glUniform1i(uniformTexture, textureUnit);
+	GLState::Uniform1i(uniformTexture, textureUnit);
+}
+
+
+TerrainUniforms::TerrainUniforms()
+{
+	uniformOrigin = 0;
+	uniformSize = 0;
+	uniformHeightScale = 0;
+	uniformTiling = 0;
+	uniformCamera = 0;
+	uniformChunk = 0;
+	uniformMorph = 0;
+}
+
+void TerrainUniforms::GetLocations(GLuint program)
+{
+	uniformOrigin = glGetUniformLocation(program, "u_terrainOrigin");
+	uniformSize = glGetUniformLocation(program, "u_terrainSize");
+	uniformHeightScale = glGetUniformLocation(program, "u_terrainHeightScale");
+	uniformTiling = glGetUniformLocation(program, "u_terrainTiling");
+	uniformCamera = glGetUniformLocation(program, "u_terrainCamera");
+	uniformChunk = glGetUniformLocation(program, "u_terrainChunk");
+	uniformMorph = glGetUniformLocation(program, "u_terrainMorph");
+
+	// The heightmap never moves from its unit
+	GLState::UseProgram(program);
+	GLState::Uniform1i(glGetUniformLocation(program, "u_heightmap"), TERRAIN_HEIGHTMAP_UNIT);
+}
+
+void TerrainUniforms::SetTerrain(glm::vec3 origin, GLfloat size, GLfloat heightScale, GLfloat tiling, glm::vec3 camera)
+{
+	GLState::Uniform3f(uniformOrigin, origin.x, origin.y, origin.z);
+	GLState::Uniform1f(uniformSize, size);
+	GLState::Uniform1f(uniformHeightScale, heightScale);
+	GLState::Uniform1f(uniformTiling, tiling);
+	GLState::Uniform3f(uniformCamera, camera.x, camera.y, camera.z);
+}
+
+void TerrainUniforms::SetChunk(glm::vec2 offset, GLfloat size, glm::vec2 morph)
+{
+	GLState::Uniform3f(uniformChunk, offset.x, offset.y, size);
+	GLState::Uniform2f(uniformMorph, morph.x, morph.y);
+}
+
+
+TerrainShader::TerrainShader() :
+	DefaultShader()
+{
+}
+
+void TerrainShader::GetShaderUniforms()
+{
+	DefaultShader::GetShaderUniforms();
+	uniformTerrain.GetLocations(shaderID);
+}
+
+
+TerrainShadowMapShader::TerrainShadowMapShader() :
+	DirectionalShadowMapShader()
+{
+}
+
+void TerrainShadowMapShader::GetShaderUniforms()
+{
+	DirectionalShadowMapShader::GetShaderUniforms();
+	uniformTerrain.GetLocations(shaderID);
 }
 
 
@@ -447,7 +571,7 @@ OmnidirectionalShadowMapShader::OmnidirectionalShadowMapShader() :
 
 void OmnidirectionalShadowMapShader::GetShaderUniforms() {
 
-	uniformModel = GetUniformLocation("u_modelMatrix");
+	uniformModel = GetUniformLocation("u_modelIndex");
 	uniformLightPos = GetUniformLocation("u_lightPos");
 	uniformFarPlane = GetUniformLocation("u_farPlane");
 
@@ -465,27 +589,27 @@ GLuint OmnidirectionalShadowMapShader::GetModelLocation()
 	return uniformModel;
 }
 
-void OmnidirectionalShadowMapShader::SetModel(glm::mat4 * mMatrix)
+void OmnidirectionalShadowMapShader::SetModelIndex(GLint index)
 {
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(*mMatrix));
+	GLState::Uniform1i(uniformModel, index);
 }
 
 void OmnidirectionalShadowMapShader::SetLightPosition(glm::vec3* lPos) {
-	glUniform3f(uniformLightPos, lPos->x, lPos->y, lPos->z);
+	GLState::Uniform3f(uniformLightPos, lPos->x, lPos->y, lPos->z);
 }
 
 void OmnidirectionalShadowMapShader::SetFarPlane(GLfloat far) {
-	glUniform1f(uniformFarPlane, far);
+	GLState::Uniform1f(uniformFarPlane, far);
 }
 
-void OmnidirectionalShadowMapShader::SetLightMatrices(std::vector<glm::mat4> lightMatrices) {
+void OmnidirectionalShadowMapShader::SetLightMatrices(const CubeMatrices& lightMatrices) {
 	for (size_t i = 0; i < 6; i++) {
-		glUniformMatrix4fv(uniformLightMatrices[i], 1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
+		GLState::UniformMatrix4fv(uniformLightMatrices[i], glm::value_ptr(lightMatrices.faces[i]));
 	}
 }
 
 void OmnidirectionalShadowMapShader::SetTexture(GLuint unit) {
-	glUniform1i(uniformTexture, unit);
+	GLState::Uniform1i(uniformTexture, unit);
 }
 
 SkyBoxShader::SkyBoxShader() :
@@ -503,12 +627,40 @@ void SkyBoxShader::GetShaderUniforms()
 
 void SkyBoxShader::SetSkyBox(GLuint textureUnit)
 {
-	glUniform1i(uniformSkyBox, textureUnit);
+	GLState::Uniform1i(uniformSkyBox, textureUnit);
 }
 
 void SkyBoxShader::SetViewProjectionMatrix(glm::mat4* viewProjectionMatrix)
 {
-	glUniformMatrix4fv(uniformViewProjectionMatrix, 1, GL_FALSE, glm::value_ptr(*viewProjectionMatrix));
+	GLState::UniformMatrix4fv(uniformViewProjectionMatrix, glm::value_ptr(*viewProjectionMatrix));
+}
+
+
+OcclusionBoxShader::OcclusionBoxShader() :
+	StandardShader()
+{
+	uniformViewProjectionMatrix = 0;
+	uniformBoxMins = 0;
+	uniformBoxMaxs = 0;
+}
+
+void OcclusionBoxShader::GetShaderUniforms()
+{
+	uniformViewProjectionMatrix = GetUniformLocation("u_viewProjectionMatrix");
+	uniformBoxMins = GetUniformLocation("u_boxMins");
+	uniformBoxMaxs = GetUniformLocation("u_boxMaxs");
+}
+
+void OcclusionBoxShader::SetViewProjectionMatrix(const glm::mat4& viewProjectionMatrix)
+{
+	GLState::UniformMatrix4fv(uniformViewProjectionMatrix, glm::value_ptr(viewProjectionMatrix));
+}
+
+void OcclusionBoxShader::SetBoxes(const glm::vec3 * boxMins, const glm::vec3 * boxMaxs, GLsizei count)
+{
+	// Different every query, not worth the state cache
+	glUniform3fv(uniformBoxMins, count, glm::value_ptr(boxMins[0]));
+	glUniform3fv(uniformBoxMaxs, count, glm::value_ptr(boxMaxs[0]));
 }
 
 
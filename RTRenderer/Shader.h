@@ -10,8 +10,11 @@
 #include <glm\gtc\type_ptr.hpp>
 
 #include "ShaderCompiler.h"
+#include "GLState.h"
 #include "ErrorShader.h"
 #include "Material.h"
+#include "MaterialTable.h"
+#include "BakedProbe.h"
 #include "Light.h"
 #include "Commons.h"
 
@@ -38,7 +41,7 @@ protected:
 
 public:
 	// Destructor
-	~Shader();
+	virtual ~Shader();
 };
 
 class StandardShader :
@@ -56,7 +59,7 @@ public:
 class LightedShader :
 	public StandardShader {
 protected:
-	// Model matrix
+	// Slot of the model matrix in the ModelMatrixBuffer
 	GLuint uniformModel;
 
 	// -- Camera --
@@ -118,11 +121,15 @@ protected:
 	} uniformSpotLights[MAX_SPOT_LIGHTS];
 
 	// -- Material --
+	GLuint uniformMaterialID;
+
+	// -- Baked reflection probe --
 	struct {
-		GLuint uniformSpecularIntensity;
-		GLuint uniformShininess;
-		GLuint uniformAlbedo;
-	} uniformMaterial;
+		GLuint uniformPosition;
+		GLuint uniformBoxMin;
+		GLuint uniformBoxMax;
+		GLuint uniformLevels;
+	} uniformProbe;
 
 public:
 	LightedShader();
@@ -137,6 +144,8 @@ public:
 	virtual void SetSpotLights(SpotLight** sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
 	void SetMaterial(Material* mat);
 	void SetTexutre(GLuint textureUnit);
+	// Probe reflected by the next objects. Null turns the probe off
+	void SetReflectionProbe(BakedProbe* probe);
 
 protected:
 	void GetShaderUniforms();
@@ -201,10 +210,12 @@ class CubeMapRenderShader :
 private:
 	// -- Transformation --
 	GLuint uniformViewProjectionMatrices[6];
+	GLuint uniformFace;
 public:
 	CubeMapRenderShader();
 
-	void SetViewProjectMatrices(std::vector<glm::mat4> lightMatrices);
+	void SetViewProjectMatrices(const CubeMatrices& viewProjectionMatrices);
+	void SetFace(int face);
 
 protected:
 	void GetShaderUniforms();
@@ -222,7 +233,8 @@ public:
 
 	GLuint GetModelLocation();
 
-	void SetModel(glm::mat4* mMatrix);
+	// Slot of the next object's matrix in the ModelMatrixBuffer
+	void SetModelIndex(GLint index);
 	void SetDirectionalLightTransform(glm::mat4* lTransform);
 	void SetTexture(GLuint textureUnit);
 
@@ -245,16 +257,67 @@ public:
 
 	GLuint GetModelLocation();
 
-	void SetModel(glm::mat4* mMatrix);
+	// Slot of the next object's matrix in the ModelMatrixBuffer
+	void SetModelIndex(GLint index);
 	void SetLightPosition(glm::vec3* lPos);
 	void SetFarPlane(GLfloat far);
-	void SetLightMatrices(std::vector<glm::mat4> lightMatrices);
+	void SetLightMatrices(const CubeMatrices& lightMatrices);
 	void SetTexture(GLuint unit);
 
 protected:
 	void GetShaderUniforms();
 };
 
+// Uniforms of the terrain vertex shader, shared by the programs that draw the terrain
+class TerrainUniforms
+{
+private:
+	GLuint uniformOrigin;
+	GLuint uniformSize;
+	GLuint uniformHeightScale;
+	GLuint uniformTiling;
+	GLuint uniformCamera;
+	GLuint uniformChunk;
+	GLuint uniformMorph;
+public:
+	TerrainUniforms();
+
+	// Also points the heightmap sampler to TERRAIN_HEIGHTMAP_UNIT
+	void GetLocations(GLuint program);
+
+	void SetTerrain(glm::vec3 origin, GLfloat size, GLfloat heightScale, GLfloat tiling, glm::vec3 camera);
+	void SetChunk(glm::vec2 offset, GLfloat size, glm::vec2 morph);
+};
+
+// Default shader with the terrain vertex shader, the terrain is lit like any other object
+class TerrainShader :
+	public DefaultShader
+{
+private:
+	TerrainUniforms uniformTerrain;
+public:
+	TerrainShader();
+
+	TerrainUniforms* GetTerrainUniforms() { return &uniformTerrain; }
+
+protected:
+	void GetShaderUniforms();
+};
+
+class TerrainShadowMapShader :
+	public DirectionalShadowMapShader
+{
+private:
+	TerrainUniforms uniformTerrain;
+public:
+	TerrainShadowMapShader();
+
+	TerrainUniforms* GetTerrainUniforms() { return &uniformTerrain; }
+
+protected:
+	void GetShaderUniforms();
+};
+
 class SkyBoxShader :
 	public StandardShader
 {
@@ -272,6 +335,26 @@ protected:
 	void GetShaderUniforms();
 };
 
+// Draws boxes for occlusion queries, up to OCCLUSION_QUERY_BATCH_SIZE instances per draw
+class OcclusionBoxShader :
+	public StandardShader
+{
+private:
+	GLuint uniformViewProjectionMatrix;
+	GLuint uniformBoxMins;
+	GLuint uniformBoxMaxs;
+
+public:
+	OcclusionBoxShader();
+
+	void SetViewProjectionMatrix(const glm::mat4& viewProjectionMatrix);
+	// World boxes of the instances
+	void SetBoxes(const glm::vec3* boxMins, const glm::vec3* boxMaxs, GLsizei count);
+
+protected:
+	void GetShaderUniforms();
+};
+
 class CustomShader 
 	: public StandardShader
 {
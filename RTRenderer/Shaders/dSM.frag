@@ -1,10 +1,13 @@
 #version 330
 
 in vec2 vert_TextCoords;
+flat in float vert_layer;
 
 uniform sampler2D u_texture;
+uniform sampler2DArray u_albedoArray;
 
 void main() {
-	if(texture(u_texture, vert_TextCoords).a <= 0.8)
+	float alpha = vert_layer >= 0.0 ? texture(u_albedoArray, vec3(vert_TextCoords, vert_layer)).a : texture(u_texture, vert_TextCoords).a;
+	if(alpha <= 0.8)
 		discard;
 }
\ No newline at end of file
@@ -2,13 +2,25 @@
 
 layout (location = 0) in vec3 vertPos;
 layout (location = 1) in vec2 vertTexCoords;
+layout (location = 3) in float vertLayer;
 
-uniform mat4 u_modelMatrix;
+// World matrices of the frame's objects, four texels each, and the slot of the one being drawn
+uniform samplerBuffer u_modelMatrices;
+uniform int u_modelIndex;
 uniform mat4 u_directionalLightTransform;
 
 out vec2 vert_TextCoords;
+flat out float vert_layer;
+
+mat4 ModelMatrix() {
+	int texel = u_modelIndex * 4;
+	return mat4(texelFetch(u_modelMatrices, texel), texelFetch(u_modelMatrices, texel + 1),
+		texelFetch(u_modelMatrices, texel + 2), texelFetch(u_modelMatrices, texel + 3));
+}
 
 void main() {
-	gl_Position = u_directionalLightTransform * u_modelMatrix * vec4(vertPos, 1.0);
+	mat4 modelMatrix = ModelMatrix();
+	gl_Position = u_directionalLightTransform * modelMatrix * vec4(vertPos, 1.0);
 	vert_TextCoords = vertTexCoords;
+	vert_layer = vertLayer;
 }
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #define MAX_POINT_LIGHTS	3
 #define MAX_SPOT_LIGHTS		3
+#define MAX_MATERIALS		256
 
 in vec3 geo_position;
 in vec3 geo_normal;
 in vec2 geo_texCoord;
+// Albedo array layer, negative when the mesh uses u_material.albedoTexture
+flat in float geo_layer;
 
 out vec4 frag_color;
 
@@ -48,12 +51,17 @@ struct FragParams {
 };
 
 struct Material {
-	float specularIntensity;
-	float shininess;
-	vec3 albedo;
 	sampler2D albedoTexture;
 };
 
+// Mirrors MaterialData in MaterialTable.h
+struct MaterialData {
+	// rgb: albedo, a: alpha
+	vec4 albedo;
+	// x: specular intensity, y: shininess, z: reflectivity
+	vec4 parameters;
+};
+
 uniform vec3 u_cameraPosition;
 
 uniform float u_ambientFactor;
@@ -64,6 +72,11 @@ uniform SpotLight u_spotLights[MAX_SPOT_LIGHTS];
 uniform int u_spotLightsCount = 0;
 
 uniform	Material u_material;
+layout (std140) uniform MaterialTable {
+	MaterialData u_materials[MAX_MATERIALS];
+};
+uniform int u_materialID;
+uniform sampler2DArray u_albedoArray;
 
 float CalculateAttenuation(float dist, float falloffStart, float falloffEnd)
 {
@@ -99,8 +112,8 @@ vec4 CalculateLighting(FragParams frag, vec3 matColor, float matShininess, vec3
 vec4 CalculateDirectionalLight(FragParams frag, vec3 matColor, float matShininess, DirectionalLight light) {
 	return CalculateLighting(
 			frag, 
-			u_material.albedo, 
-			u_material.shininess, 
+			matColor, 
+			matShininess, 
 			-u_directionalLight.direction, 
 			u_directionalLight.light, 
 			0.0);
@@ -111,7 +124,7 @@ vec4 CalculatePointLight(FragParams frag, vec3 matColor, float matShininess, Poi
 	float dLightToFrag = length(lightToFrag);
 	vec3 nLightToFrag = normalize(lightToFrag);
 
-	vec4 plColor = CalculateLighting(frag, u_material.albedo, u_material.shininess, nLightToFrag, light.light, 0.0);
+	vec4 plColor = CalculateLighting(frag, matColor, matShininess, nLightToFrag, light.light, 0.0);
 
 	// Calculate attenuation based on distance
 	float attenuation = light.exponent * dLightToFrag * dLightToFrag + light.linear * dLightToFrag + light.constant;
@@ -147,9 +160,15 @@ vec4 CalculateSpotLights(FragParams frag, vec3 matColor, float matShininess, Spo
 	return plsColor;
 }
 
+vec4 SampleAlbedo(vec2 texCoord) {
+	if(geo_layer >= 0.0)
+		return texture(u_albedoArray, vec3(texCoord, geo_layer));
+	return texture(u_material.albedoTexture, texCoord);
+}
+
 void main()
 {
-	vec4 tColor = texture(u_material.albedoTexture, geo_texCoord);
+	vec4 tColor = SampleAlbedo(geo_texCoord);
 	if(tColor.a < 0.8)
 		discard;
 
@@ -158,9 +177,10 @@ void main()
 	frag.frag_Normal = -geo_normal;
 	frag.frag_nvToCam = normalize(u_cameraPosition - geo_position);
 	
-	vec4 dlColor = CalculateDirectionalLight(frag, u_material.albedo, u_material.shininess, u_directionalLight);
-	vec4 plsColor = CalculatePointLights(frag, u_material.albedo, u_material.shininess, u_pointLights, u_pointLightsCount);
-	vec4 slsColor = CalculateSpotLights(frag, u_material.albedo, u_material.shininess, u_spotLights, u_spotLightsCount);
+	MaterialData material = u_materials[u_materialID];
+	vec4 dlColor = CalculateDirectionalLight(frag, material.albedo.rgb, material.parameters.y, u_directionalLight);
+	vec4 plsColor = CalculatePointLights(frag, material.albedo.rgb, material.parameters.y, u_pointLights, u_pointLightsCount);
+	vec4 slsColor = CalculateSpotLights(frag, material.albedo.rgb, material.parameters.y, u_spotLights, u_spotLightsCount);
 	vec4 aColor = vec4(u_ambientFactor, u_ambientFactor, u_ambientFactor, 1.0);
 	
 	frag_color = clamp( tColor * (dlColor + plsColor + slsColor + aColor), 0.0, 1.0 );
@@ -3,15 +3,27 @@
 layout (location = 0) in vec3 vertPos;
 layout (location = 1) in vec2 vertMainTex;
 layout (location = 2) in vec3 vertNormal;
+layout (location = 3) in float vertLayer;
 
-uniform mat4 u_modelMatrix;
+// World matrices of the frame's objects, four texels each, and the slot of the one being drawn
+uniform samplerBuffer u_modelMatrices;
+uniform int u_modelIndex;
 
 out vec3 vert_normal;
 out vec2 vert_texCoord;
+out float vert_layer;
+
+mat4 ModelMatrix() {
+	int texel = u_modelIndex * 4;
+	return mat4(texelFetch(u_modelMatrices, texel), texelFetch(u_modelMatrices, texel + 1),
+		texelFetch(u_modelMatrices, texel + 2), texelFetch(u_modelMatrices, texel + 3));
+}
 
 void main() {
-	gl_Position = u_modelMatrix * vec4(vertPos, 1.0);
+	mat4 modelMatrix = ModelMatrix();
+	gl_Position = modelMatrix * vec4(vertPos, 1.0);
 	
-	vert_normal = mat3(u_modelMatrix) * vertNormal;
+	vert_normal = mat3(modelMatrix) * vertNormal;
 	vert_texCoord = vertMainTex;
+	vert_layer = vertLayer;
 }
\ No newline at end of file
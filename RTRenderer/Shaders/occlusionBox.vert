@@ -0,0 +1,17 @@
+#version 330
+
+// Boxes of the query being drawn, one per instance
+const int MAX_BOXES = 8;
+
+uniform mat4 u_viewProjectionMatrix;
+uniform vec3 u_boxMins[MAX_BOXES];
+uniform vec3 u_boxMaxs[MAX_BOXES];
+
+void main()
+{
+	// Corner of a cube drawn as a 14 vertex triangle strip, without a vertex buffer
+	int bit = 1 << gl_VertexID;
+	vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0);
+	vec3 worldPos = mix(u_boxMins[gl_InstanceID], u_boxMaxs[gl_InstanceID], corner);
+	gl_Position = u_viewProjectionMatrix * vec4(worldPos, 1.0);
+}
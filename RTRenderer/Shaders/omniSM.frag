@@ -2,13 +2,16 @@
 
 in vec4 geo_position;
 in vec2 geo_textCoords;
+flat in float geo_layer;
 
 uniform vec3 u_lightPos;
 uniform float u_farPlane;
 uniform sampler2D u_texture;
+uniform sampler2DArray u_albedoArray;
 
 void main() {
-	if(texture(u_texture, geo_textCoords).a <= 0.8)
+	float alpha = geo_layer >= 0.0 ? texture(u_albedoArray, vec3(geo_textCoords, geo_layer)).a : texture(u_texture, geo_textCoords).a;
+	if(alpha <= 0.8)
 		discard;
 
 	float dist = length(geo_position.xyz - u_lightPos);
@@ -2,11 +2,14 @@
 
 #define MAX_POINT_LIGHTS	3
 #define MAX_SPOT_LIGHTS		3
+#define MAX_MATERIALS		256
 
 in vec3 vert_normal;
 in vec2 vert_mainTex;
 in vec3 vert_pos;
 in vec4 vert_directionalLightSpacePos;
+// Albedo array layer, negative when the mesh uses u_material.albedoTexture
+flat in float vert_layer;
 
 out vec4 frag_color;
 
@@ -49,17 +52,32 @@ struct FragParams {
 };
 
 struct Material {
-	float specularIntensity;
-	float shininess;
-	vec3 albedo;
 	sampler2D albedoTexture;
 };
 
+// Mirrors MaterialData in MaterialTable.h
+struct MaterialData {
+	// rgb: albedo, a: alpha
+	vec4 albedo;
+	// x: specular intensity, y: shininess, z: reflectivity
+	vec4 parameters;
+};
+
 struct ShadowMap {
 	sampler2D static_shadowmap;
 	sampler2D dynamic_shadowmap;
 };
 
+// Baked reflection probe, box projected
+struct ReflectionProbe {
+	samplerCube cubemap;
+	vec3 position;
+	vec3 boxMin;
+	vec3 boxMax;
+	// Number of roughness levels, 0 when the object has no probe
+	float levels;
+};
+
 struct OmniShadowMap {
 	samplerCube static_shadowmap;
 	float farPlane;
@@ -80,9 +98,15 @@ uniform SpotLight u_spotLights[MAX_SPOT_LIGHTS];
 uniform int u_spotLightsCount = 0;
 
 uniform	Material u_material;
+layout (std140) uniform MaterialTable {
+	MaterialData u_materials[MAX_MATERIALS];
+};
+uniform int u_materialID;
+uniform sampler2DArray u_albedoArray;
 
 uniform samplerCube u_skybox;
 uniform samplerCube u_worldReflection;
+uniform ReflectionProbe u_probe;
 uniform float u_reflectionFactor;
 uniform float u_refractionFactor;
 uniform vec3 u_IoRValues;
@@ -159,7 +183,8 @@ vec4 CalculateLighting(FragParams frag, vec3 matColor, float matSpecIntensity, f
 }
  
 vec4 CalculateDirectionalLight(FragParams frag, DirectionalLight light) {
-	return CalculateLighting(frag, u_material.albedo, u_material.specularIntensity, u_material.shininess, -u_directionalLight.direction, u_directionalLight.light, CalculateDirectionalShadowFactor(light));
+	MaterialData material = u_materials[u_materialID];
+	return CalculateLighting(frag, material.albedo.rgb, material.parameters.x, material.parameters.y, -u_directionalLight.direction, u_directionalLight.light, CalculateDirectionalShadowFactor(light));
 }
 
 vec4 CalculatePointLight(FragParams frag, PointLight light, int shadowMapIndex) {
@@ -169,7 +194,8 @@ vec4 CalculatePointLight(FragParams frag, PointLight light, int shadowMapIndex)
 
 
 	float shadowFactor = CalculateOmniShadowFactor(light, shadowMapIndex, -lightToFrag, dLightToFrag);
-	vec4 plColor = CalculateLighting(frag, u_material.albedo, u_material.specularIntensity, u_material.shininess, nLightToFrag, light.light, shadowFactor);
+	MaterialData material = u_materials[u_materialID];
+	vec4 plColor = CalculateLighting(frag, material.albedo.rgb, material.parameters.x, material.parameters.y, nLightToFrag, light.light, shadowFactor);
 
 	// Calculate attenuation based on distance
 	float attenuation = light.exponent * dLightToFrag * dLightToFrag + light.linear * dLightToFrag + light.constant;
@@ -230,6 +256,23 @@ vec4 CalculateReflection(FragParams frag) {
 	return vec4(refColor, 1.0);
 }
 
+// Moves the reflection vector so that it points from the probe to where it hits the probe's box
+vec3 BoxProjection(vec3 position, vec3 direction) {
+	vec3 firstPlane = (u_probe.boxMax - position) / direction;
+	vec3 secondPlane = (u_probe.boxMin - position) / direction;
+	vec3 furthest = max(firstPlane, secondPlane);
+	float distance = min(min(furthest.x, furthest.y), furthest.z);
+	return position + direction * distance - u_probe.position;
+}
+
+vec4 SampleReflectionProbe(FragParams frag, float roughness) {
+	vec3 direction = reflect(-frag.frag_nvToCam, frag.frag_Normal);
+	float lod = roughness * (u_probe.levels - 1.0);
+	vec4 probeColor = textureLod(u_probe.cubemap, BoxProjection(frag.frag_Position, direction), lod);
+	// Where the probe saw no geometry the sky shows through
+	return vec4(mix(texture(u_skybox, direction).rgb, probeColor.rgb, probeColor.a), 1.0);
+}
+
 vec4 CalculateRefraction(FragParams frag) {
 	// -- Refraction color --
 	vec3 refractColor;
@@ -252,9 +295,15 @@ vec4 CalculateRefraction(FragParams frag) {
 }
 
 
+vec4 SampleAlbedo(vec2 texCoord) {
+	if(vert_layer >= 0.0)
+		return texture(u_albedoArray, vec3(texCoord, vert_layer));
+	return texture(u_material.albedoTexture, texCoord);
+}
+
 void main()
 {
-	vec4 tColor = texture(u_material.albedoTexture, vert_mainTex);
+	vec4 tColor = SampleAlbedo(vert_mainTex);
 	if(tColor.a < 0.8)
 		discard;
 
@@ -277,6 +326,14 @@ void main()
 		frag_color = mix(tColor, mix(rfrColor, rflColor * lColor, fresnelTerm), u_reflectionFactor);
 	} else {
 		frag_color = tColor * lColor;
+
+		// -- Color from the baked reflection probe --
+		MaterialData material = u_materials[u_materialID];
+		if(u_probe.levels > 0.0 && material.parameters.z > 0.0) {
+			// Blinn-Phong shininess to roughness
+			float roughness = sqrt(2.0 / (material.parameters.y + 2.0));
+			frag_color = mix(frag_color, SampleReflectionProbe(frag, roughness) * lColor, material.parameters.z);
+		}
 	}
 
 	frag_color = clamp(frag_color, 0.0, 1.0);
@@ -3,24 +3,36 @@
 layout (location = 0) in vec3 vertPos;
 layout (location = 1) in vec2 vertMainTex;
 layout (location = 2) in vec3 vertNormal;
+layout (location = 3) in float vertLayer;
 
 out vec3 vert_normal;
 out vec2 vert_mainTex;
 out vec3 vert_pos;
 out vec4 vert_directionalLightSpacePos;
+flat out float vert_layer;
 
-uniform mat4 u_modelMatrix;
+// World matrices of the frame's objects, four texels each, and the slot of the one being drawn
+uniform samplerBuffer u_modelMatrices;
+uniform int u_modelIndex;
 uniform mat4 u_viewMatrix;
 uniform mat4 u_projectionMatrix;
 uniform mat4 u_directionalLightTransform;
 
+mat4 ModelMatrix() {
+	int texel = u_modelIndex * 4;
+	return mat4(texelFetch(u_modelMatrices, texel), texelFetch(u_modelMatrices, texel + 1),
+		texelFetch(u_modelMatrices, texel + 2), texelFetch(u_modelMatrices, texel + 3));
+}
+
 void main()
 {
-	vec4 worldPos = u_modelMatrix * vec4(vertPos, 1.0);
+	mat4 modelMatrix = ModelMatrix();
+	vec4 worldPos = modelMatrix * vec4(vertPos, 1.0);
 	gl_Position = u_projectionMatrix * u_viewMatrix * worldPos;
 	vert_directionalLightSpacePos = u_directionalLightTransform * worldPos;
 	
-	vert_normal = normalize(mat3(u_modelMatrix) * vertNormal);
+	vert_normal = normalize(mat3(modelMatrix) * vertNormal);
 	vert_mainTex = vertMainTex;
 	vert_pos = worldPos.xyz;
+	vert_layer = vertLayer;
 }
\ No newline at end of file
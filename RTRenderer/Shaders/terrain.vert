@@ -0,0 +1,64 @@
+#version 330
+
+// Quads along each side of the chunk grid. Must match TERRAIN_GRID_SIZE
+#define TERRAIN_GRID_SIZE 32.0
+
+// Position in the chunk, from 0 to 1
+layout (location = 0) in vec2 vertGrid;
+
+out vec3 vert_normal;
+out vec2 vert_mainTex;
+out vec3 vert_pos;
+out vec4 vert_directionalLightSpacePos;
+flat out float vert_layer;
+
+uniform mat4 u_viewMatrix;
+uniform mat4 u_projectionMatrix;
+uniform mat4 u_directionalLightTransform;
+
+uniform sampler2D u_heightmap;
+uniform vec3 u_terrainOrigin;
+uniform float u_terrainSize;
+uniform float u_terrainHeightScale;
+uniform float u_terrainTiling;
+// Point the level of detail is measured from
+uniform vec3 u_terrainCamera;
+// x and y are the corner of the chunk, z its size
+uniform vec3 u_terrainChunk;
+// Distances where the morph to the coarser level starts and ends
+uniform vec2 u_terrainMorph;
+
+float SampleHeight(vec2 position) {
+	// The texels on the border lie on the edges of the terrain, so that neighbouring pages share them
+	vec2 resolution = vec2(textureSize(u_heightmap, 0));
+	vec2 uv = ((position - u_terrainOrigin.xz) / u_terrainSize * (resolution - 1.0) + 0.5) / resolution;
+	return textureLod(u_heightmap, uv, 0.0).r * u_terrainHeightScale + u_terrainOrigin.y;
+}
+
+void main()
+{
+	vec2 position = u_terrainChunk.xy + vertGrid * u_terrainChunk.z;
+	float distanceToCamera = distance(u_terrainCamera, vec3(position.x, SampleHeight(position), position.y));
+	float morph = clamp((distanceToCamera - u_terrainMorph.x) / (u_terrainMorph.y - u_terrainMorph.x), 0.0, 1.0);
+
+	// Odd vertices slide onto the edge they split, matching the grid of the next level
+	vec2 odd = fract(vertGrid * TERRAIN_GRID_SIZE * 0.5) * 2.0 / TERRAIN_GRID_SIZE;
+	position -= odd * u_terrainChunk.z * morph;
+
+	vec4 worldPos = vec4(position.x, SampleHeight(position), position.y, 1.0);
+	gl_Position = u_projectionMatrix * u_viewMatrix * worldPos;
+	vert_directionalLightSpacePos = u_directionalLightTransform * worldPos;
+
+	// Central differences of the heightmap
+	float texel = u_terrainSize / float(textureSize(u_heightmap, 0).x - 1);
+	float left = SampleHeight(position - vec2(texel, 0.0));
+	float right = SampleHeight(position + vec2(texel, 0.0));
+	float back = SampleHeight(position - vec2(0.0, texel));
+	float front = SampleHeight(position + vec2(0.0, texel));
+	// The fragment shader flips the normals of the scene
+	vert_normal = -normalize(vec3(left - right, 2.0 * texel, back - front));
+
+	vert_mainTex = position / u_terrainTiling;
+	vert_pos = worldPos.xyz;
+	vert_layer = -1.0;
+}
@@ -0,0 +1,5 @@
+#version 330
+
+// The terrain is opaque, only its depth is written
+void main() {
+}
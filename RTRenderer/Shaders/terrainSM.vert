@@ -0,0 +1,35 @@
+#version 330
+
+// Quads along each side of the chunk grid. Must match TERRAIN_GRID_SIZE
+#define TERRAIN_GRID_SIZE 32.0
+
+layout (location = 0) in vec2 vertGrid;
+
+uniform mat4 u_directionalLightTransform;
+
+uniform sampler2D u_heightmap;
+uniform vec3 u_terrainOrigin;
+uniform float u_terrainSize;
+uniform float u_terrainHeightScale;
+uniform vec3 u_terrainCamera;
+uniform vec3 u_terrainChunk;
+uniform vec2 u_terrainMorph;
+
+float SampleHeight(vec2 position) {
+	// The texels on the border lie on the edges of the terrain, so that neighbouring pages share them
+	vec2 resolution = vec2(textureSize(u_heightmap, 0));
+	vec2 uv = ((position - u_terrainOrigin.xz) / u_terrainSize * (resolution - 1.0) + 0.5) / resolution;
+	return textureLod(u_heightmap, uv, 0.0).r * u_terrainHeightScale + u_terrainOrigin.y;
+}
+
+void main() {
+	// Same morph as the terrain's main pass, so that the shadow matches the surface
+	vec2 position = u_terrainChunk.xy + vertGrid * u_terrainChunk.z;
+	float distanceToCamera = distance(u_terrainCamera, vec3(position.x, SampleHeight(position), position.y));
+	float morph = clamp((distanceToCamera - u_terrainMorph.x) / (u_terrainMorph.y - u_terrainMorph.x), 0.0, 1.0);
+
+	vec2 odd = fract(vertGrid * TERRAIN_GRID_SIZE * 0.5) * 2.0 / TERRAIN_GRID_SIZE;
+	position -= odd * u_terrainChunk.z * morph;
+
+	gl_Position = u_directionalLightTransform * vec4(position.x, SampleHeight(position), position.y, 1.0);
+}
@@ -0,0 +1,129 @@
+#include "ShadowCache.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Identifies a shadow cache file and its layout version
+const char SHADOW_CACHE_MAGIC[4] = { 'R', 'S', 'M', '1' };
+const unsigned long long SHADOW_CACHE_HASH_PRIME = 1099511628211ULL;
+
+// The faces follow, as one 32 bit depth value per texel
+struct ShadowCacheHeader {
+	char magic[4];
+	unsigned int width;
+	unsigned int height;
+	unsigned int faces;
+	unsigned long long hash;
+};
+
+std::string ShadowCache::_GetPath(const std::string & name)
+{
+	return CACHE_DIRECTORY + "shadow_" + name + ".rsm";
+}
+
+int ShadowCache::_GetFaceCount(ShadowMap * shadowMap)
+{
+	return shadowMap->GetTarget() == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+}
+
+GLenum ShadowCache::_GetFaceTarget(ShadowMap * shadowMap, int face)
+{
+	return shadowMap->GetTarget() == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+}
+
+void ShadowCache::Hash(unsigned long long & hash, const void * data, size_t bytes)
+{
+	const unsigned char* bytePtr = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++) {
+		hash ^= bytePtr[i];
+		hash *= SHADOW_CACHE_HASH_PRIME;
+	}
+}
+
+void ShadowCache::Hash(unsigned long long & hash, const std::string & text)
+{
+	Hash(hash, text.data(), text.size());
+}
+
+void ShadowCache::HashFile(unsigned long long & hash, const std::string & path)
+{
+	Hash(hash, path);
+
+	// A file that cannot be read is only known by its path
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return;
+	long long size = (long long)info.st_size;
+	long long time = (long long)info.st_mtime;
+	Hash(hash, &size, sizeof(size));
+	Hash(hash, &time, sizeof(time));
+}
+
+bool ShadowCache::Load(const std::string & name, ShadowMap * shadowMap, unsigned long long hash)
+{
+	FILE* file = fopen(_GetPath(name).c_str(), "rb");
+	if (!file)
+		return false;
+
+	int faces = _GetFaceCount(shadowMap);
+	ShadowCacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, SHADOW_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.width == shadowMap->GetShadowWidth() && header.height == shadowMap->GetShadowHeight() &&
+		header.faces == (unsigned int)faces && header.hash == hash;
+
+	// Every face in a single read
+	size_t faceTexels = (size_t)header.width * header.height;
+	std::vector<GLuint> texels;
+	if (valid) {
+		texels.resize(faceTexels * faces);
+		valid = fread(texels.data(), sizeof(GLuint), texels.size(), file) == texels.size();
+	}
+	fclose(file);
+
+	if (!valid)
+		return false;
+
+	GLState::BindTexture(0, shadowMap->GetTarget(), shadowMap->GetShadowMap());
+	for (int face = 0; face < faces; face++) {
+		glTexSubImage2D(_GetFaceTarget(shadowMap, face), 0, 0, 0, header.width, header.height,
+			GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, texels.data() + faceTexels * face);
+	}
+	return true;
+}
+
+bool ShadowCache::Store(const std::string & name, ShadowMap * shadowMap, unsigned long long hash)
+{
+	int faces = _GetFaceCount(shadowMap);
+	ShadowCacheHeader header;
+	memcpy(header.magic, SHADOW_CACHE_MAGIC, sizeof(header.magic));
+	header.width = shadowMap->GetShadowWidth();
+	header.height = shadowMap->GetShadowHeight();
+	header.faces = (unsigned int)faces;
+	header.hash = hash;
+
+	size_t faceTexels = (size_t)header.width * header.height;
+	std::vector<GLuint> texels(faceTexels * faces);
+	GLState::BindTexture(0, shadowMap->GetTarget(), shadowMap->GetShadowMap());
+	for (int face = 0; face < faces; face++)
+		glGetTexImage(_GetFaceTarget(shadowMap, face), 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, texels.data() + faceTexels * face);
+
+	BakedProbe::EnsureDirectory(CACHE_DIRECTORY);
+	std::string path = _GetPath(name);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		printf("Failed to write the shadow cache %s\n", path.c_str());
+		return false;
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(texels.data(), sizeof(GLuint), texels.size(), file) == texels.size();
+	fclose(file);
+
+	if (!success) {
+		printf("Failed to write the shadow cache %s\n", path.c_str());
+		remove(path.c_str());
+	}
+	return success;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "GLState.h"
+#include "ShadowMap.h"
+#include "BakedProbe.h"
+
+// Starting value of the hashes, the FNV-1a offset basis
+const unsigned long long SHADOW_CACHE_HASH_SEED = 14695981039346656037ULL;
+
+/*!
+	Static shadow maps stored in CACHE_DIRECTORY between runs.
+
+	Every map is stored with a hash of what it was rendered from: the static geometry and the light's parameters. When
+	the hash still matches, the depth texels are uploaded instead of rendering the map, so a light is only re-rendered
+	when it or the static scene changed. The depth is stored as 32 bit integers, the precision the maps are read with.
+*/
+class ShadowCache
+{
+private:
+	static std::string _GetPath(const std::string& name);
+	// Faces of the map's texture, 1 or 6
+	static int _GetFaceCount(ShadowMap* shadowMap);
+	static GLenum _GetFaceTarget(ShadowMap* shadowMap, int face);
+
+public:
+	// Adds bytes to an FNV-1a hash
+	static void Hash(unsigned long long& hash, const void* data, size_t bytes);
+	static void Hash(unsigned long long& hash, const std::string& text);
+	// Adds a file's path, size and modification time, so that a file replaced at the same path changes the hash
+	static void HashFile(unsigned long long& hash, const std::string& path);
+
+	/*!
+		\n bool ShadowCache::Load(const std::string& name, ShadowMap* shadowMap, unsigned long long hash)
+		\param const std::string& name Name of the light's map in the cache
+		\param ShadowMap* shadowMap Map the cached texels are uploaded to
+		\param unsigned long long hash Hash of the geometry and light the map has to be rendered from
+
+		Returns false if the map is not cached or was rendered from something else
+	*/
+	static bool Load(const std::string& name, ShadowMap* shadowMap, unsigned long long hash);
+	// Reads back a rendered map and stores it
+	static bool Store(const std::string& name, ShadowMap* shadowMap, unsigned long long hash);
+};
@@ -2,6 +2,7 @@
 
 ShadowMap::ShadowMap() :
 	mFBO(0),
+	mTarget(nullptr),
 	mSM(0)
 {
 }
@@ -12,18 +13,16 @@ bool ShadowMap::Init(GLuint width, GLuint height)
 
 	glGenFramebuffers(1, &mFBO);
 
-	glGenTextures(1, &mSM);
-	glBindTexture(GL_TEXTURE_2D, mSM);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, mSWidth, mSHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	mTarget = RenderTargetPool::Acquire(GL_TEXTURE_2D, mSWidth, mSHeight, GL_DEPTH_COMPONENT24);
+	mSM = mTarget->texture;
+	GLState::BindTexture(0, GL_TEXTURE_2D, mSM);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	float bColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, bColor);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mFBO);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mSM, 0);
 
 	glDrawBuffer(GL_NONE);
@@ -36,20 +35,19 @@ bool ShadowMap::Init(GLuint width, GLuint height)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	return true;
 }
 
 void ShadowMap::Write()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mFBO);
 }
 
 void ShadowMap::Read(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, mSM);
+	GLState::BindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_2D, mSM);
 }
 
 GLuint ShadowMap::GetShadowWidth()
@@ -65,10 +63,9 @@ GLuint ShadowMap::GetShadowHeight()
 ShadowMap::~ShadowMap()
 {
 	if (mFBO)
-		glDeleteFramebuffers(1, &mFBO);
+		GLState::DeleteFramebuffer(mFBO);
 
-	if (mSM)
-		glDeleteTextures(1, &mSM);
+	RenderTargetPool::Release(mTarget);
 }
 
 
@@ -80,21 +77,10 @@ bool OmniShadowMap::Init(unsigned int width, unsigned int height)
 
 	glGenFramebuffers(1, &mFBO);
 
-	glGenTextures(1, &mSM);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mSM);
+	mTarget = RenderTargetPool::Acquire(GL_TEXTURE_CUBE_MAP, mSWidth, mSHeight, GL_DEPTH_COMPONENT24);
+	mSM = mTarget->texture;
 
-	for (size_t i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, mSWidth, mSHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	}
-
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, mFBO);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mSM, 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
@@ -107,18 +93,17 @@ bool OmniShadowMap::Init(unsigned int width, unsigned int height)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	return true;
 }
 
 void OmniShadowMap::Write()
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO);
 }
 
 void OmniShadowMap::Read(GLenum texUnit)
 {
-	glActiveTexture(texUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mSM);
+	GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, mSM);
 }
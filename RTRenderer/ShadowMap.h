@@ -5,10 +5,14 @@
 
 #include <GL\glew.h>
 
+#include "GLState.h"
+#include "RenderTargetPool.h"
+
 class ShadowMap
 {
 protected:
 	GLuint mFBO;
+	RenderTarget* mTarget;
 	GLuint mSM;
 	GLuint mSWidth;
 	GLuint mSHeight;
@@ -24,8 +28,10 @@ public:
 	GLuint GetShadowMap() { return mSM; };
 	GLuint GetShadowWidth();
 	GLuint GetShadowHeight();
+	// Texture target of the map, GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	virtual GLenum GetTarget() const { return GL_TEXTURE_2D; }
 
-	~ShadowMap();
+	virtual ~ShadowMap();
 };
 
 class OmniShadowMap :
@@ -37,5 +43,6 @@ public:
 	bool Init(GLuint width, GLuint height);
 	void Write();
 	void Read(GLenum textureUnit);
+	GLenum GetTarget() const { return GL_TEXTURE_CUBE_MAP; }
 };
 
@@ -10,29 +10,20 @@ SkyBox::SkyBox(std::vector<std::string>* p_faceLocation)
 	mShader->CreateFromFiles("Shaders/skybox.vert", "Shaders/skybox.frag");
 
 	glGenTextures(1, &mTextureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mTextureID);
-
-	int width, height, bitDepth;
 
+	// Decoding the six faces one after the other was the longest part of the start up
 	for (size_t i = 0; i < 6; i++)
 	{
-		unsigned char *texData = stbi_load((*p_faceLocation)[i].c_str(), &width, &height, &bitDepth, 0);
-		if (!texData)
-		{
-			printf("Failed to find: %s\n", (*p_faceLocation)[i].c_str());
-			return;
-		}
-
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-		stbi_image_free(texData);
+		std::string path = (*p_faceLocation)[i];
+		mFaces.push_back(std::async(std::launch::async, [path]() {
+			SkyBoxFace face;
+			face.data = stbi_load(path.c_str(), &face.width, &face.height, &face.channels, 0);
+			if (!face.data)
+				printf("Failed to find: %s\n", path.c_str());
+			return face;
+		}));
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
 
 	// Mesh Setup
 	unsigned int indices[] = {
@@ -76,15 +67,52 @@ SkyBox::SkyBox(std::vector<std::string>* p_faceLocation)
 	mMesh->Load();
 }
 
+bool SkyBox::_FinishLoading()
+{
+	if (mLoaded)
+		return true;
+
+	for (size_t i = 0; i < mFaces.size(); i++) {
+		if (mFaces[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return false;
+	}
+
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, mTextureID);
+
+	for (size_t i = 0; i < mFaces.size(); i++)
+	{
+		SkyBoxFace face = mFaces[i].get();
+		if (!face.data)
+			continue;
+
+		GLenum format = face.channels == 4 ? GL_RGBA : GL_RGB;
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, face.width, face.height, 0, format, GL_UNSIGNED_BYTE, face.data);
+		stbi_image_free(face.data);
+	}
+	mFaces.clear();
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	mLoaded = true;
+	return true;
+}
+
 void SkyBox::BindSkybox(GLuint textureUnit)
 {
-	glActiveTexture(GL_TEXTURE0 + textureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, mTextureID);
+	GLState::BindTexture(textureUnit, GL_TEXTURE_CUBE_MAP, mTextureID);
 }
 
 void SkyBox::Draw(glm::mat4 * viewMatrix, glm::mat4 * projectionMatrix)
 {
-	glDepthMask(GL_FALSE);
+	// Nothing to draw until the faces are decoded
+	if (!_FinishLoading())
+		return;
+
+	GLState::DepthMask(false);
 
 	mShader->UseShader();
 
@@ -100,11 +128,17 @@ void SkyBox::Draw(glm::mat4 * viewMatrix, glm::mat4 * projectionMatrix)
 
 	mMesh->Render();
 
-	glDepthMask(GL_TRUE);
+	GLState::DepthMask(true);
 }
 
 SkyBox::~SkyBox()
 {
+	for (size_t i = 0; i < mFaces.size(); i++) {
+		SkyBoxFace face = mFaces[i].get();
+		if (face.data)
+			stbi_image_free(face.data);
+	}
+
 	if (mTextureID)
-		glDeleteTextures(1, &mTextureID);
+		GLState::DeleteTexture(mTextureID);
 }
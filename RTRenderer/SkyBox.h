@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+
 #include <GL\glew.h>
 #include <glm\glm.hpp>
 #include <glm\gtc\matrix_transform.hpp>
@@ -9,6 +11,12 @@
 #include "Mesh.h"
 #include "Shader.h"
 
+// Decoded pixels of one cube face
+struct SkyBoxFace {
+	int width, height, channels;
+	unsigned char* data;
+};
+
 class SkyBox
 {
 private:
@@ -16,6 +24,13 @@ private:
 	SkyBoxShader* mShader;
 
 	GLuint mTextureID;
+
+	// The faces are decoded in parallel in the background and uploaded once all of them are ready
+	std::vector<std::future<SkyBoxFace>> mFaces;
+	bool mLoaded = false;
+
+	// Uploads the faces if they are all decoded. Never blocks
+	bool _FinishLoading();
 public:
 	SkyBox();
 	SkyBox(std::vector<std::string>* p_faceLocation);
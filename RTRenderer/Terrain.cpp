@@ -0,0 +1,367 @@
+#include "Terrain.h"
+#include "Camera.h"
+
+#include <float.h>
+#include <algorithm>
+#include <cmath>
+
+Terrain::Terrain(const char * heightmap, glm::vec3 center, float size, float heightScale, float tiling, Material * material) :
+	m_heightmapLocation(heightmap),
+	m_width(0),
+	m_height(0),
+	m_origin(center.x - size * 0.5f, center.y, center.z - size * 0.5f),
+	m_size(size),
+	m_heightScale(heightScale),
+	m_tiling(tiling),
+	m_heightmap(0),
+	m_material(material)
+{
+	// Enough levels for the root to cover the whole terrain with chunks of TERRAIN_LEAF_SIZE at level 0
+	m_levels = 1;
+	while (m_levels < TERRAIN_MAX_LOD_LEVELS && TERRAIN_LEAF_SIZE * (float)(1 << (m_levels - 1)) < size)
+		m_levels++;
+
+	for (int i = 0; i < TERRAIN_MAX_LOD_LEVELS; i++)
+		m_ranges[i] = TERRAIN_LOD_BASE_RANGE * (float)(1 << i);
+}
+
+GLuint Terrain::mGridVAO = 0;
+GLuint Terrain::mGridVBO = 0;
+GLuint Terrain::mGridEBO = 0;
+GLsizei Terrain::mQuadrantIndexCount = 0;
+int Terrain::mGridUsers = 0;
+
+bool Terrain::Import()
+{
+	int channels;
+	stbi_us* data = stbi_load_16(m_heightmapLocation.c_str(), &m_width, &m_height, &channels, 1);
+	if (!data) {
+		printf("Failed to find: %s\n", m_heightmapLocation.c_str());
+		return false;
+	}
+	m_heights.assign(data, data + (size_t)m_width * m_height);
+	stbi_image_free(data);
+
+	m_nodes.clear();
+	m_nodes.push_back(Node());
+	_BuildNode(0, glm::vec2(m_origin.x, m_origin.z), m_size, m_levels - 1);
+	_BuildOccluder();
+
+	return true;
+}
+
+void Terrain::Upload()
+{
+	glGenTextures(1, &m_heightmap);
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_heightmap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, m_width, m_height, 0, GL_RED, GL_UNSIGNED_SHORT, m_heights.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	if (mGridUsers++ == 0)
+		_BuildGrid();
+}
+
+bool Terrain::Load()
+{
+	if (!Import())
+		return false;
+	Upload();
+	return true;
+}
+
+size_t Terrain::GetByteSize() const
+{
+	// The heights are kept on both sides, the CPU copy answers GetHeight
+	return m_heights.size() * sizeof(unsigned short) * 2 + m_nodes.size() * sizeof(Node) +
+		m_occluderVertices.size() * sizeof(glm::vec3) + m_occluderIndices.size() * sizeof(unsigned int);
+}
+
+float Terrain::_GetSample(int x, int z) const
+{
+	x = std::min(std::max(x, 0), m_width - 1);
+	z = std::min(std::max(z, 0), m_height - 1);
+	return m_heights[(size_t)z * m_width + x] / 65535.0f * m_heightScale + m_origin.y;
+}
+
+float Terrain::GetHeight(float x, float z) const
+{
+	if (m_heights.empty())
+		return m_origin.y;
+
+	// Same texel centers as the bilinear filtering of the height texture
+	float fx = (x - m_origin.x) / m_size * (m_width - 1);
+	float fz = (z - m_origin.z) / m_size * (m_height - 1);
+	int x0 = (int)std::floor(fx);
+	int z0 = (int)std::floor(fz);
+	float tx = fx - x0;
+	float tz = fz - z0;
+
+	float top = _GetSample(x0, z0) * (1.0f - tx) + _GetSample(x0 + 1, z0) * tx;
+	float bottom = _GetSample(x0, z0 + 1) * (1.0f - tx) + _GetSample(x0 + 1, z0 + 1) * tx;
+	return top * (1.0f - tz) + bottom * tz;
+}
+
+void Terrain::_BuildOccluder()
+{
+	const int side = TERRAIN_OCCLUDER_GRID_SIZE + 1;
+	float quadSize = m_size / TERRAIN_OCCLUDER_GRID_SIZE;
+
+	// Lowest height of every texel the filtering of each quad can read
+	std::vector<float> quadHeights((size_t)TERRAIN_OCCLUDER_GRID_SIZE * TERRAIN_OCCLUDER_GRID_SIZE);
+	for (int j = 0; j < TERRAIN_OCCLUDER_GRID_SIZE; j++) {
+		int z0 = (int)std::floor((float)j / TERRAIN_OCCLUDER_GRID_SIZE * (m_height - 1));
+		int z1 = (int)std::ceil((float)(j + 1) / TERRAIN_OCCLUDER_GRID_SIZE * (m_height - 1));
+		for (int i = 0; i < TERRAIN_OCCLUDER_GRID_SIZE; i++) {
+			int x0 = (int)std::floor((float)i / TERRAIN_OCCLUDER_GRID_SIZE * (m_width - 1));
+			int x1 = (int)std::ceil((float)(i + 1) / TERRAIN_OCCLUDER_GRID_SIZE * (m_width - 1));
+			float minY = FLT_MAX;
+			for (int z = z0; z <= z1; z++) {
+				for (int x = x0; x <= x1; x++)
+					minY = std::min(minY, _GetSample(x, z));
+			}
+			quadHeights[(size_t)j * TERRAIN_OCCLUDER_GRID_SIZE + i] = minY;
+		}
+	}
+
+	m_occluderVertices.resize((size_t)side * side);
+	for (int j = 0; j < side; j++) {
+		for (int i = 0; i < side; i++) {
+			float y = FLT_MAX;
+			for (int qj = std::max(j - 1, 0); qj <= std::min(j, TERRAIN_OCCLUDER_GRID_SIZE - 1); qj++) {
+				for (int qi = std::max(i - 1, 0); qi <= std::min(i, TERRAIN_OCCLUDER_GRID_SIZE - 1); qi++)
+					y = std::min(y, quadHeights[(size_t)qj * TERRAIN_OCCLUDER_GRID_SIZE + qi]);
+			}
+			m_occluderVertices[(size_t)j * side + i] = glm::vec3(m_origin.x + i * quadSize, y, m_origin.z + j * quadSize);
+		}
+	}
+
+	m_occluderIndices.clear();
+	m_occluderIndices.reserve((size_t)TERRAIN_OCCLUDER_GRID_SIZE * TERRAIN_OCCLUDER_GRID_SIZE * 6);
+	for (int j = 0; j < TERRAIN_OCCLUDER_GRID_SIZE; j++) {
+		for (int i = 0; i < TERRAIN_OCCLUDER_GRID_SIZE; i++) {
+			unsigned int corner = (unsigned int)(j * side + i);
+			unsigned int quad[6] = { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 };
+			m_occluderIndices.insert(m_occluderIndices.end(), quad, quad + 6);
+		}
+	}
+}
+
+void Terrain::_BuildNode(int index, glm::vec2 offset, float size, int level)
+{
+	Node node;
+	node.children = -1;
+
+	if (level == 0) {
+		// Every texel that the filtering of the node's area can read
+		int x0 = (int)std::floor((offset.x - m_origin.x) / m_size * (m_width - 1));
+		int x1 = (int)std::ceil((offset.x + size - m_origin.x) / m_size * (m_width - 1));
+		int z0 = (int)std::floor((offset.y - m_origin.z) / m_size * (m_height - 1));
+		int z1 = (int)std::ceil((offset.y + size - m_origin.z) / m_size * (m_height - 1));
+
+		float minY = FLT_MAX, maxY = -FLT_MAX;
+		for (int z = z0; z <= z1; z++) {
+			for (int x = x0; x <= x1; x++) {
+				float y = _GetSample(x, z);
+				minY = std::min(minY, y);
+				maxY = std::max(maxY, y);
+			}
+		}
+		node.boxMin = glm::vec3(offset.x, minY, offset.y);
+		node.boxMax = glm::vec3(offset.x + size, maxY, offset.y + size);
+	}
+	else {
+		// Children are consecutive, the first quadrant holds the smallest coordinates
+		node.children = (int)m_nodes.size();
+		m_nodes.resize(m_nodes.size() + 4);
+
+		float half = size * 0.5f;
+		node.boxMin = glm::vec3(offset.x, FLT_MAX, offset.y);
+		node.boxMax = glm::vec3(offset.x + size, -FLT_MAX, offset.y + size);
+		for (int i = 0; i < 4; i++) {
+			glm::vec2 childOffset = offset + glm::vec2((i & 1) ? half : 0.0f, (i & 2) ? half : 0.0f);
+			_BuildNode(node.children + i, childOffset, half, level - 1);
+			node.boxMin.y = std::min(node.boxMin.y, m_nodes[node.children + i].boxMin.y);
+			node.boxMax.y = std::max(node.boxMax.y, m_nodes[node.children + i].boxMax.y);
+		}
+	}
+
+	m_nodes[index] = node;
+}
+
+void Terrain::_BuildGrid()
+{
+	const int side = TERRAIN_GRID_SIZE + 1;
+	const int half = TERRAIN_GRID_SIZE / 2;
+
+	std::vector<GLfloat> vertices;
+	vertices.reserve((size_t)side * side * 2);
+	for (int z = 0; z < side; z++) {
+		for (int x = 0; x < side; x++) {
+			vertices.push_back((GLfloat)x / TERRAIN_GRID_SIZE);
+			vertices.push_back((GLfloat)z / TERRAIN_GRID_SIZE);
+		}
+	}
+
+	// Quadrant by quadrant, so that any of them can be drawn alone
+	std::vector<GLuint> indices;
+	indices.reserve((size_t)TERRAIN_GRID_SIZE * TERRAIN_GRID_SIZE * 6);
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		int startX = (quadrant & 1) ? half : 0;
+		int startZ = (quadrant & 2) ? half : 0;
+		for (int z = startZ; z < startZ + half; z++) {
+			for (int x = startX; x < startX + half; x++) {
+				GLuint corner = z * side + x;
+				// Same winding as the rest of the scene
+				indices.push_back(corner);
+				indices.push_back(corner + 1);
+				indices.push_back(corner + side + 1);
+				indices.push_back(corner);
+				indices.push_back(corner + side + 1);
+				indices.push_back(corner + side);
+			}
+		}
+	}
+	mQuadrantIndexCount = (GLsizei)(indices.size() / 4);
+
+	glGenVertexArrays(1, &mGridVAO);
+	GLState::BindVertexArray(mGridVAO);
+
+	glGenBuffers(1, &mGridEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mGridEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mGridVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, mGridVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 2, 0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindVertexArray(0);
+}
+
+bool Terrain::_BoxIntersectsSphere(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 center, float radius)
+{
+	glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+	glm::vec3 distance = closest - center;
+	return glm::dot(distance, distance) <= radius * radius;
+}
+
+bool Terrain::_Select(int index, glm::vec2 offset, float size, int level, const Frustum & frustum, glm::vec3 camera, std::vector<TerrainChunk>& chunks) const
+{
+	const Node& node = m_nodes[index];
+
+	// The root has no parent to fall back on
+	if (index != 0 && !_BoxIntersectsSphere(node.boxMin, node.boxMax, camera, m_ranges[level]))
+		return false;
+
+	// Handled, there is just nothing to draw
+	if (!frustum.IntersectsBox(node.boxMin, node.boxMax))
+		return true;
+
+	TerrainChunk chunk = { offset, size, level, 0xF };
+	if (level == 0 || !_BoxIntersectsSphere(node.boxMin, node.boxMax, camera, m_ranges[level - 1])) {
+		chunks.push_back(chunk);
+		return true;
+	}
+
+	// The children in range of the finer level draw themselves, this node draws the others
+	chunk.quadrants = 0;
+	float half = size * 0.5f;
+	for (int i = 0; i < 4; i++) {
+		glm::vec2 childOffset = offset + glm::vec2((i & 1) ? half : 0.0f, (i & 2) ? half : 0.0f);
+		if (!_Select(node.children + i, childOffset, half, level - 1, frustum, camera, chunks))
+			chunk.quadrants |= 1 << i;
+	}
+	if (chunk.quadrants != 0)
+		chunks.push_back(chunk);
+
+	return true;
+}
+
+void Terrain::Select(const Frustum & frustum, glm::vec3 camera, std::vector<TerrainChunk>& chunks) const
+{
+	if (m_nodes.empty())
+		return;
+	_Select(0, glm::vec2(m_origin.x, m_origin.z), m_size, m_levels - 1, frustum, camera, chunks);
+}
+
+void Terrain::RequestTextureLevels()
+{
+	Texture* albedo = m_material->GetAlbedo();
+	if (albedo == nullptr || Camera::GetInstance() == nullptr)
+		return;
+
+	// The closest repetition of the texture is the one below the camera
+	glm::vec3 camera = Camera::GetInstance()->GetCameraPosition();
+	float distance = std::max(camera.y - GetHeight(camera.x, camera.z), 1.0f);
+	albedo->RequestSize(Camera::GetInstance()->GetProjectedSize(camera - glm::vec3(0.0f, distance, 0.0f), m_tiling * 0.5f));
+}
+
+void Terrain::Render(TerrainUniforms * uniforms, glm::vec3 camera, const std::vector<TerrainChunk>& chunks)
+{
+	if (chunks.empty() || m_heightmap == 0)
+		return;
+
+	GLState::BindTexture(TERRAIN_HEIGHTMAP_UNIT, GL_TEXTURE_2D, m_heightmap);
+	uniforms->SetTerrain(m_origin, m_size, m_heightScale, m_tiling, camera);
+
+	GLState::BindVertexArray(mGridVAO);
+	for (size_t i = 0; i < chunks.size(); i++) {
+		const TerrainChunk& chunk = chunks[i];
+
+		float morphEnd = m_ranges[chunk.level];
+		float previous = chunk.level > 0 ? m_ranges[chunk.level - 1] : 0.0f;
+		float morphStart = previous + (morphEnd - previous) * TERRAIN_MORPH_START;
+		uniforms->SetChunk(chunk.offset, chunk.size, glm::vec2(morphStart, morphEnd));
+
+		// Consecutive quadrants go in a single draw
+		int quadrant = 0;
+		while (quadrant < 4) {
+			if (!(chunk.quadrants & (1 << quadrant))) {
+				quadrant++;
+				continue;
+			}
+			int first = quadrant;
+			while (quadrant < 4 && (chunk.quadrants & (1 << quadrant)))
+				quadrant++;
+
+			GLsizei count = mQuadrantIndexCount * (quadrant - first);
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * mQuadrantIndexCount * first));
+			Profiler::Count(PC_DRAW_CALLS);
+			Profiler::Count(PC_TERRAIN_TRIANGLES, count / 3);
+		}
+	}
+}
+
+void Terrain::Clear()
+{
+	if (m_heightmap) {
+		GLState::DeleteTexture(m_heightmap);
+		m_heightmap = 0;
+
+		// The last terrain takes the grid with it
+		if (--mGridUsers == 0) {
+			glDeleteBuffers(1, &mGridVBO);
+			glDeleteBuffers(1, &mGridEBO);
+			GLState::DeleteVertexArray(mGridVAO);
+			mGridVAO = mGridVBO = mGridEBO = 0;
+		}
+	}
+	m_heights.clear();
+	m_nodes.clear();
+	m_occluderVertices.clear();
+	m_occluderIndices.clear();
+}
+
+Terrain::~Terrain()
+{
+	Clear();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "Commons.h"
+#include "GLState.h"
+#include "Shader.h"
+#include "Frustum.h"
+#include "Texture.h"
+#include "Material.h"
+#include "Profiler.h"
+#include "RenderSnapshot.h"
+
+// Quads along each side of a chunk. Every chunk, whatever its level, is drawn with this grid
+const int TERRAIN_GRID_SIZE = 32;
+// Side of the smallest chunks, those of level 0. The quadtree gets as many levels as the terrain's size needs
+const float TERRAIN_LEAF_SIZE = 16.0f;
+// Most levels a quadtree can have
+const int TERRAIN_MAX_LOD_LEVELS = 8;
+// Distance up to which the finest level is used. Each coarser level doubles it
+const float TERRAIN_LOD_BASE_RANGE = 40.0f;
+// Fraction of a level's range, past the previous one, after which its vertices start morphing to the coarser level
+const float TERRAIN_MORPH_START = 0.7f;
+// Quads along each side of the occluder mesh, which the occlusion culler rasterizes instead of the terrain
+const int TERRAIN_OCCLUDER_GRID_SIZE = 16;
+
+// Part of a quadtree node selected for drawing
+struct TerrainChunk {
+	glm::vec2 offset;
+	float size;
+	int level;
+	// Quadrants to draw, one bit each. Quadrants covered by finer chunks are left out
+	int quadrants;
+};
+
+/*!
+	Heightmap terrain drawn with continuous distance-dependent level of detail (CDLOD).
+
+	The terrain is split in a quadtree of chunks that all share a single (TERRAIN_GRID_SIZE + 1)^2 grid. Heights and
+	normals come from the height texture in the vertex shader. Each frame the quadtree is walked from the root: a node is
+	drawn whole when the camera is out of the range of the next finer level, otherwise its children take over the
+	quadrants they cover. Vertices morph into the coarser grid as they approach the end of their level's range, so
+	there are no cracks nor pops between levels, and the number of vertices drawn depends on the ranges and not on the
+	size of the terrain. Nodes keep the height range of their area to be culled against the camera and light frustums.
+
+	The texels on the border of the heightmap lie on the edges of the terrain, so a large terrain can be split in pages
+	that share their border texels and are drawn next to each other without seams.
+*/
+class Terrain
+{
+private:
+	struct Node {
+		glm::vec3 boxMin;
+		glm::vec3 boxMax;
+		// Index of the first of the four children in m_nodes. -1 for leaves
+		int children;
+	};
+
+	std::string m_heightmapLocation;
+	std::vector<unsigned short> m_heights;
+	int m_width, m_height;
+
+	// Corner of the terrain with the smallest coordinates, at height 0 of the heightmap
+	glm::vec3 m_origin;
+	float m_size;
+	float m_heightScale;
+	// World units covered by one repetition of the albedo texture
+	float m_tiling;
+
+	GLuint m_heightmap;
+
+	// -- Chunk grid, shared by every terrain --
+	static GLuint mGridVAO, mGridVBO, mGridEBO;
+	// Indices of one quadrant of the grid. The four quadrants are consecutive in the element buffer
+	static GLsizei mQuadrantIndexCount;
+	static int mGridUsers;
+
+	std::vector<Node> m_nodes;
+	int m_levels;
+	float m_ranges[TERRAIN_MAX_LOD_LEVELS];
+
+	// Coarse mesh under the surface, so whatever it hides is hidden by the terrain
+	std::vector<glm::vec3> m_occluderVertices;
+	std::vector<unsigned int> m_occluderIndices;
+
+	Material* m_material;
+
+	// Chunks the camera sees, selected once per render snapshot
+	std::vector<TerrainChunk> m_queues[RENDER_SNAPSHOT_COUNT];
+
+	float _GetSample(int x, int z) const;
+	// Fills m_nodes[index] and its subtree
+	void _BuildNode(int index, glm::vec2 offset, float size, int level);
+	static void _BuildGrid();
+	// Each vertex takes the lowest height of the quads around it, so every quad stays below the texels it covers
+	void _BuildOccluder();
+	// Returns false if the node is out of its level's range, leaving it to the parent
+	bool _Select(int node, glm::vec2 offset, float size, int level, const Frustum& frustum, glm::vec3 camera, std::vector<TerrainChunk>& chunks) const;
+
+	static bool _BoxIntersectsSphere(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 center, float radius);
+
+public:
+	/*!
+		\n Terrain::Terrain(const char* heightmap, glm::vec3 center, float size, float heightScale, float tiling, Material* material)
+		\param const char* heightmap Grayscale image, 16 bits per channel preferably
+		\param glm::vec3 center Center of the terrain. Its y is the height of the darkest texel
+		\param float size Side of the terrain in world units
+		\param float heightScale Height of the brightest texel above the darkest
+		\param float tiling World units covered by one repetition of the material's texture
+		\param Material* material Material of the whole terrain
+	*/
+	Terrain(const char* heightmap, glm::vec3 center, float size, float heightScale, float tiling, Material* material);
+
+	// Reads the heightmap and builds the quadtree. Does not touch GL, so it can run on any thread
+	bool Import();
+	// Uploads the height texture, and the grid if no other terrain did. Main thread only
+	void Upload();
+	// Import and Upload
+	bool Load();
+
+	// CPU and GPU bytes held by the terrain
+	size_t GetByteSize() const;
+
+	// World height of the terrain below a point, as the vertex shader sees it
+	float GetHeight(float x, float z) const;
+
+	// Chunks inside the frustum, detailed according to their distance to the camera
+	void Select(const Frustum& frustum, glm::vec3 camera, std::vector<TerrainChunk>& chunks) const;
+
+	// Asks the streamer for the detail the albedo texture needs around the camera
+	void RequestTextureLevels();
+
+	// Chunks selected for the camera in the given snapshot
+	std::vector<TerrainChunk>& GetQueue(int snapshot) { return m_queues[snapshot]; }
+
+	// Draws the chunks. The shader has to be in use; it gets the heightmap on TERRAIN_HEIGHTMAP_UNIT
+	void Render(TerrainUniforms* uniforms, glm::vec3 camera, const std::vector<TerrainChunk>& chunks);
+
+	// Box around the whole terrain
+	glm::vec3 GetBoxMin() const { return m_nodes.empty() ? m_origin : m_nodes[0].boxMin; }
+	glm::vec3 GetBoxMax() const { return m_nodes.empty() ? m_origin : m_nodes[0].boxMax; }
+	const std::vector<glm::vec3>& GetOccluderVertices() const { return m_occluderVertices; }
+	const std::vector<unsigned int>& GetOccluderIndices() const { return m_occluderIndices; }
+
+	Material* GetMaterial() const { return m_material; }
+	const std::string& GetHeightmapLocation() const { return m_heightmapLocation; }
+	glm::vec3 GetOrigin() const { return m_origin; }
+	float GetSize() const { return m_size; }
+	float GetHeightScale() const { return m_heightScale; }
+
+	void Clear();
+
+	~Terrain();
+};
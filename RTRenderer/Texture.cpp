@@ -1,40 +1,139 @@
 #include "Texture.h"
-#include <string>
+#include "TextureStreamer.h"
 
-Texture::Texture()
+Texture::Texture() :
+	Texture("")
 {
-	textureID = 0;
-	width = 0;
-	height = 0;
-	bitDepth = 0;
-	fileLocation = "";
 }
 
-Texture::Texture(const char * fileLoc)
+Texture::Texture(const char * fileLoc) :
+	textureID(0),
+	fileLocation(fileLoc),
+	m_streamed(false),
+	m_decodePending(false),
+	m_internalFormat(0),
+	m_levelCount(0),
+	m_residentLevel(0),
+	m_wantedLevel(0),
+	m_requestedSize(0.0f),
+	m_lastUsedFrame(0),
+	width(0),
+	height(0),
+	bitDepth(0)
 {
-	textureID = 0;
-	width = 0;
-	height = 0;
-	bitDepth = 0;
-	fileLocation = fileLoc;
 }
 
 bool Texture::LoadTexture()
+{
+	if (_LoadCompressed())
+		return true;
+	return _LoadUncompressed();
+}
+
+bool Texture::LoadTextureAsync()
+{
+	if (textureID)
+		return true;
+
+	if (!TextureStreamer::IsInitialized())
+		return LoadTexture();
+
+	// Decoding happens later on a worker, only check that there is something to decode
+	FILE* file = fopen(fileLocation.c_str(), "rb");
+	if (!file) {
+		size_t extension = fileLocation.rfind('.');
+		if (extension != std::string::npos)
+			file = fopen((fileLocation.substr(0, extension) + ".ktx").c_str(), "rb");
+	}
+	if (!file) {
+		printf("Failed to find: %s\n", fileLocation.c_str());
+		return false;
+	}
+	fclose(file);
+
+	glGenTextures(1, &textureID);
+	m_streamed = true;
+	TextureStreamer::Register(this);
+	return true;
+}
+
+void Texture::RequestSize(float pixels)
+{
+	if (pixels > m_requestedSize)
+		m_requestedSize = pixels;
+}
+
+bool Texture::IsCompressedFormatSupported(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc;
+	case GL_COMPRESSED_RG_RGTC2:
+		// Core since 3.0
+		return true;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		return GLEW_ARB_texture_compression_bptc;
+	}
+	return false;
+}
+
+bool Texture::_LoadCompressed()
+{
+	std::string path = fileLocation;
+	size_t extension = path.rfind('.');
+	if (extension == std::string::npos)
+		return false;
+	path = path.substr(0, extension) + ".ktx";
+
+	KTXFile ktx;
+	if (!ktx.Read(path.c_str()))
+		return false;
+
+	if (!IsCompressedFormatSupported(ktx.internalFormat)) {
+		printf("Compressed format of %s is not supported, falling back to %s\n", path.c_str(), fileLocation.c_str());
+		return false;
+	}
+
+	width = ktx.width;
+	height = ktx.height;
+	bitDepth = ktx.baseInternalFormat == GL_RGB ? 3 : 4;
+
+	glGenTextures(1, &textureID);
+	GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, ktx.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)ktx.levels.size() - 1);
+
+	// The mip chain was built offline, no decode or glGenerateMipmap at load time
+	for (size_t i = 0; i < ktx.levels.size(); i++) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, ktx.internalFormat, ktx.levels[i].width, ktx.levels[i].height, 0,
+			(GLsizei)ktx.levels[i].data.size(), ktx.levels[i].data.data());
+	}
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+bool Texture::_LoadUncompressed()
 {
 	// https://github.com/nothings/stb/blob/master/stb_image.h
-	unsigned char* texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
+	unsigned char* texData = stbi_load(fileLocation.c_str(), &width, &height, &bitDepth, 0);
 	if (!texData) {
-		printf("Failed to find: %s\n", fileLocation);
+		printf("Failed to find: %s\n", fileLocation.c_str());
 		return false;
 	}
 
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	
 	if (bitDepth == 3) {
-		glGenerateMipmap(GL_TEXTURE_2D);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
@@ -49,7 +148,7 @@ bool Texture::LoadTexture()
 
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 	stbi_image_free(texData);
 
@@ -58,18 +157,28 @@ bool Texture::LoadTexture()
 
 void Texture::UseTexture()
 {
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	// Until its first levels arrive a streamed texture samples the streamer's placeholder
+	if (m_streamed && m_residentLevel >= m_levelCount)
+		GLState::BindTexture(1, GL_TEXTURE_2D, TextureStreamer::GetPlaceholder());
+	else
+		GLState::BindTexture(1, GL_TEXTURE_2D, textureID);
 }
 
 void Texture::ClearTexture()
 {
-	glDeleteTextures(1, &textureID);
+	if (m_streamed)
+		TextureStreamer::Unregister(this);
+	m_streamed = false;
+	m_levelCount = 0;
+	m_residentLevel = 0;
+
+	if (textureID)
+		GLState::DeleteTexture(textureID);
 	textureID = 0;
 	width = 0;
 	height = 0;
 	bitDepth = 0;
-	fileLocation = "";
+	fileLocation.clear();
 }
 
 
@@ -1,24 +1,68 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <GL\glew.h>
 #include "stb_image.h"
 
+#include "GLState.h"
+#include "KTXFile.h"
+
 class Texture
 {
 private:
+	friend class TextureStreamer;
+
 	GLuint textureID;
 
-	const char* fileLocation;
+	std::string fileLocation;
+
+	// -- Streaming state, owned by the TextureStreamer on the main thread --
+	bool m_streamed;
+	// A decode of this texture is queued, running or waiting to be uploaded
+	bool m_decodePending;
+	GLenum m_internalFormat;
+	// Number of levels of the full mip chain. 0 until the first decode finishes
+	int m_levelCount;
+	std::vector<size_t> m_levelBytes;
+	// Finest level resident on the GPU. Equal to m_levelCount when nothing is resident
+	int m_residentLevel;
+	// Finest level the objects using this texture need
+	int m_wantedLevel;
+	// Largest on screen size, in pixels, requested since the last streamer update
+	float m_requestedSize;
+	unsigned long long m_lastUsedFrame;
+
+	// Loads the cooked .ktx file that sits next to the source image, if there is one the GPU can sample
+	bool _LoadCompressed();
+	// Decodes the source image and uploads it uncompressed
+	bool _LoadUncompressed();
 public:
 	int width, height, bitDepth;
 	Texture();
 	Texture(const char* fileLoc);
 
+	const char* GetFileLocation() const { return fileLocation.c_str(); }
+
+	// Loads the whole texture before returning
 	bool LoadTexture();
+	// Hands the texture to the TextureStreamer. Coarse mips become resident first and finer ones follow as they are requested.
+	// Returns false if there is no image to stream. Loads synchronously when the streamer is not running
+	bool LoadTextureAsync();
+
+	/*!
+		\n void Texture::RequestSize(float pixels)
+		\param float pixels Size, in pixels, covered on screen by the whole texture (one UV repetition)
+
+		Tells the streamer how much detail this texture needs this frame. Only meaningful for streamed textures
+	*/
+	void RequestSize(float pixels);
 
 	void UseTexture();
 	void ClearTexture();
 
+	static bool IsCompressedFormatSupported(GLenum internalFormat);
+
 	~Texture();
 };
-
@@ -0,0 +1,136 @@
+#include "TextureArray.h"
+#include "stb_image.h"
+
+#include <future>
+#include <algorithm>
+
+// Decoded pixels of one layer
+struct LayerImage {
+	int width, height;
+	unsigned char* data;
+};
+
+TextureArray::TextureArray() :
+	m_textureID(0),
+	m_size(0)
+{
+}
+
+int TextureArray::AddLayer(const std::string & fileLocation)
+{
+	for (size_t i = 0; i < m_layers.size(); i++) {
+		if (m_layers[i] == fileLocation)
+			return (int)i;
+	}
+	m_layers.push_back(fileLocation);
+	return (int)m_layers.size() - 1;
+}
+
+std::vector<unsigned char> TextureArray::_Resample(const unsigned char * rgba, int width, int height, int newWidth, int newHeight)
+{
+	std::vector<unsigned char> result((size_t)newWidth * newHeight * 4);
+	for (int y = 0; y < newHeight; y++) {
+		float sy = std::max(0.0f, (y + 0.5f) * height / newHeight - 0.5f);
+		int y0 = std::min((int)sy, height - 1);
+		int y1 = std::min(y0 + 1, height - 1);
+		float fy = sy - y0;
+
+		for (int x = 0; x < newWidth; x++) {
+			float sx = std::max(0.0f, (x + 0.5f) * width / newWidth - 0.5f);
+			int x0 = std::min((int)sx, width - 1);
+			int x1 = std::min(x0 + 1, width - 1);
+			float fx = sx - x0;
+
+			for (int c = 0; c < 4; c++) {
+				float top = rgba[((size_t)y0 * width + x0) * 4 + c] * (1.0f - fx) + rgba[((size_t)y0 * width + x1) * 4 + c] * fx;
+				float bottom = rgba[((size_t)y1 * width + x0) * 4 + c] * (1.0f - fx) + rgba[((size_t)y1 * width + x1) * 4 + c] * fx;
+				result[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+	return result;
+}
+
+bool TextureArray::Build()
+{
+	if (m_layers.empty())
+		return false;
+
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if ((GLint)m_layers.size() > maxLayers) {
+		printf("Texture array with %zu layers exceeds the limit of %d\n", m_layers.size(), maxLayers);
+		return false;
+	}
+
+	// Decode every layer in parallel
+	std::vector<std::future<LayerImage>> decodes;
+	for (size_t i = 0; i < m_layers.size(); i++) {
+		std::string path = m_layers[i];
+		decodes.push_back(std::async(std::launch::async, [path]() {
+			LayerImage image;
+			int channels;
+			image.data = stbi_load(path.c_str(), &image.width, &image.height, &channels, 4);
+			if (!image.data)
+				printf("Failed to find: %s\n", path.c_str());
+			return image;
+		}));
+	}
+
+	std::vector<LayerImage> images;
+	m_size = 1;
+	for (size_t i = 0; i < decodes.size(); i++) {
+		images.push_back(decodes[i].get());
+		if (images[i].data)
+			m_size = std::max(m_size, std::max(images[i].width, images[i].height));
+	}
+	m_size = std::min(m_size, TEXTURE_ARRAY_MAX_SIZE);
+
+	glGenTextures(1, &m_textureID);
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, m_textureID);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, m_size, m_size, (GLsizei)m_layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	for (size_t i = 0; i < images.size(); i++) {
+		// Layers that failed to load are left transparent so that they are discarded like a missing texture
+		std::vector<unsigned char> layer;
+		if (!images[i].data)
+			layer.assign((size_t)m_size * m_size * 4, 0);
+		else if (images[i].width != m_size || images[i].height != m_size)
+			layer = _Resample(images[i].data, images[i].width, images[i].height, m_size, m_size);
+		else
+			layer.assign(images[i].data, images[i].data + (size_t)m_size * m_size * 4);
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, m_size, m_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+
+		if (images[i].data)
+			stbi_image_free(images[i].data);
+	}
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	return true;
+}
+
+void TextureArray::UseTextureArray()
+{
+	GLState::BindTexture(ALBEDO_ARRAY_UNIT, GL_TEXTURE_2D_ARRAY, m_textureID);
+}
+
+void TextureArray::ClearTextureArray()
+{
+	if (m_textureID)
+		GLState::DeleteTexture(m_textureID);
+	m_textureID = 0;
+	m_size = 0;
+	m_layers.clear();
+}
+
+TextureArray::~TextureArray()
+{
+	ClearTextureArray();
+}
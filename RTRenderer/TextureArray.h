@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "Commons.h"
+#include "GLState.h"
+
+// Largest side of a layer. Bigger images are scaled down to it
+const int TEXTURE_ARRAY_MAX_SIZE = 1024;
+
+/*!
+	Packs RGBA8 albedo textures into the layers of a single GL_TEXTURE_2D_ARRAY.
+
+	Every layer has the size of the largest image (up to TEXTURE_ARRAY_MAX_SIZE); the other images are resampled to
+	it, which keeps GL_REPEAT tiling working. Meshes select their layer through the layer vertex attribute, so meshes
+	with different materials can be drawn together. The array is always bound to ALBEDO_ARRAY_UNIT.
+*/
+class TextureArray
+{
+private:
+	GLuint m_textureID;
+	int m_size;
+	std::vector<std::string> m_layers;
+
+	// Bilinear resampling of an RGBA8 image
+	static std::vector<unsigned char> _Resample(const unsigned char* rgba, int width, int height, int newWidth, int newHeight);
+public:
+	TextureArray();
+
+	// Returns the layer of an image, adding it if it is not in the array yet. Must be called before Build
+	int AddLayer(const std::string& fileLocation);
+	int GetLayerCount() const { return (int)m_layers.size(); }
+
+	// Decodes all the images and uploads the array with a full mip chain
+	bool Build();
+
+	void UseTextureArray();
+	void ClearTextureArray();
+
+	~TextureArray();
+};
@@ -0,0 +1,538 @@
+#include "TextureStreamer.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "BlockCompression.h"
+
+bool TextureStreamer::mInitialized = false;
+
+std::vector<std::thread> TextureStreamer::mWorkers;
+std::mutex TextureStreamer::mMutex;
+std::condition_variable TextureStreamer::mCondition;
+std::deque<StreamedImage*> TextureStreamer::mPending;
+std::vector<StreamedImage*> TextureStreamer::mDecoding;
+std::vector<StreamedImage*> TextureStreamer::mDecoded;
+bool TextureStreamer::mStop = false;
+
+std::vector<Texture*> TextureStreamer::mTextures;
+std::vector<StreamedImage*> TextureStreamer::mUploading;
+UploadBuffer TextureStreamer::mBuffers[STREAM_UPLOAD_BUFFERS];
+int TextureStreamer::mNextBuffer = 0;
+GLuint TextureStreamer::mPlaceholder = 0;
+size_t TextureStreamer::mBudget = 0;
+size_t TextureStreamer::mUploadBudget = 0;
+size_t TextureStreamer::mResidentBytes = 0;
+unsigned long long TextureStreamer::mFrame = 0;
+
+void TextureStreamer::Initialize(size_t vramBudget, size_t uploadBytesPerFrame, unsigned int workerCount)
+{
+	if (mInitialized)
+		return;
+
+	mBudget = vramBudget;
+	mUploadBudget = uploadBytesPerFrame;
+
+	for (int i = 0; i < STREAM_UPLOAD_BUFFERS; i++) {
+		glGenBuffers(1, &mBuffers[i].pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffers[i].pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, STREAM_UPLOAD_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+		mBuffers[i].fence = nullptr;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &mPlaceholder);
+	GLState::BindTexture(0, GL_TEXTURE_2D, mPlaceholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	// Leave a core for the main thread
+	if (workerCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	mStop = false;
+	for (unsigned int i = 0; i < workerCount; i++)
+		mWorkers.push_back(std::thread(_WorkerLoop));
+
+	mInitialized = true;
+}
+
+bool TextureStreamer::IsInitialized()
+{
+	return mInitialized;
+}
+
+void TextureStreamer::Register(Texture * texture)
+{
+	mTextures.push_back(texture);
+	_Queue(texture);
+}
+
+void TextureStreamer::Unregister(Texture * texture)
+{
+	if (!mInitialized)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (StreamedImage* image : mPending)
+			if (image->texture == texture) image->texture = nullptr;
+		for (StreamedImage* image : mDecoding)
+			if (image->texture == texture) image->texture = nullptr;
+		for (StreamedImage* image : mDecoded)
+			if (image->texture == texture) image->texture = nullptr;
+	}
+
+	StreamedImage* image = _FindUploading(texture);
+	if (image != nullptr) {
+		if (image->uploadLevel >= 0)
+			mResidentBytes -= texture->m_levelBytes[image->uploadLevel];
+		mUploading.erase(std::find(mUploading.begin(), mUploading.end(), image));
+		delete image;
+	}
+
+	for (int level = texture->m_residentLevel; level < texture->m_levelCount; level++)
+		mResidentBytes -= texture->m_levelBytes[level];
+
+	mTextures.erase(std::remove(mTextures.begin(), mTextures.end(), texture), mTextures.end());
+}
+
+void TextureStreamer::_Queue(Texture * texture)
+{
+	StreamedImage* image = new StreamedImage();
+	image->texture = texture;
+	image->path = texture->fileLocation;
+	image->internalFormat = 0;
+	image->compressed = false;
+	image->failed = false;
+	image->uploadLevel = -1;
+	image->uploadRow = 0;
+
+	texture->m_decodePending = true;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending.push_back(image);
+	}
+	mCondition.notify_one();
+}
+
+void TextureStreamer::_WorkerLoop()
+{
+	while (true) {
+		StreamedImage* image;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [] { return mStop || !mPending.empty(); });
+			if (mStop)
+				return;
+
+			image = mPending.front();
+			mPending.pop_front();
+
+			// The texture was destroyed before its turn came
+			if (image->texture == nullptr) {
+				delete image;
+				continue;
+			}
+			mDecoding.push_back(image);
+		}
+
+		_Decode(image);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mDecoding.erase(std::find(mDecoding.begin(), mDecoding.end(), image));
+			mDecoded.push_back(image);
+		}
+	}
+}
+
+void TextureStreamer::_Decode(StreamedImage * image)
+{
+	// Cooked mip chains are uploaded as they are
+	size_t extension = image->path.rfind('.');
+	if (extension != std::string::npos) {
+		KTXFile ktx;
+		if (ktx.Read((image->path.substr(0, extension) + ".ktx").c_str()) &&
+			Texture::IsCompressedFormatSupported(ktx.internalFormat)) {
+			image->internalFormat = ktx.internalFormat;
+			image->compressed = true;
+			image->levels.swap(ktx.levels);
+			return;
+		}
+	}
+
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(image->path.c_str(), &width, &height, &channels, 4);
+	if (!pixels) {
+		printf("Failed to find: %s\n", image->path.c_str());
+		image->failed = true;
+		return;
+	}
+
+	// Everything is expanded to RGBA8 so that rows are always 4 byte aligned
+	image->internalFormat = GL_RGBA8;
+	image->compressed = false;
+
+	KTXLevel level;
+	level.width = width;
+	level.height = height;
+	level.data.assign(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+	image->levels.push_back(level);
+
+	while (width > 1 || height > 1) {
+		const KTXLevel& previous = image->levels.back();
+		KTXLevel next;
+		next.data = BlockCompression::Downsample(previous.data.data(), previous.width, previous.height, &next.width, &next.height);
+		width = next.width;
+		height = next.height;
+		image->levels.push_back(next);
+	}
+}
+
+bool TextureStreamer::_Prepare(Texture * texture, StreamedImage * image)
+{
+	// Later decodes of the same texture refill levels that were evicted
+	if (texture->m_levelCount > 0) {
+		if (texture->m_internalFormat != image->internalFormat || texture->m_levelCount != (int)image->levels.size()) {
+			printf("Streamed texture %s changed on disk, ignoring it\n", image->path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	texture->width = image->levels[0].width;
+	texture->height = image->levels[0].height;
+	texture->bitDepth = 4;
+	texture->m_internalFormat = image->internalFormat;
+	texture->m_levelCount = (int)image->levels.size();
+	texture->m_levelBytes.resize(image->levels.size());
+	for (size_t i = 0; i < image->levels.size(); i++)
+		texture->m_levelBytes[i] = image->levels[i].data.size();
+	texture->m_residentLevel = texture->m_levelCount;
+	texture->m_wantedLevel = _GetTailLevel(texture);
+	texture->m_lastUsedFrame = mFrame;
+
+	// The base level is lowered as levels arrive, while it is past the max level the placeholder is bound instead
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture->textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture->m_levelCount);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->m_levelCount - 1);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+int TextureStreamer::_GetTailLevel(Texture * texture)
+{
+	for (int level = 0; level < texture->m_levelCount; level++) {
+		if ((texture->width >> level) <= STREAM_TAIL_SIZE && (texture->height >> level) <= STREAM_TAIL_SIZE)
+			return level;
+	}
+	return texture->m_levelCount - 1;
+}
+
+void TextureStreamer::_UpdateWantedLevel(Texture * texture)
+{
+	float requestedSize = texture->m_requestedSize;
+	texture->m_requestedSize = 0.0f;
+
+	if (texture->m_levelCount == 0)
+		return;
+
+	int tail = _GetTailLevel(texture);
+	if (requestedSize > 0.0f) {
+		// One texel per pixel: every halving of the on screen size drops a level
+		float texels = (float)std::max(texture->width, texture->height);
+		int level = (int)floorf(log2f(texels / requestedSize));
+		texture->m_wantedLevel = std::max(0, std::min(level, tail));
+		texture->m_lastUsedFrame = mFrame;
+	}
+	else if (mFrame - texture->m_lastUsedFrame > STREAM_UNUSED_FRAMES) {
+		texture->m_wantedLevel = tail;
+	}
+}
+
+StreamedImage * TextureStreamer::_FindUploading(Texture * texture)
+{
+	for (StreamedImage* image : mUploading)
+		if (image->texture == texture)
+			return image;
+	return nullptr;
+}
+
+void TextureStreamer::_ReleaseLevel(Texture * texture, int level)
+{
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture->textureID);
+	// Raise the base level first so the texture never references the released level
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	if (texture->m_internalFormat != GL_RGBA8)
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->m_internalFormat, 0, 0, 0, 0, nullptr);
+	else
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	mResidentBytes -= texture->m_levelBytes[level];
+	if (texture->m_residentLevel == level)
+		texture->m_residentLevel = level + 1;
+}
+
+void TextureStreamer::_CancelLevel(StreamedImage * image)
+{
+	Texture* texture = image->texture;
+	int level = image->uploadLevel;
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture->textureID);
+	if (image->compressed)
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image->internalFormat, 0, 0, 0, 0, nullptr);
+	else
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	mResidentBytes -= texture->m_levelBytes[level];
+	image->uploadLevel = -1;
+	image->uploadRow = 0;
+}
+
+bool TextureStreamer::_MakeRoom(size_t bytes, Texture * requester)
+{
+	while (mResidentBytes + bytes > mBudget) {
+		// Only levels finer than what their texture currently needs can go
+		Texture* victim = nullptr;
+		for (Texture* texture : mTextures) {
+			if (texture == requester || texture->m_levelCount == 0 || texture->m_residentLevel >= texture->m_wantedLevel)
+				continue;
+			if (victim == nullptr || texture->m_lastUsedFrame < victim->m_lastUsedFrame)
+				victim = texture;
+		}
+
+		if (victim == nullptr)
+			return false;
+
+		_ReleaseLevel(victim, victim->m_residentLevel);
+	}
+	return true;
+}
+
+size_t TextureStreamer::_UploadBand(StreamedImage * image)
+{
+	UploadBuffer& buffer = mBuffers[mNextBuffer];
+	if (buffer.fence != nullptr) {
+		// Never wait on the GPU, the rest of the upload waits for the next frame instead
+		if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			return 0;
+		glDeleteSync(buffer.fence);
+		buffer.fence = nullptr;
+	}
+
+	Texture* texture = image->texture;
+	const int levelIndex = image->uploadLevel;
+	const KTXLevel& level = image->levels[levelIndex];
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture->textureID);
+
+	// Allocate the whole level before its first band. No pixel buffer can be bound here
+	if (image->uploadRow == 0) {
+		if (image->compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, levelIndex, image->internalFormat, level.width, level.height, 0,
+				(GLsizei)level.data.size(), nullptr);
+		else
+			glTexImage2D(GL_TEXTURE_2D, levelIndex, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	// Compressed levels are split in rows of 4x4 blocks
+	const int rowsPerUnit = image->compressed ? 4 : 1;
+	const int unitCount = (level.height + rowsPerUnit - 1) / rowsPerUnit;
+	const size_t unitBytes = level.data.size() / unitCount;
+	const int unitsPerBand = std::max(1, (int)(STREAM_UPLOAD_BUFFER_SIZE / unitBytes));
+
+	const int firstUnit = image->uploadRow / rowsPerUnit;
+	const int units = std::min(unitsPerBand, unitCount - firstUnit);
+	const int rows = std::min(units * rowsPerUnit, level.height - image->uploadRow);
+	const size_t bytes = units * unitBytes;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+	void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (destination == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return 0;
+	}
+	memcpy(destination, level.data.data() + firstUnit * unitBytes, bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// With a pixel buffer bound the data pointer is an offset into it
+	if (image->compressed)
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, image->uploadRow, level.width, rows, image->internalFormat,
+			(GLsizei)bytes, (void*)0);
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, image->uploadRow, level.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mNextBuffer = (mNextBuffer + 1) % STREAM_UPLOAD_BUFFERS;
+
+	image->uploadRow += rows;
+	if (image->uploadRow >= level.height) {
+		// Every level from here to the max level is now defined, let the sampler use it
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levelIndex);
+		texture->m_residentLevel = levelIndex;
+		image->uploadLevel = -1;
+		image->uploadRow = 0;
+	}
+
+	return bytes;
+}
+
+void TextureStreamer::Update()
+{
+	if (!mInitialized)
+		return;
+
+	mFrame++;
+
+	// -- Pick up the images the workers finished --
+	std::vector<StreamedImage*> decoded;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		decoded.swap(mDecoded);
+	}
+
+	for (StreamedImage* image : decoded) {
+		Texture* texture = image->texture;
+		if (texture == nullptr) {
+			delete image;
+			continue;
+		}
+
+		if (image->failed || !_Prepare(texture, image)) {
+			texture->m_decodePending = false;
+			delete image;
+			continue;
+		}
+		mUploading.push_back(image);
+	}
+
+	// -- Turn the sizes requested while rendering the last frame into wanted levels --
+	for (Texture* texture : mTextures) {
+		_UpdateWantedLevel(texture);
+
+		// The CPU copy is dropped once the wanted level is resident, decode again if more detail is needed later
+		if (texture->m_levelCount > 0 && texture->m_wantedLevel < texture->m_residentLevel && !texture->m_decodePending)
+			_Queue(texture);
+	}
+
+	for (StreamedImage* image : mUploading) {
+		if (image->uploadLevel >= 0 && image->uploadLevel < image->texture->m_wantedLevel)
+			_CancelLevel(image);
+	}
+
+	// -- Upload, the coarsest missing level among all textures first --
+	size_t uploaded = 0;
+	std::vector<StreamedImage*> blocked;
+	while (uploaded < mUploadBudget) {
+		StreamedImage* next = nullptr;
+		int nextLevel = -1;
+		for (StreamedImage* image : mUploading) {
+			Texture* texture = image->texture;
+			int level = image->uploadLevel >= 0 ? image->uploadLevel : texture->m_residentLevel - 1;
+			if (level < texture->m_wantedLevel || std::find(blocked.begin(), blocked.end(), image) != blocked.end())
+				continue;
+			if (level > nextLevel) {
+				next = image;
+				nextLevel = level;
+			}
+		}
+
+		if (next == nullptr)
+			break;
+
+		if (next->uploadLevel < 0) {
+			if (!_MakeRoom(next->texture->m_levelBytes[nextLevel], next->texture)) {
+				blocked.push_back(next);
+				continue;
+			}
+			next->uploadLevel = nextLevel;
+			next->uploadRow = 0;
+			mResidentBytes += next->texture->m_levelBytes[nextLevel];
+		}
+
+		size_t bytes = _UploadBand(next);
+		if (bytes == 0)
+			break;
+		uploaded += bytes;
+	}
+
+	// -- Drop the CPU copies that are no longer needed --
+	for (size_t i = mUploading.size(); i-- > 0;) {
+		StreamedImage* image = mUploading[i];
+		Texture* texture = image->texture;
+		if (image->uploadLevel < 0 && texture->m_residentLevel <= texture->m_wantedLevel) {
+			texture->m_decodePending = false;
+			mUploading.erase(mUploading.begin() + i);
+			delete image;
+		}
+	}
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	Profiler::Count(PC_TEXTURE_UPLOAD_BYTES, uploaded);
+	Profiler::SetGauge(PG_TEXTURE_RESIDENT_BYTES, mResidentBytes);
+}
+
+GLuint TextureStreamer::GetPlaceholder()
+{
+	return mPlaceholder;
+}
+
+void TextureStreamer::Shutdown()
+{
+	if (!mInitialized)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mCondition.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+
+	for (StreamedImage* image : mPending)
+		delete image;
+	mPending.clear();
+	for (StreamedImage* image : mDecoded)
+		delete image;
+	mDecoded.clear();
+	for (StreamedImage* image : mUploading)
+		delete image;
+	mUploading.clear();
+
+	for (Texture* texture : mTextures)
+		texture->m_decodePending = false;
+	mTextures.clear();
+
+	for (int i = 0; i < STREAM_UPLOAD_BUFFERS; i++) {
+		if (mBuffers[i].fence != nullptr)
+			glDeleteSync(mBuffers[i].fence);
+		glDeleteBuffers(1, &mBuffers[i].pbo);
+		mBuffers[i].fence = nullptr;
+		mBuffers[i].pbo = 0;
+	}
+
+	GLState::DeleteTexture(mPlaceholder);
+	mPlaceholder = 0;
+	mResidentBytes = 0;
+
+	mInitialized = false;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <GL\glew.h>
+
+#include "Texture.h"
+#include "KTXFile.h"
+#include "Profiler.h"
+
+// Number of pixel buffers in the upload ring
+const int STREAM_UPLOAD_BUFFERS = 4;
+// Size of each pixel buffer. Levels bigger than this are uploaded in bands of rows
+const size_t STREAM_UPLOAD_BUFFER_SIZE = 4 * 1024 * 1024;
+// Levels with both sides at or under this size are always kept resident
+const int STREAM_TAIL_SIZE = 64;
+// Frames without being requested before a texture only wants its tail
+const unsigned long long STREAM_UNUSED_FRAMES = 120;
+
+// CPU copy of a texture's mip chain, decoded on a worker thread and uploaded on the main thread
+struct StreamedImage {
+	// Set to null if the texture is destroyed while the image is in flight
+	Texture* texture;
+	std::string path;
+	GLenum internalFormat;
+	bool compressed;
+	bool failed;
+	std::vector<KTXLevel> levels;
+
+	// Level being uploaded, -1 if none, and the next row of it to upload
+	int uploadLevel;
+	int uploadRow;
+};
+
+// Pixel buffer of the upload ring. The fence tells when the GPU has finished reading it
+struct UploadBuffer {
+	GLuint pbo;
+	GLsync fence;
+};
+
+/*!
+	Streams textures in the background.
+
+	Worker threads decode images (or read cooked .ktx files) and build their mip chain. The main thread then uploads
+	the levels, coarsest first, through a ring of pixel buffer objects with a per-frame byte budget, lowering
+	GL_TEXTURE_BASE_LEVEL as each level completes. Each frame the renderer reports the on screen size of every
+	texture; levels finer than needed are evicted, least recently used first, when the VRAM budget is exceeded.
+*/
+class TextureStreamer
+{
+private:
+	static bool mInitialized;
+
+	// -- Shared with the workers, guarded by mMutex --
+	static std::vector<std::thread> mWorkers;
+	static std::mutex mMutex;
+	static std::condition_variable mCondition;
+	static std::deque<StreamedImage*> mPending;
+	static std::vector<StreamedImage*> mDecoding;
+	static std::vector<StreamedImage*> mDecoded;
+	static bool mStop;
+
+	// -- Main thread only --
+	static std::vector<Texture*> mTextures;
+	static std::vector<StreamedImage*> mUploading;
+	static UploadBuffer mBuffers[STREAM_UPLOAD_BUFFERS];
+	static int mNextBuffer;
+	static GLuint mPlaceholder;
+	static size_t mBudget;
+	static size_t mUploadBudget;
+	static size_t mResidentBytes;
+	static unsigned long long mFrame;
+
+	static void _WorkerLoop();
+	static void _Decode(StreamedImage* image);
+	static void _Queue(Texture* texture);
+
+	// Sets up the texture object the first time one of its decodes finishes
+	static bool _Prepare(Texture* texture, StreamedImage* image);
+	static void _UpdateWantedLevel(Texture* texture);
+	static int _GetTailLevel(Texture* texture);
+
+	// Uploads the next band of rows of an image. Returns the bytes sent, 0 if no pixel buffer is free
+	static size_t _UploadBand(StreamedImage* image);
+	// Drops a partially uploaded level
+	static void _CancelLevel(StreamedImage* image);
+	// Frees a level by redefining it as an empty image
+	static void _ReleaseLevel(Texture* texture, int level);
+	// Evicts levels finer than needed, least recently used textures first, until bytes fit in the budget
+	static bool _MakeRoom(size_t bytes, Texture* requester);
+	static StreamedImage* _FindUploading(Texture* texture);
+
+public:
+	/*!
+		\n void TextureStreamer::Initialize(size_t vramBudget, size_t uploadBytesPerFrame, unsigned int workerCount)
+		\param size_t vramBudget Bytes of texture memory the streamer may keep resident
+		\param size_t uploadBytesPerFrame Bytes uploaded to the GPU at most every frame
+		\param unsigned int workerCount Number of decode threads. 0 picks one less than the hardware threads
+
+		Creates the worker threads, the upload ring and the placeholder texture. Requires a current GL context
+	*/
+	static void Initialize(size_t vramBudget, size_t uploadBytesPerFrame, unsigned int workerCount = 0);
+	static bool IsInitialized();
+
+	static void Register(Texture* texture);
+	static void Unregister(Texture* texture);
+
+	// Consumes decoded images, updates the wanted levels, evicts and uploads. Call once per frame on the main thread
+	static void Update();
+
+	// 1x1 white texture bound in place of streamed textures that have no resident level yet
+	static GLuint GetPlaceholder();
+
+	static void Shutdown();
+};
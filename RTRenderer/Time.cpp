@@ -20,8 +20,10 @@ void Time::Update() {
 	mTime = cTime;
 
 	mFPS++;
+	Profiler::NewFrame();
 	if (mTime - (GLfloat)mSecondsCounter >= 1.0) {
 		printf("FPS: %d\n", mFPS);
+		Profiler::Report();
 		mFPS = 0;
 		mSecondsCounter++;
 	}
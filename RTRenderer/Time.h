@@ -5,6 +5,8 @@
 #include <GL\glew.h>
 #include <GLFW\glfw3.h>
 
+#include "Profiler.h"
+
 class Time {
 private:
 	static double mDTime;
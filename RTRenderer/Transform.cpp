@@ -1,6 +1,11 @@
 #include "Transform.h"
 
+#include "JobSystem.h"
+#include "MatrixKernels.h"
+
 int Transform::NEXT_ID = 1;
+std::atomic<int> Transform::mUnpooledCount(0);
+std::atomic<unsigned long long> Transform::mHierarchyVersion(0);
 
 Transform::Transform() {
 	parent = NULL;
@@ -17,15 +22,16 @@ void Transform::_InitializeVariables() {
 	m_static = _GetParentsAreStatic(parent);
 	
 	m_position = glm::vec3(0.0f, 0.0f, 0.0f);
+	m_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 	m_pitch = 0.0f; m_yaw = 0.0f; m_roll = 0.0f;
+	m_eulerValid = true;
 	m_scale = 1.0f;
 
 	if (this->parent != NULL) {
 		m_worldMatrix = parent->GetWorldMatrix();
 	}
 
-	_UpdateRotationAxis();
-	TransformMatrix(false);
+	_NotifyTransformation();
 }
 
 
@@ -65,20 +71,23 @@ glm::vec3 Transform::GetPosition() { return m_position; }
 
 glm::vec3 Transform::GetRotation() const
 {
+	_UpdateEulerAngles();
 	return glm::vec3(m_pitch, m_yaw, m_roll);
 }
 
 glm::vec3 Transform::GetWorldPosition()
 {
 	glm::mat4 lMat = glm::mat4();
-	lMat = glm::translate(lMat, m_front);
+	lMat = glm::translate(lMat, GetFront());
 	lMat = m_worldMatrix * lMat;
 	return glm::vec3(lMat[3][0], lMat[3][1], lMat[3][2]);
 }
 
-glm::vec3 Transform::GetFront() { return m_front; }
+glm::vec3 Transform::GetFront() const { return m_rotation * glm::vec3(0.0f, 0.0f, 1.0f); }
+
+glm::vec3 Transform::GetRight() const { return m_rotation * glm::vec3(1.0f, 0.0f, 0.0f); }
 
-glm::vec3 Transform::GetUp() { return m_up; }
+glm::vec3 Transform::GetUp() const { return m_rotation * glm::vec3(0.0f, 1.0f, 0.0f); }
 
 glm::vec3 Transform::GetWorldUp()
 {
@@ -87,7 +96,7 @@ glm::vec3 Transform::GetWorldUp()
 	glm::vec3 res = glm::vec3(tmp.x, tmp.y, tmp.z);
 	return res - GetWorldPosition();*/
 	glm::mat4 lMat = glm::mat4();
-	lMat = glm::translate(lMat, m_up);
+	lMat = glm::translate(lMat, GetUp());
 	lMat = m_worldMatrix * lMat;
 	glm::vec3 wPoint = glm::vec3(lMat[3][0], lMat[3][1], lMat[3][2]);
 	glm::vec3 wTranslation = glm::vec3(m_worldMatrix[3][0], m_worldMatrix[3][1], m_worldMatrix[3][2]);
@@ -103,21 +112,25 @@ glm::mat4 Transform::GetLocalMatrix() const
 	return m_localMatrix;
 }
 
-std::vector<glm::mat4> Transform::GetCubeViewProjectionMatrices(float aspect, float near, float far) {
+CubeMatrices Transform::GetCubeViewProjectionMatrices(float aspect, float near, float far) {
+	return GetCubeViewProjectionMatrices(m_position, aspect, near, far);
+}
+
+CubeMatrices Transform::GetCubeViewProjectionMatrices(glm::vec3 position, float aspect, float near, float far) {
 	glm::mat4 lightProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
-	std::vector<glm::mat4> lightTransforms;
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0)));
-	lightTransforms.push_back(lightProj *
-		glm::lookAt(m_position, m_position + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0)));
+	CubeMatrices lightTransforms;
+	lightTransforms.faces[0] = lightProj *
+		glm::lookAt(position, position + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[1] = lightProj *
+		glm::lookAt(position, position + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[2] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
+	lightTransforms.faces[3] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0));
+	lightTransforms.faces[4] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0));
+	lightTransforms.faces[5] = lightProj *
+		glm::lookAt(position, position + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
 	return lightTransforms;
 }
 
@@ -133,9 +146,21 @@ glm::vec3 Transform::LocalToWorldCoordinates(glm::vec3 point, POINT_TYPE type)
 }
 
 
-std::vector<Transform*> Transform::GetChildren() { return m_children; }
+const std::vector<Transform*>& Transform::GetChildren() const { return m_children; }
+
+void Transform::AddChild(Transform* child)
+{
+	m_children.push_back(child);
+	mHierarchyVersion.fetch_add(1);
+}
 
-void Transform::AddChild(Transform* child) { m_children.push_back(child); }
+void Transform::RemoveChild(Transform* child)
+{
+	m_children.erase(std::remove(m_children.begin(), m_children.end(), child), m_children.end());
+	if (child->parent == this)
+		child->parent = NULL;
+	mHierarchyVersion.fetch_add(1);
+}
 
 
 void Transform::SetUp() {
@@ -157,43 +182,75 @@ void Transform::Update() {
 		(*it)->Update();
 	}
 
-	// Iterate over children
-	for (std::vector<Transform*>::iterator it = m_children.begin(); it != m_children.end(); it++)
-	{
-		(*it)->Update();
+	// Behaviours only move their own subtree, so the children's subtrees are updated in parallel
+	JobSystem::ParallelFor(m_children.size(), TRANSFORM_UPDATE_BATCH, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			m_children[i]->Update();
+	});
+}
+
+void Transform::UpdateUnpooled() {
+	if (mUnpooledCount.load() == 0)
+		return;
+
+	for (size_t i = 0; i < m_updatables.size(); i++) {
+		if (m_releases[i] == nullptr)
+			m_updatables[i]->Update();
 	}
+
+	JobSystem::ParallelFor(m_children.size(), TRANSFORM_UPDATE_BATCH, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			m_children[i]->UpdateUnpooled();
+	});
 }
 
 void Transform::AddUpdatable(IUpdatable* updatable) {
 	m_updatables.push_back(updatable);
+	m_releases.push_back(nullptr);
+	mUnpooledCount.fetch_add(1);
 }
 
 void Transform::_PropagateWorldMatrix()
 {
-	for (size_t i = 0; i < m_children.size(); i++) {
-		m_children[i]->_PropagateWorldMatrix(m_worldMatrix);
-	}
+	if (m_children.empty())
+		return;
+	// Depth first algorithm, wide levels are split between the threads
+	JobSystem::ParallelFor(m_children.size(), TRANSFORM_PROPAGATE_BATCH, [this](size_t begin, size_t end) {
+		_PropagateChildren(begin, end);
+	});
 }
 
-void Transform::_PropagateWorldMatrix(glm::mat4 parentWorldMatrix)
+void Transform::_PropagateChildren(size_t begin, size_t end)
 {
-	m_worldMatrix = parentWorldMatrix * m_localMatrix;
-	// Depth first algorithm
-	for (size_t i = 0; i < m_children.size(); i++) {
-		m_children[i]->_PropagateWorldMatrix(m_worldMatrix);
+	const glm::mat4* locals[TRANSFORM_MULTIPLY_BATCH];
+	glm::mat4* worlds[TRANSFORM_MULTIPLY_BATCH];
+	for (size_t first = begin; first < end; first += TRANSFORM_MULTIPLY_BATCH) {
+		size_t count = std::min(end - first, TRANSFORM_MULTIPLY_BATCH);
+		for (size_t i = 0; i < count; i++) {
+			locals[i] = &m_children[first + i]->m_localMatrix;
+			worlds[i] = &m_children[first + i]->m_worldMatrix;
+		}
+		MatrixKernels::Multiply(m_worldMatrix, locals, worlds, count);
+
+		for (size_t i = 0; i < count; i++)
+			m_children[first + i]->_PropagateWorldMatrix();
 	}
 }
 
 void Transform::_UpdateLocalMatrix()
 {
-	m_localMatrix = glm::mat4(1.0f);
-	m_localMatrix = glm::translate(m_localMatrix, m_position);
-	m_localMatrix = m_localMatrix * glm::yawPitchRoll(m_yaw, m_pitch, m_roll);
+	MatrixKernels::Compose(&m_position, &m_rotation, &m_scale, &m_localMatrix, 1);
 }
 
 void Transform::_UpdateWolrdMatrix()
 {
-	m_worldMatrix = parent != NULL ? parent->GetWorldMatrix() * m_localMatrix : m_localMatrix;
+	if (parent == NULL) {
+		m_worldMatrix = m_localMatrix;
+		return;
+	}
+	const glm::mat4* local = &m_localMatrix;
+	glm::mat4* world = &m_worldMatrix;
+	MatrixKernels::Multiply(parent->m_worldMatrix, &local, &world, 1);
 }
 
 void Transform::_NotifyTransformation()
@@ -205,7 +262,8 @@ void Transform::_NotifyTransformation()
 
 
 void Transform::Translate(glm::vec3 translate) {
-	this->m_position += m_right * translate.x + m_up * translate.y + m_front * translate.z;
+	// Along the right, up and front vectors
+	this->m_position += m_rotation * translate;
 	_NotifyTransformation();
 }
 
@@ -217,27 +275,77 @@ void Transform::TranslateLocal(glm::vec3 translate)
 
 void Transform::Scale(GLfloat scale) {
 	this->m_scale *= scale;
+	_NotifyTransformation();
 }
 
-void Transform::_UpdateRotationAxis() {
-	glm::mat4 axis = glm::mat4(1.0f) * glm::yawPitchRoll(m_yaw, m_pitch, m_roll);
-	m_front = axis[2]; m_right = axis[0]; m_up = axis[1];
-	_NotifyTransformation();
+glm::quat Transform::EulerToQuaternion(GLfloat pitch, GLfloat yaw, GLfloat roll)
+{
+	return glm::angleAxis(yaw, glm::vec3(0.0f, 1.0f, 0.0f)) *
+		glm::angleAxis(pitch, glm::vec3(1.0f, 0.0f, 0.0f)) *
+		glm::angleAxis(roll, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void Transform::_UpdateEulerAngles() const
+{
+	if (m_eulerValid)
+		return;
+
+	// The angles yawPitchRoll builds this rotation from
+	glm::mat3 axis = glm::mat3_cast(m_rotation);
+	m_pitch = glm::asin(glm::clamp(-axis[2][1], -1.0f, 1.0f));
+	m_yaw = glm::atan(axis[2][0], axis[2][2]);
+	m_roll = glm::atan(axis[0][1], axis[1][1]);
+	m_eulerValid = true;
 }
 
 void Transform::Rotate(GLfloat pitch, GLfloat yaw, GLfloat roll) {
+	// The angles add up, so a camera turned by pitch and yaw never rolls
+	_UpdateEulerAngles();
 	this->m_pitch += pitch;
 	this->m_yaw += yaw;
 	this->m_roll += roll;
-	_UpdateRotationAxis();
+	m_rotation = EulerToQuaternion(m_pitch, m_yaw, m_roll);
+	_NotifyTransformation();
 }
 
+void Transform::Rotate(glm::quat rotation)
+{
+	m_rotation = glm::normalize(m_rotation * rotation);
+	m_eulerValid = false;
+	_NotifyTransformation();
+}
 
-glm::mat4 Transform::TransformMatrix(bool doScale) {
-	if (!doScale) return m_worldMatrix;
-	return m_worldMatrix * glm::scale(glm::mat4(), glm::vec3(this->m_scale, this->m_scale, this->m_scale));
+void Transform::SetRotation(glm::quat rotation)
+{
+	m_rotation = rotation;
+	m_eulerValid = false;
+	_NotifyTransformation();
 }
 
+void Transform::SetLocalTransform(glm::vec3 position, glm::quat rotation)
+{
+	m_position = position;
+	m_rotation = rotation;
+	m_eulerValid = false;
+	_NotifyTransformation();
+}
+
+void Transform::SetLocalTransform(glm::vec3 position, glm::quat rotation, const glm::mat4 & localMatrix)
+{
+	m_position = position;
+	m_rotation = rotation;
+	m_eulerValid = false;
+	m_localMatrix = localMatrix;
+	if (m_scale != 1.0f) {
+		m_localMatrix[0] *= m_scale;
+		m_localMatrix[1] *= m_scale;
+		m_localMatrix[2] *= m_scale;
+	}
+	_UpdateWolrdMatrix();
+	_PropagateWorldMatrix();
+}
+
+
 
 bool Transform::AreChildrenDynamic() {
 	if (!m_static)
@@ -252,9 +360,15 @@ bool Transform::AreChildrenDynamic() {
 Transform::~Transform()
 {
 	for (size_t i = 0; i < m_updatables.size(); i++) {
-		delete m_updatables[i];
+		if (m_releases[i] != nullptr) {
+			m_releases[i](m_updatables[i]);
+		}
+		else {
+			delete m_updatables[i];
+			mUnpooledCount.fetch_sub(1);
+		}
 	}
 	for (size_t i = 0; i < m_children.size(); i++) {
-		delete m_children[i];
+		ObjectPool<Transform>::Destroy(m_children[i]);
 	}
 }
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
 
 #include <GL\glew.h>
 #include <glm\glm.hpp>
@@ -12,54 +13,72 @@
 #include <glm/gtx/euler_angles.hpp>
 
 #include "IUpdatable.h"
+#include "ObjectPool.h"
+#include "BehaviorSystem.h"
+
+// Children whose subtrees are worth a job of their own when updating the behaviours
+const size_t TRANSFORM_UPDATE_BATCH = 4;
+// Children worth a job of their own when propagating a world matrix, which is cheap per transform
+const size_t TRANSFORM_PROPAGATE_BATCH = 64;
+// Children whose world matrices are multiplied by one call to the matrix kernels
+const size_t TRANSFORM_MULTIPLY_BATCH = 16;
+
+// View-projection matrices of the six faces of a cube map, in the order of the GL faces
+struct CubeMatrices {
+	glm::mat4 faces[6];
+};
+
+// Gives a behaviour back to where it was allocated
+typedef void(*UpdatableRelease)(IUpdatable* updatable);
+
+/*!
+	Node of the scene hierarchy.
 
+	Transforms live in ObjectPool<Transform>: they are made with ObjectPool<Transform>::Create and freed with
+	ObjectPool<Transform>::Destroy, which also destroys the children and the behaviours the transform owns
+*/
 class Transform : public IUpdatable
 {
 private:
 	static int NEXT_ID;
 	const int OBJECT_ID = NEXT_ID++;
+	// Behaviours added with AddUpdatable in every transform. The tree walk is skipped while there are none
+	static std::atomic<int> mUnpooledCount;
+	// Bumped whenever a transform gains or loses a child
+	static std::atomic<unsigned long long> mHierarchyVersion;
 
 	bool m_static = true;
 
 	//! List of all object behaviours
 	std::vector<IUpdatable*> m_updatables;
+	//! How each behaviour is freed, null for the ones that were allocated with new. Only those are updated by the
+	//! tree walk, the pooled ones are updated by their BehaviorSystem
+	std::vector<UpdatableRelease> m_releases;
 	//! List of all children.
 	std::vector<Transform*> m_children;
 
-	//!	Transformation matrix from individual coordinates to model coordinates
+	//!	Transformation matrix from individual coordinates to model coordinates: position, rotation and scale
 	glm::mat4 m_localMatrix;
 	//!	Transformation matrix from model coordinates to world coordinates
 	glm::mat4 m_worldMatrix;
 
 	//!	Local position of the object
 	glm::vec3 m_position;
-	//!	X is pitch, y is yaw and z is roll
-	GLfloat m_pitch;
-	GLfloat m_yaw;
-	GLfloat m_roll;
-	//!	Scale for each axis
+	//!	Local rotation of the object. The front, right and up vectors are derived from it when asked for
+	glm::quat m_rotation;
+	//!	Pitch, yaw and roll the rotation was built from. Only kept for Rotate and GetRotation, and extracted from the
+	//!	quaternion again when it was set directly
+	mutable GLfloat m_pitch;
+	mutable GLfloat m_yaw;
+	mutable GLfloat m_roll;
+	mutable bool m_eulerValid;
+	//!	Uniform scale, part of the local matrix so the children and the bounds of the objects are scaled with it
 	GLfloat m_scale;
 
-	//!	Front direction vector 
-	glm::vec3 m_front;
-	//!	Right direction vector
-	glm::vec3 m_right;
-	//!	Up direction vector
-	glm::vec3 m_up;
-
-	//! Quaternion
-	glm::quat m_quaternion;
-
 	void _NotifyTransformation();
 
-	/*!
-		\n void Transform::UpdateRotationAxis()
-
-		Updates the front, right and up direction vector according to the rotation vector
-
-		This function is called when the rotation vector is updated on the Rotate function.
-	*/
-	void _UpdateRotationAxis();
+	// Extracts the angles from the quaternion if it was set directly
+	void _UpdateEulerAngles() const;
 
 	/*!
 		\n void UpdateLocalMatrix()
@@ -70,14 +89,15 @@ private:
 
 	void _UpdateWolrdMatrix();
 
-	void _PropagateWorldMatrix();
-
 	/*!
-		\n void PropagateWorldMatrix(glm::mat4 parentWorldMatrix)
+		\n void Transform::_PropagateWorldMatrix()
 
-		Updates the world matrix of itself and propagates it to it's children
+		Propagates the world matrix to the children and their subtrees, depth first
 	*/
-	void _PropagateWorldMatrix(glm::mat4 parentWorldMatrix);
+	void _PropagateWorldMatrix();
+
+	// Multiplies the world matrices of the children [begin, end) in batches, then propagates them
+	void _PropagateChildren(size_t begin, size_t end);
 
 	/*!
 		\n void Transform::InitializeVariables()
@@ -122,11 +142,17 @@ public:
 
 	glm::vec3 GetRotation() const;
 
+	GLfloat GetScale() const { return m_scale; }
+
 	glm::vec3 GetWorldPosition();
 
-	glm::vec3 GetFront();
+	glm::vec3 GetFront() const;
+
+	glm::vec3 GetRight() const;
 
-	glm::vec3 GetUp();
+	glm::vec3 GetUp() const;
+
+	glm::quat GetQuaternion() const { return m_rotation; }
 
 	glm::vec3 GetWorldUp();
 	
@@ -134,21 +160,48 @@ public:
 
 	glm::mat4 GetLocalMatrix() const;
 
-	std::vector<glm::mat4> GetCubeViewProjectionMatrices(float aspect, float near, float far);
+	CubeMatrices GetCubeViewProjectionMatrices(float aspect, float near, float far);
+	// View-projection matrices of the six faces of a cube map rendered from a position
+	static CubeMatrices GetCubeViewProjectionMatrices(glm::vec3 position, float aspect, float near, float far);
 
 	glm::vec3 LocalToWorldCoordinates(glm::vec3 point, POINT_TYPE type);
 
-	std::vector<Transform*> GetChildren();
+	const std::vector<Transform*>& GetChildren() const;
 
 	void AddChild(Transform* child);
+	// Detaches a child without deleting it
+	void RemoveChild(Transform* child);
+	// Changes whenever the tree of transforms does
+	static unsigned long long GetHierarchyVersion() { return mHierarchyVersion.load(); }
 	
 
 	void SetUp();
 
+	// Updates every behaviour of the subtree, pooled or not, in tree order
 	void Update();
+	// Updates the behaviours of the subtree that were added with AddUpdatable
+	void UpdateUnpooled();
 	
+	// Takes ownership of a behaviour allocated with new. It is updated by the tree walk
 	void AddUpdatable(IUpdatable* updatable);
 
+	/*!
+		\n T* Transform::AddBehavior(Args&&... args)
+
+		Creates a behaviour of type T in ObjectPool<T>, with this transform and args as the constructor's arguments.
+		The transform owns it and gives it back to the pool when it is destroyed. It is updated by the system of T
+	*/
+	template<class T, class... Args>
+	T* AddBehavior(Args&&... args) {
+		BehaviorSystem::Register<T>();
+		T* behavior = ObjectPool<T>::Create(this, std::forward<Args>(args)...);
+		m_updatables.push_back(behavior);
+		m_releases.push_back([](IUpdatable* updatable) { ObjectPool<T>::Destroy(static_cast<T*>(updatable)); });
+		return behavior;
+	}
+
+	const std::vector<IUpdatable*>& GetUpdatables() const { return m_updatables; }
+
 
 	/*!
 		\n void Transform::Translate(glm::vec3 translate)
@@ -160,10 +213,10 @@ public:
 
 	void TranslateLocal(glm::vec3 translate);
 	/*!
-		\n void Transform::Scale(glm::vec3 scale)
+		\n void Transform::Scale(GLfloat scale)
 		\param GLfloat scale Scale amount for each axis
 
-		Scales the object by a given amount
+		Scales the object and its children by a given amount
 	*/
 	void Scale(GLfloat scale);
 	/*!
@@ -173,14 +226,36 @@ public:
 		Rotates the object arount itself by the given angles
 	*/
 	void Rotate(GLfloat pitch, GLfloat yaw, GLfloat roll);
-	
+
+	/*!
+		\n void Transform::Rotate(glm::quat rotation)
+		\param glm::quat rotation Rotation in the object's own space
+
+		Composes a rotation with the current one
+	*/
+	void Rotate(glm::quat rotation);
+
+	// Replaces the local rotation
+	void SetRotation(glm::quat rotation);
+
+	/*!
+		\n glm::quat Transform::EulerToQuaternion(GLfloat pitch, GLfloat yaw, GLfloat roll)
+
+		The rotation glm::yawPitchRoll builds, without going through a matrix
+	*/
+	static glm::quat EulerToQuaternion(GLfloat pitch, GLfloat yaw, GLfloat roll);
+
 	/*!
-		\n glm::mat4 Transform::TransformMatrix(bool doScale)
-		\param bool doScale Tells the function if it performes the scale operation or not
+		\n void Transform::SetLocalTransform(glm::vec3 position, glm::quat rotation)
+		\param glm::vec3 position Position in the parent's space
+		\param glm::quat rotation Rotation in the parent's space
 
-		Returns the world transformation matrix which is a result of the model transformation matrix multiplied by the parent's world transformation matrix
+		Places the object absolutely, building its matrices and propagating them once
 	*/
-	glm::mat4 TransformMatrix(bool doScale);
+	void SetLocalTransform(glm::vec3 position, glm::quat rotation);
+	// Like SetLocalTransform, with the local matrix of position and rotation already built. The scale is applied to it
+	void SetLocalTransform(glm::vec3 position, glm::quat rotation, const glm::mat4& localMatrix);
+
 
 	bool AreChildrenDynamic();
 
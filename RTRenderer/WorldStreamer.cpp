@@ -0,0 +1,538 @@
+#include "WorldStreamer.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "Camera.h"
+#include "Time.h"
+#include "ObjectController.h"
+
+bool WorldStreamer::mInitialized = false;
+
+std::vector<std::thread> WorldStreamer::mWorkers;
+std::mutex WorldStreamer::mMutex;
+std::condition_variable WorldStreamer::mCondition;
+std::condition_variable WorldStreamer::mImportedCondition;
+std::deque<WorldResource*> WorldStreamer::mPending;
+std::vector<WorldResource*> WorldStreamer::mImported;
+bool WorldStreamer::mStop = false;
+
+GLRenderer* WorldStreamer::mRenderer = nullptr;
+Transform* WorldStreamer::mRoot = nullptr;
+WorldSettings WorldStreamer::mSettings;
+std::vector<WorldTile> WorldStreamer::mTiles;
+std::map<std::string, WorldResource*> WorldStreamer::mResources;
+AnimateKeyFrame* WorldStreamer::mPath = nullptr;
+glm::vec3 WorldStreamer::mLastCamera;
+glm::vec3 WorldStreamer::mVelocity;
+size_t WorldStreamer::mResidentBytes = 0;
+unsigned long long WorldStreamer::mFrame = 0;
+
+void WorldStreamer::Initialize(GLRenderer * renderer, Transform * root, const WorldSettings & settings, unsigned int workerCount)
+{
+	if (mInitialized)
+		return;
+
+	mRenderer = renderer;
+	mRoot = root;
+	mSettings = settings;
+	mVelocity = glm::vec3(0.0f);
+	mFrame = 0;
+
+	mTiles.resize((size_t)settings.tilesX * settings.tilesZ);
+	for (int z = 0; z < settings.tilesZ; z++) {
+		for (int x = 0; x < settings.tilesX; x++) {
+			WorldTile& tile = mTiles[(size_t)z * settings.tilesX + x];
+			tile.x = x;
+			tile.z = z;
+			tile.boundsMin = glm::vec2(settings.origin.x + x * settings.tileSize, settings.origin.z + z * settings.tileSize);
+			tile.boundsMax = tile.boundsMin + glm::vec2(settings.tileSize);
+			tile.requested = false;
+			tile.page = nullptr;
+			tile.active = false;
+		}
+	}
+
+	// The texture streamer has its own threads
+	if (workerCount == 0)
+		workerCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+	mStop = false;
+	for (unsigned int i = 0; i < workerCount; i++)
+		mWorkers.push_back(std::thread(_WorkerLoop));
+
+	mInitialized = true;
+}
+
+bool WorldStreamer::IsInitialized()
+{
+	return mInitialized;
+}
+
+void WorldStreamer::AddObject(const WorldObject & object)
+{
+	int x = (int)floorf((object.position.x - mSettings.origin.x) / mSettings.tileSize);
+	int z = (int)floorf((object.position.z - mSettings.origin.z) / mSettings.tileSize);
+	if (x < 0 || z < 0 || x >= mSettings.tilesX || z >= mSettings.tilesZ) {
+		printf("Object %s at (%f, %f) is outside the world\n", object.model.c_str(), object.position.x, object.position.z);
+		return;
+	}
+	mTiles[(size_t)z * mSettings.tilesX + x].objects.push_back(object);
+}
+
+void WorldStreamer::SetPrefetchPath(AnimateKeyFrame * path)
+{
+	mPath = path;
+}
+
+void WorldStreamer::GetObjects(std::vector<WorldObject>& objects)
+{
+	for (size_t i = 0; i < mTiles.size(); i++)
+		objects.insert(objects.end(), mTiles[i].objects.begin(), mTiles[i].objects.end());
+}
+
+bool WorldStreamer::OwnsRenderer(const GLObjectRenderer * renderer)
+{
+	for (std::map<std::string, WorldResource*>::const_iterator it = mResources.begin(); it != mResources.end(); it++) {
+		if (it->second->renderer == renderer)
+			return true;
+	}
+	return false;
+}
+
+void WorldStreamer::_WorkerLoop()
+{
+	while (true) {
+		WorldResource* resource;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [] { return mStop || !mPending.empty(); });
+			if (mStop)
+				return;
+
+			resource = mPending.front();
+			mPending.pop_front();
+		}
+
+		bool imported = resource->terrain != nullptr ? resource->terrain->Import() : resource->model->Import();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			resource->failed = !imported;
+			mImported.push_back(resource);
+		}
+		mImportedCondition.notify_all();
+	}
+}
+
+WorldResource * WorldStreamer::_AcquirePage(const WorldTile & tile)
+{
+	char path[256];
+	snprintf(path, sizeof(path), mSettings.pagePattern.c_str(), tile.x, tile.z);
+
+	if (mResources.find(path) != mResources.end())
+		return _Acquire(path, nullptr, nullptr);
+
+	glm::vec2 center = (tile.boundsMin + tile.boundsMax) * 0.5f;
+	Terrain* terrain = new Terrain(path, glm::vec3(center.x, mSettings.origin.y, center.y), mSettings.tileSize,
+		mSettings.heightScale, mSettings.tiling, mSettings.terrainMaterial);
+	return _Acquire(path, terrain, nullptr);
+}
+
+WorldResource * WorldStreamer::_AcquireModel(const std::string & path, bool batched)
+{
+	if (mResources.find(path) != mResources.end())
+		return _Acquire(path, nullptr, nullptr);
+	return _Acquire(path, nullptr, new Model(path.c_str(), batched));
+}
+
+WorldResource * WorldStreamer::_Acquire(const std::string & key, Terrain * terrain, Model * model)
+{
+	std::map<std::string, WorldResource*>::iterator it = mResources.find(key);
+	if (it != mResources.end()) {
+		it->second->references++;
+		it->second->lastUsedFrame = mFrame;
+		return it->second;
+	}
+
+	WorldResource* resource = new WorldResource();
+	resource->key = key;
+	resource->terrain = terrain;
+	resource->model = model;
+	resource->failed = false;
+	resource->state = WR_QUEUED;
+	resource->renderer = nullptr;
+	resource->rendererIndex = 0;
+	resource->references = 1;
+	resource->lastUsedFrame = mFrame;
+	resource->bytes = 0;
+	mResources[key] = resource;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending.push_back(resource);
+	}
+	mCondition.notify_one();
+
+	return resource;
+}
+
+void WorldStreamer::_Release(WorldResource * resource)
+{
+	resource->references--;
+	resource->lastUsedFrame = mFrame;
+
+	// Nobody needs it anymore, do not spend a worker on it
+	if (resource->references == 0 && resource->state == WR_QUEUED)
+		_Evict(resource);
+}
+
+void WorldStreamer::_Evict(WorldResource * resource)
+{
+	if (resource->state == WR_QUEUED) {
+		// Only imports that did not start can be cancelled. The others are cached when they come back
+		std::lock_guard<std::mutex> lock(mMutex);
+		std::deque<WorldResource*>::iterator it = std::find(mPending.begin(), mPending.end(), resource);
+		if (it == mPending.end())
+			return;
+		mPending.erase(it);
+	}
+
+	if (resource->state == WR_IMPORTED || resource->state == WR_RESIDENT)
+		mResidentBytes -= resource->bytes;
+
+	// The model renderer owns the model
+	if (resource->renderer != nullptr)
+		mRenderer->RemoveObjectRenderer(resource->renderer);
+	else
+		delete resource->model;
+	delete resource->terrain;
+
+	mResources.erase(resource->key);
+	delete resource;
+}
+
+void WorldStreamer::_Trim()
+{
+	while (mResidentBytes > mSettings.memoryBudget) {
+		WorldResource* oldest = nullptr;
+		for (std::map<std::string, WorldResource*>::iterator it = mResources.begin(); it != mResources.end(); it++) {
+			WorldResource* resource = it->second;
+			if (resource->references > 0 || (resource->state != WR_IMPORTED && resource->state != WR_RESIDENT))
+				continue;
+			if (oldest == nullptr || resource->lastUsedFrame < oldest->lastUsedFrame)
+				oldest = resource;
+		}
+
+		// Everything left is in use
+		if (oldest == nullptr)
+			return;
+		_Evict(oldest);
+	}
+}
+
+void WorldStreamer::_RequestTile(WorldTile & tile)
+{
+	tile.requested = true;
+	tile.page = _AcquirePage(tile);
+
+	for (size_t i = 0; i < tile.objects.size(); i++) {
+		const WorldObject& object = tile.objects[i];
+		bool acquired = false;
+		for (size_t j = 0; j < tile.models.size() && !acquired; j++)
+			acquired = tile.models[j]->key == object.model;
+		if (!acquired)
+			tile.models.push_back(_AcquireModel(object.model, object.batched));
+	}
+}
+
+void WorldStreamer::_ReleaseTile(WorldTile & tile)
+{
+	if (tile.active)
+		_DeactivateTile(tile);
+
+	_Release(tile.page);
+	for (size_t i = 0; i < tile.models.size(); i++)
+		_Release(tile.models[i]);
+
+	tile.page = nullptr;
+	tile.models.clear();
+	tile.requested = false;
+}
+
+bool WorldStreamer::_IsTileReady(const WorldTile & tile)
+{
+	if (tile.page->state != WR_RESIDENT && tile.page->state != WR_FAILED)
+		return false;
+	for (size_t i = 0; i < tile.models.size(); i++) {
+		if (tile.models[i]->state != WR_RESIDENT && tile.models[i]->state != WR_FAILED)
+			return false;
+	}
+	return true;
+}
+
+void WorldStreamer::_ActivateTile(WorldTile & tile)
+{
+	if (tile.page->state == WR_RESIDENT)
+		mRenderer->AddTerrain(tile.page->terrain);
+
+	for (size_t i = 0; i < tile.objects.size(); i++) {
+		const WorldObject& object = tile.objects[i];
+		WorldResource* model = nullptr;
+		for (size_t j = 0; j < tile.models.size() && model == nullptr; j++) {
+			if (tile.models[j]->key == object.model)
+				model = tile.models[j];
+		}
+		if (model->state != WR_RESIDENT)
+			continue;
+
+		Transform* transform = ObjectPool<Transform>::Create(mRoot);
+		transform->Translate(object.position);
+		transform->Rotate(object.rotation.x, object.rotation.y, object.rotation.z);
+		transform->Scale(object.scale);
+
+		GLObject* glObject = ObjectPool<GLObject>::Create(transform, object.material, model->rendererIndex);
+		mRenderer->AddMeshRenderer(glObject);
+
+		tile.transforms.push_back(ObjectPool<Transform>::GetHandle(transform));
+		tile.glObjects.push_back(ObjectPool<GLObject>::GetHandle(glObject));
+	}
+
+	tile.active = true;
+}
+
+void WorldStreamer::_DeactivateTile(WorldTile & tile)
+{
+	for (size_t i = 0; i < tile.glObjects.size(); i++) {
+		GLObject* glObject = ObjectPool<GLObject>::Get(tile.glObjects[i]);
+		if (glObject != nullptr)
+			mRenderer->RemoveMeshRenderer(glObject);
+	}
+	for (size_t i = 0; i < tile.transforms.size(); i++) {
+		Transform* transform = ObjectPool<Transform>::Get(tile.transforms[i]);
+		if (transform == nullptr)
+			continue;
+		mRoot->RemoveChild(transform);
+		ObjectPool<Transform>::Destroy(transform);
+	}
+	tile.glObjects.clear();
+	tile.transforms.clear();
+
+	if (tile.page->state == WR_RESIDENT)
+		mRenderer->RemoveTerrain(tile.page->terrain);
+
+	tile.active = false;
+}
+
+void WorldStreamer::_Upload(WorldResource * resource)
+{
+	if (resource->terrain != nullptr) {
+		resource->terrain->Upload();
+	}
+	else {
+		resource->model->Upload();
+		resource->renderer = new GLModelRenderer();
+		resource->renderer->SetRenderable(resource->model);
+		resource->rendererIndex = mRenderer->AddObjectRenderer(resource->renderer);
+	}
+	resource->state = WR_RESIDENT;
+}
+
+void WorldStreamer::_ProcessImports(int maxUploads)
+{
+	std::vector<WorldResource*> imported;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		imported.swap(mImported);
+	}
+
+	for (size_t i = 0; i < imported.size(); i++) {
+		WorldResource* resource = imported[i];
+		if (resource->failed) {
+			// Kept so that it is not retried, the tiles go without it
+			resource->state = WR_FAILED;
+			continue;
+		}
+		resource->state = WR_IMPORTED;
+		resource->bytes = resource->terrain != nullptr ? resource->terrain->GetByteSize() : resource->model->GetByteSize();
+		mResidentBytes += resource->bytes;
+	}
+
+	// Tiles closest to the camera get their resources uploaded first
+	glm::vec3 camera = Camera::GetInstance() != nullptr ? Camera::GetInstance()->GetCameraPosition() : mLastCamera;
+	std::vector<std::pair<float, WorldTile*>> waiting;
+	for (size_t i = 0; i < mTiles.size(); i++) {
+		if (mTiles[i].requested && !mTiles[i].active)
+			waiting.push_back(std::make_pair(_Distance(mTiles[i], camera), &mTiles[i]));
+	}
+	std::sort(waiting.begin(), waiting.end(),
+		[](const std::pair<float, WorldTile*>& a, const std::pair<float, WorldTile*>& b) { return a.first < b.first; });
+
+	int uploads = 0;
+	for (size_t i = 0; i < waiting.size(); i++) {
+		WorldTile* tile = waiting[i].second;
+		for (int j = -1; j < (int)tile->models.size(); j++) {
+			if (maxUploads >= 0 && uploads >= maxUploads)
+				return;
+
+			WorldResource* resource = j < 0 ? tile->page : tile->models[j];
+			if (resource->state == WR_IMPORTED) {
+				_Upload(resource);
+				uploads++;
+			}
+		}
+	}
+}
+
+bool WorldStreamer::_ActivateReadyTiles()
+{
+	bool activated = false;
+	for (size_t i = 0; i < mTiles.size(); i++) {
+		if (mTiles[i].requested && !mTiles[i].active && _IsTileReady(mTiles[i])) {
+			_ActivateTile(mTiles[i]);
+			activated = true;
+		}
+	}
+	return activated;
+}
+
+float WorldStreamer::_Distance(const WorldTile & tile, glm::vec3 point)
+{
+	glm::vec2 closest = glm::clamp(glm::vec2(point.x, point.z), tile.boundsMin, tile.boundsMax);
+	return glm::length(glm::vec2(point.x, point.z) - closest);
+}
+
+void WorldStreamer::Update()
+{
+	if (!mInitialized || Camera::GetInstance() == nullptr)
+		return;
+
+	mFrame++;
+
+	// Smoothed so that a single jittery frame does not prefetch the wrong way
+	glm::vec3 camera = Camera::GetInstance()->GetCameraPosition();
+	float deltaTime = (float)Time::GetDeltaTime();
+	if (mFrame > 1 && deltaTime > 0.0f)
+		mVelocity = glm::mix(mVelocity, (camera - mLastCamera) / deltaTime, 0.1f);
+	mLastCamera = camera;
+
+	// Where the camera is and where it is heading
+	std::vector<glm::vec3> points;
+	points.push_back(camera);
+	points.push_back(camera + mVelocity * WORLD_PREFETCH_SECONDS);
+	if (mPath != nullptr)
+		mPath->GetUpcomingPositions(WORLD_PREFETCH_SECONDS, WORLD_PREFETCH_STEP, points);
+
+	bool changed = false;
+	std::vector<std::pair<float, WorldTile*>> requests;
+	for (size_t i = 0; i < mTiles.size(); i++) {
+		WorldTile& tile = mTiles[i];
+		float distance = FLT_MAX;
+		for (size_t j = 0; j < points.size(); j++)
+			distance = std::min(distance, _Distance(tile, points[j]));
+
+		if (tile.requested) {
+			if (distance > mSettings.unloadRadius) {
+				changed |= tile.active;
+				_ReleaseTile(tile);
+			}
+			else {
+				tile.page->lastUsedFrame = mFrame;
+				for (size_t j = 0; j < tile.models.size(); j++)
+					tile.models[j]->lastUsedFrame = mFrame;
+			}
+		}
+		else if (distance <= mSettings.loadRadius) {
+			requests.push_back(std::make_pair(distance, &tile));
+		}
+	}
+
+	// Closest tiles first. Past the budget only the tile under the camera is still loaded
+	std::sort(requests.begin(), requests.end(),
+		[](const std::pair<float, WorldTile*>& a, const std::pair<float, WorldTile*>& b) { return a.first < b.first; });
+	for (size_t i = 0; i < requests.size(); i++) {
+		_Trim();
+		if (mResidentBytes > mSettings.memoryBudget && requests[i].first > 0.0f)
+			break;
+		_RequestTile(*requests[i].second);
+	}
+
+	_ProcessImports(WORLD_UPLOADS_PER_FRAME);
+	changed |= _ActivateReadyTiles();
+	_Trim();
+
+	if (changed)
+		mRenderer->InvalidateStaticShadows();
+}
+
+void WorldStreamer::LoadAround(glm::vec3 position)
+{
+	if (!mInitialized)
+		return;
+
+	mLastCamera = position;
+
+	bool waiting = false;
+	for (size_t i = 0; i < mTiles.size(); i++) {
+		if (!mTiles[i].requested && _Distance(mTiles[i], position) <= mSettings.loadRadius)
+			_RequestTile(mTiles[i]);
+		waiting |= mTiles[i].requested;
+	}
+
+	while (waiting) {
+		_ProcessImports(-1);
+
+		waiting = false;
+		for (size_t i = 0; i < mTiles.size() && !waiting; i++)
+			waiting = mTiles[i].requested && !_IsTileReady(mTiles[i]);
+
+		if (waiting) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			mImportedCondition.wait(lock, [] { return !mImported.empty(); });
+		}
+	}
+
+	_ActivateReadyTiles();
+	mRenderer->InvalidateStaticShadows();
+}
+
+void WorldStreamer::Shutdown()
+{
+	if (!mInitialized)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mCondition.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+
+	for (size_t i = 0; i < mTiles.size(); i++) {
+		if (mTiles[i].active)
+			_DeactivateTile(mTiles[i]);
+	}
+	mTiles.clear();
+
+	// The map owns every resource, wherever it was in the pipeline
+	mPending.clear();
+	mImported.clear();
+	for (std::map<std::string, WorldResource*>::iterator it = mResources.begin(); it != mResources.end(); it++) {
+		WorldResource* resource = it->second;
+		if (resource->renderer != nullptr)
+			mRenderer->RemoveObjectRenderer(resource->renderer);
+		else
+			delete resource->model;
+		delete resource->terrain;
+		delete resource;
+	}
+	mResources.clear();
+
+	mPath = nullptr;
+	mResidentBytes = 0;
+	mInitialized = false;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glm\glm.hpp>
+
+#include "GLRenderer.h"
+#include "Transform.h"
+#include "Terrain.h"
+#include "Model.h"
+#include "Material.h"
+
+class AnimateKeyFrame;
+
+// Resources uploaded to the GPU at most every frame. Models are the expensive ones
+const int WORLD_UPLOADS_PER_FRAME = 2;
+// Bytes of terrain pages and model geometry kept in memory when the scene does not give a budget
+const size_t WORLD_MEMORY_BUDGET = 128 * 1024 * 1024;
+// How far ahead, in seconds, the camera's velocity and animation path are followed to prefetch tiles
+const float WORLD_PREFETCH_SECONDS = 3.0f;
+// Time between two samples of the animation path
+const float WORLD_PREFETCH_STEP = 0.5f;
+
+// Layout of the world and how much of it is kept around the camera
+struct WorldSettings {
+	// Corner of the tile grid with the smallest coordinates. Its y is the height of the darkest heightmap texel
+	glm::vec3 origin;
+	float tileSize;
+	int tilesX, tilesZ;
+	// printf pattern of the terrain pages, given the tile's x and z as its only two %d. Neighbouring pages share their
+	// border texels
+	std::string pagePattern;
+	float heightScale;
+	float tiling;
+	Material* terrainMaterial;
+	// Tiles closer than this to the camera or where it is heading are loaded
+	float loadRadius;
+	// Tiles further than this are released. Larger than loadRadius so tiles on the edge do not come and go
+	float unloadRadius;
+	size_t memoryBudget;
+};
+
+// Static object placed in the world, instanced when its tile becomes active
+struct WorldObject {
+	std::string model;
+	bool batched;
+	glm::vec3 position;
+	glm::vec3 rotation;
+	float scale;
+	Material* material;
+};
+
+enum WorldResourceState {
+	// Waiting for or being imported by a worker
+	WR_QUEUED,
+	// In CPU memory
+	WR_IMPORTED,
+	// Uploaded, ready to be drawn
+	WR_RESIDENT,
+	WR_FAILED
+};
+
+// Terrain page or model shared by the tiles that reference it
+struct WorldResource {
+	std::string key;
+	// One of the two is set
+	Terrain* terrain;
+	Model* model;
+
+	// Set by the worker, read once the import is handed back
+	bool failed;
+
+	// -- Main thread only --
+	WorldResourceState state;
+	// Renderer drawing the model's objects and its index in the GLRenderer
+	GLModelRenderer* renderer;
+	size_t rendererIndex;
+	// Tiles that need the resource. Unreferenced resources stay cached until the budget needs their memory
+	int references;
+	unsigned long long lastUsedFrame;
+	size_t bytes;
+};
+
+struct WorldTile {
+	int x, z;
+	glm::vec2 boundsMin, boundsMax;
+	std::vector<WorldObject> objects;
+
+	// -- Set while the tile is requested --
+	bool requested;
+	WorldResource* page;
+	std::vector<WorldResource*> models;
+
+	// -- Set while the tile is in the renderer --
+	bool active;
+	// Handles, as the objects go with their renderer if the model's renderer is removed first
+	std::vector<PoolHandle> transforms;
+	std::vector<PoolHandle> glObjects;
+};
+
+/*!
+	Streams a world split in square tiles around the camera.
+
+	Every tile has a terrain page and a list of static objects. When the camera, or where it is heading, gets within the
+	load radius of a tile, its page and the models of its objects are imported by worker threads and uploaded on the main
+	thread a few per frame; the tile enters the renderer once all of them are resident. Tiles past the unload radius
+	leave the renderer and release their resources, which stay cached and are evicted least recently used first when
+	the memory budget is exceeded. Textures are left to the TextureStreamer and its own budget.
+*/
+class WorldStreamer
+{
+private:
+	static bool mInitialized;
+
+	// -- Shared with the workers, guarded by mMutex --
+	static std::vector<std::thread> mWorkers;
+	static std::mutex mMutex;
+	static std::condition_variable mCondition;
+	// Signaled when a worker finishes an import
+	static std::condition_variable mImportedCondition;
+	static std::deque<WorldResource*> mPending;
+	static std::vector<WorldResource*> mImported;
+	static bool mStop;
+
+	// -- Main thread only --
+	static GLRenderer* mRenderer;
+	static Transform* mRoot;
+	static WorldSettings mSettings;
+	static std::vector<WorldTile> mTiles;
+	static std::map<std::string, WorldResource*> mResources;
+	static AnimateKeyFrame* mPath;
+	static glm::vec3 mLastCamera;
+	static glm::vec3 mVelocity;
+	static size_t mResidentBytes;
+	static unsigned long long mFrame;
+
+	static void _WorkerLoop();
+
+	// Return the resource with one more reference, queuing its import if it is not cached
+	static WorldResource* _AcquirePage(const WorldTile& tile);
+	static WorldResource* _AcquireModel(const std::string& path, bool batched);
+	static WorldResource* _Acquire(const std::string& key, Terrain* terrain, Model* model);
+	static void _Release(WorldResource* resource);
+	static void _Evict(WorldResource* resource);
+	// Evicts unreferenced resources, least recently used first, until the budget is met
+	static void _Trim();
+
+	static void _RequestTile(WorldTile& tile);
+	static void _ReleaseTile(WorldTile& tile);
+	static void _ActivateTile(WorldTile& tile);
+	static void _DeactivateTile(WorldTile& tile);
+	static bool _IsTileReady(const WorldTile& tile);
+
+	// Marks the finished imports and uploads up to maxUploads of the resources tiles are waiting for
+	static void _ProcessImports(int maxUploads);
+	static void _Upload(WorldResource* resource);
+	// Activates the tiles whose resources are all resident. Returns true if any was
+	static bool _ActivateReadyTiles();
+
+	static float _Distance(const WorldTile& tile, glm::vec3 point);
+
+public:
+	/*!
+		\n void WorldStreamer::Initialize(GLRenderer* renderer, Transform* root, const WorldSettings& settings, unsigned int workerCount)
+		\param GLRenderer* renderer Renderer the tiles are added to
+		\param Transform* root Parent of the transforms of the streamed objects
+		\param const WorldSettings& settings Layout of the tiles and streaming radii
+		\param unsigned int workerCount Number of import threads. 0 picks half the hardware threads
+
+		Creates the tile grid and the worker threads. Objects are added with AddObject afterwards
+	*/
+	static void Initialize(GLRenderer* renderer, Transform* root, const WorldSettings& settings, unsigned int workerCount = 0);
+	static bool IsInitialized();
+
+	// Places an object in the tile under its position. Objects outside the grid are dropped
+	static void AddObject(const WorldObject& object);
+
+	// Prefetches along the upcoming positions of an animation as well as along the camera's velocity
+	static void SetPrefetchPath(AnimateKeyFrame* path);
+	static AnimateKeyFrame* GetPrefetchPath() { return mPath; }
+
+	static const WorldSettings& GetSettings() { return mSettings; }
+	// Appends every object of the world, streamed in or not
+	static void GetObjects(std::vector<WorldObject>& objects);
+	// Returns true if the renderer draws models of the world
+	static bool OwnsRenderer(const GLObjectRenderer* renderer);
+
+	// Requests, releases, uploads and activates tiles around the camera. Call once per frame on the main thread
+	static void Update();
+
+	// Loads every tile within the load radius of a position before returning. Used before baking the static scene
+	static void LoadAround(glm::vec3 position);
+
+	// Takes every tile out of the renderer and frees everything. Call before the renderer is deleted
+	static void Shutdown();
+};
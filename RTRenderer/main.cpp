@@ -8,13 +8,15 @@
 #include <sstream>
 
 #include "GLProgram.h"
+#include "PoolBenchmark.h"
+#include "MatrixBenchmark.h"
 
 using namespace std;
 
 int main() {
 	RenderMode mode = RenderMode::UNDEFINED;
 	while (mode == RenderMode::UNDEFINED) {
-		printf("Which mode would you like to run?\n1. Cinematic\n2. Free roam\nChoice: ");
+		printf("Which mode would you like to run?\n1. Cinematic\n2. Free roam\n3. Bake reflection probes\n4. Object pool benchmark\n5. Matrix kernel benchmark\nChoice: ");
 		string inputStr;
 		getline(cin, inputStr);
 		if (inputStr.length() > 1)
@@ -23,6 +25,17 @@ int main() {
 			mode = RenderMode::CINEMATIC;
 		else if (inputStr[0] == '2')
 			mode = RenderMode::ROAM;
+		else if (inputStr[0] == '3')
+			mode = RenderMode::BAKE;
+		else if (inputStr[0] == '4') {
+			// Benchmarks need no window, they run before any program is created
+			PoolBenchmark::Run();
+			return 0;
+		}
+		else if (inputStr[0] == '5') {
+			MatrixBenchmark::Run();
+			return 0;
+		}
 	}
 
 	GLProgram* program = GLProgram::CreateGLProgramInstance(mode);
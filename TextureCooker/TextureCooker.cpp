@@ -0,0 +1,141 @@
+// Offline texture cooker: converts PNG/JPG/TGA images into block compressed KTX files with a full mip chain.
+// The renderer picks up "<name>.ktx" next to "<name>.<ext>" automatically.
+//
+// Usage: TextureCooker <input image> [output.ktx] [bc1|bc3|bc5|bc7]
+//        TextureCooker --all <directory> [bc1|bc3|bc5|bc7]   (Windows only)
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../RTRenderer/stb_image.h"
+#include "../RTRenderer/BlockCompression.h"
+#include "../RTRenderer/KTXFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+bool ParseFormat(const char* name, BlockFormat* format)
+{
+	if (strcmp(name, "bc1") == 0) *format = BF_BC1;
+	else if (strcmp(name, "bc3") == 0) *format = BF_BC3;
+	else if (strcmp(name, "bc5") == 0) *format = BF_BC5;
+	else if (strcmp(name, "bc7") == 0) *format = BF_BC7;
+	else return false;
+	return true;
+}
+
+std::string DefaultOutput(const std::string& input)
+{
+	size_t extension = input.rfind('.');
+	return (extension == std::string::npos ? input : input.substr(0, extension)) + ".ktx";
+}
+
+bool Cook(const std::string& input, const std::string& output, const BlockFormat* forcedFormat)
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(input.c_str(), &width, &height, &channels, 4);
+	if (!pixels) {
+		printf("Failed to load %s: %s\n", input.c_str(), stbi_failure_reason());
+		return false;
+	}
+
+	// Images without alpha only need BC1, the rest keep their alpha in BC3
+	BlockFormat format = forcedFormat ? *forcedFormat : (channels == 4 ? BF_BC3 : BF_BC1);
+
+	KTXFile ktx;
+	ktx.internalFormat = KTXFile::GetInternalFormat(format);
+	ktx.baseInternalFormat = KTXFile::GetBaseInternalFormat(format);
+	ktx.width = width;
+	ktx.height = height;
+
+	std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+
+	int levelWidth = width, levelHeight = height;
+	size_t compressedBytes = 0;
+	while (true) {
+		KTXLevel ktxLevel;
+		ktxLevel.width = levelWidth;
+		ktxLevel.height = levelHeight;
+		ktxLevel.data = BlockCompression::Compress(format, level.data(), levelWidth, levelHeight);
+		compressedBytes += ktxLevel.data.size();
+		ktx.levels.push_back(ktxLevel);
+
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		level = BlockCompression::Downsample(level.data(), levelWidth, levelHeight, &levelWidth, &levelHeight);
+	}
+
+	if (!ktx.Write(output.c_str()))
+		return false;
+
+	// Uncompressed size with a full mip chain is ~4/3 of the base level
+	size_t uncompressedBytes = (size_t)width * height * (channels == 4 ? 4 : 3) * 4 / 3;
+	printf("%s -> %s (%dx%d, %zu levels, %zu KB instead of %zu KB)\n", input.c_str(), output.c_str(), width, height,
+		ktx.levels.size(), compressedBytes / 1024, uncompressedBytes / 1024);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		printf("Usage: %s <input image> [output.ktx] [bc1|bc3|bc5|bc7]\n", argv[0]);
+		printf("       %s --all <directory> [bc1|bc3|bc5|bc7]\n", argv[0]);
+		return 1;
+	}
+
+	BlockFormat format;
+	const BlockFormat* forcedFormat = nullptr;
+
+	if (strcmp(argv[1], "--all") == 0) {
+		if (argc < 3) {
+			printf("Missing directory\n");
+			return 1;
+		}
+		if (argc > 3) {
+			if (!ParseFormat(argv[3], &format)) {
+				printf("Unknown format %s\n", argv[3]);
+				return 1;
+			}
+			forcedFormat = &format;
+		}
+
+#ifdef _WIN32
+		int failures = 0;
+		const char* patterns[] = { "*.png", "*.jpg", "*.tga" };
+		for (const char* pattern : patterns) {
+			std::string directory = argv[2];
+			WIN32_FIND_DATAA findData;
+			HANDLE handle = FindFirstFileA((directory + "\\" + pattern).c_str(), &findData);
+			if (handle == INVALID_HANDLE_VALUE)
+				continue;
+			do {
+				std::string input = directory + "\\" + findData.cFileName;
+				if (!Cook(input, DefaultOutput(input), forcedFormat))
+					failures++;
+			} while (FindNextFileA(handle, &findData));
+			FindClose(handle);
+		}
+		return failures == 0 ? 0 : 1;
+#else
+		printf("--all is only supported on Windows, cook files one by one\n");
+		return 1;
+#endif
+	}
+
+	std::string input = argv[1];
+	std::string output = DefaultOutput(input);
+	for (int i = 2; i < argc; i++) {
+		if (ParseFormat(argv[i], &format))
+			forcedFormat = &format;
+		else
+			output = argv[i];
+	}
+
+	return Cook(input, output, forcedFormat) ? 0 : 1;
+}